@@ -0,0 +1,431 @@
+#include "Bvh.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+
+static const int SahBinCount = 12;
+
+static void EmptyAabb(BvhAabb& box)
+{
+    for (int axis = 0; axis < 3; axis++)
+    {
+        box.min[axis] = FLT_MAX;
+        box.max[axis] = -FLT_MAX;
+    }
+}
+
+static void GrowAabb(BvhAabb& box, const BvhAabb& other)
+{
+    for (int axis = 0; axis < 3; axis++)
+    {
+        box.min[axis] = std::min(box.min[axis], other.min[axis]);
+        box.max[axis] = std::max(box.max[axis], other.max[axis]);
+    }
+}
+
+static float HalfArea(const BvhAabb& box)
+{
+    float dx = box.max[0] - box.min[0];
+    float dy = box.max[1] - box.min[1];
+    float dz = box.max[2] - box.min[2];
+    if (dx < 0.0f || dy < 0.0f || dz < 0.0f)
+        return 0.0f;
+    return dx * dy + dy * dz + dz * dx;
+}
+
+void Bvh::Clear()
+{
+    m_nodes.clear();
+    m_objectIndices.clear();
+    m_objectBounds.clear();
+}
+
+void Bvh::UpdateLeafBounds(Node& node) const
+{
+    EmptyAabb(node.bounds);
+    for (uint32_t i = node.first; i < node.first + node.count; i++)
+    {
+        GrowAabb(node.bounds, m_objectBounds[m_objectIndices[i]]);
+    }
+}
+
+void Bvh::Build(const std::vector<BvhAabb>& bounds)
+{
+    Clear();
+    const uint32_t count = uint32_t(bounds.size());
+    if (count == 0)
+        return;
+
+    // Primitives are partitioned by value so the build streams through memory
+    m_objectBounds = bounds;
+    std::vector<BuildPrim> prims(count);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        prims[i].bounds = bounds[i];
+        prims[i].object = i;
+        for (int axis = 0; axis < 3; axis++)
+            prims[i].centroid[axis] = (bounds[i].min[axis] + bounds[i].max[axis]) * 0.5f;
+    }
+
+    m_nodes.reserve(count * 2);
+    Node root;
+    root.first = 0;
+    root.count = count;
+    EmptyAabb(root.bounds);
+    for (const BuildPrim& prim : prims)
+        GrowAabb(root.bounds, prim.bounds);
+    m_nodes.push_back(root);
+
+    // Explicit stack, degenerate inputs could make recursion too deep
+    std::vector<uint32_t> stack(1, 0u);
+    while (!stack.empty())
+    {
+        uint32_t nodeIdx = stack.back();
+        stack.pop_back();
+        Subdivide(nodeIdx, prims);
+        if (m_nodes[nodeIdx].count == 0)
+        {
+            stack.push_back(m_nodes[nodeIdx].first);
+            stack.push_back(m_nodes[nodeIdx].first + 1);
+        }
+    }
+
+    m_objectIndices.resize(count);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        m_objectIndices[i] = prims[i].object;
+    }
+}
+
+void Bvh::Subdivide(uint32_t nodeIdx, std::vector<BuildPrim>& prims)
+{
+    // Node bounds are already set by the parent
+    const uint32_t first = m_nodes[nodeIdx].first;
+    const uint32_t count = m_nodes[nodeIdx].count;
+    if (count <= MaxLeafSize)
+        return;
+
+    BvhAabb centroidBounds;
+    EmptyAabb(centroidBounds);
+    for (uint32_t i = first; i < first + count; i++)
+    {
+        const float* c = prims[i].centroid;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            centroidBounds.min[axis] = std::min(centroidBounds.min[axis], c[axis]);
+            centroidBounds.max[axis] = std::max(centroidBounds.max[axis], c[axis]);
+        }
+    }
+
+    // Binned SAH: cost of a split is area(left) * count(left) + area(right) * count(right)
+    int bestAxis = -1;
+    int bestSplit = 0;
+    float bestCost = FLT_MAX;
+    BvhAabb bestLeft;
+    BvhAabb bestRight;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        float extent = centroidBounds.max[axis] - centroidBounds.min[axis];
+        if (extent <= 0.0f)
+            continue;
+        float scale = SahBinCount / extent;
+
+        BvhAabb binBounds[SahBinCount];
+        uint32_t binCounts[SahBinCount] = {};
+        for (int b = 0; b < SahBinCount; b++)
+            EmptyAabb(binBounds[b]);
+        for (uint32_t i = first; i < first + count; i++)
+        {
+            int bin = std::min(SahBinCount - 1, int((prims[i].centroid[axis] - centroidBounds.min[axis]) * scale));
+            binCounts[bin]++;
+            GrowAabb(binBounds[bin], prims[i].bounds);
+        }
+
+        float rightCost[SahBinCount];
+        BvhAabb rightBounds[SahBinCount];
+        BvhAabb accum;
+        EmptyAabb(accum);
+        uint32_t accumCount = 0;
+        for (int b = SahBinCount - 1; b > 0; b--)
+        {
+            GrowAabb(accum, binBounds[b]);
+            accumCount += binCounts[b];
+            rightCost[b] = HalfArea(accum) * accumCount;
+            rightBounds[b] = accum;
+        }
+        EmptyAabb(accum);
+        accumCount = 0;
+        for (int b = 0; b < SahBinCount - 1; b++)
+        {
+            GrowAabb(accum, binBounds[b]);
+            accumCount += binCounts[b];
+            float cost = HalfArea(accum) * accumCount + rightCost[b + 1];
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = b + 1;
+                bestLeft = accum;
+                bestRight = rightBounds[b + 1];
+            }
+        }
+    }
+
+    BuildPrim* pBegin = prims.data() + first;
+    BuildPrim* pEnd = pBegin + count;
+    BuildPrim* pMid = pBegin;
+    if (bestAxis >= 0)
+    {
+        float scale = SahBinCount / (centroidBounds.max[bestAxis] - centroidBounds.min[bestAxis]);
+        float minC = centroidBounds.min[bestAxis];
+        pMid = std::partition(pBegin, pEnd, [&](const BuildPrim& prim) {
+            return std::min(SahBinCount - 1, int((prim.centroid[bestAxis] - minC) * scale)) < bestSplit;
+        });
+    }
+    uint32_t leftCount = uint32_t(pMid - pBegin);
+
+    Node left;
+    left.first = first;
+    Node right;
+    if (pMid == pBegin || pMid == pEnd)
+    {
+        // All centroids coincide, halve the range instead
+        leftCount = count / 2;
+        left.count = leftCount;
+        right.first = first + leftCount;
+        right.count = count - leftCount;
+        EmptyAabb(left.bounds);
+        EmptyAabb(right.bounds);
+        for (uint32_t i = first; i < first + count; i++)
+            GrowAabb(i < right.first ? left.bounds : right.bounds, prims[i].bounds);
+    }
+    else
+    {
+        left.count = leftCount;
+        left.bounds = bestLeft;
+        right.first = first + leftCount;
+        right.count = count - leftCount;
+        right.bounds = bestRight;
+    }
+
+    uint32_t leftIdx = uint32_t(m_nodes.size());
+    m_nodes.push_back(left);
+    m_nodes.push_back(right);
+    m_nodes[nodeIdx].first = leftIdx;
+    m_nodes[nodeIdx].count = 0;
+}
+
+void Bvh::Refit(const std::vector<BvhAabb>& bounds)
+{
+    assert(bounds.size() == m_objectBounds.size());
+    m_objectBounds = bounds;
+    // Children are always stored after their parent, so a reverse walk is bottom-up
+    for (size_t i = m_nodes.size(); i-- > 0;)
+    {
+        Node& node = m_nodes[i];
+        if (node.count > 0)
+        {
+            UpdateLeafBounds(node);
+        }
+        else
+        {
+            node.bounds = m_nodes[node.first].bounds;
+            GrowAabb(node.bounds, m_nodes[node.first + 1].bounds);
+        }
+    }
+}
+
+void Bvh::CollectSubtree(uint32_t nodeIdx, std::vector<uint32_t>& result) const
+{
+    std::vector<uint32_t> stack(1, nodeIdx);
+    while (!stack.empty())
+    {
+        const Node& node = m_nodes[stack.back()];
+        stack.pop_back();
+        if (node.count > 0)
+        {
+            result.insert(result.end(), m_objectIndices.begin() + node.first, m_objectIndices.begin() + node.first + node.count);
+        }
+        else
+        {
+            stack.push_back(node.first);
+            stack.push_back(node.first + 1);
+        }
+    }
+}
+
+// 1 outside, -1 fully inside, 0 intersecting
+static int ClassifyAabb(const BvhAabb& box, const FrustumPlanes& planes, uint32_t& planeMask)
+{
+    float c[3];
+    float e[3];
+    for (int axis = 0; axis < 3; axis++)
+    {
+        c[axis] = (box.min[axis] + box.max[axis]) * 0.5f;
+        e[axis] = (box.max[axis] - box.min[axis]) * 0.5f;
+    }
+    for (int p = 0; p < 6; p++)
+    {
+        if ((planeMask & (1u << p)) == 0)
+            continue;
+        float dist = planes.nx[p] * c[0] + planes.ny[p] * c[1] + planes.nz[p] * c[2] + planes.d[p];
+        float reach = fabsf(planes.nx[p]) * e[0] + fabsf(planes.ny[p]) * e[1] + fabsf(planes.nz[p]) * e[2];
+        if (dist + reach < 0.0f)
+            return 1;
+        if (dist - reach >= 0.0f)
+            planeMask &= ~(1u << p);
+    }
+    return planeMask == 0 ? -1 : 0;
+}
+
+void Bvh::QueryFrustum(const FrustumPlanes& planes, std::vector<uint32_t>& result) const
+{
+    result.clear();
+    if (m_nodes.empty())
+        return;
+
+    // Planes the node is fully inside of are dropped for its children
+    struct Entry { uint32_t node; uint32_t planeMask; };
+    std::vector<Entry> stack;
+    stack.push_back({ 0u, 0x3Fu });
+    while (!stack.empty())
+    {
+        Entry entry = stack.back();
+        stack.pop_back();
+        const Node& node = m_nodes[entry.node];
+        int classification = ClassifyAabb(node.bounds, planes, entry.planeMask);
+        if (classification > 0)
+            continue;
+        if (classification < 0)
+        {
+            CollectSubtree(entry.node, result);
+            continue;
+        }
+        if (node.count > 0)
+        {
+            for (uint32_t i = node.first; i < node.first + node.count; i++)
+            {
+                uint32_t object = m_objectIndices[i];
+                uint32_t objectMask = entry.planeMask;
+                if (ClassifyAabb(m_objectBounds[object], planes, objectMask) <= 0)
+                    result.push_back(object);
+            }
+        }
+        else
+        {
+            stack.push_back({ node.first, entry.planeMask });
+            stack.push_back({ node.first + 1, entry.planeMask });
+        }
+    }
+}
+
+static bool AabbSphereOverlap(const BvhAabb& box, const float center[3], float radius)
+{
+    float distSq = 0.0f;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        float v = std::max(box.min[axis] - center[axis], std::max(0.0f, center[axis] - box.max[axis]));
+        distSq += v * v;
+    }
+    return distSq <= radius * radius;
+}
+
+void Bvh::QuerySphere(const float center[3], float radius, std::vector<uint32_t>& result) const
+{
+    result.clear();
+    if (m_nodes.empty())
+        return;
+
+    std::vector<uint32_t> stack(1, 0u);
+    while (!stack.empty())
+    {
+        const Node& node = m_nodes[stack.back()];
+        stack.pop_back();
+        if (!AabbSphereOverlap(node.bounds, center, radius))
+            continue;
+        if (node.count > 0)
+        {
+            for (uint32_t i = node.first; i < node.first + node.count; i++)
+            {
+                uint32_t object = m_objectIndices[i];
+                if (AabbSphereOverlap(m_objectBounds[object], center, radius))
+                    result.push_back(object);
+            }
+        }
+        else
+        {
+            stack.push_back(node.first);
+            stack.push_back(node.first + 1);
+        }
+    }
+}
+
+// Slab test, returns entry distance or FLT_MAX on a miss
+static float RayAabb(const BvhAabb& box, const float origin[3], const float invDir[3], float maxT)
+{
+    float tMin = 0.0f;
+    float tMax = maxT;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        float t0 = (box.min[axis] - origin[axis]) * invDir[axis];
+        float t1 = (box.max[axis] - origin[axis]) * invDir[axis];
+        if (t0 > t1)
+            std::swap(t0, t1);
+        tMin = std::max(tMin, t0);
+        tMax = std::min(tMax, t1);
+    }
+    return tMin <= tMax ? tMin : FLT_MAX;
+}
+
+bool Bvh::QueryRay(const float origin[3], const float dir[3], float maxT, uint32_t& object, float& t) const
+{
+    if (m_nodes.empty())
+        return false;
+
+    float invDir[3];
+    for (int axis = 0; axis < 3; axis++)
+    {
+        invDir[axis] = dir[axis] != 0.0f ? 1.0f / dir[axis] : FLT_MAX;
+    }
+
+    float closest = maxT;
+    bool hit = false;
+    std::vector<uint32_t> stack(1, 0u);
+    while (!stack.empty())
+    {
+        const Node& node = m_nodes[stack.back()];
+        stack.pop_back();
+        if (RayAabb(node.bounds, origin, invDir, closest) == FLT_MAX)
+            continue;
+        if (node.count > 0)
+        {
+            for (uint32_t i = node.first; i < node.first + node.count; i++)
+            {
+                float tHit = RayAabb(m_objectBounds[m_objectIndices[i]], origin, invDir, closest);
+                if (tHit != FLT_MAX && tHit <= closest)
+                {
+                    closest = tHit;
+                    object = m_objectIndices[i];
+                    hit = true;
+                }
+            }
+        }
+        else
+        {
+            // Visit the nearer child first so the far one is more likely to be pruned
+            float tLeft = RayAabb(m_nodes[node.first].bounds, origin, invDir, closest);
+            float tRight = RayAabb(m_nodes[node.first + 1].bounds, origin, invDir, closest);
+            uint32_t nearIdx = tLeft <= tRight ? node.first : node.first + 1;
+            uint32_t farIdx = tLeft <= tRight ? node.first + 1 : node.first;
+            if (std::max(tLeft, tRight) != FLT_MAX)
+                stack.push_back(farIdx);
+            if (std::min(tLeft, tRight) != FLT_MAX)
+                stack.push_back(nearIdx);
+        }
+    }
+    if (hit)
+        t = closest;
+    return hit;
+}
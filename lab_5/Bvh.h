@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "FrustumCulling.h"
+
+struct BvhAabb
+{
+    float min[3];
+    float max[3];
+};
+
+// Bounding volume hierarchy over object AABBs. Built top-down with a binned
+// surface area heuristic; moving objects are handled by Refit, which keeps the
+// topology and only recomputes node bounds.
+class Bvh
+{
+public:
+    static const uint32_t MaxLeafSize = 4;
+
+    void Build(const std::vector<BvhAabb>& bounds);
+    // bounds must hold the same objects, in the same order, as at Build time
+    void Refit(const std::vector<BvhAabb>& bounds);
+    void Clear();
+
+    size_t GetObjectCount() const { return m_objectIndices.size(); }
+    size_t GetNodeCount() const { return m_nodes.size(); }
+
+    void QueryFrustum(const FrustumPlanes& planes, std::vector<uint32_t>& result) const;
+    void QuerySphere(const float center[3], float radius, std::vector<uint32_t>& result) const;
+    // Closest object whose AABB the ray hits within [0, maxT]; dir need not be normalized
+    bool QueryRay(const float origin[3], const float dir[3], float maxT, uint32_t& object, float& t) const;
+private:
+    struct Node
+    {
+        BvhAabb bounds;
+        uint32_t first; // leaf: first entry in m_objectIndices, inner: left child (right is first + 1)
+        uint32_t count; // 0 for inner nodes
+    };
+
+    struct BuildPrim
+    {
+        BvhAabb bounds;
+        float centroid[3];
+        uint32_t object;
+    };
+
+    void Subdivide(uint32_t nodeIdx, std::vector<BuildPrim>& prims);
+    void UpdateLeafBounds(Node& node) const;
+    void CollectSubtree(uint32_t nodeIdx, std::vector<uint32_t>& result) const;
+
+    std::vector<Node> m_nodes;
+    std::vector<uint32_t> m_objectIndices;
+    std::vector<BvhAabb> m_objectBounds;
+};
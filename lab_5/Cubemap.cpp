@@ -0,0 +1,160 @@
+#include "Cubemap.h"
+
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+    const uint64_t FnvOffset = 0xCBF29CE484222325ull;
+    const uint64_t FnvPrime = 0x100000001B3ull;
+
+    uint64_t HashBytes(uint64_t hash, const void* pData, size_t size)
+    {
+        // Eight bytes per step, the tail one at a time
+        const uint8_t* pBytes = static_cast<const uint8_t*>(pData);
+        size_t i = 0;
+        for (; i + 8 <= size; i += 8)
+        {
+            uint64_t word;
+            memcpy(&word, pBytes + i, sizeof(word));
+            hash = (hash ^ word) * FnvPrime;
+        }
+        for (; i < size; i++)
+        {
+            hash = (hash ^ pBytes[i]) * FnvPrime;
+        }
+        return hash;
+    }
+
+    void Rgb565ToFloat(uint16_t color, float* pRgba)
+    {
+        pRgba[0] = float((color >> 11) & 0x1F) / 31.0f;
+        pRgba[1] = float((color >> 5) & 0x3F) / 63.0f;
+        pRgba[2] = float(color & 0x1F) / 31.0f;
+        pRgba[3] = 1.0f;
+    }
+
+    // 4x4 texels into four rows of pitch floats
+    void DecodeBC1Block(const uint8_t* pBlock, float* pRgba, size_t pitch)
+    {
+        uint16_t color0, color1;
+        uint32_t selectors;
+        memcpy(&color0, pBlock, sizeof(color0));
+        memcpy(&color1, pBlock + 2, sizeof(color1));
+        memcpy(&selectors, pBlock + 4, sizeof(selectors));
+
+        float palette[4][4];
+        Rgb565ToFloat(color0, palette[0]);
+        Rgb565ToFloat(color1, palette[1]);
+        for (int channel = 0; channel < 3; channel++)
+        {
+            if (color0 > color1)
+            {
+                palette[2][channel] = (2.0f * palette[0][channel] + palette[1][channel]) / 3.0f;
+                palette[3][channel] = (palette[0][channel] + 2.0f * palette[1][channel]) / 3.0f;
+            }
+            else
+            {
+                // Three color mode, the fourth entry is transparent black
+                palette[2][channel] = 0.5f * (palette[0][channel] + palette[1][channel]);
+                palette[3][channel] = 0.0f;
+            }
+        }
+        palette[2][3] = 1.0f;
+        palette[3][3] = color0 > color1 ? 1.0f : 0.0f;
+
+        for (int y = 0; y < 4; y++)
+        {
+            for (int x = 0; x < 4; x++)
+            {
+                const uint32_t idx = (selectors >> (2 * (y * 4 + x))) & 3;
+                memcpy(pRgba + y * pitch + x * 4, palette[idx], sizeof(palette[idx]));
+            }
+        }
+    }
+}
+
+void GetCubemapDirection(uint32_t face, float u, float v, float direction[3])
+{
+    switch (face)
+    {
+    case 0: direction[0] = 1.0f; direction[1] = -v; direction[2] = -u; break;
+    case 1: direction[0] = -1.0f; direction[1] = -v; direction[2] = u; break;
+    case 2: direction[0] = u; direction[1] = 1.0f; direction[2] = v; break;
+    case 3: direction[0] = u; direction[1] = -1.0f; direction[2] = -v; break;
+    case 4: direction[0] = u; direction[1] = -v; direction[2] = 1.0f; break;
+    default: direction[0] = -u; direction[1] = -v; direction[2] = -1.0f; break;
+    }
+}
+
+void GetCubemapFace(const float direction[3], uint32_t& face, float& u, float& v)
+{
+    const float x = direction[0], y = direction[1], z = direction[2];
+    const float ax = fabsf(x), ay = fabsf(y), az = fabsf(z);
+    if (ax >= ay && ax >= az)
+    {
+        face = x >= 0.0f ? 0 : 1;
+        u = (x >= 0.0f ? -z : z) / ax;
+        v = -y / ax;
+    }
+    else if (ay >= az)
+    {
+        face = y >= 0.0f ? 2 : 3;
+        u = x / ay;
+        v = (y >= 0.0f ? z : -z) / ay;
+    }
+    else
+    {
+        face = z >= 0.0f ? 4 : 5;
+        u = (z >= 0.0f ? x : -x) / az;
+        v = -y / az;
+    }
+}
+
+void DecodeCubemapRows(const CubemapFaces& faces, uint32_t face, uint32_t firstRow, uint32_t rowCount, float* pRgba)
+{
+    const uint8_t* pFace = static_cast<const uint8_t*>(faces.pFaces[face]);
+    const size_t pitch = size_t(faces.size) * 4;
+    if (faces.format == CubemapFormatRGBA8)
+    {
+        const uint8_t* pTexels = pFace + size_t(firstRow) * pitch;
+        for (size_t i = 0; i < rowCount * pitch; i++)
+        {
+            pRgba[i] = float(pTexels[i]) / 255.0f;
+        }
+        return;
+    }
+
+    assert(faces.size % 4 == 0 && firstRow % 4 == 0 && rowCount % 4 == 0);
+    const size_t blocksPerRow = (faces.size + 3) / 4;
+    for (uint32_t blockRow = firstRow / 4; blockRow < (firstRow + rowCount) / 4; blockRow++)
+    {
+        const uint8_t* pBlocks = pFace + blockRow * blocksPerRow * 8;
+        float* pRows = pRgba + (blockRow * 4 - firstRow) * pitch;
+        for (size_t block = 0; block < blocksPerRow; block++)
+        {
+            DecodeBC1Block(pBlocks + block * 8, pRows + block * 16, pitch);
+        }
+    }
+}
+
+size_t GetCubemapFaceBytes(const CubemapFaces& faces)
+{
+    if (faces.format == CubemapFormatRGBA8)
+        return size_t(faces.size) * faces.size * 4;
+    const size_t blocks = (faces.size + 3) / 4;
+    return blocks * blocks * 8;
+}
+
+uint64_t HashCubemapFaces(const CubemapFaces& faces)
+{
+    uint64_t hash = HashBytes(FnvOffset, &faces.size, sizeof(faces.size));
+    hash = HashBytes(hash, &faces.format, sizeof(faces.format));
+    const size_t faceBytes = GetCubemapFaceBytes(faces);
+    for (int face = 0; face < 6; face++)
+    {
+        hash = HashBytes(hash, faces.pFaces[face], faceBytes);
+    }
+    return hash;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Texel data the CPU cubemap tools read. BC1 is what the skybox faces are
+// stored in, RGBA8 covers uncompressed sources.
+enum CubemapFormat : uint32_t
+{
+    CubemapFormatBC1,
+    CubemapFormatRGBA8
+};
+
+// Top mip of the six faces of a square cubemap, in D3D11 array order:
+// +X, -X, +Y, -Y, +Z, -Z. Rows are tightly packed (blocks of 4 rows for BC1).
+struct CubemapFaces
+{
+    const void* pFaces[6];
+    uint32_t size;
+    CubemapFormat format;
+};
+
+// Direction through a point of a face, u right and v down in [-1, 1] as D3D
+// samples them; not normalized, the major axis component is +-1
+void GetCubemapDirection(uint32_t face, float u, float v, float direction[3]);
+
+// The inverse: the face a direction of any length hits and u, v on it
+void GetCubemapFace(const float direction[3], uint32_t& face, float& u, float& v);
+
+// rowCount rows from firstRow of a face as float RGBA in [0, 1], size * 4
+// floats per row. BC1 goes by whole blocks, the size and both row arguments
+// have to be multiples of 4.
+void DecodeCubemapRows(const CubemapFaces& faces, uint32_t face, uint32_t firstRow, uint32_t rowCount, float* pRgba);
+
+size_t GetCubemapFaceBytes(const CubemapFaces& faces);
+
+// 64 bit FNV-1a over the size, format and texel data, to tell whether results
+// cached from the faces are still current
+uint64_t HashCubemapFaces(const CubemapFaces& faces);
@@ -0,0 +1,455 @@
+#include "CubemapPrefilter.h"
+#include "WorkerPool.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+    // Output rows per task
+    const uint32_t BandRows = 16;
+    const float Pi = 3.14159265f;
+
+    const uint32_t DdsMagic = 0x20534444; // "DDS "
+
+#pragma pack(push, 1)
+    // Legacy DDS header, the layout LoadDDS reads
+    struct DdsPixelFormat
+    {
+        uint32_t size;
+        uint32_t flags;
+        uint32_t fourCC;
+        uint32_t rgbBitCount;
+        uint32_t rBitMask;
+        uint32_t gBitMask;
+        uint32_t bBitMask;
+        uint32_t aBitMask;
+    };
+
+    struct DdsHeader
+    {
+        uint32_t size;
+        uint32_t flags;
+        uint32_t height;
+        uint32_t width;
+        uint32_t pitchOrLinearSize;
+        uint32_t depth;
+        uint32_t mipMapCount;
+        uint32_t reserved1[11];
+        DdsPixelFormat ddspf;
+        uint32_t caps;
+        uint32_t caps2;
+        uint32_t caps3;
+        uint32_t caps4;
+        uint32_t reserved2;
+    };
+#pragma pack(pop)
+
+    const uint32_t DdsdCaps = 0x1;
+    const uint32_t DdsdHeight = 0x2;
+    const uint32_t DdsdWidth = 0x4;
+    const uint32_t DdsdPitch = 0x8;
+    const uint32_t DdsdPixelFormat = 0x1000;
+    const uint32_t DdsdMipMapCount = 0x20000;
+    const uint32_t DdpfAlphaPixels = 0x1;
+    const uint32_t DdpfRgb = 0x40;
+    const uint32_t DdsCapsComplex = 0x8;
+    const uint32_t DdsCapsTexture = 0x1000;
+    const uint32_t DdsCapsMipMap = 0x400000;
+    const uint32_t DdsCaps2AllFaces = 0xFE00; // DDSCAPS2_CUBEMAP and all six faces
+
+    uint32_t GetLevelSize(uint32_t size, uint32_t mip)
+    {
+        return size >> mip > 0 ? size >> mip : 1;
+    }
+
+    // Box filtered copies of the source from the base size down to 1x1,
+    // float RGBA, the six faces of a level one after another
+    struct SourcePyramid
+    {
+        uint32_t baseSize = 0;
+        std::vector<std::vector<float>> levels;
+
+        const float* GetTexel(uint32_t level, uint32_t face, uint32_t x, uint32_t y) const
+        {
+            const size_t size = GetLevelSize(baseSize, level);
+            return &levels[level][((face * size + y) * size + x) * 4];
+        }
+
+        void SampleBilinear(uint32_t level, uint32_t face, float u, float v, float rgb[3]) const
+        {
+            const uint32_t size = GetLevelSize(baseSize, level);
+            const float maxCoord = float(size - 1);
+            float x = (u + 1.0f) * 0.5f * float(size) - 0.5f;
+            float y = (v + 1.0f) * 0.5f * float(size) - 0.5f;
+            // Clamped to the face, seams are a texel wide at most
+            x = x < 0.0f ? 0.0f : (x > maxCoord ? maxCoord : x);
+            y = y < 0.0f ? 0.0f : (y > maxCoord ? maxCoord : y);
+            const uint32_t x0 = uint32_t(x), y0 = uint32_t(y);
+            const uint32_t x1 = x0 + 1 < size ? x0 + 1 : x0;
+            const uint32_t y1 = y0 + 1 < size ? y0 + 1 : y0;
+            const float fx = x - float(x0), fy = y - float(y0);
+            const float* p00 = GetTexel(level, face, x0, y0);
+            const float* p10 = GetTexel(level, face, x1, y0);
+            const float* p01 = GetTexel(level, face, x0, y1);
+            const float* p11 = GetTexel(level, face, x1, y1);
+            for (int channel = 0; channel < 3; channel++)
+            {
+                const float top = p00[channel] + (p10[channel] - p00[channel]) * fx;
+                const float bottom = p01[channel] + (p11[channel] - p01[channel]) * fx;
+                rgb[channel] = top + (bottom - top) * fy;
+            }
+        }
+
+        // Trilinear between the two levels around lod, lod 0 is the base
+        void Sample(const float direction[3], float lod, float rgb[3]) const
+        {
+            uint32_t face;
+            float u, v;
+            GetCubemapFace(direction, face, u, v);
+            const float maxLod = float(levels.size() - 1);
+            lod = lod < 0.0f ? 0.0f : (lod > maxLod ? maxLod : lod);
+            const uint32_t level = uint32_t(lod);
+            const float fraction = lod - float(level);
+            SampleBilinear(level, face, u, v, rgb);
+            if (fraction > 0.0f && level + 1 < levels.size())
+            {
+                float coarse[3];
+                SampleBilinear(level + 1, face, u, v, coarse);
+                for (int channel = 0; channel < 3; channel++)
+                {
+                    rgb[channel] += (coarse[channel] - rgb[channel]) * fraction;
+                }
+            }
+        }
+    };
+
+    // Importance sample in tangent space (normal along +z) with its N.L and
+    // the source lod that matches the solid angle the sample stands for
+    struct PrefilterSample
+    {
+        float direction[3];
+        float nDotL;
+        float lod;
+    };
+
+    float RadicalInverse(uint32_t bits)
+    {
+        bits = (bits << 16) | (bits >> 16);
+        bits = ((bits & 0x55555555u) << 1) | ((bits & 0xAAAAAAAAu) >> 1);
+        bits = ((bits & 0x33333333u) << 2) | ((bits & 0xCCCCCCCCu) >> 2);
+        bits = ((bits & 0x0F0F0F0Fu) << 4) | ((bits & 0xF0F0F0F0u) >> 4);
+        bits = ((bits & 0x00FF00FFu) << 8) | ((bits & 0xFF00FF00u) >> 8);
+        return float(bits) * 2.3283064e-10f;
+    }
+
+    // The same Hammersley set for every texel of a level, rotated into its frame
+    void BuildSamples(float roughness, uint32_t sampleCount, uint32_t baseSize, std::vector<PrefilterSample>& samples)
+    {
+        samples.clear();
+        const float alpha = roughness * roughness;
+        const float alpha2 = alpha * alpha;
+        const float texelSolidAngle = 4.0f * Pi / (6.0f * float(baseSize) * float(baseSize));
+        for (uint32_t i = 0; i < sampleCount; i++)
+        {
+            const float xi0 = (float(i) + 0.5f) / float(sampleCount);
+            const float xi1 = RadicalInverse(i);
+            const float phi = 2.0f * Pi * xi0;
+            const float cosTheta = sqrtf((1.0f - xi1) / (1.0f + (alpha2 - 1.0f) * xi1));
+            const float sinTheta = sqrtf(1.0f - cosTheta * cosTheta);
+
+            // L is H reflected about N = V
+            PrefilterSample sample;
+            sample.direction[0] = 2.0f * cosTheta * sinTheta * cosf(phi);
+            sample.direction[1] = 2.0f * cosTheta * sinTheta * sinf(phi);
+            sample.direction[2] = 2.0f * cosTheta * cosTheta - 1.0f;
+            sample.nDotL = sample.direction[2];
+            if (sample.nDotL <= 0.0f)
+                continue;
+
+            // With N = V the pdf of L is D(H) / 4
+            const float denominator = cosTheta * cosTheta * (alpha2 - 1.0f) + 1.0f;
+            const float pdf = alpha2 / (Pi * denominator * denominator) * 0.25f;
+            const float sampleSolidAngle = 1.0f / (float(sampleCount) * pdf + 1e-6f);
+            // One level up from the matching one, as in GPU Gems 3 ch. 20
+            sample.lod = 0.5f * log2f(sampleSolidAngle / texelSolidAngle) + 1.0f;
+            samples.push_back(sample);
+        }
+    }
+
+    void BuildSourcePyramid(const CubemapFaces& source, uint32_t size, SourcePyramid& pyramid, WorkerPool* pPool)
+    {
+        // Twice the output resolution is all level 0 and the sharp samples read
+        uint32_t factor = 1;
+        while (source.size / factor > 2 * size && (source.size / factor) % 2 == 0)
+        {
+            factor *= 2;
+        }
+        const uint32_t baseSize = source.size / factor;
+        pyramid.baseSize = baseSize;
+        pyramid.levels.clear();
+        for (uint32_t levelSize = baseSize; ; levelSize /= 2)
+        {
+            pyramid.levels.emplace_back(size_t(levelSize) * levelSize * 6 * 4);
+            if (levelSize == 1 || levelSize % 2 != 0)
+                break;
+        }
+
+        // BC1 decodes by whole blocks of rows
+        const uint32_t sourceRows = source.format == CubemapFormatBC1 && factor < 4 ? 4 : factor;
+        const uint32_t tasksPerFace = source.size / sourceRows;
+        const float scale = 1.0f / float(factor * factor);
+        auto downsampleBand = [&](size_t idx)
+        {
+            const uint32_t face = uint32_t(idx / tasksPerFace);
+            const uint32_t firstRow = uint32_t(idx % tasksPerFace) * sourceRows;
+            std::vector<float> texels(size_t(sourceRows) * source.size * 4);
+            DecodeCubemapRows(source, face, firstRow, sourceRows, texels.data());
+            for (uint32_t y = 0; y < sourceRows / factor; y++)
+            {
+                float* pResult = &pyramid.levels[0][((face * baseSize) + firstRow / factor + y) * size_t(baseSize) * 4];
+                for (uint32_t x = 0; x < baseSize; x++)
+                {
+                    float sum[4] = {};
+                    for (uint32_t sy = 0; sy < factor; sy++)
+                    {
+                        const float* pRow = &texels[((y * factor + sy) * size_t(source.size) + x * factor) * 4];
+                        for (uint32_t sx = 0; sx < factor * 4; sx++)
+                        {
+                            sum[sx % 4] += pRow[sx];
+                        }
+                    }
+                    for (int channel = 0; channel < 4; channel++)
+                    {
+                        pResult[x * 4 + channel] = sum[channel] * scale;
+                    }
+                }
+            }
+        };
+        if (pPool != nullptr)
+        {
+            pPool->ParallelFor(size_t(tasksPerFace) * 6, downsampleBand);
+        }
+        else
+        {
+            for (size_t i = 0; i < size_t(tasksPerFace) * 6; i++)
+            {
+                downsampleBand(i);
+            }
+        }
+
+        // The small levels are a fraction of the base, not worth the pool
+        for (uint32_t level = 1; level < pyramid.levels.size(); level++)
+        {
+            const uint32_t levelSize = GetLevelSize(baseSize, level);
+            for (uint32_t face = 0; face < 6; face++)
+            {
+                for (uint32_t y = 0; y < levelSize; y++)
+                {
+                    float* pResult = &pyramid.levels[level][((face * levelSize) + y) * size_t(levelSize) * 4];
+                    for (uint32_t x = 0; x < levelSize; x++)
+                    {
+                        const float* p00 = pyramid.GetTexel(level - 1, face, x * 2, y * 2);
+                        const float* p10 = pyramid.GetTexel(level - 1, face, x * 2 + 1, y * 2);
+                        const float* p01 = pyramid.GetTexel(level - 1, face, x * 2, y * 2 + 1);
+                        const float* p11 = pyramid.GetTexel(level - 1, face, x * 2 + 1, y * 2 + 1);
+                        for (int channel = 0; channel < 4; channel++)
+                        {
+                            pResult[x * 4 + channel] = 0.25f * (p00[channel] + p10[channel] + p01[channel] + p11[channel]);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    uint8_t ToUnorm8(float value)
+    {
+        value = value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+        return uint8_t(value * 255.0f + 0.5f);
+    }
+
+    struct PrefilterTask
+    {
+        uint32_t mip;
+        uint32_t face;
+        uint32_t firstRow;
+        uint32_t rowCount;
+    };
+}
+
+size_t PrefilteredCubemap::GetOffset(uint32_t face, uint32_t mip) const
+{
+    size_t faceBytes = 0, mipOffset = 0;
+    for (uint32_t level = 0; level < mipCount; level++)
+    {
+        const size_t levelSize = GetLevelSize(size, level);
+        if (level == mip)
+        {
+            mipOffset = faceBytes;
+        }
+        faceBytes += levelSize * levelSize * 4;
+    }
+    return face * faceBytes + mipOffset;
+}
+
+void PrefilterCubemap(const CubemapFaces& source, const PrefilterSettings& settings, PrefilteredCubemap& result,
+    WorkerPool* pPool)
+{
+    result.size = 0;
+    result.mipCount = 0;
+    result.texels.clear();
+    if (source.size == 0 || (source.format == CubemapFormatBC1 && source.size % 4 != 0) || settings.size == 0)
+        return;
+
+    uint32_t mipCount = 1;
+    while (mipCount < settings.mipCount && settings.size >> mipCount > 0)
+    {
+        mipCount++;
+    }
+    result.size = settings.size;
+    result.mipCount = mipCount;
+    result.texels.resize(result.GetOffset(6, 0));
+
+    SourcePyramid pyramid;
+    BuildSourcePyramid(source, settings.size, pyramid, pPool);
+
+    std::vector<std::vector<PrefilterSample>> samples(mipCount);
+    std::vector<PrefilterTask> tasks;
+    for (uint32_t mip = 0; mip < mipCount; mip++)
+    {
+        if (mip > 0)
+        {
+            const uint32_t sampleCount = settings.sampleCount > 0 ? settings.sampleCount : 1;
+            BuildSamples(GetPrefilterRoughness(mip, mipCount), sampleCount, pyramid.baseSize, samples[mip]);
+        }
+        const uint32_t levelSize = GetLevelSize(settings.size, mip);
+        for (uint32_t face = 0; face < 6; face++)
+        {
+            for (uint32_t row = 0; row < levelSize; row += BandRows)
+            {
+                const uint32_t rowCount = levelSize - row < BandRows ? levelSize - row : BandRows;
+                tasks.push_back({ mip, face, row, rowCount });
+            }
+        }
+    }
+
+    // Level 0 reads the source level of its own size, one texel per texel
+    const float mirrorLod = log2f(float(pyramid.baseSize) / float(settings.size));
+    auto prefilterBand = [&](size_t idx)
+    {
+        const PrefilterTask& task = tasks[idx];
+        const uint32_t levelSize = GetLevelSize(settings.size, task.mip);
+        const std::vector<PrefilterSample>& levelSamples = samples[task.mip];
+        uint8_t* pLevel = &result.texels[result.GetOffset(task.face, task.mip)];
+        for (uint32_t y = task.firstRow; y < task.firstRow + task.rowCount; y++)
+        {
+            const float v = (float(y) + 0.5f) * 2.0f / float(levelSize) - 1.0f;
+            for (uint32_t x = 0; x < levelSize; x++)
+            {
+                const float u = (float(x) + 0.5f) * 2.0f / float(levelSize) - 1.0f;
+                float n[3];
+                GetCubemapDirection(task.face, u, v, n);
+                const float invLength = 1.0f / sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+                for (float& component : n)
+                {
+                    component *= invLength;
+                }
+
+                float color[3] = {};
+                if (levelSamples.empty())
+                {
+                    pyramid.Sample(n, mirrorLod, color);
+                }
+                else
+                {
+                    // Tangent frame around the normal
+                    const float up[3] = { fabsf(n[2]) < 0.999f ? 0.0f : 1.0f, 0.0f, fabsf(n[2]) < 0.999f ? 1.0f : 0.0f };
+                    float t[3] = { up[1] * n[2] - up[2] * n[1], up[2] * n[0] - up[0] * n[2], up[0] * n[1] - up[1] * n[0] };
+                    const float invTangentLength = 1.0f / sqrtf(t[0] * t[0] + t[1] * t[1] + t[2] * t[2]);
+                    for (float& component : t)
+                    {
+                        component *= invTangentLength;
+                    }
+                    const float b[3] = { n[1] * t[2] - n[2] * t[1], n[2] * t[0] - n[0] * t[2], n[0] * t[1] - n[1] * t[0] };
+
+                    float weight = 0.0f;
+                    for (const PrefilterSample& sample : levelSamples)
+                    {
+                        float l[3];
+                        for (int axis = 0; axis < 3; axis++)
+                        {
+                            l[axis] = t[axis] * sample.direction[0] + b[axis] * sample.direction[1] + n[axis] * sample.direction[2];
+                        }
+                        float radiance[3];
+                        pyramid.Sample(l, sample.lod, radiance);
+                        for (int channel = 0; channel < 3; channel++)
+                        {
+                            color[channel] += radiance[channel] * sample.nDotL;
+                        }
+                        weight += sample.nDotL;
+                    }
+                    for (float& channel : color)
+                    {
+                        channel /= weight;
+                    }
+                }
+
+                uint8_t* pTexel = pLevel + (size_t(y) * levelSize + x) * 4;
+                pTexel[0] = ToUnorm8(color[0]);
+                pTexel[1] = ToUnorm8(color[1]);
+                pTexel[2] = ToUnorm8(color[2]);
+                pTexel[3] = 255;
+            }
+        }
+    };
+    if (pPool != nullptr)
+    {
+        pPool->ParallelFor(tasks.size(), prefilterBand);
+    }
+    else
+    {
+        for (size_t i = 0; i < tasks.size(); i++)
+        {
+            prefilterBand(i);
+        }
+    }
+}
+
+bool WriteCubemapDds(const char* path, const PrefilteredCubemap& cubemap)
+{
+    if (cubemap.size == 0 || cubemap.mipCount == 0)
+        return false;
+
+    DdsHeader header;
+    memset(&header, 0, sizeof(header));
+    header.size = sizeof(DdsHeader);
+    header.flags = DdsdCaps | DdsdHeight | DdsdWidth | DdsdPitch | DdsdPixelFormat | DdsdMipMapCount;
+    header.height = cubemap.size;
+    header.width = cubemap.size;
+    header.pitchOrLinearSize = cubemap.size * 4;
+    header.mipMapCount = cubemap.mipCount;
+    header.ddspf.size = sizeof(DdsPixelFormat);
+    header.ddspf.flags = DdpfRgb | DdpfAlphaPixels;
+    header.ddspf.rgbBitCount = 32;
+    header.ddspf.rBitMask = 0x000000FF;
+    header.ddspf.gBitMask = 0x0000FF00;
+    header.ddspf.bBitMask = 0x00FF0000;
+    header.ddspf.aBitMask = 0xFF000000;
+    header.caps = DdsCapsComplex | DdsCapsTexture | DdsCapsMipMap;
+    header.caps2 = DdsCaps2AllFaces;
+
+    FILE* pFile = nullptr;
+#ifdef _MSC_VER
+    fopen_s(&pFile, path, "wb");
+#else
+    pFile = fopen(path, "wb");
+#endif
+    if (pFile == nullptr)
+        return false;
+    bool written = fwrite(&DdsMagic, sizeof(DdsMagic), 1, pFile) == 1;
+    written = written && fwrite(&header, sizeof(header), 1, pFile) == 1;
+    written = written && fwrite(cubemap.texels.data(), cubemap.texels.size(), 1, pFile) == 1;
+    return fclose(pFile) == 0 && written;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "Cubemap.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class WorkerPool;
+
+struct PrefilterSettings
+{
+    // Face size of the sharpest level, every next level is half as large
+    uint32_t size = 256;
+    uint32_t mipCount = 6;
+    // GGX samples per texel of the rough levels; level 0 is a mirror and
+    // only downsamples the source
+    uint32_t sampleCount = 64;
+};
+
+// Specular cubemap with roughness growing along the mip chain, R8G8B8A8
+// texels in DDS order: the faces one after another, each from level 0 down.
+// The D3D11 subresource of a face and a level is face * mipCount + mip.
+struct PrefilteredCubemap
+{
+    uint32_t size = 0;
+    uint32_t mipCount = 0;
+    std::vector<uint8_t> texels;
+
+    size_t GetOffset(uint32_t face, uint32_t mip) const;
+};
+
+// Roughness a level is filtered for, linear in the level so the shaders pick
+// the level as roughness * (mipCount - 1)
+inline float GetPrefilterRoughness(uint32_t mip, uint32_t mipCount)
+{
+    return mipCount > 1 ? float(mip) / float(mipCount - 1) : 0.0f;
+}
+
+// Split sum prefilter with the view along the normal (N = V = R): every texel
+// averages GGX importance samples of the source weighted by N.L. Samples are
+// taken from a box filtered copy of the source at the level whose texels
+// match the solid angle of the sample, so few samples don't alias the
+// full-res faces. Bands of rows run in parallel on the pool when there is one.
+void PrefilterCubemap(const CubemapFaces& source, const PrefilterSettings& settings, PrefilteredCubemap& result,
+    WorkerPool* pPool = nullptr);
+
+// DDS with the legacy header LoadDDS reads: R8G8B8A8 masks, the cubemap caps
+// and the whole mip chain
+bool WriteCubemapDds(const char* path, const PrefilteredCubemap& cubemap);
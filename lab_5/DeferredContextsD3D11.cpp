@@ -0,0 +1,52 @@
+#include "DeferredContextsD3D11.h"
+
+#include <cassert>
+
+#define SafeRelease(A) if ((A) != NULL) { (A)->Release(); (A) = NULL; }
+
+HRESULT DeferredContextsD3D11::Init(ID3D11Device* pDevice, ID3D11DeviceContext* pImmediateContext, int slotCount)
+{
+    m_pImmediateContext = pImmediateContext;
+    HRESULT result = S_OK;
+    for (int i = 0; i < slotCount && SUCCEEDED(result); i++)
+    {
+        ID3D11DeviceContext* pContext = nullptr;
+        result = pDevice->CreateDeferredContext(0, &pContext);
+        if (SUCCEEDED(result))
+            m_deferredContexts.push_back(pContext);
+    }
+    return result;
+}
+
+void DeferredContextsD3D11::Clean()
+{
+    for (ID3D11DeviceContext*& pContext : m_deferredContexts)
+    {
+        SafeRelease(pContext);
+    }
+    m_deferredContexts.clear();
+    m_pImmediateContext = nullptr;
+}
+
+void* DeferredContextsD3D11::BeginRecording(int slot)
+{
+    assert(slot < int(m_deferredContexts.size()));
+    return m_deferredContexts[slot];
+}
+
+void* DeferredContextsD3D11::FinishRecording(int slot)
+{
+    ID3D11CommandList* pCommandList = nullptr;
+    HRESULT result = m_deferredContexts[slot]->FinishCommandList(FALSE, &pCommandList);
+    assert(SUCCEEDED(result));
+    return pCommandList;
+}
+
+void DeferredContextsD3D11::Execute(void* pCommandList)
+{
+    ID3D11CommandList* pList = static_cast<ID3D11CommandList*>(pCommandList);
+    if (pList == nullptr)
+        return;
+    m_pImmediateContext->ExecuteCommandList(pList, FALSE);
+    pList->Release();
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <d3d11.h>
+#include <vector>
+
+#include "ParallelRecorder.h"
+
+// One deferred context per recording slot, command lists are played back on the immediate context
+class DeferredContextsD3D11 : public ICommandRecordingBackend
+{
+public:
+    HRESULT Init(ID3D11Device* pDevice, ID3D11DeviceContext* pImmediateContext, int slotCount);
+    void Clean();
+
+    void* BeginRecording(int slot) override;
+    void* FinishRecording(int slot) override;
+    void Execute(void* pCommandList) override;
+private:
+    ID3D11DeviceContext* m_pImmediateContext = nullptr;
+    std::vector<ID3D11DeviceContext*> m_deferredContexts;
+};
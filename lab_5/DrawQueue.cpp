@@ -0,0 +1,132 @@
+#include "DrawQueue.h"
+
+#include <cstring>
+
+namespace DrawKey
+{
+    const uint32_t PassShift = 64 - PassBits;
+    const uint32_t BlendShift = PassShift - BlendBits;
+
+    const uint32_t OpaqueShaderShift = BlendShift - ShaderBits;
+    const uint32_t OpaqueTextureShift = OpaqueShaderShift - TextureBits;
+
+    const uint32_t TransDepthShift = BlendShift - DepthBits;
+    const uint32_t TransShaderShift = TransDepthShift - ShaderBits;
+    const uint32_t TransTextureShift = TransShaderShift - TextureBits;
+
+    static uint64_t Field(uint32_t value, uint32_t bits, uint32_t shift)
+    {
+        return (uint64_t(value) & ((uint64_t(1) << bits) - 1)) << shift;
+    }
+
+    static uint32_t Extract(uint64_t key, uint32_t bits, uint32_t shift)
+    {
+        return uint32_t((key >> shift) & ((uint64_t(1) << bits) - 1));
+    }
+
+    uint32_t DepthToBits(float depth)
+    {
+        if (!(depth > 0.0f))
+            return 0;
+        // Positive IEEE floats compare like their bit patterns
+        uint32_t bits;
+        memcpy(&bits, &depth, sizeof(bits));
+        return bits;
+    }
+
+    uint64_t MakeOpaque(uint32_t pass, uint32_t shader, uint32_t texture, float depth)
+    {
+        return Field(pass, PassBits, PassShift)
+            | Field(BlendOpaque, BlendBits, BlendShift)
+            | Field(shader, ShaderBits, OpaqueShaderShift)
+            | Field(texture, TextureBits, OpaqueTextureShift)
+            | Field(DepthToBits(depth), DepthBits, 0);
+    }
+
+    uint64_t MakeTransparent(uint32_t pass, uint32_t shader, uint32_t texture, float depth)
+    {
+        return Field(pass, PassBits, PassShift)
+            | Field(BlendTransparent, BlendBits, BlendShift)
+            | Field(~DepthToBits(depth), DepthBits, TransDepthShift)
+            | Field(shader, ShaderBits, TransShaderShift)
+            | Field(texture, TextureBits, TransTextureShift);
+    }
+
+    uint32_t GetPass(uint64_t key)
+    {
+        return Extract(key, PassBits, PassShift);
+    }
+
+    uint32_t GetBlend(uint64_t key)
+    {
+        return Extract(key, BlendBits, BlendShift);
+    }
+
+    uint32_t GetShader(uint64_t key)
+    {
+        return GetBlend(key) == BlendTransparent
+            ? Extract(key, ShaderBits, TransShaderShift)
+            : Extract(key, ShaderBits, OpaqueShaderShift);
+    }
+
+    uint32_t GetTexture(uint64_t key)
+    {
+        return GetBlend(key) == BlendTransparent
+            ? Extract(key, TextureBits, TransTextureShift)
+            : Extract(key, TextureBits, OpaqueTextureShift);
+    }
+}
+
+void DrawQueue::Reserve(size_t count)
+{
+    m_packets.reserve(count);
+    m_scratch.reserve(count);
+}
+
+void DrawQueue::Sort()
+{
+    const size_t count = m_packets.size();
+    if (count < 2)
+        return;
+
+    // All eight byte histograms are built in a single read of the keys
+    uint32_t histograms[8][256];
+    memset(histograms, 0, sizeof(histograms));
+    for (const DrawPacket& packet : m_packets)
+    {
+        uint64_t key = packet.key;
+        for (int byte = 0; byte < 8; byte++)
+        {
+            histograms[byte][(key >> (byte * 8)) & 0xFF]++;
+        }
+    }
+
+    m_scratch.resize(count);
+    DrawPacket* pSrc = m_packets.data();
+    DrawPacket* pDst = m_scratch.data();
+    for (int byte = 0; byte < 8; byte++)
+    {
+        uint32_t* histogram = histograms[byte];
+        const uint32_t shift = byte * 8;
+        if (histogram[(pSrc[0].key >> shift) & 0xFF] == count)
+            continue;
+
+        uint32_t offset = 0;
+        for (int bucket = 0; bucket < 256; bucket++)
+        {
+            uint32_t bucketCount = histogram[bucket];
+            histogram[bucket] = offset;
+            offset += bucketCount;
+        }
+        for (size_t i = 0; i < count; i++)
+        {
+            pDst[histogram[(pSrc[i].key >> shift) & 0xFF]++] = pSrc[i];
+        }
+        DrawPacket* pTmp = pSrc;
+        pSrc = pDst;
+        pDst = pTmp;
+    }
+
+    if (pSrc != m_packets.data())
+        m_packets.swap(m_scratch);
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// 64-bit draw sort key, most significant bits first:
+//   opaque:      pass:4 | blend:2 | shader:10 | texture:16 | depth:32 (front-to-back)
+//   transparent: pass:4 | blend:2 | depth:32 (back-to-front) | shader:10 | texture:16
+// Sorting keys ascending groups draws by pass and state, and orders them by
+// depth in the direction each blend mode needs.
+namespace DrawKey
+{
+    enum BlendMode : uint32_t
+    {
+        BlendOpaque = 0,
+        BlendTransparent = 1,
+    };
+
+    const uint32_t PassBits = 4;
+    const uint32_t BlendBits = 2;
+    const uint32_t ShaderBits = 10;
+    const uint32_t TextureBits = 16;
+    const uint32_t DepthBits = 32;
+
+    uint64_t MakeOpaque(uint32_t pass, uint32_t shader, uint32_t texture, float depth);
+    uint64_t MakeTransparent(uint32_t pass, uint32_t shader, uint32_t texture, float depth);
+
+    uint32_t GetPass(uint64_t key);
+    uint32_t GetBlend(uint64_t key);
+    uint32_t GetShader(uint64_t key);
+    uint32_t GetTexture(uint64_t key);
+
+    // Order preserving float to uint mapping, negatives clamp to zero
+    uint32_t DepthToBits(float depth);
+}
+
+struct DrawPacket
+{
+    uint64_t key;
+    uint32_t drawIdx; // index into the submitter's draw data
+};
+
+class DrawQueue
+{
+public:
+    void Clear() { m_packets.clear(); }
+    void Reserve(size_t count);
+    void Submit(uint64_t key, uint32_t drawIdx) { m_packets.push_back({ key, drawIdx }); }
+    // Stable LSD radix sort on the key, byte passes that are constant for all keys are skipped
+    void Sort();
+
+    size_t GetSize() const { return m_packets.size(); }
+    const DrawPacket& operator[](size_t idx) const { return m_packets[idx]; }
+    const std::vector<DrawPacket>& GetPackets() const { return m_packets; }
+private:
+    std::vector<DrawPacket> m_packets;
+    std::vector<DrawPacket> m_scratch;
+};
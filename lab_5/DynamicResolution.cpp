@@ -0,0 +1,63 @@
+#include "DynamicResolution.h"
+
+#include <cmath>
+
+namespace
+{
+    double Clamp(double value, double low, double high)
+    {
+        return value < low ? low : (value > high ? high : value);
+    }
+
+    uint32_t ScaleSize(uint32_t size, double scale)
+    {
+        const double scaled = floor(double(size) * scale + 0.5);
+        return scaled < 1.0 ? 1 : (scaled > double(size) ? size : uint32_t(scaled));
+    }
+}
+
+DynamicResolution::DynamicResolution(const DynamicResolutionSettings& settings)
+    : m_settings(settings)
+{
+    Reset();
+}
+
+void DynamicResolution::Reset()
+{
+    m_scale = m_settings.maxScale;
+    m_logArea = 2.0 * log(m_settings.maxScale);
+    m_lastError = 0.0;
+    m_lastDelta = 0.0;
+    m_history = 0;
+}
+
+double DynamicResolution::Update(double frameTime)
+{
+    const double budget = m_settings.targetFrameTime * (1.0 - m_settings.headroom);
+    if (frameTime <= 0.0 || budget <= 0.0)
+        return m_scale;
+
+    // Positive with time to spare; the differences need the previous errors,
+    // the first updates go without them instead of kicking on a made up history
+    const double error = log(budget / frameTime);
+    const double delta = m_history > 0 ? error - m_lastError : 0.0;
+    const double curvature = m_history > 1 ? delta - m_lastDelta : 0.0;
+    double step = m_settings.kp * delta + m_settings.ki * error + m_settings.kd * curvature;
+    step = Clamp(step, -m_settings.maxStep, m_settings.maxStep);
+
+    m_logArea = Clamp(m_logArea + step, 2.0 * log(m_settings.minScale), 2.0 * log(m_settings.maxScale));
+    m_scale = exp(0.5 * m_logArea);
+    m_lastError = error;
+    m_lastDelta = delta;
+    if (m_history < 2)
+    {
+        m_history++;
+    }
+    return m_scale;
+}
+
+void DynamicResolution::GetRenderSize(uint32_t width, uint32_t height, uint32_t& renderWidth, uint32_t& renderHeight) const
+{
+    renderWidth = ScaleSize(width, m_scale);
+    renderHeight = ScaleSize(height, m_scale);
+}
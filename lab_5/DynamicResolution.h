@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+
+struct DynamicResolutionSettings
+{
+    double targetFrameTime = 1.0 / 60.0; // seconds
+    // Share of the target kept free, so noise around the set point stays under the target
+    double headroom = 0.1;
+    // Range of the linear scale of the render target
+    double minScale = 0.5;
+    double maxScale = 1.0;
+    // Gains on the error in log space, see DynamicResolution
+    double kp = 0.1;
+    double ki = 0.15;
+    double kd = 0.05;
+    // Largest change of log area per update, one hitch can't throw the resolution away
+    double maxStep = 0.15;
+};
+
+// Picks the render resolution for the next frame from the measured frame
+// time. GPU time grows with the pixel count, so the PID controller works on the
+// log of the area against the log of budget / time: a frame twice over budget
+// asks for half the pixels whatever the current scale. The velocity form
+// integrates the output itself, clamping it to the scale range leaves no
+// wound up state behind when the load drops again.
+class DynamicResolution
+{
+public:
+    explicit DynamicResolution(const DynamicResolutionSettings& settings = DynamicResolutionSettings());
+
+    void SetTargetFrameTime(double seconds) { m_settings.targetFrameTime = seconds; }
+    const DynamicResolutionSettings& GetSettings() const { return m_settings; }
+    // Back to the largest scale with no history
+    void Reset();
+
+    // Frame time measured at the scale returned before, returns the scale for the next frame
+    double Update(double frameTime);
+    double GetScale() const { return m_scale; }
+    // Width and height at the current scale, at least one pixel
+    void GetRenderSize(uint32_t width, uint32_t height, uint32_t& renderWidth, uint32_t& renderHeight) const;
+private:
+    DynamicResolutionSettings m_settings;
+    double m_logArea = 0.0;
+    double m_scale = 1.0;
+    // Errors of the two previous updates for the proportional and derivative differences
+    double m_lastError = 0.0;
+    double m_lastDelta = 0.0;
+    uint32_t m_history = 0;
+};
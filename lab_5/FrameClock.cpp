@@ -0,0 +1,97 @@
+#include "FrameClock.h"
+
+#include <cassert>
+#include <cmath>
+
+FrameClock::FrameClock(double fixedStep, double maxFrameTime, uint32_t maxSteps)
+    : m_fixedStep(fixedStep)
+    , m_maxFrameTime(maxFrameTime)
+    , m_maxSteps(maxSteps)
+{
+    assert(fixedStep > 0.0);
+    Reset();
+}
+
+void FrameClock::Reset()
+{
+    m_started = false;
+    m_delta = 0.0;
+    m_accumulator = 0.0;
+    m_simulationTime = 0.0;
+    m_frameIndex = 0;
+    m_historyCount = 0;
+    m_historyNext = 0;
+}
+
+uint32_t FrameClock::Tick()
+{
+    return Tick(Clock::now());
+}
+
+uint32_t FrameClock::Tick(Clock::time_point now)
+{
+    // The first frame only sets the time origin
+    if (!m_started)
+    {
+        m_started = true;
+        m_lastTime = now;
+        return 0;
+    }
+
+    double delta = std::chrono::duration<double>(now - m_lastTime).count();
+    m_lastTime = now;
+    if (delta > m_maxFrameTime)
+        delta = m_maxFrameTime;
+    if (delta < 0.0)
+        delta = 0.0;
+    m_delta = delta;
+    m_frameIndex++;
+
+    m_history[m_historyNext] = delta;
+    m_historyNext = (m_historyNext + 1) % HistorySize;
+    if (m_historyCount < HistorySize)
+        m_historyCount++;
+
+    m_accumulator += delta;
+    uint32_t steps = 0;
+    while (m_accumulator >= m_fixedStep && steps < m_maxSteps)
+    {
+        m_accumulator -= m_fixedStep;
+        m_simulationTime += m_fixedStep;
+        steps++;
+    }
+    // Behind by more than maxSteps: drop the backlog instead of catching up
+    if (m_accumulator >= m_fixedStep)
+        m_accumulator = fmod(m_accumulator, m_fixedStep);
+    return steps;
+}
+
+FrameTimeStats FrameClock::GetStats() const
+{
+    FrameTimeStats stats;
+    if (m_historyCount == 0)
+        return stats;
+
+    double sum = 0.0;
+    stats.minimum = m_history[0];
+    stats.maximum = m_history[0];
+    for (size_t i = 0; i < m_historyCount; i++)
+    {
+        sum += m_history[i];
+        if (m_history[i] < stats.minimum)
+            stats.minimum = m_history[i];
+        if (m_history[i] > stats.maximum)
+            stats.maximum = m_history[i];
+    }
+    stats.frameCount = uint32_t(m_historyCount);
+    stats.average = sum / m_historyCount;
+
+    double variance = 0.0;
+    for (size_t i = 0; i < m_historyCount; i++)
+    {
+        double diff = m_history[i] - stats.average;
+        variance += diff * diff;
+    }
+    stats.deviation = sqrt(variance / m_historyCount);
+    return stats;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+struct FrameTimeStats
+{
+    double average = 0.0; // seconds
+    double minimum = 0.0;
+    double maximum = 0.0;
+    double deviation = 0.0;
+    uint32_t frameCount = 0;
+};
+
+// Frame clock for a fixed timestep simulation. Tick measures the real time since
+// the previous frame and turns it into a number of fixed steps to simulate; the
+// time left over is returned as the interpolation factor between the last two
+// simulated states. Frame deltas are kept for statistics over the last frames.
+class FrameClock
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    static const size_t HistorySize = 128;
+
+    // Frames longer than maxFrameTime (a breakpoint, a window drag) are clamped, and at
+    // most maxSteps steps run per frame so a slow simulation can't spiral
+    explicit FrameClock(double fixedStep = 1.0 / 60.0, double maxFrameTime = 0.25, uint32_t maxSteps = 8);
+
+    void Reset();
+    uint32_t Tick();
+    uint32_t Tick(Clock::time_point now);
+
+    double GetFixedStep() const { return m_fixedStep; }
+    // Real time of the last frame in seconds, after clamping
+    double GetDelta() const { return m_delta; }
+    // Simulated time not yet consumed, as a fraction of a step in [0, 1)
+    double GetAlpha() const { return m_accumulator / m_fixedStep; }
+    double GetSimulationTime() const { return m_simulationTime; }
+    uint64_t GetFrameIndex() const { return m_frameIndex; }
+
+    FrameTimeStats GetStats() const;
+private:
+    double m_fixedStep;
+    double m_maxFrameTime;
+    uint32_t m_maxSteps;
+
+    bool m_started = false;
+    Clock::time_point m_lastTime;
+    double m_delta = 0.0;
+    double m_accumulator = 0.0;
+    double m_simulationTime = 0.0;
+    uint64_t m_frameIndex = 0;
+
+    double m_history[HistorySize];
+    size_t m_historyCount = 0;
+    size_t m_historyNext = 0;
+};
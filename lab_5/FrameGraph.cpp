@@ -0,0 +1,307 @@
+#include "FrameGraph.h"
+
+#include <algorithm>
+#include <cassert>
+#include <functional>
+#include <queue>
+
+void* FrameGraphNullBackend::CreateTransient(const FrameGraphTextureDesc& desc)
+{
+    m_aliveCount++;
+    m_createdCount++;
+    return new FrameGraphTextureDesc(desc);
+}
+
+void FrameGraphNullBackend::DestroyTransient(void* pResource)
+{
+    assert(m_aliveCount > 0);
+    m_aliveCount--;
+    delete static_cast<FrameGraphTextureDesc*>(pResource);
+}
+
+FrameGraphResource FrameGraphBuilder::Create(const std::string& name, const FrameGraphTextureDesc& desc)
+{
+    FrameGraph::Resource resource;
+    resource.name = name;
+    resource.desc = desc;
+    m_graph.m_resources.push_back(resource);
+    return FrameGraphResource(m_graph.m_resources.size() - 1);
+}
+
+FrameGraphResource FrameGraphBuilder::Read(FrameGraphResource resource)
+{
+    assert(resource >= 0 && resource < (int)m_graph.m_resources.size());
+    m_graph.m_passes[m_passIdx].reads.push_back(resource);
+    return resource;
+}
+
+FrameGraphResource FrameGraphBuilder::Write(FrameGraphResource resource)
+{
+    assert(resource >= 0 && resource < (int)m_graph.m_resources.size());
+    m_graph.m_passes[m_passIdx].writes.push_back(resource);
+    return resource;
+}
+
+void FrameGraphBuilder::SideEffect()
+{
+    m_graph.m_passes[m_passIdx].sideEffect = true;
+}
+
+FrameGraphResource FrameGraph::Import(const std::string& name, void* pResource)
+{
+    Resource resource;
+    resource.name = name;
+    resource.imported = true;
+    resource.pImported = pResource;
+    m_resources.push_back(resource);
+    m_compiled = false;
+    return FrameGraphResource(m_resources.size() - 1);
+}
+
+void FrameGraph::AddPass(const std::string& name, const SetupFunc& setup, const ExecuteFunc& execute)
+{
+    Pass pass;
+    pass.name = name;
+    pass.execute = execute;
+    m_passes.push_back(pass);
+    m_compiled = false;
+
+    FrameGraphBuilder builder(*this, int(m_passes.size() - 1));
+    setup(builder);
+}
+
+bool FrameGraph::Compile()
+{
+    const int passCount = int(m_passes.size());
+    const int resourceCount = int(m_resources.size());
+
+    // Cull passes whose outputs are never consumed
+    for (Resource& resource : m_resources)
+    {
+        resource.refCount = 0;
+        resource.firstUse = resource.lastUse = -1;
+        resource.physical = -1;
+    }
+    for (Pass& pass : m_passes)
+    {
+        pass.culled = false;
+        pass.refCount = int(pass.writes.size());
+        for (FrameGraphResource res : pass.reads)
+            m_resources[res].refCount++;
+    }
+
+    std::vector<FrameGraphResource> unreferenced;
+    for (int i = 0; i < resourceCount; i++)
+    {
+        if (m_resources[i].refCount == 0 && !m_resources[i].imported)
+            unreferenced.push_back(i);
+    }
+    while (!unreferenced.empty())
+    {
+        FrameGraphResource res = unreferenced.back();
+        unreferenced.pop_back();
+        for (Pass& pass : m_passes)
+        {
+            if (pass.culled || std::find(pass.writes.begin(), pass.writes.end(), res) == pass.writes.end())
+                continue;
+            if (--pass.refCount == 0 && !pass.sideEffect)
+            {
+                pass.culled = true;
+                for (FrameGraphResource read : pass.reads)
+                {
+                    if (--m_resources[read].refCount == 0 && !m_resources[read].imported)
+                        unreferenced.push_back(read);
+                }
+            }
+        }
+    }
+
+    // Dependency edges follow declaration order: read-after-write,
+    // write-after-write and write-after-read on every resource
+    std::vector<std::vector<int>> edges(passCount);
+    std::vector<int> inDegree(passCount, 0);
+    std::vector<int> lastWriter(resourceCount, -1);
+    std::vector<std::vector<int>> readersSinceWrite(resourceCount);
+    auto addEdge = [&](int from, int to) {
+        if (from < 0 || from == to)
+            return;
+        edges[from].push_back(to);
+        inDegree[to]++;
+    };
+    for (int p = 0; p < passCount; p++)
+    {
+        const Pass& pass = m_passes[p];
+        if (pass.culled)
+            continue;
+        for (FrameGraphResource res : pass.reads)
+        {
+            if (lastWriter[res] < 0 && !m_resources[res].imported)
+                return false; // transient is read before anything wrote it
+            addEdge(lastWriter[res], p);
+            readersSinceWrite[res].push_back(p);
+        }
+        for (FrameGraphResource res : pass.writes)
+        {
+            addEdge(lastWriter[res], p);
+            for (int reader : readersSinceWrite[res])
+                addEdge(reader, p);
+            readersSinceWrite[res].clear();
+            lastWriter[res] = p;
+        }
+    }
+
+    // Kahn's sort, ties broken by declaration order so the result is stable
+    m_order.clear();
+    std::priority_queue<int, std::vector<int>, std::greater<int>> ready;
+    for (int p = 0; p < passCount; p++)
+    {
+        if (!m_passes[p].culled && inDegree[p] == 0)
+            ready.push(p);
+    }
+    while (!ready.empty())
+    {
+        int p = ready.top();
+        ready.pop();
+        m_order.push_back(p);
+        for (int next : edges[p])
+        {
+            if (--inDegree[next] == 0)
+                ready.push(next);
+        }
+    }
+
+    for (int pos = 0; pos < int(m_order.size()); pos++)
+    {
+        const Pass& pass = m_passes[m_order[pos]];
+        auto use = [&](FrameGraphResource res) {
+            Resource& resource = m_resources[res];
+            if (resource.firstUse < 0)
+                resource.firstUse = pos;
+            resource.lastUse = pos;
+        };
+        for (FrameGraphResource res : pass.reads)
+            use(res);
+        for (FrameGraphResource res : pass.writes)
+            use(res);
+    }
+
+    m_compiled = true;
+    return true;
+}
+
+int FrameGraph::AcquirePhysical(IFrameGraphBackend& backend, const FrameGraphTextureDesc& desc)
+{
+    for (int i = 0; i < int(m_pool.size()); i++)
+    {
+        if (!m_pool[i].inUse && m_pool[i].desc == desc)
+        {
+            m_pool[i].inUse = true;
+            m_pool[i].usedThisFrame = true;
+            return i;
+        }
+    }
+
+    Physical physical;
+    physical.desc = desc;
+    physical.pResource = backend.CreateTransient(desc);
+    physical.inUse = true;
+    physical.usedThisFrame = true;
+    m_pool.push_back(physical);
+    return int(m_pool.size() - 1);
+}
+
+void FrameGraph::BeginExecute(IFrameGraphBackend& backend)
+{
+    assert(m_compiled);
+    m_pBackend = &backend;
+    for (Physical& physical : m_pool)
+    {
+        physical.inUse = false;
+        physical.usedThisFrame = false;
+    }
+
+    // Walk the schedule, transients whose lifetimes don't overlap share memory
+    for (int pos = 0; pos < int(m_order.size()); pos++)
+    {
+        for (Resource& resource : m_resources)
+        {
+            if (!resource.imported && resource.firstUse == pos)
+                resource.physical = AcquirePhysical(backend, resource.desc);
+        }
+        for (Resource& resource : m_resources)
+        {
+            if (!resource.imported && resource.lastUse == pos)
+                m_pool[resource.physical].inUse = false;
+        }
+    }
+}
+
+void FrameGraph::ExecutePass(int passIdx, void* pContext) const
+{
+    const Pass& pass = m_passes[passIdx];
+    if (pass.execute)
+        pass.execute(*this, pContext);
+}
+
+void FrameGraph::EndExecute()
+{
+    // Physical resources nobody asked for this frame go back to the backend
+    std::vector<Physical> pool;
+    for (Physical& physical : m_pool)
+    {
+        if (physical.usedThisFrame)
+            pool.push_back(physical);
+        else
+            m_pBackend->DestroyTransient(physical.pResource);
+    }
+    m_pool.swap(pool);
+    for (Resource& resource : m_resources)
+    {
+        resource.physical = -1;
+    }
+}
+
+void FrameGraph::Execute(IFrameGraphBackend& backend, void* pContext)
+{
+    BeginExecute(backend);
+    for (int passIdx : m_order)
+    {
+        ExecutePass(passIdx, pContext);
+    }
+    EndExecute();
+}
+
+void* FrameGraph::GetResource(FrameGraphResource resource) const
+{
+    const Resource& res = m_resources[resource];
+    if (res.imported)
+        return res.pImported;
+    return res.physical >= 0 ? m_pool[res.physical].pResource : nullptr;
+}
+
+FrameGraphResource FrameGraph::FindResource(const std::string& name) const
+{
+    for (int i = 0; i < int(m_resources.size()); i++)
+    {
+        if (m_resources[i].name == name)
+            return i;
+    }
+    return InvalidFrameGraphResource;
+}
+
+void FrameGraph::Reset()
+{
+    m_passes.clear();
+    m_resources.clear();
+    m_order.clear();
+    m_compiled = false;
+}
+
+void FrameGraph::ReleasePool(IFrameGraphBackend& backend)
+{
+    for (Physical& physical : m_pool)
+    {
+        backend.DestroyTransient(physical.pResource);
+    }
+    m_pool.clear();
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Frame graph: passes declare which named resources they read and write,
+// the graph culls passes that don't contribute to an imported resource,
+// orders the rest and maps transient textures onto a pool of physical ones.
+// The compiler knows nothing about D3D11, physical resources come from IFrameGraphBackend.
+
+typedef int FrameGraphResource;
+const FrameGraphResource InvalidFrameGraphResource = -1;
+
+struct FrameGraphTextureDesc
+{
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t format = 0;    // backend format, DXGI_FORMAT for D3D11
+    uint32_t bindFlags = 0; // backend bind flags, D3D11_BIND_FLAG for D3D11
+
+    bool operator==(const FrameGraphTextureDesc& other) const
+    {
+        return width == other.width && height == other.height && format == other.format && bindFlags == other.bindFlags;
+    }
+};
+
+class IFrameGraphBackend
+{
+public:
+    virtual ~IFrameGraphBackend() {}
+    virtual void* CreateTransient(const FrameGraphTextureDesc& desc) = 0;
+    virtual void DestroyTransient(void* pResource) = 0;
+};
+
+// Backend without a device, hands out dummy resources and counts them
+class FrameGraphNullBackend : public IFrameGraphBackend
+{
+public:
+    void* CreateTransient(const FrameGraphTextureDesc& desc) override;
+    void DestroyTransient(void* pResource) override;
+
+    int GetAliveCount() const { return m_aliveCount; }
+    int GetCreatedCount() const { return m_createdCount; }
+private:
+    int m_aliveCount = 0;
+    int m_createdCount = 0;
+};
+
+class FrameGraph;
+
+class FrameGraphBuilder
+{
+public:
+    FrameGraphResource Create(const std::string& name, const FrameGraphTextureDesc& desc);
+    FrameGraphResource Read(FrameGraphResource resource);
+    FrameGraphResource Write(FrameGraphResource resource);
+    // Pass is kept even if nothing reads its outputs
+    void SideEffect();
+private:
+    friend class FrameGraph;
+    FrameGraphBuilder(FrameGraph& graph, int passIdx) : m_graph(graph), m_passIdx(passIdx) {}
+
+    FrameGraph& m_graph;
+    int m_passIdx;
+};
+
+class FrameGraph
+{
+public:
+    typedef std::function<void(FrameGraphBuilder&)> SetupFunc;
+    typedef std::function<void(const FrameGraph&, void* pContext)> ExecuteFunc;
+
+    // Imported resources live outside the graph and are treated as its outputs
+    FrameGraphResource Import(const std::string& name, void* pResource);
+    void AddPass(const std::string& name, const SetupFunc& setup, const ExecuteFunc& execute);
+
+    bool Compile();
+    void Execute(IFrameGraphBackend& backend, void* pContext);
+    // Binds every transient to a physical resource up front, so passes
+    // may be recorded in any order or in parallel between Begin/EndExecute
+    void BeginExecute(IFrameGraphBackend& backend);
+    void ExecutePass(int passIdx, void* pContext) const;
+    void EndExecute();
+
+    void* GetResource(FrameGraphResource resource) const;
+    FrameGraphResource FindResource(const std::string& name) const;
+    const std::string& GetPassName(int passIdx) const { return m_passes[passIdx].name; }
+    const std::vector<int>& GetPassOrder() const { return m_order; }
+    bool IsPassCulled(int passIdx) const { return m_passes[passIdx].culled; }
+    size_t GetPhysicalCount() const { return m_pool.size(); }
+
+    // Drops passes and resources, keeps physical pool for the next frame
+    void Reset();
+    // Destroys the physical pool
+    void ReleasePool(IFrameGraphBackend& backend);
+private:
+    friend class FrameGraphBuilder;
+
+    struct Resource
+    {
+        std::string name;
+        FrameGraphTextureDesc desc;
+        bool imported = false;
+        void* pImported = nullptr;
+        int physical = -1;
+        int firstUse = -1;
+        int lastUse = -1;
+        int refCount = 0;
+    };
+
+    struct Pass
+    {
+        std::string name;
+        ExecuteFunc execute;
+        std::vector<FrameGraphResource> reads;
+        std::vector<FrameGraphResource> writes;
+        bool sideEffect = false;
+        bool culled = false;
+        int refCount = 0;
+    };
+
+    struct Physical
+    {
+        FrameGraphTextureDesc desc;
+        void* pResource = nullptr;
+        bool inUse = false;
+        bool usedThisFrame = false;
+    };
+
+    int AcquirePhysical(IFrameGraphBackend& backend, const FrameGraphTextureDesc& desc);
+
+    std::vector<Resource> m_resources;
+    std::vector<Pass> m_passes;
+    std::vector<int> m_order;
+    std::vector<Physical> m_pool;
+    IFrameGraphBackend* m_pBackend = nullptr;
+    bool m_compiled = false;
+};
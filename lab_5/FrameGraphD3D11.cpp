@@ -0,0 +1,55 @@
+#include "FrameGraphD3D11.h"
+
+#include <cassert>
+
+#define SafeRelease(A) if ((A) != NULL) { (A)->Release(); (A) = NULL; }
+
+void* FrameGraphD3D11Backend::CreateTransient(const FrameGraphTextureDesc& frameGraphDesc)
+{
+    assert(m_pDevice != nullptr);
+    FrameGraphD3D11Texture* pTexture = new FrameGraphD3D11Texture();
+
+    D3D11_TEXTURE2D_DESC desc = {};
+    desc.Format = DXGI_FORMAT(frameGraphDesc.format);
+    desc.ArraySize = 1;
+    desc.MipLevels = 1;
+    desc.Usage = D3D11_USAGE_DEFAULT;
+    desc.BindFlags = frameGraphDesc.bindFlags;
+    desc.CPUAccessFlags = 0;
+    desc.MiscFlags = 0;
+    desc.SampleDesc.Count = 1;
+    desc.SampleDesc.Quality = 0;
+    desc.Width = frameGraphDesc.width;
+    desc.Height = frameGraphDesc.height;
+    HRESULT result = m_pDevice->CreateTexture2D(&desc, nullptr, &pTexture->pTexture);
+    assert(SUCCEEDED(result));
+
+    if (SUCCEEDED(result) && (desc.BindFlags & D3D11_BIND_RENDER_TARGET))
+    {
+        result = m_pDevice->CreateRenderTargetView(pTexture->pTexture, nullptr, &pTexture->pRTV);
+        assert(SUCCEEDED(result));
+    }
+    if (SUCCEEDED(result) && (desc.BindFlags & D3D11_BIND_SHADER_RESOURCE))
+    {
+        result = m_pDevice->CreateShaderResourceView(pTexture->pTexture, nullptr, &pTexture->pSRV);
+        assert(SUCCEEDED(result));
+    }
+    if (SUCCEEDED(result) && (desc.BindFlags & D3D11_BIND_DEPTH_STENCIL))
+    {
+        result = m_pDevice->CreateDepthStencilView(pTexture->pTexture, nullptr, &pTexture->pDSV);
+        assert(SUCCEEDED(result));
+    }
+    return pTexture;
+}
+
+void FrameGraphD3D11Backend::DestroyTransient(void* pResource)
+{
+    FrameGraphD3D11Texture* pTexture = static_cast<FrameGraphD3D11Texture*>(pResource);
+    if (pTexture == nullptr)
+        return;
+    SafeRelease(pTexture->pDSV);
+    SafeRelease(pTexture->pSRV);
+    SafeRelease(pTexture->pRTV);
+    SafeRelease(pTexture->pTexture);
+    delete pTexture;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <d3d11.h>
+
+#include "FrameGraph.h"
+
+// Physical frame graph texture, views are created according to the bind flags
+struct FrameGraphD3D11Texture
+{
+    ID3D11Texture2D* pTexture = nullptr;
+    ID3D11RenderTargetView* pRTV = nullptr;
+    ID3D11ShaderResourceView* pSRV = nullptr;
+    ID3D11DepthStencilView* pDSV = nullptr;
+};
+
+class FrameGraphD3D11Backend : public IFrameGraphBackend
+{
+public:
+    void SetDevice(ID3D11Device* pDevice) { m_pDevice = pDevice; }
+
+    void* CreateTransient(const FrameGraphTextureDesc& desc) override;
+    void DestroyTransient(void* pResource) override;
+private:
+    ID3D11Device* m_pDevice = nullptr;
+};
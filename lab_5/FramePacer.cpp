@@ -0,0 +1,117 @@
+#include "FramePacer.h"
+
+#include <cmath>
+#include <thread>
+
+void FramePacer::SetTargetFps(double fps)
+{
+    m_targetFps = fps > 0.0 ? fps : 0.0;
+    m_interval = m_targetFps > 0.0
+        ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / m_targetFps))
+        : Clock::duration::zero();
+    m_scheduled = false;
+}
+
+void FramePacer::SleepFor(double seconds)
+{
+    // Sleep in 1 ms slices while the remaining time stays above the usual
+    // overshoot plus one deviation; each slice refines the estimate
+    Clock::time_point start = Clock::now();
+    Clock::time_point end = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+    for (;;)
+    {
+        Clock::time_point now = Clock::now();
+        double remaining = std::chrono::duration<double>(end - now).count();
+        double margin = m_sleepMean + sqrt(m_sleepM2 / m_sleepCount);
+        if (remaining <= margin)
+            break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        double observed = std::chrono::duration<double>(Clock::now() - now).count();
+        m_sleepTime += observed;
+
+        m_sleepCount++;
+        double delta = observed - m_sleepMean;
+        m_sleepMean += delta / m_sleepCount;
+        m_sleepM2 += delta * (observed - m_sleepMean);
+        // Keep adapting: old samples fade out once the window is full
+        if (m_sleepCount > 1000)
+        {
+            m_sleepM2 *= 1000.0 / m_sleepCount;
+            m_sleepCount = 1000;
+        }
+    }
+
+    Clock::time_point spinStart = Clock::now();
+    while (Clock::now() < end)
+    {
+        std::this_thread::yield();
+    }
+    m_spinTime += std::chrono::duration<double>(Clock::now() - spinStart).count();
+}
+
+void FramePacer::WaitForNextFrame()
+{
+    Clock::time_point now = Clock::now();
+    if (m_targetFps <= 0.0)
+    {
+        RecordFrameStart(now, now);
+        return;
+    }
+
+    if (!m_scheduled)
+    {
+        m_deadline = now;
+        m_scheduled = true;
+    }
+    m_deadline += m_interval;
+    // More than a whole frame behind: start over from now rather than rushing frames out
+    if (now > m_deadline + m_interval)
+        m_deadline = now;
+
+    if (now < m_deadline)
+        SleepFor(std::chrono::duration<double>(m_deadline - now).count());
+    RecordFrameStart(Clock::now(), m_deadline);
+}
+
+void FramePacer::RecordFrameStart(Clock::time_point now, Clock::time_point deadline)
+{
+    if (m_hasLastFrame)
+    {
+        double interval = std::chrono::duration<double>(now - m_lastFrameStart).count();
+        m_intervalSum += interval;
+        m_intervalSquareSum += interval * interval;
+        m_frameCount++;
+    }
+    double lateness = std::chrono::duration<double>(now - deadline).count();
+    if (lateness > m_maxLateness)
+        m_maxLateness = lateness;
+    m_lastFrameStart = now;
+    m_hasLastFrame = true;
+}
+
+FramePacingStats FramePacer::GetStats() const
+{
+    FramePacingStats stats;
+    stats.frameCount = m_frameCount;
+    stats.sleepTime = m_sleepTime;
+    stats.spinTime = m_spinTime;
+    stats.maxLateness = m_maxLateness;
+    if (m_frameCount > 0)
+    {
+        stats.averageInterval = m_intervalSum / m_frameCount;
+        double variance = m_intervalSquareSum / m_frameCount - stats.averageInterval * stats.averageInterval;
+        stats.jitter = variance > 0.0 ? sqrt(variance) : 0.0;
+    }
+    return stats;
+}
+
+void FramePacer::ResetStats()
+{
+    m_hasLastFrame = false;
+    m_intervalSum = 0.0;
+    m_intervalSquareSum = 0.0;
+    m_maxLateness = 0.0;
+    m_sleepTime = 0.0;
+    m_spinTime = 0.0;
+    m_frameCount = 0;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+struct FramePacingStats
+{
+    double averageInterval = 0.0; // seconds between frame starts
+    double jitter = 0.0;          // standard deviation of the interval
+    double maxLateness = 0.0;     // worst frame start past its deadline
+    double sleepTime = 0.0;       // total time given back to the OS
+    double spinTime = 0.0;        // total time busy waiting
+    uint32_t frameCount = 0;
+};
+
+// Frame rate limiter. Frames are scheduled on fixed deadlines; the wait sleeps
+// while the remaining time is safely above the measured sleep overshoot and
+// spins for the rest, which keeps the CPU idle for most of the frame without
+// the jitter of relying on sleep alone. Frames that fall more than a whole
+// interval behind reschedule from the current time instead of bursting.
+class FramePacer
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    // 0 disables limiting, WaitForNextFrame then only records statistics
+    void SetTargetFps(double fps);
+    double GetTargetFps() const { return m_targetFps; }
+
+    void WaitForNextFrame();
+
+    FramePacingStats GetStats() const;
+    void ResetStats();
+private:
+    void SleepFor(double seconds);
+    void RecordFrameStart(Clock::time_point now, Clock::time_point deadline);
+
+    double m_targetFps = 0.0;
+    Clock::duration m_interval = Clock::duration::zero();
+    Clock::time_point m_deadline;
+    bool m_scheduled = false;
+
+    // Running estimate of how long a 1 ms sleep really takes (Welford mean and variance)
+    double m_sleepMean = 2e-3;
+    double m_sleepM2 = 0.0;
+    uint64_t m_sleepCount = 1;
+
+    Clock::time_point m_lastFrameStart;
+    bool m_hasLastFrame = false;
+    double m_intervalSum = 0.0;
+    double m_intervalSquareSum = 0.0;
+    double m_maxLateness = 0.0;
+    double m_sleepTime = 0.0;
+    double m_spinTime = 0.0;
+    uint32_t m_frameCount = 0;
+};
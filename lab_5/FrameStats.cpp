@@ -0,0 +1,186 @@
+#include "FrameStats.h"
+
+#include <cmath>
+#include <cstdio>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace
+{
+    uint32_t HighestBit(uint64_t value)
+    {
+#ifdef _MSC_VER
+        unsigned long idx;
+        _BitScanReverse64(&idx, value);
+        return uint32_t(idx);
+#else
+        return uint32_t(63 - __builtin_clzll(value));
+#endif
+    }
+}
+
+AtomicHistogram::AtomicHistogram()
+{
+    Reset();
+}
+
+uint32_t AtomicHistogram::GetBucket(uint64_t value)
+{
+    if (value < SubBucketCount)
+        return uint32_t(value);
+    uint32_t shift = HighestBit(value) - SubBucketBits;
+    if (shift > MaxValueBits - SubBucketBits - 1)
+        return BucketCount - 1;
+    return (shift + 1) * SubBucketCount + uint32_t(value >> shift) - SubBucketCount;
+}
+
+uint64_t AtomicHistogram::GetBucketLow(uint32_t bucket)
+{
+    if (bucket < SubBucketCount)
+        return bucket;
+    uint32_t shift = bucket / SubBucketCount - 1;
+    return uint64_t(bucket % SubBucketCount + SubBucketCount) << shift;
+}
+
+uint64_t AtomicHistogram::GetBucketWidth(uint32_t bucket)
+{
+    return bucket < SubBucketCount ? 1 : uint64_t(1) << (bucket / SubBucketCount - 1);
+}
+
+void AtomicHistogram::Add(uint64_t value)
+{
+    m_buckets[GetBucket(value)].fetch_add(1, std::memory_order_relaxed);
+    m_sum.fetch_add(value, std::memory_order_relaxed);
+
+    uint64_t current = m_min.load(std::memory_order_relaxed);
+    while (value < current && !m_min.compare_exchange_weak(current, value, std::memory_order_relaxed))
+    {
+    }
+    current = m_max.load(std::memory_order_relaxed);
+    while (value > current && !m_max.compare_exchange_weak(current, value, std::memory_order_relaxed))
+    {
+    }
+    // Counted last, a reader that sees the count also finds the value in a bucket
+    m_count.fetch_add(1, std::memory_order_release);
+}
+
+void AtomicHistogram::Reset()
+{
+    for (std::atomic<uint64_t>& bucket : m_buckets)
+    {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    m_count.store(0, std::memory_order_relaxed);
+    m_sum.store(0, std::memory_order_relaxed);
+    m_min.store(UINT64_MAX, std::memory_order_relaxed);
+    m_max.store(0, std::memory_order_relaxed);
+}
+
+uint64_t AtomicHistogram::GetMin() const
+{
+    uint64_t minimum = m_min.load(std::memory_order_relaxed);
+    return minimum == UINT64_MAX ? 0 : minimum;
+}
+
+double AtomicHistogram::GetMean() const
+{
+    uint64_t count = GetCount();
+    return count > 0 ? double(m_sum.load(std::memory_order_relaxed)) / double(count) : 0.0;
+}
+
+uint64_t AtomicHistogram::GetPercentile(double p) const
+{
+    uint64_t count = m_count.load(std::memory_order_acquire);
+    if (count == 0)
+        return 0;
+    uint64_t rank = uint64_t(ceil(p * double(count)));
+    if (rank < 1)
+        rank = 1;
+
+    uint64_t seen = 0;
+    uint32_t bucket = 0;
+    for (; bucket < BucketCount - 1; bucket++)
+    {
+        seen += m_buckets[bucket].load(std::memory_order_relaxed);
+        if (seen >= rank)
+            break;
+    }
+    uint64_t value = GetBucketLow(bucket) + GetBucketWidth(bucket) / 2;
+    uint64_t minimum = GetMin();
+    uint64_t maximum = GetMax();
+    return value < minimum ? minimum : (value > maximum ? maximum : value);
+}
+
+void FrameStats::Record(const FrameSample& sample)
+{
+    double micros = sample.cpuTime * 1e6;
+    m_histograms[MetricCpuTime].Add(micros > 0.0 ? uint64_t(micros + 0.5) : 0);
+    m_histograms[MetricDrawCalls].Add(sample.drawCalls);
+    m_histograms[MetricStateChanges].Add(sample.stateChanges);
+    m_histograms[MetricBytesUploaded].Add(sample.bytesUploaded);
+}
+
+void FrameStats::Reset()
+{
+    for (AtomicHistogram& histogram : m_histograms)
+    {
+        histogram.Reset();
+    }
+}
+
+FrameStatsSummary FrameStats::GetSummary(Metric metric) const
+{
+    const AtomicHistogram& histogram = m_histograms[metric];
+    const double scale = metric == MetricCpuTime ? 1e-3 : 1.0;
+    FrameStatsSummary summary;
+    summary.count = histogram.GetCount();
+    summary.minimum = double(histogram.GetMin()) * scale;
+    summary.mean = histogram.GetMean() * scale;
+    summary.p50 = double(histogram.GetPercentile(0.50)) * scale;
+    summary.p95 = double(histogram.GetPercentile(0.95)) * scale;
+    summary.p99 = double(histogram.GetPercentile(0.99)) * scale;
+    summary.maximum = double(histogram.GetMax()) * scale;
+    return summary;
+}
+
+const char* FrameStats::GetMetricName(Metric metric)
+{
+    switch (metric)
+    {
+    case MetricCpuTime:
+        return "cpu_time_ms";
+    case MetricDrawCalls:
+        return "draw_calls";
+    case MetricStateChanges:
+        return "state_changes";
+    case MetricBytesUploaded:
+        return "bytes_uploaded";
+    default:
+        return "unknown";
+    }
+}
+
+bool FrameStats::WriteCsv(const char* path) const
+{
+    FILE* pFile = nullptr;
+#ifdef _MSC_VER
+    fopen_s(&pFile, path, "w");
+#else
+    pFile = fopen(path, "w");
+#endif
+    if (pFile == nullptr)
+        return false;
+
+    fprintf(pFile, "metric,count,min,mean,p50,p95,p99,max\n");
+    for (int metric = 0; metric < MetricCount; metric++)
+    {
+        FrameStatsSummary summary = GetSummary(Metric(metric));
+        fprintf(pFile, "%s,%llu,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f\n", GetMetricName(Metric(metric)), (unsigned long long)summary.count,
+            summary.minimum, summary.mean, summary.p50, summary.p95, summary.p99, summary.maximum);
+    }
+    bool result = ferror(pFile) == 0;
+    fclose(pFile);
+    return result;
+}
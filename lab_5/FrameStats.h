@@ -0,0 +1,111 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Lock-free histogram of non-negative integers. Buckets are log-linear: values
+// below 32 get a bucket each, above that every power of two is split into 32
+// buckets, so a percentile is off by at most 1/32 of the value. Add may be
+// called from any number of threads; readers see a consistent enough picture
+// for reporting while writers keep going.
+class AtomicHistogram
+{
+public:
+    static const uint32_t SubBucketBits = 5;
+    static const uint32_t SubBucketCount = 1 << SubBucketBits;
+    // Values up to 2^40 are told apart, larger ones land in the last bucket
+    static const uint32_t MaxValueBits = 40;
+    static const uint32_t BucketCount = (MaxValueBits - SubBucketBits + 1) * SubBucketCount;
+
+    AtomicHistogram();
+
+    void Add(uint64_t value);
+    void Reset();
+
+    uint64_t GetCount() const { return m_count.load(std::memory_order_relaxed); }
+    uint64_t GetMin() const;
+    uint64_t GetMax() const { return m_max.load(std::memory_order_relaxed); }
+    double GetMean() const;
+    // p in [0, 1], the middle of the bucket holding that rank, clamped to the observed range
+    uint64_t GetPercentile(double p) const;
+
+    static uint32_t GetBucket(uint64_t value);
+    static uint64_t GetBucketLow(uint32_t bucket);
+    static uint64_t GetBucketWidth(uint32_t bucket);
+private:
+    std::atomic<uint64_t> m_buckets[BucketCount];
+    std::atomic<uint64_t> m_count;
+    std::atomic<uint64_t> m_sum;
+    std::atomic<uint64_t> m_min;
+    std::atomic<uint64_t> m_max;
+};
+
+// Counters filled while a frame is recorded, possibly on several threads.
+// State changes count pipeline sub-states and shader resources rebound.
+struct FrameCounters
+{
+    std::atomic<uint32_t> drawCalls{ 0 };
+    std::atomic<uint32_t> stateChanges{ 0 };
+    std::atomic<uint64_t> bytesUploaded{ 0 };
+
+    void Add(uint32_t draws, uint32_t states, uint64_t bytes)
+    {
+        drawCalls.fetch_add(draws, std::memory_order_relaxed);
+        stateChanges.fetch_add(states, std::memory_order_relaxed);
+        bytesUploaded.fetch_add(bytes, std::memory_order_relaxed);
+    }
+    void Reset()
+    {
+        drawCalls.store(0, std::memory_order_relaxed);
+        stateChanges.store(0, std::memory_order_relaxed);
+        bytesUploaded.store(0, std::memory_order_relaxed);
+    }
+};
+
+struct FrameSample
+{
+    double cpuTime = 0.0; // seconds
+    uint32_t drawCalls = 0;
+    uint32_t stateChanges = 0;
+    uint64_t bytesUploaded = 0;
+};
+
+struct FrameStatsSummary
+{
+    uint64_t count = 0;
+    double minimum = 0.0;
+    double mean = 0.0;
+    double p50 = 0.0;
+    double p95 = 0.0;
+    double p99 = 0.0;
+    double maximum = 0.0;
+};
+
+// Per frame metrics collected into histograms, CPU time is kept in microseconds
+// and reported in milliseconds. Nothing here depends on the window or the device,
+// so a headless benchmark can feed it the same way the main loop does.
+class FrameStats
+{
+public:
+    enum Metric
+    {
+        MetricCpuTime,
+        MetricDrawCalls,
+        MetricStateChanges,
+        MetricBytesUploaded,
+        MetricCount
+    };
+
+    void Record(const FrameSample& sample);
+    void Reset();
+
+    uint64_t GetFrameCount() const { return m_histograms[MetricCpuTime].GetCount(); }
+    FrameStatsSummary GetSummary(Metric metric) const;
+    static const char* GetMetricName(Metric metric);
+
+    // One row per metric: count, min, mean and percentiles
+    bool WriteCsv(const char* path) const;
+private:
+    AtomicHistogram m_histograms[MetricCount];
+};
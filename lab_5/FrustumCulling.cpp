@@ -0,0 +1,242 @@
+#include "FrustumCulling.h"
+
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+#include <xmmintrin.h>
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+// Padding entries: huge negative radius/extent, no plane test can pass
+static const float CulledPadding = -1e30f;
+
+void ExtractFrustumPlanes(const float viewProj[16], FrustumPlanes& planes)
+{
+    // Column j of the matrix maps a position to clip component j
+    auto column = [&](int j, int row) { return viewProj[row * 4 + j]; };
+    for (int i = 0; i < 6; i++)
+    {
+        int axis = i / 2;
+        float sign = (i % 2 == 0) ? 1.0f : -1.0f;
+        float p[4];
+        for (int row = 0; row < 4; row++)
+        {
+            if (i == 4)
+                p[row] = column(2, row);                       // near: z >= 0
+            else if (i == 5)
+                p[row] = column(3, row) - column(2, row);      // far: z <= w
+            else
+                p[row] = column(3, row) + sign * column(axis, row);
+        }
+        float len = sqrtf(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+        float invLen = len > 0.0f ? 1.0f / len : 0.0f;
+        planes.nx[i] = p[0] * invLen;
+        planes.ny[i] = p[1] * invLen;
+        planes.nz[i] = p[2] * invLen;
+        planes.d[i] = p[3] * invLen;
+    }
+}
+
+AlignedFloatArray::~AlignedFloatArray()
+{
+    _mm_free(m_pData);
+}
+
+void AlignedFloatArray::Resize(size_t size, float fill)
+{
+    if (size > m_capacity)
+    {
+        size_t capacity = m_capacity == 0 ? 64 : m_capacity;
+        while (capacity < size)
+            capacity *= 2;
+        float* pData = static_cast<float*>(_mm_malloc(capacity * sizeof(float), 32));
+        if (m_size > 0)
+            memcpy(pData, m_pData, m_size * sizeof(float));
+        _mm_free(m_pData);
+        m_pData = pData;
+        m_capacity = capacity;
+    }
+    for (size_t i = m_size; i < size; i++)
+    {
+        m_pData[i] = fill;
+    }
+    m_size = size;
+}
+
+void CullingBounds::Resize(size_t count)
+{
+    size_t padded = (count + CullingBatch - 1) / CullingBatch * CullingBatch;
+    m_centerX.Resize(padded, 0.0f);
+    m_centerY.Resize(padded, 0.0f);
+    m_centerZ.Resize(padded, 0.0f);
+    m_radius.Resize(padded, CulledPadding);
+    m_extentX.Resize(padded, CulledPadding);
+    m_extentY.Resize(padded, CulledPadding);
+    m_extentZ.Resize(padded, CulledPadding);
+    // Entries freed by shrinking become padding again
+    for (size_t i = count; i < padded; i++)
+    {
+        m_radius[i] = m_extentX[i] = m_extentY[i] = m_extentZ[i] = CulledPadding;
+    }
+    m_count = count;
+}
+
+void CullingBounds::SetSphere(size_t idx, float x, float y, float z, float radius)
+{
+    assert(idx < m_count);
+    m_centerX[idx] = x;
+    m_centerY[idx] = y;
+    m_centerZ[idx] = z;
+    m_radius[idx] = radius;
+    m_extentX[idx] = m_extentY[idx] = m_extentZ[idx] = radius;
+}
+
+void CullingBounds::SetAabb(size_t idx, float minX, float minY, float minZ, float maxX, float maxY, float maxZ)
+{
+    assert(idx < m_count);
+    float ex = (maxX - minX) * 0.5f;
+    float ey = (maxY - minY) * 0.5f;
+    float ez = (maxZ - minZ) * 0.5f;
+    m_centerX[idx] = (minX + maxX) * 0.5f;
+    m_centerY[idx] = (minY + maxY) * 0.5f;
+    m_centerZ[idx] = (minZ + maxZ) * 0.5f;
+    m_extentX[idx] = ex;
+    m_extentY[idx] = ey;
+    m_extentZ[idx] = ez;
+    m_radius[idx] = sqrtf(ex * ex + ey * ey + ez * ez);
+}
+
+// Appends base + lane for every set bit of mask without branching on it
+static inline size_t CompactLanes(int mask, int lanes, uint32_t base, uint32_t* pOut, size_t count)
+{
+    for (int lane = 0; lane < lanes; lane++)
+    {
+        pOut[count] = base + lane;
+        count += (mask >> lane) & 1;
+    }
+    return count;
+}
+
+#ifdef __AVX__
+
+size_t CullSpheres(const FrustumPlanes& planes, const CullingBounds& bounds, std::vector<uint32_t>& visible)
+{
+    const size_t padded = bounds.GetPaddedSize();
+    visible.resize(padded);
+    size_t count = 0;
+    const __m256 zero = _mm256_setzero_ps();
+    for (size_t i = 0; i < padded; i += 8)
+    {
+        __m256 cx = _mm256_load_ps(bounds.GetCenterX() + i);
+        __m256 cy = _mm256_load_ps(bounds.GetCenterY() + i);
+        __m256 cz = _mm256_load_ps(bounds.GetCenterZ() + i);
+        __m256 r = _mm256_load_ps(bounds.GetRadius() + i);
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (int p = 0; p < 6; p++)
+        {
+            __m256 dist = _mm256_add_ps(_mm256_mul_ps(cx, _mm256_set1_ps(planes.nx[p])), _mm256_set1_ps(planes.d[p]));
+            dist = _mm256_add_ps(dist, _mm256_mul_ps(cy, _mm256_set1_ps(planes.ny[p])));
+            dist = _mm256_add_ps(dist, _mm256_mul_ps(cz, _mm256_set1_ps(planes.nz[p])));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(dist, r), zero, _CMP_GE_OQ));
+        }
+        count = CompactLanes(_mm256_movemask_ps(inside), 8, uint32_t(i), visible.data(), count);
+    }
+    visible.resize(count);
+    return count;
+}
+
+size_t CullAabbs(const FrustumPlanes& planes, const CullingBounds& bounds, std::vector<uint32_t>& visible)
+{
+    const size_t padded = bounds.GetPaddedSize();
+    visible.resize(padded);
+    size_t count = 0;
+    const __m256 zero = _mm256_setzero_ps();
+    for (size_t i = 0; i < padded; i += 8)
+    {
+        __m256 cx = _mm256_load_ps(bounds.GetCenterX() + i);
+        __m256 cy = _mm256_load_ps(bounds.GetCenterY() + i);
+        __m256 cz = _mm256_load_ps(bounds.GetCenterZ() + i);
+        __m256 ex = _mm256_load_ps(bounds.GetExtentX() + i);
+        __m256 ey = _mm256_load_ps(bounds.GetExtentY() + i);
+        __m256 ez = _mm256_load_ps(bounds.GetExtentZ() + i);
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (int p = 0; p < 6; p++)
+        {
+            __m256 dist = _mm256_add_ps(_mm256_mul_ps(cx, _mm256_set1_ps(planes.nx[p])), _mm256_set1_ps(planes.d[p]));
+            dist = _mm256_add_ps(dist, _mm256_mul_ps(cy, _mm256_set1_ps(planes.ny[p])));
+            dist = _mm256_add_ps(dist, _mm256_mul_ps(cz, _mm256_set1_ps(planes.nz[p])));
+            // Projected half size of the box on the plane normal
+            __m256 reach = _mm256_mul_ps(ex, _mm256_set1_ps(fabsf(planes.nx[p])));
+            reach = _mm256_add_ps(reach, _mm256_mul_ps(ey, _mm256_set1_ps(fabsf(planes.ny[p]))));
+            reach = _mm256_add_ps(reach, _mm256_mul_ps(ez, _mm256_set1_ps(fabsf(planes.nz[p]))));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(dist, reach), zero, _CMP_GE_OQ));
+        }
+        count = CompactLanes(_mm256_movemask_ps(inside), 8, uint32_t(i), visible.data(), count);
+    }
+    visible.resize(count);
+    return count;
+}
+
+#else
+
+size_t CullSpheres(const FrustumPlanes& planes, const CullingBounds& bounds, std::vector<uint32_t>& visible)
+{
+    const size_t padded = bounds.GetPaddedSize();
+    visible.resize(padded);
+    size_t count = 0;
+    const __m128 zero = _mm_setzero_ps();
+    for (size_t i = 0; i < padded; i += 4)
+    {
+        __m128 cx = _mm_load_ps(bounds.GetCenterX() + i);
+        __m128 cy = _mm_load_ps(bounds.GetCenterY() + i);
+        __m128 cz = _mm_load_ps(bounds.GetCenterZ() + i);
+        __m128 r = _mm_load_ps(bounds.GetRadius() + i);
+        __m128 inside = _mm_cmpeq_ps(zero, zero);
+        for (int p = 0; p < 6; p++)
+        {
+            __m128 dist = _mm_add_ps(_mm_mul_ps(cx, _mm_set1_ps(planes.nx[p])), _mm_set1_ps(planes.d[p]));
+            dist = _mm_add_ps(dist, _mm_mul_ps(cy, _mm_set1_ps(planes.ny[p])));
+            dist = _mm_add_ps(dist, _mm_mul_ps(cz, _mm_set1_ps(planes.nz[p])));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(dist, r), zero));
+        }
+        count = CompactLanes(_mm_movemask_ps(inside), 4, uint32_t(i), visible.data(), count);
+    }
+    visible.resize(count);
+    return count;
+}
+
+size_t CullAabbs(const FrustumPlanes& planes, const CullingBounds& bounds, std::vector<uint32_t>& visible)
+{
+    const size_t padded = bounds.GetPaddedSize();
+    visible.resize(padded);
+    size_t count = 0;
+    const __m128 zero = _mm_setzero_ps();
+    for (size_t i = 0; i < padded; i += 4)
+    {
+        __m128 cx = _mm_load_ps(bounds.GetCenterX() + i);
+        __m128 cy = _mm_load_ps(bounds.GetCenterY() + i);
+        __m128 cz = _mm_load_ps(bounds.GetCenterZ() + i);
+        __m128 ex = _mm_load_ps(bounds.GetExtentX() + i);
+        __m128 ey = _mm_load_ps(bounds.GetExtentY() + i);
+        __m128 ez = _mm_load_ps(bounds.GetExtentZ() + i);
+        __m128 inside = _mm_cmpeq_ps(zero, zero);
+        for (int p = 0; p < 6; p++)
+        {
+            __m128 dist = _mm_add_ps(_mm_mul_ps(cx, _mm_set1_ps(planes.nx[p])), _mm_set1_ps(planes.d[p]));
+            dist = _mm_add_ps(dist, _mm_mul_ps(cy, _mm_set1_ps(planes.ny[p])));
+            dist = _mm_add_ps(dist, _mm_mul_ps(cz, _mm_set1_ps(planes.nz[p])));
+            // Projected half size of the box on the plane normal
+            __m128 reach = _mm_mul_ps(ex, _mm_set1_ps(fabsf(planes.nx[p])));
+            reach = _mm_add_ps(reach, _mm_mul_ps(ey, _mm_set1_ps(fabsf(planes.ny[p]))));
+            reach = _mm_add_ps(reach, _mm_mul_ps(ez, _mm_set1_ps(fabsf(planes.nz[p]))));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(dist, reach), zero));
+        }
+        count = CompactLanes(_mm_movemask_ps(inside), 4, uint32_t(i), visible.data(), count);
+    }
+    visible.resize(count);
+    return count;
+}
+
+#endif
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Frustum planes in SoA form, plane i is nx[i] * x + ny[i] * y + nz[i] * z + d[i] >= 0 inside.
+// Order: left, right, bottom, top, near, far.
+struct FrustumPlanes
+{
+    float nx[6];
+    float ny[6];
+    float nz[6];
+    float d[6];
+};
+
+// viewProj is a row-major 4x4 matrix for row vectors (clip = pos * viewProj), as
+// DirectXMath builds them; planes come out normalized. Depth range is [0, w], which
+// holds for both regular and reversed depth.
+void ExtractFrustumPlanes(const float viewProj[16], FrustumPlanes& planes);
+
+// Float array with 32-byte aligned storage, so SIMD loops can use aligned loads
+class AlignedFloatArray
+{
+public:
+    AlignedFloatArray() {}
+    AlignedFloatArray(const AlignedFloatArray&) = delete;
+    AlignedFloatArray& operator=(const AlignedFloatArray&) = delete;
+    ~AlignedFloatArray();
+
+    void Resize(size_t size, float fill);
+    float* GetData() { return m_pData; }
+    const float* GetData() const { return m_pData; }
+    float& operator[](size_t idx) { return m_pData[idx]; }
+    float operator[](size_t idx) const { return m_pData[idx]; }
+private:
+    float* m_pData = nullptr;
+    size_t m_size = 0;
+    size_t m_capacity = 0;
+};
+
+// Object bounds in structure-of-arrays form: a sphere (center, radius) and an AABB
+// (same center, half extents) per object. Storage is padded to a multiple of
+// CullingBatch with entries that never pass the test.
+class CullingBounds
+{
+public:
+    static const size_t CullingBatch = 8;
+
+    void Resize(size_t count);
+    void Clear() { Resize(0); }
+    size_t GetSize() const { return m_count; }
+    size_t GetPaddedSize() const { return (m_count + CullingBatch - 1) / CullingBatch * CullingBatch; }
+
+    void SetSphere(size_t idx, float x, float y, float z, float radius);
+    void SetAabb(size_t idx, float minX, float minY, float minZ, float maxX, float maxY, float maxZ);
+
+    const float* GetCenterX() const { return m_centerX.GetData(); }
+    const float* GetCenterY() const { return m_centerY.GetData(); }
+    const float* GetCenterZ() const { return m_centerZ.GetData(); }
+    const float* GetRadius() const { return m_radius.GetData(); }
+    const float* GetExtentX() const { return m_extentX.GetData(); }
+    const float* GetExtentY() const { return m_extentY.GetData(); }
+    const float* GetExtentZ() const { return m_extentZ.GetData(); }
+private:
+    size_t m_count = 0;
+    AlignedFloatArray m_centerX;
+    AlignedFloatArray m_centerY;
+    AlignedFloatArray m_centerZ;
+    AlignedFloatArray m_radius;
+    AlignedFloatArray m_extentX;
+    AlignedFloatArray m_extentY;
+    AlignedFloatArray m_extentZ;
+};
+
+// Writes indices of objects intersecting the frustum into visible, returns their count.
+// Uses AVX when compiled with it, SSE otherwise.
+size_t CullSpheres(const FrustumPlanes& planes, const CullingBounds& bounds, std::vector<uint32_t>& visible);
+size_t CullAabbs(const FrustumPlanes& planes, const CullingBounds& bounds, std::vector<uint32_t>& visible);
@@ -0,0 +1,190 @@
+#include "GpuProfiler.h"
+#include "Profiler.h"
+
+#include <algorithm>
+
+GpuQueryFakeBackend::GpuQueryFakeBackend(uint32_t latency, uint64_t frequency)
+    : m_latency(latency), m_frequency(frequency), m_clock(0)
+{
+}
+
+bool GpuQueryFakeBackend::Init(uint32_t frameCount, uint32_t timestampsPerFrame)
+{
+    m_frames.assign(frameCount, Frame());
+    for (Frame& frame : m_frames)
+    {
+        frame.timestamps.resize(timestampsPerFrame);
+    }
+    return true;
+}
+
+void GpuQueryFakeBackend::Release()
+{
+    m_frames.clear();
+}
+
+void GpuQueryFakeBackend::BeginFrame(uint32_t frame)
+{
+    m_frames[frame].ended = false;
+}
+
+void GpuQueryFakeBackend::WriteTimestamp(uint32_t frame, uint32_t idx, void*)
+{
+    m_frames[frame].timestamps[idx] = m_clock.fetch_add(m_tickStep) + m_tickStep;
+}
+
+void GpuQueryFakeBackend::EndFrame(uint32_t frame)
+{
+    Frame& data = m_frames[frame];
+    data.ended = true;
+    data.endedAt = m_endedFrames++;
+    data.disjoint = m_disjoint;
+}
+
+bool GpuQueryFakeBackend::ReadFrame(uint32_t frame, uint32_t timestampCount, uint64_t* pTimestamps, uint64_t& frequency, bool& disjoint)
+{
+    m_readAttempts++;
+    const Frame& data = m_frames[frame];
+    if (!data.ended || m_endedFrames - data.endedAt <= m_latency)
+        return false;
+    std::copy(data.timestamps.begin(), data.timestamps.begin() + timestampCount, pTimestamps);
+    frequency = m_frequency;
+    disjoint = data.disjoint;
+    return true;
+}
+
+bool GpuProfiler::Init(IGpuQueryBackend& backend)
+{
+    m_pBackend = &backend;
+    m_nextSlot = 0;
+    m_pendingCount = 0;
+    m_currentSlot = -1;
+    m_nextPass.store(0);
+    if (m_track < 0)
+        m_track = Profiler::RegisterTrack("GPU");
+    if (!backend.Init(FrameCount, TimestampsPerFrame))
+    {
+        // Profiling stays off, every call turns into a no-op
+        m_pBackend = nullptr;
+        return false;
+    }
+    return true;
+}
+
+void GpuProfiler::Release()
+{
+    if (m_pBackend != nullptr)
+        m_pBackend->Release();
+    m_pBackend = nullptr;
+    m_pendingCount = 0;
+    m_currentSlot = -1;
+}
+
+void GpuProfiler::BeginFrame()
+{
+    if (m_pBackend == nullptr)
+        return;
+    Collect();
+    if (m_pendingCount == FrameCount)
+    {
+        // The GPU is more than FrameCount frames behind, skip rather than wait for it
+        m_skippedFrames++;
+        m_currentSlot = -1;
+        return;
+    }
+
+    FrameSlot& slot = m_slots[m_nextSlot];
+    slot.passCount = 0;
+    slot.cpuStart = Profiler::Now();
+    m_nextPass.store(0);
+    m_pBackend->BeginFrame(m_nextSlot);
+    m_pBackend->WriteTimestamp(m_nextSlot, 0, nullptr);
+    m_currentSlot = int(m_nextSlot);
+}
+
+void GpuProfiler::EndFrame()
+{
+    if (m_currentSlot < 0)
+        return;
+    const uint32_t slotIdx = uint32_t(m_currentSlot);
+    m_pBackend->WriteTimestamp(slotIdx, 1, nullptr);
+    m_pBackend->EndFrame(slotIdx);
+    const uint32_t passCount = m_nextPass.load();
+    m_slots[slotIdx].passCount = passCount < MaxPasses ? passCount : MaxPasses;
+    m_pendingCount++;
+    m_nextSlot = (slotIdx + 1) % FrameCount;
+    m_currentSlot = -1;
+}
+
+int GpuProfiler::BeginPass(const char* name, void* pContext)
+{
+    if (m_currentSlot < 0)
+        return -1;
+    uint32_t pass = m_nextPass.fetch_add(1);
+    if (pass >= MaxPasses)
+        return -1;
+    m_slots[m_currentSlot].names[pass] = name;
+    m_pBackend->WriteTimestamp(uint32_t(m_currentSlot), 2 + 2 * pass, pContext);
+    return int(pass);
+}
+
+void GpuProfiler::EndPass(int pass, void* pContext)
+{
+    if (pass < 0 || m_currentSlot < 0)
+        return;
+    m_pBackend->WriteTimestamp(uint32_t(m_currentSlot), 3 + 2 * uint32_t(pass), pContext);
+}
+
+void GpuProfiler::Collect()
+{
+    uint64_t timestamps[TimestampsPerFrame];
+    while (m_pendingCount > 0)
+    {
+        const uint32_t slotIdx = (m_nextSlot + FrameCount - m_pendingCount) % FrameCount;
+        const FrameSlot& slot = m_slots[slotIdx];
+        uint64_t frequency = 0;
+        bool disjoint = false;
+        if (!m_pBackend->ReadFrame(slotIdx, 2 + 2 * slot.passCount, timestamps, frequency, disjoint))
+            break;
+        m_pendingCount--;
+        if (disjoint || frequency == 0)
+        {
+            m_disjointFrames++;
+            continue;
+        }
+
+        // Differences are taken as signed, a timestamp the driver reordered shows up as zero length
+        const double secondsPerTick = 1.0 / double(frequency);
+        auto elapsed = [&](uint64_t from, uint64_t to) {
+            return std::max(0.0, double(int64_t(to - from)) * secondsPerTick);
+        };
+        m_lastFrame.clear();
+        m_lastFrameDuration = elapsed(timestamps[0], timestamps[1]);
+        // Passes recorded on workers may start in any order
+        double firstStart = 0.0;
+        double lastEnd = 0.0;
+        for (uint32_t pass = 0; pass < slot.passCount; pass++)
+        {
+            GpuPassTiming timing;
+            timing.name = slot.names[pass];
+            timing.start = elapsed(timestamps[0], timestamps[2 + 2 * pass]);
+            timing.duration = elapsed(timestamps[2 + 2 * pass], timestamps[3 + 2 * pass]);
+            m_lastFrame.push_back(timing);
+            firstStart = pass == 0 ? timing.start : std::min(firstStart, timing.start);
+            lastEnd = std::max(lastEnd, timing.start + timing.duration);
+        }
+        m_lastPassSpan = lastEnd - firstStart;
+        m_measuredFrames++;
+
+#ifndef PROFILER_DISABLED
+        const double ticksPerSecond = Profiler::GetTicksPerSecond();
+        auto toTicks = [ticksPerSecond](double seconds) { return uint64_t(seconds * ticksPerSecond); };
+        Profiler::RecordOnTrack(m_track, "GPU frame", slot.cpuStart, slot.cpuStart + toTicks(m_lastFrameDuration));
+        for (const GpuPassTiming& timing : m_lastFrame)
+        {
+            uint64_t start = slot.cpuStart + toTicks(timing.start);
+            Profiler::RecordOnTrack(m_track, timing.name, start, start + toTicks(timing.duration));
+        }
+#endif
+    }
+}
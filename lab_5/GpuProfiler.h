@@ -0,0 +1,154 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+// Timestamp query API seen by GpuProfiler. Every frame slot owns a disjoint
+// query and a fixed number of timestamps; WriteTimestamp may be called on
+// worker threads with the context a pass records into, the rest on the thread
+// that submits frames.
+class IGpuQueryBackend
+{
+public:
+    virtual ~IGpuQueryBackend() {}
+    virtual bool Init(uint32_t frameCount, uint32_t timestampsPerFrame) = 0;
+    virtual void Release() = 0;
+    virtual void BeginFrame(uint32_t frame) = 0;
+    virtual void WriteTimestamp(uint32_t frame, uint32_t idx, void* pContext) = 0;
+    virtual void EndFrame(uint32_t frame) = 0;
+    // Must not block, returns false while the GPU hasn't finished the frame.
+    // disjoint is set when the counter was unreliable and the values should be dropped.
+    virtual bool ReadFrame(uint32_t frame, uint32_t timestampCount, uint64_t* pTimestamps, uint64_t& frequency, bool& disjoint) = 0;
+};
+
+// Backend without a device. Timestamps advance a fake GPU clock by a set amount
+// and a frame becomes readable only after a number of later frames were ended,
+// which mimics a GPU running behind the CPU.
+class GpuQueryFakeBackend : public IGpuQueryBackend
+{
+public:
+    explicit GpuQueryFakeBackend(uint32_t latency = 2, uint64_t frequency = 1000000);
+
+    bool Init(uint32_t frameCount, uint32_t timestampsPerFrame) override;
+    void Release() override;
+    void BeginFrame(uint32_t frame) override;
+    void WriteTimestamp(uint32_t frame, uint32_t idx, void* pContext) override;
+    void EndFrame(uint32_t frame) override;
+    bool ReadFrame(uint32_t frame, uint32_t timestampCount, uint64_t* pTimestamps, uint64_t& frequency, bool& disjoint) override;
+
+    // Amount of GPU ticks every following timestamp adds
+    void SetTickStep(uint64_t step) { m_tickStep = step; }
+    void SetLatency(uint32_t latency) { m_latency = latency; }
+    // Marks the frames ended from now on as disjoint
+    void SetDisjoint(bool disjoint) { m_disjoint = disjoint; }
+    uint32_t GetReadAttempts() const { return m_readAttempts; }
+private:
+    struct Frame
+    {
+        std::vector<uint64_t> timestamps;
+        uint64_t endedAt = 0;
+        bool ended = false;
+        bool disjoint = false;
+    };
+
+    uint32_t m_latency;
+    uint64_t m_frequency;
+    uint64_t m_tickStep = 100;
+    std::atomic<uint64_t> m_clock;
+    uint64_t m_endedFrames = 0;
+    bool m_disjoint = false;
+    uint32_t m_readAttempts = 0;
+    std::vector<Frame> m_frames;
+};
+
+struct GpuPassTiming
+{
+    const char* name;
+    double start;    // seconds from the beginning of the frame on the GPU
+    double duration; // seconds
+};
+
+// Per pass GPU timing with timestamp queries. Queries of a frame are read back
+// a few frames later from a ring of frame slots, so the CPU never waits on the
+// GPU; when every slot is still in flight the frame is not measured.
+// Finished frames are also recorded on a "GPU" track of the CPU profiler,
+// aligned so that the frame starts when the CPU began submitting it, which is
+// the earliest the GPU could have started.
+class GpuProfiler
+{
+public:
+    static const uint32_t FrameCount = 4;
+    static const uint32_t MaxPasses = 16;
+
+    bool Init(IGpuQueryBackend& backend);
+    void Release();
+
+    // Reads back finished frames and starts measuring a new one
+    void BeginFrame();
+    void EndFrame();
+
+    // Safe to call from several threads between BeginFrame and EndFrame.
+    // name must outlive the profiler, pContext is handed to the backend.
+    int BeginPass(const char* name, void* pContext);
+    void EndPass(int pass, void* pContext);
+
+    // Timings of the most recent frame read back, in the order passes were begun
+    const std::vector<GpuPassTiming>& GetLastFrame() const { return m_lastFrame; }
+    double GetLastFrameDuration() const { return m_lastFrameDuration; }
+    // From the start of the first pass to the end of the last one, 0 without
+    // passes. The frame duration also counts the time before the first pass,
+    // when the GPU may only be waiting for the CPU to cull and set up the frame.
+    double GetLastPassSpan() const { return m_lastPassSpan; }
+    uint64_t GetMeasuredFrames() const { return m_measuredFrames; }
+    uint64_t GetSkippedFrames() const { return m_skippedFrames; }
+    uint64_t GetDisjointFrames() const { return m_disjointFrames; }
+private:
+    // Frame begin and end take the first two timestamps, every pass two more
+    static const uint32_t TimestampsPerFrame = 2 + 2 * MaxPasses;
+
+    struct FrameSlot
+    {
+        const char* names[MaxPasses];
+        uint32_t passCount = 0;
+        uint64_t cpuStart = 0;
+    };
+
+    void Collect();
+
+    IGpuQueryBackend* m_pBackend = nullptr;
+    FrameSlot m_slots[FrameCount];
+    // Slots are used round robin, the oldest of the pending ones is read first
+    uint32_t m_nextSlot = 0;
+    uint32_t m_pendingCount = 0;
+    int m_currentSlot = -1;
+    std::atomic<uint32_t> m_nextPass{ 0 };
+    int m_track = -1;
+
+    std::vector<GpuPassTiming> m_lastFrame;
+    double m_lastFrameDuration = 0.0;
+    double m_lastPassSpan = 0.0;
+    uint64_t m_measuredFrames = 0;
+    uint64_t m_skippedFrames = 0;
+    uint64_t m_disjointFrames = 0;
+};
+
+// Measures the GPU time between construction and destruction
+class GpuProfileScope
+{
+public:
+    GpuProfileScope(GpuProfiler& profiler, const char* name, void* pContext)
+        : m_profiler(profiler), m_pContext(pContext), m_pass(profiler.BeginPass(name, pContext))
+    {
+    }
+    ~GpuProfileScope()
+    {
+        m_profiler.EndPass(m_pass, m_pContext);
+    }
+    GpuProfileScope(const GpuProfileScope&) = delete;
+    GpuProfileScope& operator=(const GpuProfileScope&) = delete;
+private:
+    GpuProfiler& m_profiler;
+    void* m_pContext;
+    int m_pass;
+};
@@ -0,0 +1,87 @@
+#include "GpuProfilerD3D11.h"
+
+#include <cassert>
+
+#define SafeRelease(A) if ((A) != NULL) { (A)->Release(); (A) = NULL; }
+
+void GpuQueryD3D11Backend::SetDevice(ID3D11Device* pDevice, ID3D11DeviceContext* pImmediateContext)
+{
+    m_pDevice = pDevice;
+    m_pImmediateContext = pImmediateContext;
+}
+
+bool GpuQueryD3D11Backend::Init(uint32_t frameCount, uint32_t timestampsPerFrame)
+{
+    assert(m_pDevice != nullptr);
+    m_frames.resize(frameCount);
+    HRESULT result = S_OK;
+    for (Frame& frame : m_frames)
+    {
+        D3D11_QUERY_DESC desc = {};
+        desc.Query = D3D11_QUERY_TIMESTAMP_DISJOINT;
+        result = m_pDevice->CreateQuery(&desc, &frame.pDisjoint);
+        desc.Query = D3D11_QUERY_TIMESTAMP;
+        frame.timestamps.resize(timestampsPerFrame, nullptr);
+        for (ID3D11Query*& pQuery : frame.timestamps)
+        {
+            if (SUCCEEDED(result))
+                result = m_pDevice->CreateQuery(&desc, &pQuery);
+        }
+        if (FAILED(result))
+            break;
+    }
+    if (FAILED(result))
+    {
+        Release();
+        return false;
+    }
+    return true;
+}
+
+void GpuQueryD3D11Backend::Release()
+{
+    for (Frame& frame : m_frames)
+    {
+        SafeRelease(frame.pDisjoint);
+        for (ID3D11Query*& pQuery : frame.timestamps)
+        {
+            SafeRelease(pQuery);
+        }
+    }
+    m_frames.clear();
+}
+
+void GpuQueryD3D11Backend::BeginFrame(uint32_t frame)
+{
+    m_pImmediateContext->Begin(m_frames[frame].pDisjoint);
+}
+
+void GpuQueryD3D11Backend::WriteTimestamp(uint32_t frame, uint32_t idx, void* pContext)
+{
+    ID3D11DeviceContext* pDeviceContext = pContext != nullptr ? static_cast<ID3D11DeviceContext*>(pContext) : m_pImmediateContext;
+    pDeviceContext->End(m_frames[frame].timestamps[idx]);
+}
+
+void GpuQueryD3D11Backend::EndFrame(uint32_t frame)
+{
+    m_pImmediateContext->End(m_frames[frame].pDisjoint);
+}
+
+bool GpuQueryD3D11Backend::ReadFrame(uint32_t frame, uint32_t timestampCount, uint64_t* pTimestamps, uint64_t& frequency, bool& disjoint)
+{
+    // DONOTFLUSH keeps GetData from forcing a flush, S_FALSE means the GPU isn't there yet
+    const Frame& data = m_frames[frame];
+    D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disjointData;
+    if (m_pImmediateContext->GetData(data.pDisjoint, &disjointData, sizeof(disjointData), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK)
+        return false;
+    for (uint32_t idx = 0; idx < timestampCount; idx++)
+    {
+        UINT64 timestamp = 0;
+        if (m_pImmediateContext->GetData(data.timestamps[idx], &timestamp, sizeof(timestamp), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK)
+            return false;
+        pTimestamps[idx] = timestamp;
+    }
+    frequency = disjointData.Frequency;
+    disjoint = disjointData.Disjoint != FALSE;
+    return true;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <d3d11.h>
+#include <vector>
+
+#include "GpuProfiler.h"
+
+// Timestamp queries on a D3D11 device. Frame queries go to the immediate context,
+// pass timestamps to the context the pass records into, deferred ones included.
+class GpuQueryD3D11Backend : public IGpuQueryBackend
+{
+public:
+    void SetDevice(ID3D11Device* pDevice, ID3D11DeviceContext* pImmediateContext);
+
+    bool Init(uint32_t frameCount, uint32_t timestampsPerFrame) override;
+    void Release() override;
+    void BeginFrame(uint32_t frame) override;
+    void WriteTimestamp(uint32_t frame, uint32_t idx, void* pContext) override;
+    void EndFrame(uint32_t frame) override;
+    bool ReadFrame(uint32_t frame, uint32_t timestampCount, uint64_t* pTimestamps, uint64_t& frequency, bool& disjoint) override;
+private:
+    struct Frame
+    {
+        ID3D11Query* pDisjoint = nullptr;
+        std::vector<ID3D11Query*> timestamps;
+    };
+
+    ID3D11Device* m_pDevice = nullptr;
+    ID3D11DeviceContext* m_pImmediateContext = nullptr;
+    std::vector<Frame> m_frames;
+};
@@ -0,0 +1,242 @@
+#include "MeshFile.h"
+
+#include <cstdio>
+#include <cstring>
+
+#ifdef _MSC_VER
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    uint64_t AlignUp(uint64_t value)
+    {
+        return (value + MeshFileAlignment - 1) & ~uint64_t(MeshFileAlignment - 1);
+    }
+
+    uint32_t GetStreamStride(uint32_t format)
+    {
+        switch (format)
+        {
+        case MeshStreamPackedPosition:
+            return sizeof(PackedPosition);
+        case MeshStreamPackedTextureVertex:
+            return sizeof(PackedTextureVertex);
+        case MeshStreamPackedNormal:
+            return sizeof(PackedNormal);
+        default:
+            return 0;
+        }
+    }
+
+    bool IsSectionValid(uint32_t offset, uint64_t size, uint32_t fileSize)
+    {
+        return offset % MeshFileAlignment == 0 && offset >= sizeof(MeshFileHeader) && uint64_t(offset) + size <= fileSize;
+    }
+
+    bool IsHeaderValid(const MeshFileHeader& header, size_t fileSize)
+    {
+        if (header.magic != MeshFileMagic || header.version != MeshFileVersion || header.fileSize != fileSize)
+            return false;
+        if (header.indexSize != 2 && header.indexSize != 4)
+            return false;
+        if (header.streamCount > MeshFileMaxStreams || header.lodCount == 0 || header.lodCount > MeshLodChain::MaxLevels)
+            return false;
+        for (uint32_t i = 0; i < header.streamCount; i++)
+        {
+            const MeshFileStream& stream = header.streams[i];
+            if (stream.stride == 0 || stream.stride != GetStreamStride(stream.format))
+                return false;
+            if (stream.size != uint64_t(stream.stride) * header.vertexCount || !IsSectionValid(stream.offset, stream.size, header.fileSize))
+                return false;
+        }
+        if (!IsSectionValid(header.indexOffset, uint64_t(header.indexCount) * header.indexSize, header.fileSize))
+            return false;
+        for (uint32_t i = 0; i < header.lodCount; i++)
+        {
+            const MeshLodLevel& lod = header.lods[i];
+            if (uint64_t(lod.firstIndex) + lod.indexCount > header.indexCount || lod.indexCount % 3 != 0)
+                return false;
+        }
+        return true;
+    }
+
+    bool WritePadded(FILE* pFile, const void* pData, size_t size)
+    {
+        static const uint8_t Zeros[MeshFileAlignment] = {};
+        const size_t padding = size_t(AlignUp(size) - size);
+        return fwrite(pData, 1, size, pFile) == size && fwrite(Zeros, 1, padding, pFile) == padding;
+    }
+}
+
+bool WriteMeshFile(const char* path, const MeshFileData& data)
+{
+    if (data.streams.size() > MeshFileMaxStreams || data.lods.empty() || data.lods.size() > MeshLodChain::MaxLevels)
+        return false;
+
+    MeshFileHeader header = {};
+    header.magic = MeshFileMagic;
+    header.version = MeshFileVersion;
+    header.vertexCount = data.vertexCount;
+    header.indexCount = uint32_t(data.indices.size());
+    header.indexSize = data.vertexCount <= 0x10000 ? 2 : 4;
+    header.streamCount = uint32_t(data.streams.size());
+    header.lodCount = uint32_t(data.lods.size());
+    header.quantization = data.quantization;
+    memcpy(header.boundsMin, data.boundsMin, sizeof(data.boundsMin));
+    memcpy(header.boundsMax, data.boundsMax, sizeof(data.boundsMax));
+    memcpy(header.boundingSphere, data.boundingSphere, sizeof(data.boundingSphere));
+    memcpy(header.lods, data.lods.data(), data.lods.size() * sizeof(MeshLodLevel));
+
+    // 64 bit sums, a file past 4 GB is refused rather than wrapped
+    uint64_t offset = sizeof(MeshFileHeader);
+    for (size_t i = 0; i < data.streams.size(); i++)
+    {
+        const MeshFileStreamData& stream = data.streams[i];
+        header.streams[i].format = stream.format;
+        header.streams[i].stride = stream.stride;
+        header.streams[i].offset = uint32_t(offset);
+        header.streams[i].size = uint32_t(stream.data.size());
+        offset += AlignUp(stream.data.size());
+    }
+    header.indexOffset = uint32_t(offset);
+    offset += AlignUp(uint64_t(header.indexCount) * header.indexSize);
+    if (offset > 0xFFFFFFF0ull)
+        return false;
+    header.fileSize = uint32_t(offset);
+    if (!IsHeaderValid(header, header.fileSize))
+        return false;
+
+    std::vector<uint16_t> shortIndices;
+    const void* pIndices = data.indices.data();
+    if (header.indexSize == 2)
+    {
+        shortIndices.assign(data.indices.begin(), data.indices.end());
+        pIndices = shortIndices.data();
+    }
+
+    FILE* pFile = nullptr;
+#ifdef _MSC_VER
+    fopen_s(&pFile, path, "wb");
+#else
+    pFile = fopen(path, "wb");
+#endif
+    if (pFile == nullptr)
+        return false;
+    bool written = fwrite(&header, sizeof(header), 1, pFile) == 1;
+    for (size_t i = 0; i < data.streams.size() && written; i++)
+    {
+        const std::vector<uint8_t>& stream = data.streams[i].data;
+        written = WritePadded(pFile, stream.data(), stream.size());
+    }
+    if (written)
+        written = WritePadded(pFile, pIndices, size_t(header.indexCount) * header.indexSize);
+    return fclose(pFile) == 0 && written;
+}
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+bool MappedFile::Open(const char* path)
+{
+    Close();
+#ifdef _MSC_VER
+    m_file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (m_file == INVALID_HANDLE_VALUE)
+    {
+        m_file = nullptr;
+        return false;
+    }
+    LARGE_INTEGER size;
+    // Mapping an empty file fails, there is nothing to read from one anyway
+    if (!GetFileSizeEx(m_file, &size) || size.QuadPart == 0 || size.QuadPart > LONGLONG(SIZE_MAX))
+    {
+        Close();
+        return false;
+    }
+    m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (m_mapping != nullptr)
+        m_pData = static_cast<const uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+    if (m_pData == nullptr)
+    {
+        Close();
+        return false;
+    }
+    m_size = size_t(size.QuadPart);
+#else
+    const int file = open(path, O_RDONLY);
+    if (file < 0)
+        return false;
+    struct stat status;
+    void* pData = MAP_FAILED;
+    if (fstat(file, &status) == 0 && status.st_size > 0)
+        pData = mmap(nullptr, size_t(status.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+    // The mapping keeps the file alive on its own
+    close(file);
+    if (pData == MAP_FAILED)
+        return false;
+    m_pData = static_cast<const uint8_t*>(pData);
+    m_size = size_t(status.st_size);
+#endif
+    return true;
+}
+
+void MappedFile::Close()
+{
+#ifdef _MSC_VER
+    if (m_pData != nullptr)
+        UnmapViewOfFile(m_pData);
+    if (m_mapping != nullptr)
+        CloseHandle(m_mapping);
+    if (m_file != nullptr)
+        CloseHandle(m_file);
+    m_file = nullptr;
+    m_mapping = nullptr;
+#else
+    if (m_pData != nullptr)
+        munmap(const_cast<uint8_t*>(m_pData), m_size);
+#endif
+    m_pData = nullptr;
+    m_size = 0;
+}
+
+bool MeshFile::Open(const char* path)
+{
+    Close();
+    if (!m_file.Open(path))
+        return false;
+    // Mappings start on a page boundary, the header and every section stay aligned in memory
+    const MeshFileHeader* pHeader = reinterpret_cast<const MeshFileHeader*>(m_file.GetData());
+    if (m_file.GetSize() < sizeof(MeshFileHeader) || !IsHeaderValid(*pHeader, m_file.GetSize()))
+    {
+        m_file.Close();
+        return false;
+    }
+    m_pHeader = pHeader;
+    return true;
+}
+
+void MeshFile::Close()
+{
+    m_pHeader = nullptr;
+    m_file.Close();
+}
+
+const MeshFileStream* MeshFile::FindStream(MeshStreamFormat format) const
+{
+    for (uint32_t i = 0; i < m_pHeader->streamCount; i++)
+    {
+        if (m_pHeader->streams[i].format == format)
+            return &m_pHeader->streams[i];
+    }
+    return nullptr;
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include "MeshLod.h"
+#include "MeshPacking.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// .mesh files hold vertex streams, indices, bounds and LODs exactly as the
+// renderer uploads them. The header is followed by the sections it points to,
+// each starting on a 16 byte boundary, so a mapped file is used in place:
+// opening checks the header and hands out pointers, nothing is parsed or copied.
+// Little endian, written by MeshImport from OBJ files.
+
+const uint32_t MeshFileMagic = 0x48534D44; // "DMSH"
+const uint32_t MeshFileVersion = 1;
+const uint32_t MeshFileAlignment = 16;
+const uint32_t MeshFileMaxStreams = 4;
+
+enum MeshStreamFormat : uint32_t
+{
+    MeshStreamNone = 0,
+    // Positions decode with the header's quantization
+    MeshStreamPackedPosition,
+    MeshStreamPackedTextureVertex,
+    MeshStreamPackedNormal,
+};
+
+// offset and size in bytes from the start of the file
+struct MeshFileStream
+{
+    uint32_t format;
+    uint32_t stride;
+    uint32_t offset;
+    uint32_t size;
+};
+
+struct MeshFileHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t fileSize;
+    uint32_t vertexCount;
+    // Every LOD back to back, the levels index into them
+    uint32_t indexCount;
+    // 2 bytes when the vertices fit, 4 otherwise
+    uint32_t indexSize;
+    uint32_t indexOffset;
+    uint32_t streamCount;
+    uint32_t lodCount;
+    uint32_t reserved[3];
+    VertexQuantization quantization;
+    float boundsMin[4];
+    float boundsMax[4];
+    // Center at the vertex centroid, the radius the LOD errors are relative to
+    float boundingSphere[4];
+    MeshFileStream streams[MeshFileMaxStreams];
+    MeshLodLevel lods[MeshLodChain::MaxLevels];
+};
+
+static_assert(sizeof(MeshFileHeader) % MeshFileAlignment == 0, "Sections after the header have to stay aligned");
+
+struct MeshFileStreamData
+{
+    MeshStreamFormat format = MeshStreamNone;
+    uint32_t stride = 0;
+    std::vector<uint8_t> data;
+};
+
+// Everything a .mesh file is written from
+struct MeshFileData
+{
+    uint32_t vertexCount = 0;
+    VertexQuantization quantization = {};
+    float boundsMin[3] = {};
+    float boundsMax[3] = {};
+    float boundingSphere[4] = {};
+    std::vector<MeshFileStreamData> streams;
+    std::vector<uint32_t> indices;
+    std::vector<MeshLodLevel> lods;
+};
+
+bool WriteMeshFile(const char* path, const MeshFileData& data);
+
+// Read only view of a whole file, mapped where the platform allows it
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool Open(const char* path);
+    void Close();
+
+    const uint8_t* GetData() const { return m_pData; }
+    size_t GetSize() const { return m_size; }
+private:
+    const uint8_t* m_pData = nullptr;
+    size_t m_size = 0;
+#ifdef _MSC_VER
+    void* m_file = nullptr;
+    void* m_mapping = nullptr;
+#endif
+};
+
+class MeshFile
+{
+public:
+    // Fails on a missing file and on anything whose header doesn't describe
+    // sections inside the file
+    bool Open(const char* path);
+    void Close();
+
+    bool IsOpen() const { return m_pHeader != nullptr; }
+    const MeshFileHeader& GetHeader() const { return *m_pHeader; }
+    // nullptr when the file has no stream in this format
+    const MeshFileStream* FindStream(MeshStreamFormat format) const;
+    const void* GetStreamData(const MeshFileStream& stream) const { return m_file.GetData() + stream.offset; }
+    const void* GetIndices() const { return m_file.GetData() + m_pHeader->indexOffset; }
+private:
+    MappedFile m_file;
+    const MeshFileHeader* m_pHeader = nullptr;
+};
@@ -0,0 +1,414 @@
+#include "MeshGenerator.h"
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+
+namespace
+{
+    const float Pi = 3.14159265358979f;
+    // Below this many vertices waking the workers costs more than it saves
+    const uint64_t MinParallelVertices = 1 << 14;
+
+    void ForEachRow(WorkerPool* pPool, uint64_t vertexCount, size_t rowCount, const std::function<void(size_t)>& func)
+    {
+        if (pPool != nullptr && vertexCount >= MinParallelVertices && rowCount > 1)
+        {
+            pPool->ParallelFor(rowCount, func);
+        }
+        else
+        {
+            for (size_t row = 0; row < rowCount; row++)
+            {
+                func(row);
+            }
+        }
+    }
+
+    template <typename Index>
+    bool Allocate(GeneratedMesh<Index>& mesh, uint64_t vertexCount, uint64_t indexCount)
+    {
+        mesh.vertices.clear();
+        mesh.indices.clear();
+        if (vertexCount == 0 || vertexCount - 1 > std::numeric_limits<Index>::max() || indexCount > std::numeric_limits<uint32_t>::max())
+            return false;
+        mesh.vertices.resize(size_t(vertexCount));
+        mesh.indices.resize(size_t(indexCount));
+        return true;
+    }
+
+    MeshVertex MakeVertex(const float* position, const float* normal, float u, float v)
+    {
+        return { position[0], position[1], position[2], normal[0], normal[1], normal[2], u, v };
+    }
+
+    // Point on a sphere from its unit direction; u follows the angle around y
+    // as GenerateUVSphere lays it out, v runs from the +y pole to the -y pole
+    MeshVertex MakeSphereVertex(const float* direction, float radius)
+    {
+        const float position[3] = { direction[0] * radius, direction[1] * radius, direction[2] * radius };
+        float u = atan2f(-direction[2], direction[0]) / (2.0f * Pi);
+        if (u < 0.0f)
+            u += 1.0f;
+        const float v = acosf(std::min(1.0f, std::max(-1.0f, direction[1]))) / Pi;
+        return MakeVertex(position, direction, u, v);
+    }
+
+    // One row of a grid laid out row after row with columns + 1 vertices each,
+    // two triangles per cell: (a, b, b + 1) and (a, b + 1, a + 1) with b the
+    // vertex below a. Outward is cross(d/drow, d/dcolumn).
+    template <typename Index>
+    void WriteGridRow(Index* pOut, uint32_t base, uint32_t row, uint32_t columns, bool first, bool second)
+    {
+        for (uint32_t col = 0; col < columns; col++)
+        {
+            const uint32_t a = base + row * (columns + 1) + col;
+            const uint32_t b = a + columns + 1;
+            if (first)
+            {
+                *pOut++ = Index(a);
+                *pOut++ = Index(b);
+                *pOut++ = Index(b + 1);
+            }
+            if (second)
+            {
+                *pOut++ = Index(a);
+                *pOut++ = Index(b + 1);
+                *pOut++ = Index(a + 1);
+            }
+        }
+    }
+
+    void Normalize(float* v)
+    {
+        const float length = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+        v[0] /= length;
+        v[1] /= length;
+        v[2] /= length;
+    }
+
+    // Icosahedron with outward facing clockwise (in D3D terms) faces
+    const float GoldenRatio = 1.61803398875f;
+    const float IcosahedronVertices[12][3] = {
+        { -1.0f, GoldenRatio, 0.0f }, { 1.0f, GoldenRatio, 0.0f }, { -1.0f, -GoldenRatio, 0.0f }, { 1.0f, -GoldenRatio, 0.0f },
+        { 0.0f, -1.0f, GoldenRatio }, { 0.0f, 1.0f, GoldenRatio }, { 0.0f, -1.0f, -GoldenRatio }, { 0.0f, 1.0f, -GoldenRatio },
+        { GoldenRatio, 0.0f, -1.0f }, { GoldenRatio, 0.0f, 1.0f }, { -GoldenRatio, 0.0f, -1.0f }, { -GoldenRatio, 0.0f, 1.0f },
+    };
+    const uint8_t IcosahedronFaces[20][3] = {
+        { 0, 11, 5 }, { 0, 5, 1 }, { 0, 1, 7 }, { 0, 7, 10 }, { 0, 10, 11 },
+        { 1, 5, 9 }, { 5, 11, 4 }, { 11, 10, 2 }, { 10, 7, 6 }, { 7, 1, 8 },
+        { 3, 9, 4 }, { 3, 4, 2 }, { 3, 2, 6 }, { 3, 6, 8 }, { 3, 8, 9 },
+        { 4, 9, 5 }, { 2, 4, 11 }, { 6, 2, 10 }, { 8, 6, 7 }, { 9, 8, 1 },
+    };
+    const uint32_t IcosahedronEdgeCount = 30;
+
+    // Vertex numbering shared by all faces: the 12 corners, then n - 1 points
+    // per edge from its lower to its higher corner, then each face's interior
+    // row by row. Faces touching an edge agree on its vertices without talking.
+    struct IcosphereLayout
+    {
+        uint32_t n;
+        uint8_t edgeIds[12][12];
+        uint8_t edges[IcosahedronEdgeCount][2];
+        float corners[12][3];
+
+        explicit IcosphereLayout(uint32_t frequency)
+            : n(frequency)
+        {
+            uint32_t edgeCount = 0;
+            for (int f = 0; f < 20; f++)
+            {
+                for (int e = 0; e < 3; e++)
+                {
+                    uint8_t p = IcosahedronFaces[f][e];
+                    uint8_t q = IcosahedronFaces[f][(e + 1) % 3];
+                    if (p > q)
+                        std::swap(p, q);
+                    // Every edge shows up in two faces, the first one numbers it
+                    bool known = false;
+                    for (uint32_t i = 0; i < edgeCount && !known; i++)
+                    {
+                        known = edges[i][0] == p && edges[i][1] == q;
+                    }
+                    if (!known)
+                    {
+                        edges[edgeCount][0] = p;
+                        edges[edgeCount][1] = q;
+                        edgeIds[p][q] = edgeIds[q][p] = uint8_t(edgeCount);
+                        edgeCount++;
+                    }
+                }
+            }
+            for (int v = 0; v < 12; v++)
+            {
+                for (int axis = 0; axis < 3; axis++)
+                {
+                    corners[v][axis] = IcosahedronVertices[v][axis];
+                }
+                Normalize(corners[v]);
+            }
+        }
+
+        uint64_t GetVertexCount() const { return 10ull * n * n + 2; }
+        uint32_t GetInteriorBase() const { return 12 + IcosahedronEdgeCount * (n - 1); }
+        uint32_t GetInteriorPerFace() const { return (n - 1) * (n - 2) / 2; }
+
+        // k-th of the n - 1 points going from corner from to corner to
+        uint32_t GetEdgeVertex(uint32_t from, uint32_t to, uint32_t k) const
+        {
+            const uint32_t base = 12 + edgeIds[from][to] * (n - 1);
+            return from < to ? base + k - 1 : base + (n - k) - 1;
+        }
+
+        // Point (i, j) of a face, 0 <= j <= i <= n; row i lies between a + i/n (b - a) and a + i/n (c - a)
+        uint32_t GetVertex(uint32_t face, uint32_t i, uint32_t j) const
+        {
+            const uint8_t* corner = IcosahedronFaces[face];
+            if (i == 0)
+                return corner[0];
+            if (i == n)
+            {
+                if (j == 0)
+                    return corner[1];
+                if (j == n)
+                    return corner[2];
+                return GetEdgeVertex(corner[1], corner[2], j);
+            }
+            if (j == 0)
+                return GetEdgeVertex(corner[0], corner[1], i);
+            if (j == i)
+                return GetEdgeVertex(corner[0], corner[2], i);
+            return GetInteriorBase() + face * GetInteriorPerFace() + (i - 1) * (i - 2) / 2 + (j - 1);
+        }
+    };
+}
+
+template <typename Index>
+bool GenerateUVSphere(float radius, uint32_t rings, uint32_t segments, GeneratedMesh<Index>& mesh, WorkerPool* pPool)
+{
+    if (rings < 2 || segments < 3)
+        return false;
+    const uint64_t vertexCount = uint64_t(rings + 1) * (segments + 1);
+    // The first and the last ring have one triangle per segment, the rest two
+    if (!Allocate(mesh, vertexCount, uint64_t(segments) * (2 * rings - 2) * 3))
+        return false;
+
+    MeshVertex* pVertices = mesh.vertices.data();
+    Index* pIndices = mesh.indices.data();
+    ForEachRow(pPool, vertexCount, rings + 1, [=](size_t ring)
+    {
+        const float beta = Pi * float(ring) / float(rings);
+        for (uint32_t segment = 0; segment <= segments; segment++)
+        {
+            const float alpha = 2.0f * Pi * float(segment) / float(segments);
+            const float direction[3] = { sinf(beta) * cosf(alpha), cosf(beta), -sinf(beta) * sinf(alpha) };
+            const float position[3] = { direction[0] * radius, direction[1] * radius, direction[2] * radius };
+            pVertices[ring * (segments + 1) + segment] = MakeVertex(position, direction,
+                float(segment) / float(segments), float(ring) / float(rings));
+        }
+        if (ring < rings)
+        {
+            const size_t firstTriangle = ring == 0 ? 0 : segments * (2 * ring - 1);
+            WriteGridRow(pIndices + firstTriangle * 3, 0, uint32_t(ring), segments, ring + 1 < rings, ring > 0);
+        }
+    });
+    return true;
+}
+
+template <typename Index>
+bool GenerateIcosphere(float radius, uint32_t subdivisions, GeneratedMesh<Index>& mesh, WorkerPool* pPool)
+{
+    if (subdivisions > 14)
+        return false;
+    const IcosphereLayout layout(1u << subdivisions);
+    const uint32_t n = layout.n;
+    const uint64_t vertexCount = layout.GetVertexCount();
+    if (!Allocate(mesh, vertexCount, 20ull * n * n * 3))
+        return false;
+
+    MeshVertex* pVertices = mesh.vertices.data();
+    Index* pIndices = mesh.indices.data();
+    for (int v = 0; v < 12; v++)
+    {
+        pVertices[v] = MakeSphereVertex(layout.corners[v], radius);
+    }
+    // Edges first, the faces only write their own interior
+    ForEachRow(pPool, vertexCount, IcosahedronEdgeCount, [&](size_t edge)
+    {
+        const float* p = layout.corners[layout.edges[edge][0]];
+        const float* q = layout.corners[layout.edges[edge][1]];
+        for (uint32_t k = 1; k < n; k++)
+        {
+            const float t = float(k) / float(n);
+            float direction[3] = { p[0] + (q[0] - p[0]) * t, p[1] + (q[1] - p[1]) * t, p[2] + (q[2] - p[2]) * t };
+            Normalize(direction);
+            pVertices[12 + edge * (n - 1) + k - 1] = MakeSphereVertex(direction, radius);
+        }
+    });
+    ForEachRow(pPool, vertexCount, size_t(20) * n, [&](size_t task)
+    {
+        const uint32_t face = uint32_t(task / n);
+        const uint32_t i = uint32_t(task % n);
+        const float* a = layout.corners[IcosahedronFaces[face][0]];
+        const float* b = layout.corners[IcosahedronFaces[face][1]];
+        const float* c = layout.corners[IcosahedronFaces[face][2]];
+        for (uint32_t j = 1; j < i; j++)
+        {
+            const float s = float(i) / float(n);
+            const float t = float(j) / float(n);
+            float direction[3];
+            for (int axis = 0; axis < 3; axis++)
+            {
+                direction[axis] = a[axis] + (b[axis] - a[axis]) * s + (c[axis] - b[axis]) * t;
+            }
+            Normalize(direction);
+            pVertices[layout.GetVertex(face, i, j)] = MakeSphereVertex(direction, radius);
+        }
+
+        // Row i holds 2i + 1 triangles, i^2 come before it in the face
+        Index* pOut = pIndices + (size_t(face) * n * n + size_t(i) * i) * 3;
+        uint32_t upper = layout.GetVertex(face, i, 0);
+        uint32_t lower = layout.GetVertex(face, i + 1, 0);
+        for (uint32_t j = 0; j <= i; j++)
+        {
+            const uint32_t lowerNext = layout.GetVertex(face, i + 1, j + 1);
+            *pOut++ = Index(upper);
+            *pOut++ = Index(lower);
+            *pOut++ = Index(lowerNext);
+            if (j < i)
+            {
+                const uint32_t upperNext = layout.GetVertex(face, i, j + 1);
+                *pOut++ = Index(upper);
+                *pOut++ = Index(lowerNext);
+                *pOut++ = Index(upperNext);
+                upper = upperNext;
+            }
+            lower = lowerNext;
+        }
+    });
+    return true;
+}
+
+template <typename Index>
+bool GenerateCube(float halfExtent, uint32_t segments, GeneratedMesh<Index>& mesh, WorkerPool* pPool)
+{
+    if (segments < 1)
+        return false;
+    // Outward normal, then the row and column directions with cross(row, column) = normal
+    static const float Faces[6][3][3] = {
+        { { 1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 1.0f } },
+        { { -1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, -1.0f } },
+        { { 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 1.0f }, { 1.0f, 0.0f, 0.0f } },
+        { { 0.0f, -1.0f, 0.0f }, { 0.0f, 0.0f, -1.0f }, { 1.0f, 0.0f, 0.0f } },
+        { { 0.0f, 0.0f, 1.0f }, { 0.0f, 1.0f, 0.0f }, { -1.0f, 0.0f, 0.0f } },
+        { { 0.0f, 0.0f, -1.0f }, { 0.0f, 1.0f, 0.0f }, { 1.0f, 0.0f, 0.0f } },
+    };
+    const uint32_t faceVertices = (segments + 1) * (segments + 1);
+    const uint64_t vertexCount = 6ull * faceVertices;
+    if (!Allocate(mesh, vertexCount, 6ull * segments * segments * 6))
+        return false;
+
+    MeshVertex* pVertices = mesh.vertices.data();
+    Index* pIndices = mesh.indices.data();
+    ForEachRow(pPool, vertexCount, size_t(6) * (segments + 1), [=](size_t task)
+    {
+        const uint32_t face = uint32_t(task / (segments + 1));
+        const uint32_t row = uint32_t(task % (segments + 1));
+        const float* normal = Faces[face][0];
+        const float* rowAxis = Faces[face][1];
+        const float* columnAxis = Faces[face][2];
+        const float s = 2.0f * float(row) / float(segments) - 1.0f;
+        for (uint32_t column = 0; column <= segments; column++)
+        {
+            const float t = 2.0f * float(column) / float(segments) - 1.0f;
+            float position[3];
+            for (int axis = 0; axis < 3; axis++)
+            {
+                position[axis] = (normal[axis] + rowAxis[axis] * s + columnAxis[axis] * t) * halfExtent;
+            }
+            pVertices[face * faceVertices + row * (segments + 1) + column] = MakeVertex(position, normal,
+                float(column) / float(segments), 1.0f - float(row) / float(segments));
+        }
+        if (row < segments)
+        {
+            WriteGridRow(pIndices + (size_t(face) * segments + row) * segments * 6, face * faceVertices, row, segments, true, true);
+        }
+    });
+    return true;
+}
+
+template <typename Index>
+bool GeneratePlane(float width, float depth, uint32_t xSegments, uint32_t zSegments, GeneratedMesh<Index>& mesh, WorkerPool* pPool)
+{
+    if (xSegments < 1 || zSegments < 1)
+        return false;
+    const uint64_t vertexCount = uint64_t(xSegments + 1) * (zSegments + 1);
+    if (!Allocate(mesh, vertexCount, uint64_t(xSegments) * zSegments * 6))
+        return false;
+
+    MeshVertex* pVertices = mesh.vertices.data();
+    Index* pIndices = mesh.indices.data();
+    // Rows go along +z and columns along +x, cross(z, x) = +y
+    ForEachRow(pPool, vertexCount, zSegments + 1, [=](size_t row)
+    {
+        static const float Normal[3] = { 0.0f, 1.0f, 0.0f };
+        const float v = float(row) / float(zSegments);
+        for (uint32_t column = 0; column <= xSegments; column++)
+        {
+            const float u = float(column) / float(xSegments);
+            const float position[3] = { (u - 0.5f) * width, 0.0f, (v - 0.5f) * depth };
+            pVertices[row * (xSegments + 1) + column] = MakeVertex(position, Normal, u, 1.0f - v);
+        }
+        if (row < zSegments)
+        {
+            WriteGridRow(pIndices + row * xSegments * 6, 0, uint32_t(row), xSegments, true, true);
+        }
+    });
+    return true;
+}
+
+template <typename Index>
+bool GenerateTorus(float majorRadius, float minorRadius, uint32_t majorSegments, uint32_t minorSegments,
+    GeneratedMesh<Index>& mesh, WorkerPool* pPool)
+{
+    if (majorSegments < 3 || minorSegments < 3)
+        return false;
+    const uint64_t vertexCount = uint64_t(majorSegments + 1) * (minorSegments + 1);
+    if (!Allocate(mesh, vertexCount, uint64_t(majorSegments) * minorSegments * 6))
+        return false;
+
+    MeshVertex* pVertices = mesh.vertices.data();
+    Index* pIndices = mesh.indices.data();
+    // Rows go around y, columns around the tube; the seam vertices repeat for the texture coordinates
+    ForEachRow(pPool, vertexCount, majorSegments + 1, [=](size_t row)
+    {
+        const float theta = 2.0f * Pi * float(row) / float(majorSegments);
+        for (uint32_t column = 0; column <= minorSegments; column++)
+        {
+            const float phi = 2.0f * Pi * float(column) / float(minorSegments);
+            const float normal[3] = { cosf(phi) * cosf(theta), sinf(phi), -cosf(phi) * sinf(theta) };
+            const float ring = majorRadius + minorRadius * cosf(phi);
+            const float position[3] = { ring * cosf(theta), minorRadius * sinf(phi), -ring * sinf(theta) };
+            pVertices[row * (minorSegments + 1) + column] = MakeVertex(position, normal,
+                float(row) / float(majorSegments), float(column) / float(minorSegments));
+        }
+        if (row < majorSegments)
+        {
+            WriteGridRow(pIndices + row * minorSegments * 6, 0, uint32_t(row), minorSegments, true, true);
+        }
+    });
+    return true;
+}
+
+template bool GenerateUVSphere<uint16_t>(float, uint32_t, uint32_t, GeneratedMesh<uint16_t>&, WorkerPool*);
+template bool GenerateUVSphere<uint32_t>(float, uint32_t, uint32_t, GeneratedMesh<uint32_t>&, WorkerPool*);
+template bool GenerateIcosphere<uint16_t>(float, uint32_t, GeneratedMesh<uint16_t>&, WorkerPool*);
+template bool GenerateIcosphere<uint32_t>(float, uint32_t, GeneratedMesh<uint32_t>&, WorkerPool*);
+template bool GenerateCube<uint16_t>(float, uint32_t, GeneratedMesh<uint16_t>&, WorkerPool*);
+template bool GenerateCube<uint32_t>(float, uint32_t, GeneratedMesh<uint32_t>&, WorkerPool*);
+template bool GeneratePlane<uint16_t>(float, float, uint32_t, uint32_t, GeneratedMesh<uint16_t>&, WorkerPool*);
+template bool GeneratePlane<uint32_t>(float, float, uint32_t, uint32_t, GeneratedMesh<uint32_t>&, WorkerPool*);
+template bool GenerateTorus<uint16_t>(float, float, uint32_t, uint32_t, GeneratedMesh<uint16_t>&, WorkerPool*);
+template bool GenerateTorus<uint32_t>(float, float, uint32_t, uint32_t, GeneratedMesh<uint32_t>&, WorkerPool*);
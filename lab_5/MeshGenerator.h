@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class WorkerPool;
+
+// Position first, so every mesh function taking a float3 at the start of each
+// vertex works on these directly
+struct MeshVertex
+{
+    float x, y, z;
+    float nx, ny, nz;
+    float u, v;
+};
+
+// Index is uint16_t or uint32_t
+template <typename Index>
+struct GeneratedMesh
+{
+    std::vector<MeshVertex> vertices;
+    std::vector<Index> indices;
+};
+
+// Procedural shapes centered on the origin. Front faces are clockwise seen
+// from outside, as D3D11 culls by default. Vertex and index counts are known
+// up front, so big tessellations are written row by row on the pool; without
+// one, or for small meshes, everything runs on the calling thread.
+// Each returns false, leaving the mesh empty, if the parameters are out of
+// range or the vertices don't fit the index type.
+
+// rings run from pole to pole, segments around the y axis; poles repeat per segment
+template <typename Index>
+bool GenerateUVSphere(float radius, uint32_t rings, uint32_t segments, GeneratedMesh<Index>& mesh, WorkerPool* pPool = nullptr);
+
+// Every icosahedron face split into 4^subdivisions triangles, shared edges welded
+template <typename Index>
+bool GenerateIcosphere(float radius, uint32_t subdivisions, GeneratedMesh<Index>& mesh, WorkerPool* pPool = nullptr);
+
+// segments per face edge, faces don't share vertices so normals stay flat
+template <typename Index>
+bool GenerateCube(float halfExtent, uint32_t segments, GeneratedMesh<Index>& mesh, WorkerPool* pPool = nullptr);
+
+// In the xz plane facing +y
+template <typename Index>
+bool GeneratePlane(float width, float depth, uint32_t xSegments, uint32_t zSegments, GeneratedMesh<Index>& mesh, WorkerPool* pPool = nullptr);
+
+// Around the y axis; majorRadius to the tube's center, minorRadius of the tube
+template <typename Index>
+bool GenerateTorus(float majorRadius, float minorRadius, uint32_t majorSegments, uint32_t minorSegments,
+    GeneratedMesh<Index>& mesh, WorkerPool* pPool = nullptr);
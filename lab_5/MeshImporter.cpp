@@ -0,0 +1,318 @@
+#include "MeshImporter.h"
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unordered_map>
+
+namespace
+{
+    struct ObjVertexKey
+    {
+        uint32_t position;
+        uint32_t texCoord;
+        uint32_t normal;
+
+        bool operator==(const ObjVertexKey& other) const
+        {
+            return position == other.position && texCoord == other.texCoord && normal == other.normal;
+        }
+    };
+
+    struct ObjVertexKeyHash
+    {
+        size_t operator()(const ObjVertexKey& key) const
+        {
+            return size_t(key.position * 0x9E3779B1u ^ key.texCoord * 0x85EBCA77u ^ key.normal * 0xC2B2AE3Du);
+        }
+    };
+
+    bool ReadFile(const char* path, std::vector<char>& data)
+    {
+        FILE* pFile = nullptr;
+#ifdef _MSC_VER
+        fopen_s(&pFile, path, "rb");
+#else
+        pFile = fopen(path, "rb");
+#endif
+        if (pFile == nullptr)
+            return false;
+        data.clear();
+        char buffer[1 << 16];
+        size_t size;
+        while ((size = fread(buffer, 1, sizeof(buffer), pFile)) > 0)
+        {
+            data.insert(data.end(), buffer, buffer + size);
+        }
+        fclose(pFile);
+        // strtof and strtol stop at the terminator instead of running off the end
+        data.push_back('\0');
+        return true;
+    }
+
+    const char* SkipSpaces(const char* p)
+    {
+        while (*p == ' ' || *p == '\t')
+            p++;
+        return p;
+    }
+
+    const char* NextLine(const char* p)
+    {
+        while (*p != '\0' && *p != '\n')
+            p++;
+        return *p == '\n' ? p + 1 : p;
+    }
+
+    void ReadFloats(const char* p, float* values, int count)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            char* pEnd;
+            values[i] = strtof(p, &pEnd);
+            p = pEnd;
+        }
+    }
+
+    // 1 based, negative counts back from the last element; 0 when out of range
+    uint32_t ResolveIndex(long idx, size_t count)
+    {
+        if (idx > 0 && size_t(idx) <= count)
+            return uint32_t(idx);
+        if (idx < 0 && size_t(-idx) <= count)
+            return uint32_t(count + 1 - size_t(-idx));
+        return 0;
+    }
+
+    bool Fail(std::string* pError, const char* message, size_t line)
+    {
+        if (pError != nullptr)
+            *pError = std::string(message) + " on line " + std::to_string(line);
+        return false;
+    }
+
+    void ComputeNormals(ImportedMesh& mesh)
+    {
+        for (MeshVertex& vertex : mesh.vertices)
+        {
+            vertex.nx = vertex.ny = vertex.nz = 0.0f;
+        }
+        // Unnormalized face normals, bigger triangles weigh more
+        for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+        {
+            MeshVertex* v[3] = { &mesh.vertices[mesh.indices[i]], &mesh.vertices[mesh.indices[i + 1]], &mesh.vertices[mesh.indices[i + 2]] };
+            const float e1[3] = { v[1]->x - v[0]->x, v[1]->y - v[0]->y, v[1]->z - v[0]->z };
+            const float e2[3] = { v[2]->x - v[0]->x, v[2]->y - v[0]->y, v[2]->z - v[0]->z };
+            const float normal[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+            for (MeshVertex* pVertex : v)
+            {
+                pVertex->nx += normal[0];
+                pVertex->ny += normal[1];
+                pVertex->nz += normal[2];
+            }
+        }
+        for (MeshVertex& vertex : mesh.vertices)
+        {
+            const float length = sqrtf(vertex.nx * vertex.nx + vertex.ny * vertex.ny + vertex.nz * vertex.nz);
+            if (length > 0.0f)
+            {
+                vertex.nx /= length;
+                vertex.ny /= length;
+                vertex.nz /= length;
+            }
+        }
+        mesh.hasNormals = true;
+    }
+
+    template <typename Packed>
+    MeshFileStreamData MakeStream(MeshStreamFormat format, size_t vertexCount)
+    {
+        MeshFileStreamData stream;
+        stream.format = format;
+        stream.stride = sizeof(Packed);
+        stream.data.resize(vertexCount * sizeof(Packed));
+        return stream;
+    }
+}
+
+bool ImportObj(const char* path, ImportedMesh& mesh, std::string* pError)
+{
+    mesh = ImportedMesh();
+    std::vector<char> text;
+    if (!ReadFile(path, text))
+    {
+        if (pError != nullptr)
+            *pError = std::string("Can't open ") + path;
+        return false;
+    }
+
+    std::vector<float> positions;
+    std::vector<float> texCoords;
+    std::vector<float> normals;
+    std::unordered_map<ObjVertexKey, uint32_t, ObjVertexKeyHash> vertexIds;
+    std::vector<uint32_t> polygon;
+    // Normals are only kept when every face vertex has one, otherwise they are all computed
+    bool allNormals = true;
+
+    size_t line = 1;
+    for (const char* p = text.data(); *p != '\0'; p = NextLine(p), line++)
+    {
+        p = SkipSpaces(p);
+        if (p[0] == 'v' && (p[1] == ' ' || p[1] == '\t'))
+        {
+            float values[3];
+            ReadFloats(p + 2, values, 3);
+            positions.insert(positions.end(), values, values + 3);
+        }
+        else if (p[0] == 'v' && p[1] == 't' && (p[2] == ' ' || p[2] == '\t'))
+        {
+            float values[2];
+            ReadFloats(p + 3, values, 2);
+            texCoords.insert(texCoords.end(), values, values + 2);
+        }
+        else if (p[0] == 'v' && p[1] == 'n' && (p[2] == ' ' || p[2] == '\t'))
+        {
+            float values[3];
+            ReadFloats(p + 3, values, 3);
+            normals.insert(normals.end(), values, values + 3);
+        }
+        else if (p[0] == 'f' && (p[1] == ' ' || p[1] == '\t'))
+        {
+            polygon.clear();
+            p = SkipSpaces(p + 2);
+            while (*p != '\0' && *p != '\n' && *p != '\r' && *p != '#')
+            {
+                // v, v/vt, v//vn or v/vt/vn
+                char* pEnd;
+                ObjVertexKey key = { ResolveIndex(strtol(p, &pEnd, 10), positions.size() / 3), 0, 0 };
+                if (pEnd == p || key.position == 0)
+                    return Fail(pError, "Bad position index", line);
+                p = pEnd;
+                if (*p == '/')
+                {
+                    p++;
+                    if (*p != '/')
+                    {
+                        key.texCoord = ResolveIndex(strtol(p, &pEnd, 10), texCoords.size() / 2);
+                        if (pEnd == p || key.texCoord == 0)
+                            return Fail(pError, "Bad texture coordinate index", line);
+                        p = pEnd;
+                    }
+                    if (*p == '/')
+                    {
+                        p++;
+                        key.normal = ResolveIndex(strtol(p, &pEnd, 10), normals.size() / 3);
+                        if (pEnd == p || key.normal == 0)
+                            return Fail(pError, "Bad normal index", line);
+                        p = pEnd;
+                    }
+                }
+
+                auto inserted = vertexIds.insert({ key, uint32_t(mesh.vertices.size()) });
+                if (inserted.second)
+                {
+                    // Mirrored along z for the left handed view space, v flipped for top left texture origins
+                    const float* position = &positions[(key.position - 1) * 3];
+                    MeshVertex vertex = { position[0], position[1], -position[2], 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+                    if (key.texCoord != 0)
+                    {
+                        vertex.u = texCoords[(key.texCoord - 1) * 2];
+                        vertex.v = 1.0f - texCoords[(key.texCoord - 1) * 2 + 1];
+                    }
+                    if (key.normal != 0)
+                    {
+                        const float* normal = &normals[(key.normal - 1) * 3];
+                        vertex.nx = normal[0];
+                        vertex.ny = normal[1];
+                        vertex.nz = -normal[2];
+                    }
+                    mesh.vertices.push_back(vertex);
+                }
+                polygon.push_back(inserted.first->second);
+                mesh.hasTexCoords |= key.texCoord != 0;
+                allNormals &= key.normal != 0;
+                p = SkipSpaces(p);
+            }
+            if (polygon.size() < 3)
+                return Fail(pError, "Face with less than 3 vertices", line);
+            // Mirrored or not, counter clockwise stays counter clockwise on screen, so the fan is reversed
+            for (size_t i = 2; i < polygon.size(); i++)
+            {
+                mesh.indices.push_back(polygon[0]);
+                mesh.indices.push_back(polygon[i]);
+                mesh.indices.push_back(polygon[i - 1]);
+            }
+        }
+    }
+
+    if (mesh.indices.empty())
+    {
+        if (pError != nullptr)
+            *pError = std::string("No faces in ") + path;
+        return false;
+    }
+    mesh.hasNormals = allNormals;
+    return true;
+}
+
+void BuildMeshFileData(ImportedMesh& mesh, MeshFileData& result)
+{
+    result = MeshFileData();
+    if (mesh.indices.empty())
+        return;
+    if (!mesh.hasNormals)
+        ComputeNormals(mesh);
+
+    mesh.vertices.resize(OptimizeMesh(mesh.indices.data(), mesh.indices.size(), mesh.vertices.data(), mesh.vertices.size(), sizeof(MeshVertex)));
+    const float* positions = &mesh.vertices[0].x;
+    const size_t vertexCount = mesh.vertices.size();
+
+    MeshLodChain lods;
+    lods.Build(positions, vertexCount, sizeof(MeshVertex), mesh.indices.data(), mesh.indices.size());
+    result.indices = lods.GetIndices();
+    for (uint32_t level = 0; level < lods.GetLevelCount(); level++)
+    {
+        result.lods.push_back(lods.GetLevel(level));
+    }
+
+    result.vertexCount = uint32_t(vertexCount);
+    result.quantization = ComputeQuantization(positions, vertexCount, sizeof(MeshVertex));
+    // The sphere is centered like the LOD chain's so its radius matches the LOD errors
+    for (int axis = 0; axis < 3; axis++)
+    {
+        result.boundsMin[axis] = (&mesh.vertices[0].x)[axis];
+        result.boundsMax[axis] = (&mesh.vertices[0].x)[axis];
+    }
+    for (const MeshVertex& vertex : mesh.vertices)
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            const float value = (&vertex.x)[axis];
+            result.boundsMin[axis] = std::min(result.boundsMin[axis], value);
+            result.boundsMax[axis] = std::max(result.boundsMax[axis], value);
+            result.boundingSphere[axis] += value / float(vertexCount);
+        }
+    }
+    result.boundingSphere[3] = lods.GetRadius();
+
+    if (mesh.hasTexCoords)
+    {
+        MeshFileStreamData stream = MakeStream<PackedTextureVertex>(MeshStreamPackedTextureVertex, vertexCount);
+        PackTextureVertices(positions, &mesh.vertices[0].u, vertexCount, sizeof(MeshVertex), result.quantization,
+            reinterpret_cast<PackedTextureVertex*>(stream.data.data()));
+        result.streams.push_back(std::move(stream));
+    }
+    else
+    {
+        MeshFileStreamData stream = MakeStream<PackedPosition>(MeshStreamPackedPosition, vertexCount);
+        PackPositions(positions, vertexCount, sizeof(MeshVertex), result.quantization,
+            reinterpret_cast<PackedPosition*>(stream.data.data()));
+        result.streams.push_back(std::move(stream));
+    }
+    MeshFileStreamData normals = MakeStream<PackedNormal>(MeshStreamPackedNormal, vertexCount);
+    PackNormals(&mesh.vertices[0].nx, vertexCount, sizeof(MeshVertex), reinterpret_cast<PackedNormal*>(normals.data.data()));
+    result.streams.push_back(std::move(normals));
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "MeshFile.h"
+#include "MeshGenerator.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct ImportedMesh
+{
+    std::vector<MeshVertex> vertices;
+    std::vector<uint32_t> indices;
+    bool hasTexCoords = false;
+    bool hasNormals = false;
+};
+
+// Wavefront OBJ: v, vt and vn with f faces, polygons are split into fans and
+// every distinct position/uv/normal triple becomes one vertex. Other statements
+// are skipped. OBJ is right handed with counter clockwise front faces and v
+// going up; the result is flipped along z, in winding and in v to match the renderer.
+// Returns false with a message in pError on unreadable input.
+bool ImportObj(const char* path, ImportedMesh& mesh, std::string* pError = nullptr);
+
+// Offline half of the pipeline: computes missing normals, optimizes the mesh
+// in place, builds its LOD chain and packs the vertex streams the renderer
+// binds. Meshes with texture coordinates get a PackedTextureVertex stream,
+// the rest a PackedPosition one; both also get a PackedNormal stream.
+void BuildMeshFileData(ImportedMesh& mesh, MeshFileData& result);
@@ -0,0 +1,440 @@
+#include "MeshLod.h"
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <unordered_set>
+
+// Open edges are held in place by a plane through them, weighted well above a
+// regular triangle so the border outline survives simplification
+static const double BorderWeight = 10.0;
+// Cosine of the largest normal rotation a collapse may cause
+static const double MaxNormalTurn = 0.25;
+
+namespace
+{
+    // Symmetric 4x4 plane quadric plus the accumulated plane weight
+    struct Quadric
+    {
+        double a00, a01, a02, a03;
+        double a11, a12, a13;
+        double a22, a23;
+        double a33;
+        double weight;
+    };
+
+    enum VertexKind : uint8_t
+    {
+        VertexManifold,
+        VertexBorder,
+        VertexLocked,
+    };
+
+    enum TouchedState : uint8_t
+    {
+        TouchedNone,
+        TouchedPinned,
+        TouchedCollapsed,
+    };
+
+    struct Collapse
+    {
+        uint32_t from;
+        uint32_t to;
+        double cost;
+    };
+
+    struct Vec3
+    {
+        double x, y, z;
+    };
+}
+
+static Vec3 Sub(const Vec3& a, const Vec3& b)
+{
+    return { a.x - b.x, a.y - b.y, a.z - b.z };
+}
+
+static Vec3 Cross(const Vec3& a, const Vec3& b)
+{
+    return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+}
+
+static double Dot(const Vec3& a, const Vec3& b)
+{
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+static void AddPlane(Quadric& q, const Vec3& n, double d, double weight)
+{
+    q.a00 += weight * n.x * n.x;
+    q.a01 += weight * n.x * n.y;
+    q.a02 += weight * n.x * n.z;
+    q.a03 += weight * n.x * d;
+    q.a11 += weight * n.y * n.y;
+    q.a12 += weight * n.y * n.z;
+    q.a13 += weight * n.y * d;
+    q.a22 += weight * n.z * n.z;
+    q.a23 += weight * n.z * d;
+    q.a33 += weight * d * d;
+    q.weight += weight;
+}
+
+static void AddQuadric(Quadric& q, const Quadric& other)
+{
+    q.a00 += other.a00;
+    q.a01 += other.a01;
+    q.a02 += other.a02;
+    q.a03 += other.a03;
+    q.a11 += other.a11;
+    q.a12 += other.a12;
+    q.a13 += other.a13;
+    q.a22 += other.a22;
+    q.a23 += other.a23;
+    q.a33 += other.a33;
+    q.weight += other.weight;
+}
+
+// Weighted mean squared distance from p to the planes of q
+static double EvaluateQuadric(const Quadric& q, const Vec3& p)
+{
+    double error = q.a00 * p.x * p.x + q.a11 * p.y * p.y + q.a22 * p.z * p.z + q.a33
+        + 2.0 * (q.a01 * p.x * p.y + q.a02 * p.x * p.z + q.a12 * p.y * p.z)
+        + 2.0 * (q.a03 * p.x + q.a13 * p.y + q.a23 * p.z);
+    return q.weight > 0.0 ? std::max(error, 0.0) / q.weight : 0.0;
+}
+
+static uint64_t EdgeKey(uint32_t a, uint32_t b)
+{
+    return (uint64_t(a) << 32) | b;
+}
+
+static uint64_t UndirectedEdgeKey(uint32_t a, uint32_t b)
+{
+    return a < b ? EdgeKey(a, b) : EdgeKey(b, a);
+}
+
+size_t SimplifyMesh(const float* positions, size_t vertexCount, size_t vertexStride,
+    const uint32_t* indices, size_t indexCount, size_t targetIndexCount, float maxError,
+    std::vector<uint32_t>& result, float* pResultError)
+{
+    assert(indexCount % 3 == 0);
+    std::vector<Vec3> points(vertexCount);
+    for (size_t i = 0; i < vertexCount; i++)
+    {
+        const float* p = reinterpret_cast<const float*>(reinterpret_cast<const char*>(positions) + i * vertexStride);
+        points[i] = { p[0], p[1], p[2] };
+    }
+
+    result.assign(indices, indices + indexCount);
+    double resultError = 0.0;
+
+    // Vertices sharing a position sit on an attribute seam, removing one of them would open a crack
+    std::vector<uint8_t> kind(vertexCount, VertexManifold);
+    {
+        std::vector<uint32_t> order(vertexCount);
+        for (size_t i = 0; i < vertexCount; i++)
+            order[i] = uint32_t(i);
+        auto lessPosition = [&points](uint32_t a, uint32_t b) {
+            const Vec3& pa = points[a];
+            const Vec3& pb = points[b];
+            if (pa.x != pb.x)
+                return pa.x < pb.x;
+            if (pa.y != pb.y)
+                return pa.y < pb.y;
+            return pa.z < pb.z;
+        };
+        std::sort(order.begin(), order.end(), lessPosition);
+        for (size_t i = 1; i < vertexCount; i++)
+        {
+            if (!lessPosition(order[i - 1], order[i]))
+                kind[order[i - 1]] = kind[order[i]] = VertexLocked;
+        }
+    }
+
+    std::vector<Quadric> quadrics(vertexCount);
+    memset(quadrics.data(), 0, quadrics.size() * sizeof(Quadric));
+    // Area weighted source normal of every vertex, what the surface looked like before any collapse
+    std::vector<Vec3> sourceNormals(vertexCount, Vec3{ 0.0, 0.0, 0.0 });
+    std::unordered_set<uint64_t> directedEdges;
+    for (size_t i = 0; i < indexCount; i += 3)
+    {
+        for (int e = 0; e < 3; e++)
+            directedEdges.insert(EdgeKey(indices[i + e], indices[i + (e + 1) % 3]));
+    }
+    for (size_t i = 0; i < indexCount; i += 3)
+    {
+        const Vec3& p0 = points[indices[i]];
+        Vec3 normal = Cross(Sub(points[indices[i + 1]], p0), Sub(points[indices[i + 2]], p0));
+        double length = sqrt(Dot(normal, normal));
+        if (length == 0.0)
+            continue;
+        Vec3 n = { normal.x / length, normal.y / length, normal.z / length };
+        double area = length * 0.5;
+        for (int e = 0; e < 3; e++)
+        {
+            AddPlane(quadrics[indices[i + e]], n, -Dot(n, p0), area);
+            Vec3& sourceNormal = sourceNormals[indices[i + e]];
+            sourceNormal = { sourceNormal.x + normal.x, sourceNormal.y + normal.y, sourceNormal.z + normal.z };
+        }
+
+        for (int e = 0; e < 3; e++)
+        {
+            uint32_t a = indices[i + e];
+            uint32_t b = indices[i + (e + 1) % 3];
+            if (directedEdges.count(EdgeKey(b, a)) != 0)
+                continue;
+            // Border edge: plane through the edge, perpendicular to the triangle
+            Vec3 edge = Sub(points[b], points[a]);
+            Vec3 side = Cross(edge, n);
+            double sideLength = sqrt(Dot(side, side));
+            if (sideLength == 0.0)
+                continue;
+            Vec3 sn = { side.x / sideLength, side.y / sideLength, side.z / sideLength };
+            double weight = Dot(edge, edge) * BorderWeight;
+            AddPlane(quadrics[a], sn, -Dot(sn, points[a]), weight);
+            AddPlane(quadrics[b], sn, -Dot(sn, points[a]), weight);
+            if (kind[a] == VertexManifold)
+                kind[a] = VertexBorder;
+            if (kind[b] == VertexManifold)
+                kind[b] = VertexBorder;
+        }
+    }
+
+    const double maxCost = double(maxError) * maxError;
+    std::vector<uint32_t> triangleOffsets(vertexCount + 1);
+    std::vector<uint32_t> vertexTriangles;
+    std::vector<uint64_t> edges;
+    std::vector<Collapse> collapses;
+    std::vector<uint8_t> touched(vertexCount);
+    std::vector<uint32_t> remap(vertexCount);
+
+    while (result.size() > targetIndexCount)
+    {
+        const size_t triangleCount = result.size() / 3;
+
+        // Triangles around every vertex, counting sort by vertex
+        std::fill(triangleOffsets.begin(), triangleOffsets.end(), 0);
+        for (uint32_t v : result)
+            triangleOffsets[v + 1]++;
+        for (size_t v = 0; v < vertexCount; v++)
+            triangleOffsets[v + 1] += triangleOffsets[v];
+        vertexTriangles.resize(result.size());
+        {
+            std::vector<uint32_t> fill(triangleOffsets.begin(), triangleOffsets.end() - 1);
+            for (size_t i = 0; i < result.size(); i++)
+                vertexTriangles[fill[result[i]]++] = uint32_t(i / 3);
+        }
+
+        // Undirected edges sorted by key; an edge seen once is on the border
+        edges.clear();
+        for (size_t i = 0; i < result.size(); i += 3)
+        {
+            for (int e = 0; e < 3; e++)
+                edges.push_back(UndirectedEdgeKey(result[i + e], result[i + (e + 1) % 3]));
+        }
+        std::sort(edges.begin(), edges.end());
+
+        // Every edge once, in its cheaper allowed direction
+        collapses.clear();
+        for (size_t i = 0; i < edges.size();)
+        {
+            size_t next = i + 1;
+            while (next < edges.size() && edges[next] == edges[i])
+                next++;
+            bool border = next - i == 1;
+            uint32_t a = uint32_t(edges[i] >> 32);
+            uint32_t b = uint32_t(edges[i]);
+            i = next;
+
+            Collapse best = { 0, 0, -1.0 };
+            for (int dir = 0; dir < 2; dir++)
+            {
+                uint32_t from = dir == 0 ? a : b;
+                uint32_t to = dir == 0 ? b : a;
+                if (kind[from] == VertexLocked)
+                    continue;
+                // Border vertices may only slide along the border
+                if (kind[from] == VertexBorder && !border)
+                    continue;
+                Quadric q = quadrics[from];
+                AddQuadric(q, quadrics[to]);
+                double cost = EvaluateQuadric(q, points[to]);
+                if (best.cost < 0.0 || cost < best.cost)
+                    best = { from, to, cost };
+            }
+            if (best.cost >= 0.0 && best.cost <= maxCost)
+                collapses.push_back(best);
+        }
+        if (collapses.empty())
+            break;
+        std::sort(collapses.begin(), collapses.end(),
+            [](const Collapse& a, const Collapse& b) { return a.cost < b.cost; });
+
+        // Collapses within a pass must not interact: neighbours of a removed vertex stay
+        // in place, both ends of a collapse take no further part
+        std::fill(touched.begin(), touched.end(), 0);
+        for (size_t v = 0; v < vertexCount; v++)
+            remap[v] = uint32_t(v);
+        size_t removeBudget = (result.size() - targetIndexCount) / 3;
+        size_t removed = 0;
+        for (const Collapse& collapse : collapses)
+        {
+            if (removed >= removeBudget)
+                break;
+            if (touched[collapse.from] != 0 || touched[collapse.to] == TouchedCollapsed)
+                continue;
+
+            bool valid = true;
+            size_t sharedTriangles = 0;
+            for (uint32_t t = triangleOffsets[collapse.from]; t < triangleOffsets[collapse.from + 1] && valid; t++)
+            {
+                const uint32_t* tri = &result[vertexTriangles[t] * 3];
+                if (tri[0] == collapse.to || tri[1] == collapse.to || tri[2] == collapse.to)
+                {
+                    sharedTriangles++;
+                    continue;
+                }
+                Vec3 corners[3];
+                Vec3 moved[3];
+                for (int c = 0; c < 3; c++)
+                {
+                    corners[c] = points[tri[c]];
+                    moved[c] = tri[c] == collapse.from ? points[collapse.to] : corners[c];
+                }
+                Vec3 before = Cross(Sub(corners[1], corners[0]), Sub(corners[2], corners[0]));
+                Vec3 after = Cross(Sub(moved[1], moved[0]), Sub(moved[2], moved[0]));
+                double lengths = sqrt(Dot(before, before) * Dot(after, after));
+                valid = lengths > 0.0 && Dot(before, after) >= MaxNormalTurn * lengths;
+                // Turns within the limit every pass could still add up to a flip over
+                // several passes, so the corners' source normals bound it as well
+                for (int c = 0; c < 3 && valid; c++)
+                {
+                    const Vec3& sourceNormal = sourceNormals[tri[c] == collapse.from ? collapse.to : tri[c]];
+                    double sourceLengths = sqrt(Dot(sourceNormal, sourceNormal) * Dot(after, after));
+                    valid = sourceLengths > 0.0 && Dot(sourceNormal, after) >= MaxNormalTurn * sourceLengths;
+                }
+            }
+            if (!valid)
+                continue;
+
+            remap[collapse.from] = collapse.to;
+            AddQuadric(quadrics[collapse.to], quadrics[collapse.from]);
+            // Keeps at most one moving vertex per triangle, so the flip test above stays exact
+            for (uint32_t t = triangleOffsets[collapse.from]; t < triangleOffsets[collapse.from + 1]; t++)
+            {
+                const uint32_t* tri = &result[vertexTriangles[t] * 3];
+                for (int c = 0; c < 3; c++)
+                    touched[tri[c]] = std::max(touched[tri[c]], uint8_t(TouchedPinned));
+            }
+            touched[collapse.from] = touched[collapse.to] = TouchedCollapsed;
+            removed += sharedTriangles;
+            resultError = std::max(resultError, collapse.cost);
+        }
+        if (removed == 0)
+            break;
+
+        size_t write = 0;
+        for (size_t i = 0; i < triangleCount * 3; i += 3)
+        {
+            uint32_t a = remap[result[i]];
+            uint32_t b = remap[result[i + 1]];
+            uint32_t c = remap[result[i + 2]];
+            if (a == b || b == c || c == a)
+                continue;
+            result[write++] = a;
+            result[write++] = b;
+            result[write++] = c;
+        }
+        result.resize(write);
+    }
+
+    if (pResultError)
+        *pResultError = float(sqrt(resultError));
+    return result.size();
+}
+
+float GetProjectedRadius(float radius, float viewDepth, float projScaleY, float viewportHeight)
+{
+    // Camera inside the sphere: it covers the whole screen
+    if (viewDepth <= radius)
+        return viewportHeight;
+    return radius * projScaleY / viewDepth * viewportHeight * 0.5f;
+}
+
+void MeshLodChain::Clear()
+{
+    m_levels.clear();
+    m_indices.clear();
+    m_radius = 0.0f;
+}
+
+void MeshLodChain::SetLevels(const MeshLodLevel* levels, uint32_t levelCount, float radius)
+{
+    Clear();
+    m_levels.assign(levels, levels + (levelCount < MaxLevels ? levelCount : MaxLevels));
+    m_radius = radius;
+}
+
+void MeshLodChain::Build(const float* positions, size_t vertexCount, size_t vertexStride,
+    const uint32_t* indices, size_t indexCount, uint32_t maxLevels, float reduction, float maxError)
+{
+    Clear();
+
+    float center[3] = { 0.0f, 0.0f, 0.0f };
+    for (size_t i = 0; i < vertexCount; i++)
+    {
+        const float* p = reinterpret_cast<const float*>(reinterpret_cast<const char*>(positions) + i * vertexStride);
+        for (int axis = 0; axis < 3; axis++)
+            center[axis] += p[axis] / float(vertexCount);
+    }
+    for (size_t i = 0; i < vertexCount; i++)
+    {
+        const float* p = reinterpret_cast<const float*>(reinterpret_cast<const char*>(positions) + i * vertexStride);
+        float dx = p[0] - center[0];
+        float dy = p[1] - center[1];
+        float dz = p[2] - center[2];
+        m_radius = std::max(m_radius, sqrtf(dx * dx + dy * dy + dz * dz));
+    }
+
+    m_indices.assign(indices, indices + indexCount);
+    m_levels.push_back({ 0, uint32_t(indexCount), 0.0f });
+
+    // Every level starts again from the source, so errors don't compound across levels
+    std::vector<uint32_t> simplified;
+    size_t target = indexCount;
+    while (m_levels.size() < maxLevels)
+    {
+        target = size_t(target * reduction) / 3 * 3;
+        float error = 0.0f;
+        size_t count = SimplifyMesh(positions, vertexCount, vertexStride, indices, indexCount,
+            target, maxError * m_radius, simplified, &error);
+        // Stalled on locked vertices or the error limit, a level this close to the previous one isn't worth keeping
+        if (count == 0 || count + count / 8 >= m_levels.back().indexCount)
+            break;
+        // Collapses leave the triangles in source order with holes, the cache order has to be rebuilt
+        OptimizeVertexCache(simplified.data(), count, vertexCount, simplified.data());
+        MeshLodLevel level;
+        level.firstIndex = uint32_t(m_indices.size());
+        level.indexCount = uint32_t(count);
+        level.error = m_radius > 0.0f ? std::max(error / m_radius, m_levels.back().error) : 0.0f;
+        m_indices.insert(m_indices.end(), simplified.begin(), simplified.end());
+        m_levels.push_back(level);
+        if (count > target)
+            break;
+    }
+}
+
+uint32_t MeshLodChain::SelectLevel(float projectedRadius, float maxPixelError) const
+{
+    uint32_t selected = 0;
+    for (uint32_t level = 1; level < m_levels.size(); level++)
+    {
+        if (m_levels[level].error * projectedRadius > maxPixelError)
+            break;
+        selected = level;
+    }
+    return selected;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Simplifies an indexed triangle list with quadric error metric edge collapses.
+// Vertices are only removed, never moved, so every LOD shares the source vertex
+// buffer. Open edges are kept in place and vertices sharing a position with
+// another vertex (attribute seams) are never removed.
+// positions: float3 at the start of every vertexStride bytes. Stops at
+// targetIndexCount or when the next collapse would exceed maxError (in position
+// units); returns the index count written to result.
+size_t SimplifyMesh(const float* positions, size_t vertexCount, size_t vertexStride,
+    const uint32_t* indices, size_t indexCount, size_t targetIndexCount, float maxError,
+    std::vector<uint32_t>& result, float* pResultError = nullptr);
+
+// Screen space radius in pixels of a sphere viewDepth units in front of the
+// camera. projScaleY is element [1][1] of the projection matrix.
+float GetProjectedRadius(float radius, float viewDepth, float projScaleY, float viewportHeight);
+
+struct MeshLodLevel
+{
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    float error; // relative to the mesh bounding radius
+};
+
+// Chain of progressively simplified index lists, all stored back to back.
+// Level 0 is the source mesh, the simplified levels are reordered for the
+// vertex cache.
+class MeshLodChain
+{
+public:
+    static const uint32_t MaxLevels = 8;
+
+    // Every level aims at reduction times the index count of the previous one;
+    // the chain ends early once a level would deviate more than maxError of the radius.
+    void Build(const float* positions, size_t vertexCount, size_t vertexStride,
+        const uint32_t* indices, size_t indexCount,
+        uint32_t maxLevels = MaxLevels, float reduction = 0.5f, float maxError = 0.05f);
+    // Levels built offline, as a .mesh file stores them; the indices stay with
+    // their owner, GetIndices is left empty
+    void SetLevels(const MeshLodLevel* levels, uint32_t levelCount, float radius);
+    void Clear();
+
+    uint32_t GetLevelCount() const { return uint32_t(m_levels.size()); }
+    const MeshLodLevel& GetLevel(uint32_t level) const { return m_levels[level]; }
+    const std::vector<uint32_t>& GetIndices() const { return m_indices; }
+    float GetRadius() const { return m_radius; }
+
+    // Coarsest level whose error stays under maxPixelError for a mesh covering
+    // projectedRadius pixels on screen
+    uint32_t SelectLevel(float projectedRadius, float maxPixelError) const;
+private:
+    std::vector<MeshLodLevel> m_levels;
+    std::vector<uint32_t> m_indices;
+    float m_radius = 0.0f;
+};
@@ -0,0 +1,402 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+    // Forsyth's constants, tuned for a 32 entry LRU cache
+    const uint32_t CacheSize = 32;
+    const float CacheDecayPower = 1.5f;
+    const float LastTriangleScore = 0.75f;
+    const float ValenceBoostScale = 2.0f;
+    const float ValenceBoostPower = 0.5f;
+
+    const uint32_t MaxValenceTable = 32;
+
+    // powf per vertex update dominated the run time, both terms come from tables
+    struct ScoreTables
+    {
+        float cache[CacheSize];
+        float valence[MaxValenceTable];
+
+        ScoreTables()
+        {
+            for (uint32_t i = 0; i < CacheSize; i++)
+            {
+                // The last triangle's vertices get a fixed score, so the next one
+                // doesn't prefer reusing an edge of it over the rest of the cache
+                cache[i] = i < 3 ? LastTriangleScore : powf(1.0f - float(i - 3) / float(CacheSize - 3), CacheDecayPower);
+            }
+            valence[0] = 0.0f;
+            for (uint32_t i = 1; i < MaxValenceTable; i++)
+            {
+                valence[i] = ValenceBoostScale * powf(float(i), -ValenceBoostPower);
+            }
+        }
+    };
+
+    float GetVertexScore(const ScoreTables& tables, int cachePosition, uint32_t remaining)
+    {
+        // No triangle left to use the vertex
+        if (remaining == 0)
+            return -1.0f;
+        float score = cachePosition >= 0 ? tables.cache[cachePosition] : 0.0f;
+        // Vertices with few triangles left are worth finishing off
+        return score + (remaining < MaxValenceTable ? tables.valence[remaining] : ValenceBoostScale * powf(float(remaining), -ValenceBoostPower));
+    }
+
+    // FIFO cache tracked with timestamps: time only advances on a miss, so a
+    // vertex is still cached while fewer than cacheSize misses happened since
+    class FifoCache
+    {
+    public:
+        FifoCache(size_t vertexCount, uint32_t cacheSize)
+            : m_stamps(vertexCount, 0), m_cacheSize(cacheSize), m_time(cacheSize + 1)
+        {
+        }
+
+        bool Access(uint32_t vertex)
+        {
+            if (m_time - m_stamps[vertex] <= m_cacheSize)
+                return false;
+            m_stamps[vertex] = m_time++;
+            return true;
+        }
+        uint32_t AccessTriangle(const uint32_t* triangle)
+        {
+            return uint32_t(Access(triangle[0])) + uint32_t(Access(triangle[1])) + uint32_t(Access(triangle[2]));
+        }
+        void Reset() { m_time += m_cacheSize + 1; }
+    private:
+        std::vector<uint32_t> m_stamps;
+        uint32_t m_cacheSize;
+        uint32_t m_time;
+    };
+
+    const uint32_t OverdrawCacheSize = 16;
+
+    const float* GetPosition(const float* positions, size_t stride, uint32_t vertex)
+    {
+        return reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(positions) + vertex * stride);
+    }
+}
+
+void OptimizeVertexCache(const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t* result)
+{
+    assert(indexCount % 3 == 0);
+    const size_t triangleCount = indexCount / 3;
+    if (triangleCount == 0)
+        return;
+    // result may alias indices
+    std::vector<uint32_t> source(indices, indices + indexCount);
+
+    // Triangles of every vertex; the first remaining[v] entries are the ones not emitted yet
+    std::vector<uint32_t> remaining(vertexCount, 0);
+    for (uint32_t idx : source)
+    {
+        remaining[idx]++;
+    }
+    std::vector<uint32_t> offsets(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; v++)
+    {
+        offsets[v + 1] = offsets[v] + remaining[v];
+    }
+    std::vector<uint32_t> adjacency(indexCount);
+    {
+        std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < indexCount; i++)
+        {
+            adjacency[fill[source[i]]++] = uint32_t(i / 3);
+        }
+    }
+
+    static const ScoreTables tables;
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> vertexScore(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++)
+    {
+        vertexScore[v] = GetVertexScore(tables, -1, remaining[v]);
+    }
+    std::vector<float> triangleScore(triangleCount);
+    std::vector<uint8_t> emitted(triangleCount, 0);
+    size_t best = 0;
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        const uint32_t* triangle = &source[t * 3];
+        triangleScore[t] = vertexScore[triangle[0]] + vertexScore[triangle[1]] + vertexScore[triangle[2]];
+        if (triangleScore[t] > triangleScore[best])
+            best = t;
+    }
+
+    // Room for the 3 vertices pushed in front before the tail is evicted
+    uint32_t cache[CacheSize + 3];
+    uint32_t newCache[CacheSize + 3];
+    uint32_t cacheCount = 0;
+    size_t nextUnused = 0;
+    const size_t NoTriangle = size_t(-1);
+    for (size_t out = 0; out < triangleCount; out++)
+    {
+        if (best == NoTriangle)
+        {
+            // Nothing in the cache has triangles left, carry on in source order
+            while (emitted[nextUnused])
+                nextUnused++;
+            best = nextUnused;
+        }
+        const uint32_t* triangle = &source[best * 3];
+        emitted[best] = 1;
+        result[out * 3 + 0] = triangle[0];
+        result[out * 3 + 1] = triangle[1];
+        result[out * 3 + 2] = triangle[2];
+
+        for (int corner = 0; corner < 3; corner++)
+        {
+            const uint32_t v = triangle[corner];
+            uint32_t* pAdjacent = &adjacency[offsets[v]];
+            for (uint32_t i = 0; i < remaining[v]; i++)
+            {
+                if (pAdjacent[i] == best)
+                {
+                    std::swap(pAdjacent[i], pAdjacent[remaining[v] - 1]);
+                    remaining[v]--;
+                    break;
+                }
+            }
+        }
+
+        // The triangle's vertices move to the front, the rest keep their order
+        uint32_t newCount = 0;
+        for (int corner = 0; corner < 3; corner++)
+        {
+            if (std::find(newCache, newCache + newCount, triangle[corner]) == newCache + newCount)
+                newCache[newCount++] = triangle[corner];
+        }
+        for (uint32_t i = 0; i < cacheCount; i++)
+        {
+            const uint32_t v = cache[i];
+            if (v != triangle[0] && v != triangle[1] && v != triangle[2])
+                newCache[newCount++] = v;
+        }
+        for (uint32_t i = 0; i < newCount; i++)
+        {
+            const uint32_t v = newCache[i];
+            cachePosition[v] = i < CacheSize ? int(i) : -1;
+            vertexScore[v] = GetVertexScore(tables, cachePosition[v], remaining[v]);
+        }
+
+        // Only triangles touching the cache changed score, evicted vertices included
+        best = NoTriangle;
+        float bestScore = -1.0f;
+        for (uint32_t i = 0; i < newCount; i++)
+        {
+            const uint32_t v = newCache[i];
+            const uint32_t* pAdjacent = &adjacency[offsets[v]];
+            for (uint32_t j = 0; j < remaining[v]; j++)
+            {
+                const uint32_t t = pAdjacent[j];
+                const uint32_t* other = &source[t * 3];
+                triangleScore[t] = vertexScore[other[0]] + vertexScore[other[1]] + vertexScore[other[2]];
+                if (triangleScore[t] > bestScore)
+                {
+                    bestScore = triangleScore[t];
+                    best = t;
+                }
+            }
+        }
+
+        cacheCount = std::min(newCount, CacheSize);
+        memcpy(cache, newCache, cacheCount * sizeof(uint32_t));
+    }
+}
+
+void OptimizeOverdraw(const uint32_t* indices, size_t indexCount, const float* positions, size_t vertexCount,
+    size_t vertexStride, float threshold, uint32_t* result)
+{
+    assert(indexCount % 3 == 0);
+    assert(result != indices);
+    const size_t triangleCount = indexCount / 3;
+    if (triangleCount == 0)
+        return;
+
+    // Hard boundaries: all three vertices of a triangle miss, the cache started over
+    std::vector<size_t> hardClusters;
+    {
+        FifoCache cache(vertexCount, OverdrawCacheSize);
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            if (cache.AccessTriangle(&indices[t * 3]) == 3)
+                hardClusters.push_back(t);
+        }
+    }
+    // The first triangle always misses everything, so the list starts at 0
+    hardClusters.push_back(triangleCount);
+
+    // Soft boundaries: splitting where the run is already almost as cache
+    // friendly as the whole cluster costs at most threshold in ACMR
+    std::vector<size_t> clusters;
+    FifoCache cache(vertexCount, OverdrawCacheSize);
+    for (size_t c = 0; c + 1 < hardClusters.size(); c++)
+    {
+        const size_t start = hardClusters[c];
+        const size_t end = hardClusters[c + 1];
+        cache.Reset();
+        uint32_t clusterMisses = 0;
+        for (size_t t = start; t < end; t++)
+        {
+            clusterMisses += cache.AccessTriangle(&indices[t * 3]);
+        }
+        const float clusterThreshold = threshold * float(clusterMisses) / float(end - start);
+
+        cache.Reset();
+        clusters.push_back(start);
+        size_t runStart = start;
+        uint32_t runMisses = 0;
+        for (size_t t = start; t < end; t++)
+        {
+            runMisses += cache.AccessTriangle(&indices[t * 3]);
+            if (t + 1 < end && float(runMisses) / float(t + 1 - runStart) <= clusterThreshold)
+            {
+                cache.Reset();
+                clusters.push_back(t + 1);
+                runStart = t + 1;
+                runMisses = 0;
+            }
+        }
+    }
+    clusters.push_back(triangleCount);
+
+    // Area weighted centroid and normal of every cluster, and of the whole mesh
+    const size_t clusterCount = clusters.size() - 1;
+    std::vector<float> clusterData(clusterCount * 6, 0.0f);
+    float meshCentroid[3] = { 0.0f, 0.0f, 0.0f };
+    float meshArea = 0.0f;
+    for (size_t c = 0; c < clusterCount; c++)
+    {
+        float* centroid = &clusterData[c * 6];
+        float* normal = centroid + 3;
+        float clusterArea = 0.0f;
+        for (size_t t = clusters[c]; t < clusters[c + 1]; t++)
+        {
+            const float* a = GetPosition(positions, vertexStride, indices[t * 3 + 0]);
+            const float* b = GetPosition(positions, vertexStride, indices[t * 3 + 1]);
+            const float* p = GetPosition(positions, vertexStride, indices[t * 3 + 2]);
+            const float ab[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+            const float ac[3] = { p[0] - a[0], p[1] - a[1], p[2] - a[2] };
+            // Length is twice the area, pointing out of clockwise front faces
+            const float cross[3] = { ab[1] * ac[2] - ab[2] * ac[1], ab[2] * ac[0] - ab[0] * ac[2], ab[0] * ac[1] - ab[1] * ac[0] };
+            const float area = sqrtf(cross[0] * cross[0] + cross[1] * cross[1] + cross[2] * cross[2]);
+            for (int axis = 0; axis < 3; axis++)
+            {
+                centroid[axis] += (a[axis] + b[axis] + p[axis]) / 3.0f * area;
+                normal[axis] += cross[axis];
+            }
+            clusterArea += area;
+        }
+        for (int axis = 0; axis < 3; axis++)
+        {
+            meshCentroid[axis] += centroid[axis];
+        }
+        meshArea += clusterArea;
+        if (clusterArea > 0.0f)
+        {
+            for (int axis = 0; axis < 3; axis++)
+            {
+                centroid[axis] /= clusterArea;
+            }
+        }
+        const float length = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+        if (length > 0.0f)
+        {
+            for (int axis = 0; axis < 3; axis++)
+            {
+                normal[axis] /= length;
+            }
+        }
+    }
+    if (meshArea > 0.0f)
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            meshCentroid[axis] /= meshArea;
+        }
+    }
+
+    // Clusters facing away from the center are in front of the others from
+    // most directions, drawing them first lets the depth test reject the rest
+    std::vector<float> sortKeys(clusterCount);
+    std::vector<uint32_t> order(clusterCount);
+    for (size_t c = 0; c < clusterCount; c++)
+    {
+        const float* centroid = &clusterData[c * 6];
+        const float* normal = centroid + 3;
+        sortKeys[c] = (centroid[0] - meshCentroid[0]) * normal[0] + (centroid[1] - meshCentroid[1]) * normal[1] +
+            (centroid[2] - meshCentroid[2]) * normal[2];
+        order[c] = uint32_t(c);
+    }
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return sortKeys[a] > sortKeys[b]; });
+
+    size_t out = 0;
+    for (uint32_t c : order)
+    {
+        const size_t count = (clusters[c + 1] - clusters[c]) * 3;
+        memcpy(result + out, indices + clusters[c] * 3, count * sizeof(uint32_t));
+        out += count;
+    }
+}
+
+size_t OptimizeVertexFetch(uint32_t* indices, size_t indexCount, void* vertices, size_t vertexCount, size_t vertexSize)
+{
+    const uint32_t Unused = uint32_t(-1);
+    std::vector<uint32_t> remap(vertexCount, Unused);
+    std::vector<uint8_t> source(static_cast<const uint8_t*>(vertices), static_cast<const uint8_t*>(vertices) + vertexCount * vertexSize);
+    uint8_t* pDst = static_cast<uint8_t*>(vertices);
+    uint32_t next = 0;
+    for (size_t i = 0; i < indexCount; i++)
+    {
+        const uint32_t v = indices[i];
+        if (remap[v] == Unused)
+        {
+            remap[v] = next;
+            memcpy(pDst + size_t(next) * vertexSize, &source[size_t(v) * vertexSize], vertexSize);
+            next++;
+        }
+        indices[i] = remap[v];
+    }
+    return next;
+}
+
+size_t OptimizeMesh(uint32_t* indices, size_t indexCount, void* vertices, size_t vertexCount, size_t vertexSize,
+    float overdrawThreshold)
+{
+    std::vector<uint32_t> cacheOrder(indexCount);
+    OptimizeVertexCache(indices, indexCount, vertexCount, cacheOrder.data());
+    OptimizeOverdraw(cacheOrder.data(), indexCount, static_cast<const float*>(vertices), vertexCount, vertexSize,
+        overdrawThreshold, indices);
+    return OptimizeVertexFetch(indices, indexCount, vertices, vertexCount, vertexSize);
+}
+
+VertexCacheStats AnalyzeVertexCache(const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize)
+{
+    VertexCacheStats stats;
+    FifoCache cache(vertexCount, cacheSize);
+    std::vector<uint8_t> referenced(vertexCount, 0);
+    size_t referencedCount = 0;
+    for (size_t i = 0; i < indexCount; i++)
+    {
+        stats.misses += cache.Access(indices[i]) ? 1 : 0;
+        if (!referenced[indices[i]])
+        {
+            referenced[indices[i]] = 1;
+            referencedCount++;
+        }
+    }
+    if (indexCount >= 3)
+        stats.acmr = float(stats.misses) / float(indexCount / 3);
+    if (referencedCount > 0)
+        stats.atvr = float(stats.misses) / float(referencedCount);
+    return stats;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Index and vertex reordering for indexed triangle lists. Nothing is added or
+// removed, only the order changes, so every function can run on a mesh that
+// already went through another one.
+
+// Forsyth's linear-speed vertex cache optimisation: greedily emits the
+// triangle whose vertices score best in a simulated LRU cache of 32 entries.
+// result may alias indices.
+void OptimizeVertexCache(const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t* result);
+
+// Splits a cache optimized list into clusters where the cache starts over, or
+// where a cluster's own ACMR already comes within threshold of the whole
+// cluster's, then draws outward facing clusters first so they occlude the rest
+// (Sander, Nehab and Barczak, "Fast Triangle Reordering for Vertex Locality and
+// Reduced Overdraw"). Front faces are clockwise, as D3D11 expects by default.
+// positions: float3 at the start of every vertexStride bytes. result may not alias indices.
+void OptimizeOverdraw(const uint32_t* indices, size_t indexCount, const float* positions, size_t vertexCount,
+    size_t vertexStride, float threshold, uint32_t* result);
+
+// Moves vertices into the order the indices first reference them and rewrites
+// the indices. Unreferenced vertices are dropped, the new vertex count is returned.
+size_t OptimizeVertexFetch(uint32_t* indices, size_t indexCount, void* vertices, size_t vertexCount, size_t vertexSize);
+
+// All three in order; positions are the float3 at the start of every vertex.
+// Returns the new vertex count.
+size_t OptimizeMesh(uint32_t* indices, size_t indexCount, void* vertices, size_t vertexCount, size_t vertexSize,
+    float overdrawThreshold = 1.05f);
+
+struct VertexCacheStats
+{
+    size_t misses = 0;
+    // Average cache miss ratio: transformed vertices per triangle, 0.5 at best for big regular meshes
+    float acmr = 0.0f;
+    // Average transform to vertex ratio: transformed per referenced vertex, 1 at best
+    float atvr = 0.0f;
+};
+
+// Simulates a FIFO post-transform cache as fixed function hardware had it
+VertexCacheStats AnalyzeVertexCache(const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize = 16);
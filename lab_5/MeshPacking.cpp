@@ -0,0 +1,236 @@
+#include "MeshPacking.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+    uint32_t FloatBits(float value)
+    {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+
+    float BitsFloat(uint32_t bits)
+    {
+        float value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    const float* At(const float* data, size_t idx, size_t stride)
+    {
+        return reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(data) + idx * stride);
+    }
+
+    template <typename Packed>
+    void PackPosition(const float* position, const VertexQuantization& quantization, const float* invScale, Packed& result)
+    {
+        result.x = FloatToSnorm16((position[0] - quantization.bias[0]) * invScale[0]);
+        result.y = FloatToSnorm16((position[1] - quantization.bias[1]) * invScale[1]);
+        result.z = FloatToSnorm16((position[2] - quantization.bias[2]) * invScale[2]);
+        result.w = 0;
+    }
+
+    void GetInverseScale(const VertexQuantization& quantization, float* invScale)
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            invScale[axis] = 1.0f / quantization.scale[axis];
+        }
+    }
+
+    struct ErrorAccumulator
+    {
+        double sumPosition = 0.0;
+        double sumUV = 0.0;
+        QuantizationError error;
+
+        template <typename Packed>
+        void AddPosition(const float* position, const VertexQuantization& quantization, const Packed& packed)
+        {
+            const int16_t snorm[3] = { packed.x, packed.y, packed.z };
+            float distance2 = 0.0f;
+            for (int axis = 0; axis < 3; axis++)
+            {
+                float decoded = Snorm16ToFloat(snorm[axis]) * quantization.scale[axis] + quantization.bias[axis];
+                float delta = decoded - position[axis];
+                distance2 += delta * delta;
+            }
+            error.maxPosition = std::max(error.maxPosition, sqrtf(distance2));
+            sumPosition += distance2;
+        }
+
+        void AddUV(const float* uv, const PackedTextureVertex& packed)
+        {
+            float du = HalfToFloat(packed.u) - uv[0];
+            float dv = HalfToFloat(packed.v) - uv[1];
+            float distance2 = du * du + dv * dv;
+            error.maxUV = std::max(error.maxUV, sqrtf(distance2));
+            sumUV += distance2;
+        }
+
+        QuantizationError Finish(size_t count, const VertexQuantization& quantization, bool hasUV)
+        {
+            if (count > 0)
+            {
+                error.rmsPosition = float(sqrt(sumPosition / double(count)));
+                if (hasUV)
+                    error.rmsUV = float(sqrt(sumUV / double(count)));
+            }
+            float extent = 2.0f * std::max(quantization.scale[0], std::max(quantization.scale[1], quantization.scale[2]));
+            error.maxRelativePosition = error.maxPosition / extent;
+            return error;
+        }
+    };
+}
+
+uint16_t FloatToHalf(float value)
+{
+    uint32_t bits = FloatBits(value);
+    const uint16_t sign = uint16_t((bits >> 16) & 0x8000);
+    bits &= 0x7FFFFFFF;
+
+    uint16_t result;
+    if (bits >= 0x47800000)
+    {
+        // Too large for a half, or infinity and NaN already
+        result = bits > 0x7F800000 ? 0x7E00 : 0x7C00;
+    }
+    else if (bits < 0x38800000)
+    {
+        // Denormal or zero: adding the magic number lines the mantissa up with
+        // the half's, the FPU does the round to nearest even
+        const uint32_t magicBits = ((127 - 15) + (23 - 10) + 1) << 23;
+        result = uint16_t(FloatBits(BitsFloat(bits) + BitsFloat(magicBits)) - magicBits);
+    }
+    else
+    {
+        const uint32_t odd = (bits >> 13) & 1;
+        // Rebias the exponent and round, a carry out of the mantissa bumps the exponent
+        bits += (uint32_t(15 - 127) << 23) + 0xFFF + odd;
+        result = uint16_t(bits >> 13);
+    }
+    return uint16_t(result | sign);
+}
+
+float HalfToFloat(uint16_t value)
+{
+    const uint32_t sign = uint32_t(value & 0x8000) << 16;
+    const uint32_t exponent = (value >> 10) & 0x1F;
+    const uint32_t mantissa = value & 0x3FF;
+    if (exponent == 0)
+    {
+        // Denormals are mantissa * 2^-24
+        float result = float(mantissa) * (1.0f / 16777216.0f);
+        return sign != 0 ? -result : result;
+    }
+    if (exponent == 0x1F)
+        return BitsFloat(sign | 0x7F800000 | (mantissa << 13));
+    return BitsFloat(sign | ((exponent + 127 - 15) << 23) | (mantissa << 13));
+}
+
+int16_t FloatToSnorm16(float value)
+{
+    value = std::min(1.0f, std::max(-1.0f, value));
+    return int16_t(lrintf(value * 32767.0f));
+}
+
+float Snorm16ToFloat(int16_t value)
+{
+    // -32768 and -32767 both decode to -1
+    return std::max(-1.0f, float(value) / 32767.0f);
+}
+
+VertexQuantization ComputeQuantization(const float* positions, size_t count, size_t stride)
+{
+    float minimum[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+    float maximum[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    for (size_t i = 0; i < count; i++)
+    {
+        const float* position = At(positions, i, stride);
+        for (int axis = 0; axis < 3; axis++)
+        {
+            minimum[axis] = std::min(minimum[axis], position[axis]);
+            maximum[axis] = std::max(maximum[axis], position[axis]);
+        }
+    }
+
+    VertexQuantization result = {};
+    for (int axis = 0; axis < 3; axis++)
+    {
+        if (count == 0)
+        {
+            minimum[axis] = maximum[axis] = 0.0f;
+        }
+        result.bias[axis] = 0.5f * (minimum[axis] + maximum[axis]);
+        float halfExtent = 0.5f * (maximum[axis] - minimum[axis]);
+        // A flat axis still needs a usable scale, every value there encodes to zero
+        result.scale[axis] = halfExtent > 0.0f ? halfExtent : 1.0f;
+    }
+    result.scale[3] = 1.0f;
+    return result;
+}
+
+void PackPositions(const float* positions, size_t count, size_t stride,
+    const VertexQuantization& quantization, PackedPosition* pResult)
+{
+    float invScale[3];
+    GetInverseScale(quantization, invScale);
+    for (size_t i = 0; i < count; i++)
+    {
+        PackPosition(At(positions, i, stride), quantization, invScale, pResult[i]);
+    }
+}
+
+void PackNormals(const float* normals, size_t count, size_t stride, PackedNormal* pResult)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        const float* normal = At(normals, i, stride);
+        pResult[i].x = int8_t(lrintf(std::min(1.0f, std::max(-1.0f, normal[0])) * 127.0f));
+        pResult[i].y = int8_t(lrintf(std::min(1.0f, std::max(-1.0f, normal[1])) * 127.0f));
+        pResult[i].z = int8_t(lrintf(std::min(1.0f, std::max(-1.0f, normal[2])) * 127.0f));
+        pResult[i].w = 0;
+    }
+}
+
+void PackTextureVertices(const float* positions, const float* uvs, size_t count, size_t stride,
+    const VertexQuantization& quantization, PackedTextureVertex* pResult)
+{
+    float invScale[3];
+    GetInverseScale(quantization, invScale);
+    for (size_t i = 0; i < count; i++)
+    {
+        PackPosition(At(positions, i, stride), quantization, invScale, pResult[i]);
+        const float* uv = At(uvs, i, stride);
+        pResult[i].u = FloatToHalf(uv[0]);
+        pResult[i].v = FloatToHalf(uv[1]);
+    }
+}
+
+QuantizationError MeasureQuantizationError(const float* positions, size_t count, size_t stride,
+    const VertexQuantization& quantization, const PackedPosition* pPacked)
+{
+    ErrorAccumulator accumulator;
+    for (size_t i = 0; i < count; i++)
+    {
+        accumulator.AddPosition(At(positions, i, stride), quantization, pPacked[i]);
+    }
+    return accumulator.Finish(count, quantization, false);
+}
+
+QuantizationError MeasureQuantizationError(const float* positions, const float* uvs, size_t count, size_t stride,
+    const VertexQuantization& quantization, const PackedTextureVertex* pPacked)
+{
+    ErrorAccumulator accumulator;
+    for (size_t i = 0; i < count; i++)
+    {
+        accumulator.AddPosition(At(positions, i, stride), quantization, pPacked[i]);
+        accumulator.AddUV(At(uvs, i, stride), pPacked[i]);
+    }
+    return accumulator.Finish(count, quantization, true);
+}
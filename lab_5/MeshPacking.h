@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Per mesh position decode, position = snorm * scale + bias. Laid out as two
+// float4 so it can be uploaded as a constant buffer as is.
+struct VertexQuantization
+{
+    float scale[4];
+    float bias[4];
+};
+
+// R16G16B16A16_SNORM, w is unused
+struct PackedPosition
+{
+    int16_t x, y, z, w;
+};
+
+// R16G16B16A16_SNORM position followed by R16G16_FLOAT texture coordinates,
+// 12 bytes against 20 for float3 + float2
+struct PackedTextureVertex
+{
+    int16_t x, y, z, w;
+    uint16_t u, v;
+};
+
+// R8G8B8A8_SNORM unit normal, w is unused
+struct PackedNormal
+{
+    int8_t x, y, z, w;
+};
+
+// Round to nearest even, overflow gives infinity, NaN stays NaN
+uint16_t FloatToHalf(float value);
+float HalfToFloat(uint16_t value);
+int16_t FloatToSnorm16(float value);
+float Snorm16ToFloat(int16_t value);
+
+// Maps the bounding box of the positions onto [-1, 1] on every axis.
+// positions: float3 at the start of every stride bytes.
+VertexQuantization ComputeQuantization(const float* positions, size_t count, size_t stride);
+
+void PackPositions(const float* positions, size_t count, size_t stride,
+    const VertexQuantization& quantization, PackedPosition* pResult);
+// normals: float3 at the start of every stride bytes
+void PackNormals(const float* normals, size_t count, size_t stride, PackedNormal* pResult);
+// uvs: float2 at the start of every stride bytes, may point into the same vertices as positions
+void PackTextureVertices(const float* positions, const float* uvs, size_t count, size_t stride,
+    const VertexQuantization& quantization, PackedTextureVertex* pResult);
+
+// Differences between the source and the decoded vertices, positions in mesh
+// units, relative values are divided by the largest bounding box extent
+struct QuantizationError
+{
+    float maxPosition = 0.0f;
+    float rmsPosition = 0.0f;
+    float maxRelativePosition = 0.0f;
+    float maxUV = 0.0f;
+    float rmsUV = 0.0f;
+};
+
+QuantizationError MeasureQuantizationError(const float* positions, size_t count, size_t stride,
+    const VertexQuantization& quantization, const PackedPosition* pPacked);
+QuantizationError MeasureQuantizationError(const float* positions, const float* uvs, size_t count, size_t stride,
+    const VertexQuantization& quantization, const PackedTextureVertex* pPacked);
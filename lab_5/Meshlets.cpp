@@ -0,0 +1,273 @@
+#include "Meshlets.h"
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    // Visible meshlets per index writing task
+    const size_t MeshletsPerTask = 64;
+    // Cones wider than this (dot of the widest normal with the axis) never cull enough to be worth testing
+    const float MinConeSpread = 0.1f;
+    // Keeps nearly edge-on triangles from being culled on float rounding
+    const float ConeMargin = 0.01f;
+
+    const float* GetPosition(const float* positions, size_t vertexStride, uint32_t idx)
+    {
+        return reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(positions) + idx * vertexStride);
+    }
+
+    float Dot(const float* a, const float* b)
+    {
+        return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+    }
+
+    bool Normalize(float* v)
+    {
+        const float length = sqrtf(Dot(v, v));
+        if (length == 0.0f)
+            return false;
+        v[0] /= length;
+        v[1] /= length;
+        v[2] /= length;
+        return true;
+    }
+
+    MeshletBounds ComputeBounds(const MeshletMesh& mesh, const Meshlet& meshlet, const float* positions, size_t vertexStride)
+    {
+        MeshletBounds bounds = {};
+
+        // Sphere around the box center, a little looser than a minimal one
+        float minimum[3], maximum[3];
+        const float* first = GetPosition(positions, vertexStride, mesh.vertices[meshlet.vertexOffset]);
+        std::copy(first, first + 3, minimum);
+        std::copy(first, first + 3, maximum);
+        for (uint32_t i = 1; i < meshlet.vertexCount; i++)
+        {
+            const float* p = GetPosition(positions, vertexStride, mesh.vertices[meshlet.vertexOffset + i]);
+            for (int axis = 0; axis < 3; axis++)
+            {
+                minimum[axis] = std::min(minimum[axis], p[axis]);
+                maximum[axis] = std::max(maximum[axis], p[axis]);
+            }
+        }
+        for (int axis = 0; axis < 3; axis++)
+        {
+            bounds.center[axis] = 0.5f * (minimum[axis] + maximum[axis]);
+        }
+        for (uint32_t i = 0; i < meshlet.vertexCount; i++)
+        {
+            const float* p = GetPosition(positions, vertexStride, mesh.vertices[meshlet.vertexOffset + i]);
+            const float delta[3] = { p[0] - bounds.center[0], p[1] - bounds.center[1], p[2] - bounds.center[2] };
+            bounds.radius = std::max(bounds.radius, sqrtf(Dot(delta, delta)));
+        }
+
+        // Cone axis is the mean of the unit triangle normals
+        std::vector<float> normals(meshlet.triangleCount * 3);
+        std::vector<float> centers(meshlet.triangleCount * 3);
+        uint32_t normalCount = 0;
+        for (uint32_t t = 0; t < meshlet.triangleCount; t++)
+        {
+            const uint8_t* triangle = &mesh.triangles[(meshlet.triangleOffset + t) * 3];
+            const float* a = GetPosition(positions, vertexStride, mesh.vertices[meshlet.vertexOffset + triangle[0]]);
+            const float* b = GetPosition(positions, vertexStride, mesh.vertices[meshlet.vertexOffset + triangle[1]]);
+            const float* c = GetPosition(positions, vertexStride, mesh.vertices[meshlet.vertexOffset + triangle[2]]);
+            const float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+            const float e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+            // Clockwise front faces, so this points out of the front
+            float* n = &normals[normalCount * 3];
+            n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+            n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+            n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+            // Degenerate triangles are invisible from everywhere
+            if (!Normalize(n))
+                continue;
+            float* center = &centers[normalCount * 3];
+            for (int axis = 0; axis < 3; axis++)
+            {
+                center[axis] = (a[axis] + b[axis] + c[axis]) / 3.0f;
+                bounds.coneAxis[axis] += n[axis];
+            }
+            normalCount++;
+        }
+
+        std::copy(bounds.center, bounds.center + 3, bounds.coneApex);
+        bounds.coneCutoff = 1.0f;
+        if (normalCount == 0 || !Normalize(bounds.coneAxis))
+            return bounds;
+        float minDot = 1.0f;
+        for (uint32_t t = 0; t < normalCount; t++)
+        {
+            minDot = std::min(minDot, Dot(&normals[t * 3], bounds.coneAxis));
+        }
+        if (minDot <= MinConeSpread)
+            return bounds;
+
+        // The apex slides back along the axis until it is behind every
+        // triangle's plane, then any camera inside the cone sees only backs
+        float maxT = 0.0f;
+        for (uint32_t t = 0; t < normalCount; t++)
+        {
+            const float* n = &normals[t * 3];
+            const float toCenter[3] = { centers[t * 3] - bounds.center[0], centers[t * 3 + 1] - bounds.center[1], centers[t * 3 + 2] - bounds.center[2] };
+            maxT = std::max(maxT, Dot(toCenter, n) / Dot(bounds.coneAxis, n));
+        }
+        for (int axis = 0; axis < 3; axis++)
+        {
+            bounds.coneApex[axis] = bounds.center[axis] - bounds.coneAxis[axis] * maxT;
+        }
+        bounds.coneCutoff = std::min(1.0f, sqrtf(1.0f - minDot * minDot) + ConeMargin);
+        return bounds;
+    }
+}
+
+void BuildMeshlets(const uint32_t* indices, size_t indexCount, const float* positions, size_t vertexCount,
+    size_t vertexStride, MeshletMesh& result)
+{
+    result = MeshletMesh();
+    // Meshlet vertex number of every mesh vertex in the meshlet being filled
+    const uint8_t Unused = 0xFF;
+    std::vector<uint8_t> localIds(vertexCount, Unused);
+
+    Meshlet current = {};
+    auto flush = [&]()
+    {
+        if (current.triangleCount == 0)
+            return;
+        for (uint32_t i = 0; i < current.vertexCount; i++)
+        {
+            localIds[result.vertices[current.vertexOffset + i]] = Unused;
+        }
+        result.meshlets.push_back(current);
+        current.vertexOffset = uint32_t(result.vertices.size());
+        current.triangleOffset = uint32_t(result.triangles.size() / 3);
+        current.vertexCount = 0;
+        current.triangleCount = 0;
+    };
+
+    for (size_t i = 0; i + 2 < indexCount; i += 3)
+    {
+        const uint32_t* triangle = indices + i;
+        const uint32_t newVertices = (localIds[triangle[0]] == Unused)
+            + (localIds[triangle[1]] == Unused && triangle[1] != triangle[0])
+            + (localIds[triangle[2]] == Unused && triangle[2] != triangle[0] && triangle[2] != triangle[1]);
+        if (current.vertexCount + newVertices > MeshletMaxVertices || current.triangleCount + 1 > MeshletMaxTriangles)
+            flush();
+        for (int k = 0; k < 3; k++)
+        {
+            uint8_t& local = localIds[triangle[k]];
+            if (local == Unused)
+            {
+                local = uint8_t(current.vertexCount++);
+                result.vertices.push_back(triangle[k]);
+            }
+            result.triangles.push_back(local);
+        }
+        current.triangleCount++;
+    }
+    flush();
+
+    result.bounds.resize(result.meshlets.size());
+    for (size_t i = 0; i < result.meshlets.size(); i++)
+    {
+        result.bounds[i] = ComputeBounds(result, result.meshlets[i], positions, vertexStride);
+    }
+}
+
+void MeshletCuller::SetMesh(const MeshletMesh* pMesh)
+{
+    m_pMesh = pMesh;
+    const size_t count = pMesh != nullptr ? pMesh->meshlets.size() : 0;
+    m_spheres.Resize(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        const MeshletBounds& bounds = pMesh->bounds[i];
+        m_spheres.SetSphere(i, bounds.center[0], bounds.center[1], bounds.center[2], bounds.radius);
+    }
+    m_indices.clear();
+    m_stats = MeshletCullStats();
+}
+
+size_t MeshletCuller::Cull(const float modelViewProj[16], const float cameraPosition[3], WorkerPool* pPool)
+{
+    m_stats = MeshletCullStats();
+    if (m_pMesh == nullptr)
+        return 0;
+
+    // Planes come out in mesh space, so do the sphere distances
+    FrustumPlanes planes;
+    ExtractFrustumPlanes(modelViewProj, planes);
+    const size_t inFrustum = CullSpheres(planes, m_spheres, m_visible);
+    m_stats.frustumCulled = m_pMesh->meshlets.size() - inFrustum;
+
+    size_t kept = 0;
+    for (size_t i = 0; i < inFrustum; i++)
+    {
+        const MeshletBounds& bounds = m_pMesh->bounds[m_visible[i]];
+        float view[3] = { bounds.coneApex[0] - cameraPosition[0], bounds.coneApex[1] - cameraPosition[1], bounds.coneApex[2] - cameraPosition[2] };
+        const float distance = sqrtf(Dot(view, view));
+        if (Dot(view, bounds.coneAxis) < bounds.coneCutoff * distance)
+            m_visible[kept++] = m_visible[i];
+    }
+    m_visible.resize(kept);
+    m_stats.backfaceCulled = inFrustum - kept;
+    return WriteIndices(pPool);
+}
+
+size_t MeshletCuller::CullNone(WorkerPool* pPool)
+{
+    m_stats = MeshletCullStats();
+    if (m_pMesh == nullptr)
+        return 0;
+    m_visible.resize(m_pMesh->meshlets.size());
+    for (size_t i = 0; i < m_visible.size(); i++)
+    {
+        m_visible[i] = uint32_t(i);
+    }
+    return WriteIndices(pPool);
+}
+
+size_t MeshletCuller::WriteIndices(WorkerPool* pPool)
+{
+    // Prefix sum first, then every task writes its own range of the output
+    m_firstIndex.resize(m_visible.size());
+    size_t indexCount = 0;
+    for (size_t i = 0; i < m_visible.size(); i++)
+    {
+        m_firstIndex[i] = uint32_t(indexCount);
+        indexCount += m_pMesh->meshlets[m_visible[i]].triangleCount * 3;
+    }
+    m_indices.resize(indexCount);
+    m_stats.visible = m_visible.size();
+    m_stats.triangles = indexCount / 3;
+
+    auto writeRange = [this](size_t task)
+    {
+        const size_t end = std::min(m_visible.size(), (task + 1) * MeshletsPerTask);
+        for (size_t i = task * MeshletsPerTask; i < end; i++)
+        {
+            const Meshlet& meshlet = m_pMesh->meshlets[m_visible[i]];
+            const uint32_t* vertices = &m_pMesh->vertices[meshlet.vertexOffset];
+            const uint8_t* triangles = &m_pMesh->triangles[meshlet.triangleOffset * 3];
+            uint32_t* pOut = &m_indices[m_firstIndex[i]];
+            for (uint32_t k = 0; k < meshlet.triangleCount * 3; k++)
+            {
+                pOut[k] = vertices[triangles[k]];
+            }
+        }
+    };
+    const size_t taskCount = (m_visible.size() + MeshletsPerTask - 1) / MeshletsPerTask;
+    if (pPool != nullptr && taskCount > 1)
+    {
+        pPool->ParallelFor(taskCount, writeRange);
+    }
+    else
+    {
+        for (size_t task = 0; task < taskCount; task++)
+        {
+            writeRange(task);
+        }
+    }
+    return indexCount;
+}
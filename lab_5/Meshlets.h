@@ -0,0 +1,91 @@
+#pragma once
+
+#include "FrustumCulling.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class WorkerPool;
+
+// Small clusters of a triangle list that are culled on their own, sized the
+// way mesh shader hardware likes them
+const uint32_t MeshletMaxVertices = 64;
+const uint32_t MeshletMaxTriangles = 124;
+
+struct Meshlet
+{
+    // Into MeshletMesh::vertices and MeshletMesh::triangles
+    uint32_t vertexOffset;
+    uint32_t triangleOffset;
+    uint32_t vertexCount;
+    uint32_t triangleCount;
+};
+
+// Bounding sphere and normal cone in mesh space. Every triangle of the meshlet
+// faces away from cameras where dot(normalize(coneApex - camera), coneAxis) >= coneCutoff;
+// the cutoff is 1 when the normals spread too far for the cone to cull anything.
+struct MeshletBounds
+{
+    float center[3];
+    float radius;
+    float coneApex[3];
+    float coneAxis[3];
+    float coneCutoff;
+};
+
+struct MeshletMesh
+{
+    std::vector<Meshlet> meshlets;
+    std::vector<MeshletBounds> bounds;
+    // Mesh vertex of every meshlet vertex
+    std::vector<uint32_t> vertices;
+    // Three meshlet vertex numbers per triangle
+    std::vector<uint8_t> triangles;
+};
+
+// Fills meshlets in index order, starting a new one when the next triangle
+// would go over either limit. Compact clusters need an index order with
+// locality, run OptimizeVertexCache first.
+// positions: float3 at the start of every vertexStride bytes. Winding as
+// D3D11 culls by default, front faces are clockwise.
+void BuildMeshlets(const uint32_t* indices, size_t indexCount, const float* positions, size_t vertexCount,
+    size_t vertexStride, MeshletMesh& result);
+
+struct MeshletCullStats
+{
+    size_t frustumCulled = 0;
+    size_t backfaceCulled = 0;
+    size_t visible = 0;
+    size_t triangles = 0;
+};
+
+// Per frame cluster culling: spheres against the frustum with the SIMD
+// culler, normal cones against the camera, then the triangles of the
+// survivors written back to back as a plain index list.
+class MeshletCuller
+{
+public:
+    // Keeps a pointer to the mesh, which has to stay alive and unchanged
+    void SetMesh(const MeshletMesh* pMesh);
+
+    // modelViewProj takes mesh space to clip space (row vectors, as
+    // ExtractFrustumPlanes expects), cameraPosition is in mesh space.
+    // Index writing is split across the pool when there is one.
+    // Returns the number of indices in GetIndices.
+    size_t Cull(const float modelViewProj[16], const float cameraPosition[3], WorkerPool* pPool = nullptr);
+    // Everything passes, for comparisons against the culled result
+    size_t CullNone(WorkerPool* pPool = nullptr);
+
+    const std::vector<uint32_t>& GetIndices() const { return m_indices; }
+    const MeshletCullStats& GetStats() const { return m_stats; }
+private:
+    size_t WriteIndices(WorkerPool* pPool);
+
+    const MeshletMesh* m_pMesh = nullptr;
+    CullingBounds m_spheres;
+    std::vector<uint32_t> m_visible;
+    std::vector<uint32_t> m_firstIndex;
+    std::vector<uint32_t> m_indices;
+    MeshletCullStats m_stats;
+};
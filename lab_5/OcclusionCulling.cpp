@@ -0,0 +1,293 @@
+#include "OcclusionCulling.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+
+#include <xmmintrin.h>
+
+#include "WorkerPool.h"
+
+static const float MinClipW = 1e-5f;
+
+void OcclusionBuffer::Resize(uint32_t width, uint32_t height)
+{
+    // Tiles never straddle the buffer border
+    m_tilesX = (width + TileSize - 1) / TileSize;
+    m_tilesY = (height + TileSize - 1) / TileSize;
+    m_width = m_tilesX * TileSize;
+    m_height = m_tilesY * TileSize;
+    m_tileBins.assign(m_tilesX * m_tilesY, std::vector<uint32_t>());
+
+    m_hiZ.clear();
+    m_levelWidth.clear();
+    m_levelHeight.clear();
+    uint32_t levelWidth = m_width;
+    uint32_t levelHeight = m_height;
+    for (;;)
+    {
+        m_hiZ.push_back(std::vector<float>(size_t(levelWidth) * levelHeight, 0.0f));
+        m_levelWidth.push_back(levelWidth);
+        m_levelHeight.push_back(levelHeight);
+        if (levelWidth == 1 && levelHeight == 1)
+            break;
+        levelWidth = std::max(1u, (levelWidth + 1) / 2);
+        levelHeight = std::max(1u, (levelHeight + 1) / 2);
+    }
+}
+
+void OcclusionBuffer::Clear()
+{
+    m_triangles.clear();
+    for (std::vector<uint32_t>& bin : m_tileBins)
+    {
+        bin.clear();
+    }
+    std::fill(m_hiZ[0].begin(), m_hiZ[0].end(), 0.0f);
+}
+
+void OcclusionBuffer::AddOccluder(const float* positions, size_t vertexCount, size_t vertexStride,
+    const uint16_t* indices, size_t indexCount, const float modelViewProj[16])
+{
+    const float* m = modelViewProj;
+    std::vector<float> clip(vertexCount * 4);
+    for (size_t i = 0; i < vertexCount; i++)
+    {
+        const float* p = reinterpret_cast<const float*>(reinterpret_cast<const char*>(positions) + i * vertexStride);
+        for (int c = 0; c < 4; c++)
+        {
+            clip[i * 4 + c] = p[0] * m[c] + p[1] * m[4 + c] + p[2] * m[8 + c] + m[12 + c];
+        }
+    }
+
+    for (size_t i = 0; i + 2 < indexCount; i += 3)
+    {
+        ScreenTriangle tri;
+        bool valid = true;
+        for (int v = 0; v < 3 && valid; v++)
+        {
+            const float* c = &clip[size_t(indices[i + v]) * 4];
+            if (c[3] <= MinClipW)
+            {
+                valid = false;
+                break;
+            }
+            float invW = 1.0f / c[3];
+            tri.x[v] = (c[0] * invW * 0.5f + 0.5f) * m_width;
+            tri.y[v] = (0.5f - c[1] * invW * 0.5f) * m_height;
+            tri.z[v] = c[2] * invW;
+        }
+        if (!valid)
+            continue;
+
+        float minX = std::min(tri.x[0], std::min(tri.x[1], tri.x[2]));
+        float maxX = std::max(tri.x[0], std::max(tri.x[1], tri.x[2]));
+        float minY = std::min(tri.y[0], std::min(tri.y[1], tri.y[2]));
+        float maxY = std::max(tri.y[0], std::max(tri.y[1], tri.y[2]));
+        if (maxX < 0.0f || maxY < 0.0f || minX >= float(m_width) || minY >= float(m_height))
+            continue;
+
+        uint32_t triIdx = uint32_t(m_triangles.size());
+        m_triangles.push_back(tri);
+        int tileX0 = std::max(0, int(minX) / int(TileSize));
+        int tileY0 = std::max(0, int(minY) / int(TileSize));
+        int tileX1 = std::min(int(m_tilesX) - 1, int(maxX) / int(TileSize));
+        int tileY1 = std::min(int(m_tilesY) - 1, int(maxY) / int(TileSize));
+        for (int ty = tileY0; ty <= tileY1; ty++)
+        {
+            for (int tx = tileX0; tx <= tileX1; tx++)
+            {
+                m_tileBins[ty * m_tilesX + tx].push_back(triIdx);
+            }
+        }
+    }
+}
+
+void OcclusionBuffer::RasterizeTile(uint32_t tileIdx)
+{
+    PROFILE_SCOPE("OcclusionBuffer::RasterizeTile");
+    const int tileX = int(tileIdx % m_tilesX) * int(TileSize);
+    const int tileY = int(tileIdx / m_tilesX) * int(TileSize);
+    float* pDepth = m_hiZ[0].data();
+    const __m128 laneOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+    const __m128 zero = _mm_setzero_ps();
+
+    for (uint32_t triIdx : m_tileBins[tileIdx])
+    {
+        ScreenTriangle tri = m_triangles[triIdx];
+        float area = (tri.x[1] - tri.x[0]) * (tri.y[2] - tri.y[0]) - (tri.y[1] - tri.y[0]) * (tri.x[2] - tri.x[0]);
+        if (fabsf(area) < 1e-8f)
+            continue;
+        if (area < 0.0f)
+        {
+            std::swap(tri.x[1], tri.x[2]);
+            std::swap(tri.y[1], tri.y[2]);
+            std::swap(tri.z[1], tri.z[2]);
+            area = -area;
+        }
+
+        // Edge i goes from vertex i to i+1, E(p) = A * px + B * py + C, positive inside.
+        // Coefficients are always computed from the lexicographically smaller vertex, so a
+        // shared edge gives exactly negated values in both triangles; pixels with E == 0
+        // go to the triangle that owns the edge in that direction, leaving no cracks.
+        float edgeA[3];
+        float edgeB[3];
+        float edgeC[3];
+        __m128 edgeInclusive[3];
+        for (int e = 0; e < 3; e++)
+        {
+            int n = (e + 1) % 3;
+            bool forward = tri.x[e] < tri.x[n] || (tri.x[e] == tri.x[n] && tri.y[e] < tri.y[n]);
+            int s = forward ? e : n;
+            int t = forward ? n : e;
+            float sign = forward ? 1.0f : -1.0f;
+            float a = -(tri.y[t] - tri.y[s]);
+            float b = tri.x[t] - tri.x[s];
+            float c = -a * tri.x[s] - b * tri.y[s];
+            edgeA[e] = sign * a;
+            edgeB[e] = sign * b;
+            edgeC[e] = sign * c;
+            edgeInclusive[e] = forward ? _mm_cmpeq_ps(zero, zero) : zero;
+        }
+        // z/w is linear in screen space; vertex i weight is the edge opposite to it over the area
+        float invArea = 1.0f / area;
+        float zA = (edgeA[1] * tri.z[0] + edgeA[2] * tri.z[1] + edgeA[0] * tri.z[2]) * invArea;
+        float zB = (edgeB[1] * tri.z[0] + edgeB[2] * tri.z[1] + edgeB[0] * tri.z[2]) * invArea;
+        float zC = (edgeC[1] * tri.z[0] + edgeC[2] * tri.z[1] + edgeC[0] * tri.z[2]) * invArea;
+
+        int x0 = std::max(tileX, int(floorf(std::min(tri.x[0], std::min(tri.x[1], tri.x[2])))));
+        int x1 = std::min(tileX + int(TileSize) - 1, int(ceilf(std::max(tri.x[0], std::max(tri.x[1], tri.x[2])))));
+        int y0 = std::max(tileY, int(floorf(std::min(tri.y[0], std::min(tri.y[1], tri.y[2])))));
+        int y1 = std::min(tileY + int(TileSize) - 1, int(ceilf(std::max(tri.y[0], std::max(tri.y[1], tri.y[2])))));
+        if (x0 > x1 || y0 > y1)
+            continue;
+        x0 &= ~3;
+
+        for (int y = y0; y <= y1; y++)
+        {
+            __m128 py = _mm_set1_ps(float(y) + 0.5f);
+            __m128 e0Row = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(edgeB[0]), py), _mm_set1_ps(edgeC[0]));
+            __m128 e1Row = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(edgeB[1]), py), _mm_set1_ps(edgeC[1]));
+            __m128 e2Row = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(edgeB[2]), py), _mm_set1_ps(edgeC[2]));
+            __m128 zRow = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(zB), py), _mm_set1_ps(zC));
+            float* pRow = pDepth + size_t(y) * m_width;
+            for (int x = x0; x <= x1; x += 4)
+            {
+                __m128 px = _mm_add_ps(_mm_set1_ps(float(x)), laneOffsets);
+                __m128 e0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(edgeA[0]), px), e0Row);
+                __m128 e1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(edgeA[1]), px), e1Row);
+                __m128 e2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(edgeA[2]), px), e2Row);
+                __m128 in0 = _mm_or_ps(_mm_cmpgt_ps(e0, zero), _mm_and_ps(_mm_cmpeq_ps(e0, zero), edgeInclusive[0]));
+                __m128 in1 = _mm_or_ps(_mm_cmpgt_ps(e1, zero), _mm_and_ps(_mm_cmpeq_ps(e1, zero), edgeInclusive[1]));
+                __m128 in2 = _mm_or_ps(_mm_cmpgt_ps(e2, zero), _mm_and_ps(_mm_cmpeq_ps(e2, zero), edgeInclusive[2]));
+                __m128 inside = _mm_and_ps(in0, _mm_and_ps(in1, in2));
+                if (_mm_movemask_ps(inside) == 0)
+                    continue;
+                __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(zA), px), zRow);
+                __m128 old = _mm_loadu_ps(pRow + x);
+                __m128 kept = _mm_max_ps(old, z);
+                _mm_storeu_ps(pRow + x, _mm_or_ps(_mm_and_ps(inside, kept), _mm_andnot_ps(inside, old)));
+            }
+        }
+    }
+}
+
+void OcclusionBuffer::Rasterize(WorkerPool& pool)
+{
+    // Tiles own disjoint pixels, so they need no synchronization
+    pool.ParallelFor(m_tileBins.size(), [this](size_t tileIdx) { RasterizeTile(uint32_t(tileIdx)); });
+}
+
+void OcclusionBuffer::BuildHiZ()
+{
+    for (size_t level = 1; level < m_hiZ.size(); level++)
+    {
+        const std::vector<float>& src = m_hiZ[level - 1];
+        std::vector<float>& dst = m_hiZ[level];
+        const uint32_t srcWidth = m_levelWidth[level - 1];
+        const uint32_t srcHeight = m_levelHeight[level - 1];
+        for (uint32_t y = 0; y < m_levelHeight[level]; y++)
+        {
+            uint32_t sy0 = y * 2;
+            uint32_t sy1 = std::min(sy0 + 1, srcHeight - 1);
+            for (uint32_t x = 0; x < m_levelWidth[level]; x++)
+            {
+                uint32_t sx0 = x * 2;
+                uint32_t sx1 = std::min(sx0 + 1, srcWidth - 1);
+                // Reversed depth: the farthest value is the smallest one
+                dst[y * m_levelWidth[level] + x] = std::min(
+                    std::min(src[sy0 * srcWidth + sx0], src[sy0 * srcWidth + sx1]),
+                    std::min(src[sy1 * srcWidth + sx0], src[sy1 * srcWidth + sx1]));
+            }
+        }
+    }
+}
+
+bool OcclusionBuffer::IsRectVisible(float minX, float minY, float maxX, float maxY, float maxDepth) const
+{
+    minX = std::max(minX, 0.0f);
+    minY = std::max(minY, 0.0f);
+    maxX = std::min(maxX, float(m_width - 1));
+    maxY = std::min(maxY, float(m_height - 1));
+    if (minX > maxX || minY > maxY)
+        return true;
+
+    // Pick the level where the rectangle spans at most five texels per axis: coarser
+    // levels are cheaper to scan but pull in far depth from around the rectangle
+    float size = std::max(maxX - minX, maxY - minY);
+    uint32_t level = size > 4.0f ? uint32_t(ceilf(log2f(size))) - 2 : 0;
+    level = std::min(level, uint32_t(m_hiZ.size() - 1));
+
+    const std::vector<float>& depth = m_hiZ[level];
+    const uint32_t levelWidth = m_levelWidth[level];
+    uint32_t x0 = uint32_t(minX) >> level;
+    uint32_t x1 = std::min(uint32_t(maxX) >> level, levelWidth - 1);
+    uint32_t y0 = uint32_t(minY) >> level;
+    uint32_t y1 = std::min(uint32_t(maxY) >> level, m_levelHeight[level] - 1);
+    float farthest = FLT_MAX;
+    for (uint32_t y = y0; y <= y1; y++)
+    {
+        for (uint32_t x = x0; x <= x1; x++)
+        {
+            farthest = std::min(farthest, depth[y * levelWidth + x]);
+        }
+    }
+    return maxDepth >= farthest;
+}
+
+bool OcclusionBuffer::IsVisible(const float aabbMin[3], const float aabbMax[3], const float viewProj[16]) const
+{
+    const float* m = viewProj;
+    float minX = FLT_MAX;
+    float minY = FLT_MAX;
+    float maxX = -FLT_MAX;
+    float maxY = -FLT_MAX;
+    float maxDepth = 0.0f;
+    for (int corner = 0; corner < 8; corner++)
+    {
+        float p[3] = {
+            (corner & 1) ? aabbMax[0] : aabbMin[0],
+            (corner & 2) ? aabbMax[1] : aabbMin[1],
+            (corner & 4) ? aabbMax[2] : aabbMin[2],
+        };
+        float clip[4];
+        for (int c = 0; c < 4; c++)
+        {
+            clip[c] = p[0] * m[c] + p[1] * m[4 + c] + p[2] * m[8 + c] + m[12 + c];
+        }
+        // Box reaches behind the camera, can't bound it on screen
+        if (clip[3] <= MinClipW)
+            return true;
+        float invW = 1.0f / clip[3];
+        float x = (clip[0] * invW * 0.5f + 0.5f) * m_width;
+        float y = (0.5f - clip[1] * invW * 0.5f) * m_height;
+        minX = std::min(minX, x);
+        maxX = std::max(maxX, x);
+        minY = std::min(minY, y);
+        maxY = std::max(maxY, y);
+        maxDepth = std::max(maxDepth, clip[2] * invW);
+    }
+    return IsRectVisible(floorf(minX), floorf(minY), ceilf(maxX), ceilf(maxY), maxDepth);
+}
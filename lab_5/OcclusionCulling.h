@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class WorkerPool;
+
+// Low resolution software depth buffer for occlusion culling. Occluder triangles
+// are binned into screen tiles and rasterized per tile in parallel with SSE, then
+// reduced into a hierarchical depth pyramid that object bounds are tested against.
+// Depth follows the renderer's reversed convention: 1 is near, 0 is far, and a
+// fragment is kept when it is GREATER_EQUAL than the stored value.
+class OcclusionBuffer
+{
+public:
+    static const uint32_t TileSize = 32;
+
+    void Resize(uint32_t width, uint32_t height);
+    uint32_t GetWidth() const { return m_width; }
+    uint32_t GetHeight() const { return m_height; }
+
+    // Starts a new frame: clears depth to far and drops queued occluders
+    void Clear();
+    // positions: float3 per vertex, modelViewProj: row-major, row vector convention.
+    // Triangles crossing the near plane are dropped, which only makes culling more conservative.
+    void AddOccluder(const float* positions, size_t vertexCount, size_t vertexStride,
+        const uint16_t* indices, size_t indexCount, const float modelViewProj[16]);
+    void Rasterize(WorkerPool& pool);
+    void BuildHiZ();
+
+    // True when some part of the box may be in front of the occluders
+    bool IsVisible(const float aabbMin[3], const float aabbMax[3], const float viewProj[16]) const;
+    // Screen rectangle in pixels of level 0 whose nearest point has depth maxDepth
+    bool IsRectVisible(float minX, float minY, float maxX, float maxY, float maxDepth) const;
+
+    size_t GetTriangleCount() const { return m_triangles.size(); }
+    const float* GetDepth(uint32_t level) const { return m_hiZ[level].data(); }
+    uint32_t GetLevelCount() const { return uint32_t(m_hiZ.size()); }
+private:
+    struct ScreenTriangle
+    {
+        float x[3];
+        float y[3];
+        float z[3];
+    };
+
+    void RasterizeTile(uint32_t tileIdx);
+
+    uint32_t m_width = 0;
+    uint32_t m_height = 0;
+    uint32_t m_tilesX = 0;
+    uint32_t m_tilesY = 0;
+    std::vector<ScreenTriangle> m_triangles;
+    std::vector<std::vector<uint32_t>> m_tileBins;
+    // Level 0 is the full resolution depth, every next level keeps the farthest depth of 2x2 texels
+    std::vector<std::vector<float>> m_hiZ;
+    std::vector<uint32_t> m_levelWidth;
+    std::vector<uint32_t> m_levelHeight;
+};
@@ -0,0 +1,19 @@
+Texture2D accumTexture : register (t0);
+Texture2D revealageTexture : register (t1);
+
+struct VSOutput
+{
+    float4 pos : SV_Position;
+};
+
+float4 ps(VSOutput pixel) : SV_Target0
+{
+    int3 coord = int3(pixel.pos.xy, 0);
+    float revealage = revealageTexture.Load(coord).r;
+    // No transparent surface covers the pixel
+    if (revealage >= 1.0)
+        discard;
+    float4 accum = accumTexture.Load(coord);
+    // Blended over the back buffer with SRC_ALPHA, INV_SRC_ALPHA
+    return float4(accum.rgb / max(accum.a, 1e-5), 1.0 - revealage);
+}
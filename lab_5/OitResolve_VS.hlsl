@@ -0,0 +1,12 @@
+struct VSOutput
+{
+    float4 pos : SV_Position;
+};
+
+VSOutput vs(uint vertexId : SV_VertexID) {
+    VSOutput result;
+    // One triangle covering the screen: (-1, 1), (3, 1), (-1, -3)
+    float2 uv = float2((vertexId << 1) & 2, vertexId & 2);
+    result.pos = float4(uv * float2(2.0, -2.0) + float2(-1.0, 1.0), 0.0, 1.0);
+    return result;
+}
@@ -0,0 +1,114 @@
+#include "ParallelRecorder.h"
+#include "Profiler.h"
+
+#include <cassert>
+#include <cstdint>
+
+void* CommandRecordingNullBackend::BeginRecording(int slot)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (slot >= int(m_slots.size()))
+        m_slots.resize(slot + 1);
+    m_slots[slot] = slot;
+    return nullptr;
+}
+
+void* CommandRecordingNullBackend::FinishRecording(int slot)
+{
+    return reinterpret_cast<void*>(intptr_t(slot) + 1);
+}
+
+void CommandRecordingNullBackend::Execute(void* pCommandList)
+{
+    m_executed.push_back(int(reinterpret_cast<intptr_t>(pCommandList) - 1));
+}
+
+ParallelRecorder::~ParallelRecorder()
+{
+    Stop();
+}
+
+void ParallelRecorder::Start(unsigned int workerCount)
+{
+    assert(m_workers.empty());
+    m_exit = false;
+    for (unsigned int i = 0; i < workerCount; i++)
+    {
+        m_workers.push_back(std::thread(&ParallelRecorder::WorkerLoop, this));
+    }
+}
+
+void ParallelRecorder::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_exit = true;
+    }
+    m_wake.notify_all();
+    for (std::thread& worker : m_workers)
+    {
+        worker.join();
+    }
+    m_workers.clear();
+}
+
+void ParallelRecorder::WorkerLoop()
+{
+    Profiler::SetThreadName("Recorder");
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;)
+    {
+        m_wake.wait(lock, [this]() { return m_exit || (m_pJobs != nullptr && m_nextJob < m_pJobs->size()); });
+        if (m_exit)
+            return;
+
+        size_t jobIdx = m_nextJob++;
+        const RecordFunc& job = (*m_pJobs)[jobIdx];
+        ICommandRecordingBackend* pBackend = m_pBackend;
+        lock.unlock();
+
+        void* pContext = pBackend->BeginRecording(int(jobIdx));
+        job(pContext);
+        void* pCommandList = pBackend->FinishRecording(int(jobIdx));
+
+        lock.lock();
+        m_commandLists[jobIdx] = pCommandList;
+        m_recorded[jobIdx] = true;
+        m_done.notify_all();
+    }
+}
+
+void ParallelRecorder::Record(ICommandRecordingBackend& backend, const std::vector<RecordFunc>& jobs)
+{
+    if (m_workers.empty())
+    {
+        // No workers, record inline but keep the same backend contract
+        for (size_t i = 0; i < jobs.size(); i++)
+        {
+            void* pContext = backend.BeginRecording(int(i));
+            jobs[i](pContext);
+            backend.Execute(backend.FinishRecording(int(i)));
+        }
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_pBackend = &backend;
+    m_pJobs = &jobs;
+    m_nextJob = 0;
+    m_commandLists.assign(jobs.size(), nullptr);
+    m_recorded.assign(jobs.size(), false);
+    m_wake.notify_all();
+
+    for (size_t i = 0; i < jobs.size(); i++)
+    {
+        m_done.wait(lock, [this, i]() { return m_recorded[i]; });
+        void* pCommandList = m_commandLists[i];
+        lock.unlock();
+        backend.Execute(pCommandList);
+        lock.lock();
+    }
+
+    m_pJobs = nullptr;
+    m_pBackend = nullptr;
+}
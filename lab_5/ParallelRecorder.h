@@ -0,0 +1,66 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Command recording API seen by ParallelRecorder. Begin/FinishRecording are
+// called on worker threads, one slot per job; Execute runs on the thread that
+// called Record, in job order.
+class ICommandRecordingBackend
+{
+public:
+    virtual ~ICommandRecordingBackend() {}
+    virtual void* BeginRecording(int slot) = 0;
+    virtual void* FinishRecording(int slot) = 0;
+    virtual void Execute(void* pCommandList) = 0;
+};
+
+// Backend without a device, keeps the order command lists were executed in
+class CommandRecordingNullBackend : public ICommandRecordingBackend
+{
+public:
+    void* BeginRecording(int slot) override;
+    void* FinishRecording(int slot) override;
+    void Execute(void* pCommandList) override;
+
+    const std::vector<int>& GetExecuted() const { return m_executed; }
+    void Clear() { m_executed.clear(); }
+private:
+    std::vector<int> m_slots;
+    std::mutex m_mutex;
+    std::vector<int> m_executed;
+};
+
+// Records jobs on a pool of worker threads and executes the resulting command
+// lists in submission order; job N is executed as soon as it and all jobs
+// before it are recorded, while later jobs keep recording.
+class ParallelRecorder
+{
+public:
+    typedef std::function<void(void* pContext)> RecordFunc;
+
+    ~ParallelRecorder();
+
+    void Start(unsigned int workerCount);
+    void Stop();
+    bool IsStarted() const { return !m_workers.empty(); }
+
+    void Record(ICommandRecordingBackend& backend, const std::vector<RecordFunc>& jobs);
+private:
+    void WorkerLoop();
+
+    std::vector<std::thread> m_workers;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+
+    ICommandRecordingBackend* m_pBackend = nullptr;
+    const std::vector<RecordFunc>* m_pJobs = nullptr;
+    std::vector<void*> m_commandLists;
+    std::vector<bool> m_recorded;
+    size_t m_nextJob = 0;
+    bool m_exit = false;
+};
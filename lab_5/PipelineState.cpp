@@ -0,0 +1,259 @@
+#include "PipelineState.h"
+
+#include <cassert>
+#include <cstring>
+
+#define SafeRelease(A) if ((A) != NULL) { (A)->Release(); (A) = NULL; }
+
+PipelineStateDesc::PipelineStateDesc()
+{
+    memset(this, 0, sizeof(*this));
+    topology = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+
+    for (D3D11_RENDER_TARGET_BLEND_DESC& target : blend.RenderTarget)
+    {
+        target.SrcBlend = D3D11_BLEND_ONE;
+        target.DestBlend = D3D11_BLEND_ZERO;
+        target.BlendOp = D3D11_BLEND_OP_ADD;
+        target.SrcBlendAlpha = D3D11_BLEND_ONE;
+        target.DestBlendAlpha = D3D11_BLEND_ZERO;
+        target.BlendOpAlpha = D3D11_BLEND_OP_ADD;
+        target.RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_ALL;
+    }
+
+    depthStencil.DepthEnable = TRUE;
+    depthStencil.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ALL;
+    depthStencil.DepthFunc = D3D11_COMPARISON_LESS;
+    depthStencil.StencilReadMask = D3D11_DEFAULT_STENCIL_READ_MASK;
+    depthStencil.StencilWriteMask = D3D11_DEFAULT_STENCIL_WRITE_MASK;
+    const D3D11_DEPTH_STENCILOP_DESC stencilOp = { D3D11_STENCIL_OP_KEEP, D3D11_STENCIL_OP_KEEP, D3D11_STENCIL_OP_KEEP, D3D11_COMPARISON_ALWAYS };
+    depthStencil.FrontFace = stencilOp;
+    depthStencil.BackFace = stencilOp;
+
+    rasterizer.FillMode = D3D11_FILL_SOLID;
+    rasterizer.CullMode = D3D11_CULL_BACK;
+    rasterizer.DepthClipEnable = TRUE;
+}
+
+namespace
+{
+    // Copies field by field into a zeroed descriptor, so padding bytes of the
+    // caller's copy, which assignments may leave undefined, never reach the hash
+    PipelineStateDesc Normalize(const PipelineStateDesc& desc)
+    {
+        PipelineStateDesc result;
+        result.pVS = desc.pVS;
+        result.pPS = desc.pPS;
+        result.pInputLayout = desc.pInputLayout;
+        result.topology = desc.topology;
+        result.blend.AlphaToCoverageEnable = desc.blend.AlphaToCoverageEnable;
+        result.blend.IndependentBlendEnable = desc.blend.IndependentBlendEnable;
+        // Without independent blending only the first target counts
+        const int targetCount = desc.blend.IndependentBlendEnable ? D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT : 1;
+        for (int i = 0; i < targetCount; i++)
+        {
+            const D3D11_RENDER_TARGET_BLEND_DESC& src = desc.blend.RenderTarget[i];
+            D3D11_RENDER_TARGET_BLEND_DESC& dst = result.blend.RenderTarget[i];
+            dst.BlendEnable = src.BlendEnable;
+            dst.SrcBlend = src.SrcBlend;
+            dst.DestBlend = src.DestBlend;
+            dst.BlendOp = src.BlendOp;
+            dst.SrcBlendAlpha = src.SrcBlendAlpha;
+            dst.DestBlendAlpha = src.DestBlendAlpha;
+            dst.BlendOpAlpha = src.BlendOpAlpha;
+            dst.RenderTargetWriteMask = src.RenderTargetWriteMask;
+        }
+        result.depthStencil.DepthEnable = desc.depthStencil.DepthEnable;
+        result.depthStencil.DepthWriteMask = desc.depthStencil.DepthWriteMask;
+        result.depthStencil.DepthFunc = desc.depthStencil.DepthFunc;
+        result.depthStencil.StencilEnable = desc.depthStencil.StencilEnable;
+        result.depthStencil.StencilReadMask = desc.depthStencil.StencilReadMask;
+        result.depthStencil.StencilWriteMask = desc.depthStencil.StencilWriteMask;
+        result.depthStencil.FrontFace = desc.depthStencil.FrontFace;
+        result.depthStencil.BackFace = desc.depthStencil.BackFace;
+        result.rasterizer = desc.rasterizer;
+        return result;
+    }
+
+    template <typename SubState, typename Desc>
+    SubState* FindSubState(std::vector<SubState>& states, const Desc& desc, uint64_t hash)
+    {
+        for (SubState& state : states)
+        {
+            if (state.hash == hash && memcmp(state.desc, &desc, sizeof(Desc)) == 0)
+                return &state;
+        }
+        return nullptr;
+    }
+
+    template <typename SubState, typename Desc, typename State>
+    void AddSubState(std::vector<SubState>& states, const Desc& desc, uint64_t hash, State* pState)
+    {
+        SubState state;
+        memcpy(state.desc, &desc, sizeof(Desc));
+        state.hash = hash;
+        state.pState = pState;
+        states.push_back(state);
+    }
+}
+
+PipelineStateCache::~PipelineStateCache()
+{
+    Clear();
+}
+
+uint64_t PipelineStateCache::Hash(const void* pData, size_t size)
+{
+    // FNV-1a
+    const uint8_t* pBytes = static_cast<const uint8_t*>(pData);
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= pBytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+const PipelineState* PipelineStateCache::Get(const PipelineStateDesc& desc)
+{
+    const PipelineStateDesc key = Normalize(desc);
+    const uint64_t hash = Hash(&key, sizeof(key));
+    auto range = m_stateLookup.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it)
+    {
+        const PipelineState* pState = m_states[it->second].get();
+        if (memcmp(&pState->m_desc, &key, sizeof(key)) == 0)
+            return pState;
+    }
+
+    assert(m_pDevice != nullptr);
+    std::unique_ptr<PipelineState> state(new PipelineState());
+    memcpy(&state->m_desc, &key, sizeof(key));
+    state->m_pBlendState = GetBlendState(key.blend);
+    state->m_pDepthStencilState = GetDepthStencilState(key.depthStencil);
+    state->m_pRasterizerState = GetRasterizerState(key.rasterizer);
+    if (state->m_pBlendState == nullptr || state->m_pDepthStencilState == nullptr || state->m_pRasterizerState == nullptr)
+        return nullptr;
+
+    m_stateLookup.insert(std::make_pair(hash, m_states.size()));
+    m_states.push_back(std::move(state));
+    return m_states.back().get();
+}
+
+ID3D11BlendState* PipelineStateCache::GetBlendState(const D3D11_BLEND_DESC& desc)
+{
+    uint64_t hash = Hash(&desc, sizeof(desc));
+    if (SubState<D3D11_BLEND_DESC, ID3D11BlendState>* pFound = FindSubState(m_blendStates, desc, hash))
+        return pFound->pState;
+    ID3D11BlendState* pState = nullptr;
+    if (FAILED(m_pDevice->CreateBlendState(&desc, &pState)))
+        return nullptr;
+    AddSubState(m_blendStates, desc, hash, pState);
+    return pState;
+}
+
+ID3D11DepthStencilState* PipelineStateCache::GetDepthStencilState(const D3D11_DEPTH_STENCIL_DESC& desc)
+{
+    uint64_t hash = Hash(&desc, sizeof(desc));
+    if (SubState<D3D11_DEPTH_STENCIL_DESC, ID3D11DepthStencilState>* pFound = FindSubState(m_depthStencilStates, desc, hash))
+        return pFound->pState;
+    ID3D11DepthStencilState* pState = nullptr;
+    if (FAILED(m_pDevice->CreateDepthStencilState(&desc, &pState)))
+        return nullptr;
+    AddSubState(m_depthStencilStates, desc, hash, pState);
+    return pState;
+}
+
+ID3D11RasterizerState* PipelineStateCache::GetRasterizerState(const D3D11_RASTERIZER_DESC& desc)
+{
+    uint64_t hash = Hash(&desc, sizeof(desc));
+    if (SubState<D3D11_RASTERIZER_DESC, ID3D11RasterizerState>* pFound = FindSubState(m_rasterizerStates, desc, hash))
+        return pFound->pState;
+    ID3D11RasterizerState* pState = nullptr;
+    if (FAILED(m_pDevice->CreateRasterizerState(&desc, &pState)))
+        return nullptr;
+    AddSubState(m_rasterizerStates, desc, hash, pState);
+    return pState;
+}
+
+void PipelineStateCache::Clear()
+{
+    for (auto& state : m_blendStates)
+    {
+        SafeRelease(state.pState);
+    }
+    for (auto& state : m_depthStencilStates)
+    {
+        SafeRelease(state.pState);
+    }
+    for (auto& state : m_rasterizerStates)
+    {
+        SafeRelease(state.pState);
+    }
+    m_blendStates.clear();
+    m_depthStencilStates.clear();
+    m_rasterizerStates.clear();
+    m_states.clear();
+    m_stateLookup.clear();
+}
+
+PipelineStateBinder::PipelineStateBinder(ID3D11DeviceContext* pContext)
+    : m_pContext(pContext)
+{
+}
+
+void PipelineStateBinder::Invalidate()
+{
+    m_valid = false;
+}
+
+uint32_t PipelineStateBinder::Bind(const PipelineState* pState)
+{
+    assert(pState != nullptr);
+    uint32_t changes = 0;
+    if (!m_valid || pState->GetVS() != m_pVS)
+    {
+        m_pVS = pState->GetVS();
+        m_pContext->VSSetShader(m_pVS, nullptr, 0);
+        changes++;
+    }
+    if (!m_valid || pState->GetPS() != m_pPS)
+    {
+        m_pPS = pState->GetPS();
+        m_pContext->PSSetShader(m_pPS, nullptr, 0);
+        changes++;
+    }
+    if (!m_valid || pState->GetInputLayout() != m_pInputLayout)
+    {
+        m_pInputLayout = pState->GetInputLayout();
+        m_pContext->IASetInputLayout(m_pInputLayout);
+        changes++;
+    }
+    if (!m_valid || pState->GetTopology() != m_topology)
+    {
+        m_topology = pState->GetTopology();
+        m_pContext->IASetPrimitiveTopology(m_topology);
+        changes++;
+    }
+    if (!m_valid || pState->GetBlendState() != m_pBlendState)
+    {
+        m_pBlendState = pState->GetBlendState();
+        m_pContext->OMSetBlendState(m_pBlendState, nullptr, 0xFFFFFFFF);
+        changes++;
+    }
+    if (!m_valid || pState->GetDepthStencilState() != m_pDepthStencilState)
+    {
+        m_pDepthStencilState = pState->GetDepthStencilState();
+        m_pContext->OMSetDepthStencilState(m_pDepthStencilState, 0);
+        changes++;
+    }
+    if (!m_valid || pState->GetRasterizerState() != m_pRasterizerState)
+    {
+        m_pRasterizerState = pState->GetRasterizerState();
+        m_pContext->RSSetState(m_pRasterizerState);
+        changes++;
+    }
+    m_valid = true;
+    return changes;
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <d3d11.h>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// Everything that configures the pipeline for a draw apart from resources.
+// The constructor zeroes the whole struct, padding included, and fills in the
+// D3D11 defaults, so descriptors can be hashed and compared as raw bytes.
+// Shaders and input layouts are referenced, not owned.
+struct PipelineStateDesc
+{
+    PipelineStateDesc();
+
+    ID3D11VertexShader* pVS;
+    ID3D11PixelShader* pPS;
+    ID3D11InputLayout* pInputLayout;
+    D3D11_PRIMITIVE_TOPOLOGY topology;
+    D3D11_BLEND_DESC blend;
+    D3D11_DEPTH_STENCIL_DESC depthStencil;
+    D3D11_RASTERIZER_DESC rasterizer;
+};
+
+// Immutable result of a descriptor. Sub-state objects are shared between all
+// pipeline states with an equal sub-descriptor, so comparing pointers tells
+// whether a sub-state has to be rebound.
+class PipelineState
+{
+public:
+    const PipelineStateDesc& GetDesc() const { return m_desc; }
+    ID3D11VertexShader* GetVS() const { return m_desc.pVS; }
+    ID3D11PixelShader* GetPS() const { return m_desc.pPS; }
+    ID3D11InputLayout* GetInputLayout() const { return m_desc.pInputLayout; }
+    D3D11_PRIMITIVE_TOPOLOGY GetTopology() const { return m_desc.topology; }
+    ID3D11BlendState* GetBlendState() const { return m_pBlendState; }
+    ID3D11DepthStencilState* GetDepthStencilState() const { return m_pDepthStencilState; }
+    ID3D11RasterizerState* GetRasterizerState() const { return m_pRasterizerState; }
+private:
+    friend class PipelineStateCache;
+
+    PipelineStateDesc m_desc;
+    ID3D11BlendState* m_pBlendState = nullptr;
+    ID3D11DepthStencilState* m_pDepthStencilState = nullptr;
+    ID3D11RasterizerState* m_pRasterizerState = nullptr;
+};
+
+// Creates pipeline states on demand. Equal descriptors give the same object,
+// and equal blend, depth stencil and rasterizer descriptors the same state
+// objects, so new materials only cost the sub-states that are really new.
+class PipelineStateCache
+{
+public:
+    ~PipelineStateCache();
+
+    void SetDevice(ID3D11Device* pDevice) { m_pDevice = pDevice; }
+    // nullptr if a state object could not be created
+    const PipelineState* Get(const PipelineStateDesc& desc);
+    // Releases every state object, pointers handed out become invalid
+    void Clear();
+
+    size_t GetStateCount() const { return m_states.size(); }
+    size_t GetSubStateCount() const { return m_blendStates.size() + m_depthStencilStates.size() + m_rasterizerStates.size(); }
+    static uint64_t Hash(const void* pData, size_t size);
+private:
+    // Descriptors are kept as bytes, copying the struct could drop the zeroed padding
+    template <typename Desc, typename State>
+    struct SubState
+    {
+        uint8_t desc[sizeof(Desc)];
+        uint64_t hash;
+        State* pState;
+    };
+
+    ID3D11BlendState* GetBlendState(const D3D11_BLEND_DESC& desc);
+    ID3D11DepthStencilState* GetDepthStencilState(const D3D11_DEPTH_STENCIL_DESC& desc);
+    ID3D11RasterizerState* GetRasterizerState(const D3D11_RASTERIZER_DESC& desc);
+
+    ID3D11Device* m_pDevice = nullptr;
+    std::vector<std::unique_ptr<PipelineState>> m_states;
+    std::unordered_multimap<uint64_t, size_t> m_stateLookup;
+    std::vector<SubState<D3D11_BLEND_DESC, ID3D11BlendState>> m_blendStates;
+    std::vector<SubState<D3D11_DEPTH_STENCIL_DESC, ID3D11DepthStencilState>> m_depthStencilStates;
+    std::vector<SubState<D3D11_RASTERIZER_DESC, ID3D11RasterizerState>> m_rasterizerStates;
+};
+
+// Tracks what is bound on one context. Bind only touches the sub-states that
+// differ from the previous call; a new binder assumes nothing is bound.
+class PipelineStateBinder
+{
+public:
+    explicit PipelineStateBinder(ID3D11DeviceContext* pContext);
+
+    // Returns how many sub-states were changed
+    uint32_t Bind(const PipelineState* pState);
+    void Invalidate();
+private:
+    ID3D11DeviceContext* m_pContext;
+    bool m_valid = false;
+    ID3D11VertexShader* m_pVS = nullptr;
+    ID3D11PixelShader* m_pPS = nullptr;
+    ID3D11InputLayout* m_pInputLayout = nullptr;
+    D3D11_PRIMITIVE_TOPOLOGY m_topology = D3D11_PRIMITIVE_TOPOLOGY_UNDEFINED;
+    ID3D11BlendState* m_pBlendState = nullptr;
+    ID3D11DepthStencilState* m_pDepthStencilState = nullptr;
+    ID3D11RasterizerState* m_pRasterizerState = nullptr;
+};
@@ -0,0 +1,208 @@
+#include "Profiler.h"
+
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace
+{
+    struct ProfileEvent
+    {
+        const char* name;
+        uint64_t start;
+        uint64_t end;
+    };
+
+    struct ThreadBuffer
+    {
+        ProfileEvent pinned[Profiler::PinnedCapacity];
+        ProfileEvent ring[Profiler::RingCapacity];
+        // Total events recorded, published with release so a reader sees complete events
+        std::atomic<uint64_t> count;
+        uint32_t threadId = 0;
+        std::string name;
+    };
+
+    struct ProfilerState
+    {
+        ProfilerState()
+            : baseTick(Profiler::Now()), baseTime(std::chrono::steady_clock::now())
+        {
+        }
+
+        std::mutex mutex;
+        // Buffers are owned here so events survive the threads that recorded them
+        std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+        uint64_t baseTick;
+        std::chrono::steady_clock::time_point baseTime;
+    };
+
+    ProfilerState& GetState()
+    {
+        static ProfilerState state;
+        return state;
+    }
+
+    thread_local ThreadBuffer* t_pBuffer = nullptr;
+
+    ThreadBuffer* AddBuffer(ProfilerState& state)
+    {
+        std::unique_ptr<ThreadBuffer> buffer(new ThreadBuffer());
+        buffer->count.store(0);
+        buffer->threadId = uint32_t(state.buffers.size() + 1);
+        buffer->name = "Thread " + std::to_string(buffer->threadId);
+        state.buffers.push_back(std::move(buffer));
+        return state.buffers.back().get();
+    }
+
+    ThreadBuffer* RegisterThread()
+    {
+        ProfilerState& state = GetState();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        t_pBuffer = AddBuffer(state);
+        return t_pBuffer;
+    }
+
+    void Append(ThreadBuffer& buffer, const char* name, uint64_t start, uint64_t end)
+    {
+        // Only one thread writes a buffer, a relaxed load of its own counter is enough
+        uint64_t count = buffer.count.load(std::memory_order_relaxed);
+        ProfileEvent& event = count < Profiler::PinnedCapacity
+            ? buffer.pinned[count]
+            : buffer.ring[(count - Profiler::PinnedCapacity) & (Profiler::RingCapacity - 1)];
+        event.name = name;
+        event.start = start;
+        event.end = end;
+        buffer.count.store(count + 1, std::memory_order_release);
+    }
+
+    double MeasureTicksPerSecond(const ProfilerState& state, std::chrono::steady_clock::duration minElapsed)
+    {
+#if defined(PROFILER_USE_STEADY_CLOCK)
+        (void)state;
+        (void)minElapsed;
+        return double(std::chrono::steady_clock::period::den) / double(std::chrono::steady_clock::period::num);
+#else
+        // The counter rate is measured against steady_clock over the whole session,
+        // a very short one is extended so the estimate is not dominated by clock resolution
+        std::chrono::steady_clock::time_point now;
+        uint64_t tick;
+        do
+        {
+            now = std::chrono::steady_clock::now();
+            tick = Profiler::Now();
+        } while (now - state.baseTime < minElapsed);
+        double seconds = std::chrono::duration<double>(now - state.baseTime).count();
+        return double(tick - state.baseTick) / seconds;
+#endif
+    }
+
+    void WriteEscaped(FILE* pFile, const char* text)
+    {
+        for (; *text != 0; text++)
+        {
+            unsigned char c = static_cast<unsigned char>(*text);
+            if (c == '"' || c == '\\')
+                fprintf(pFile, "\\%c", c);
+            else if (c < 0x20)
+                fprintf(pFile, "\\u%04x", c);
+            else
+                fputc(c, pFile);
+        }
+    }
+}
+
+void Profiler::Record(const char* name, uint64_t start, uint64_t end)
+{
+    ThreadBuffer* pBuffer = t_pBuffer;
+    if (pBuffer == nullptr)
+        pBuffer = RegisterThread();
+    Append(*pBuffer, name, start, end);
+}
+
+void Profiler::SetThreadName(const char* name)
+{
+    ThreadBuffer* pBuffer = t_pBuffer;
+    if (pBuffer == nullptr)
+        pBuffer = RegisterThread();
+    std::lock_guard<std::mutex> lock(GetState().mutex);
+    pBuffer->name = name;
+}
+
+int Profiler::RegisterTrack(const char* name)
+{
+    ProfilerState& state = GetState();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    ThreadBuffer* pBuffer = AddBuffer(state);
+    pBuffer->name = name;
+    return int(state.buffers.size() - 1);
+}
+
+void Profiler::RecordOnTrack(int track, const char* name, uint64_t start, uint64_t end)
+{
+    ProfilerState& state = GetState();
+    ThreadBuffer* pBuffer;
+    {
+        // The vector may grow while another thread registers, the buffers themselves don't move
+        std::lock_guard<std::mutex> lock(state.mutex);
+        pBuffer = state.buffers[track].get();
+    }
+    Append(*pBuffer, name, start, end);
+}
+
+double Profiler::GetTicksPerSecond()
+{
+    return MeasureTicksPerSecond(GetState(), std::chrono::milliseconds(1));
+}
+
+bool Profiler::WriteChromeTrace(const char* path)
+{
+    ProfilerState& state = GetState();
+    const double ticksPerMicrosecond = 1e-6 * MeasureTicksPerSecond(state, std::chrono::milliseconds(50));
+
+    FILE* pFile = nullptr;
+#ifdef _MSC_VER
+    fopen_s(&pFile, path, "w");
+#else
+    pFile = fopen(path, "w");
+#endif
+    if (pFile == nullptr)
+        return false;
+
+    std::lock_guard<std::mutex> lock(state.mutex);
+    fprintf(pFile, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+    for (const std::unique_ptr<ThreadBuffer>& pBuffer : state.buffers)
+    {
+        fprintf(pFile, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"",
+            first ? "" : ",\n", pBuffer->threadId);
+        WriteEscaped(pFile, pBuffer->name.c_str());
+        fprintf(pFile, "\"}}");
+        first = false;
+
+        const uint64_t count = pBuffer->count.load(std::memory_order_acquire);
+        const uint64_t pinnedCount = count < PinnedCapacity ? count : PinnedCapacity;
+        const uint64_t ringCount = count - pinnedCount;
+        // Older ring events were overwritten, only the last RingCapacity are left
+        const uint64_t ringFirst = ringCount > RingCapacity ? ringCount - RingCapacity : 0;
+        for (uint64_t idx = 0; idx < pinnedCount + ringCount - ringFirst; idx++)
+        {
+            const ProfileEvent& event = idx < pinnedCount
+                ? pBuffer->pinned[idx]
+                : pBuffer->ring[(ringFirst + idx - pinnedCount) & (RingCapacity - 1)];
+            double ts = double(int64_t(event.start - state.baseTick)) / ticksPerMicrosecond;
+            double dur = double(event.end - event.start) / ticksPerMicrosecond;
+            fprintf(pFile, ",\n{\"name\":\"");
+            WriteEscaped(pFile, event.name);
+            fprintf(pFile, "\",\"cat\":\"cpu\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                pBuffer->threadId, ts, dur);
+        }
+    }
+    fprintf(pFile, "\n]}\n");
+    bool result = ferror(pFile) == 0;
+    fclose(pFile);
+    return result;
+}
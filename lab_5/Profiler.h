@@ -0,0 +1,77 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#if !defined(PROFILER_USE_STEADY_CLOCK)
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
+
+// Scoped CPU profiler. Every thread records finished scopes into its own ring
+// buffer, so a marker costs two timestamp reads and a store with no locking.
+// The first events of a thread are never overwritten to keep startup in the
+// trace, later ones wrap around and keep the most recent frames.
+// Timestamps come from rdtsc unless PROFILER_USE_STEADY_CLOCK is defined;
+// defining PROFILER_DISABLED compiles every PROFILE_SCOPE out.
+class Profiler
+{
+public:
+    static const size_t PinnedCapacity = 512;
+    static const size_t RingCapacity = 1 << 14;
+
+    static uint64_t Now()
+    {
+#if defined(PROFILER_USE_STEADY_CLOCK)
+        return uint64_t(std::chrono::steady_clock::now().time_since_epoch().count());
+#else
+        return __rdtsc();
+#endif
+    }
+
+    // name must outlive the profiler, markers pass string literals
+    static void Record(const char* name, uint64_t start, uint64_t end);
+    // Shown as the track name in the trace, name is copied
+    static void SetThreadName(const char* name);
+    // Extra track for events that don't come from a CPU thread, like GPU timings.
+    // A track must only be written from one thread at a time.
+    static int RegisterTrack(const char* name);
+    static void RecordOnTrack(int track, const char* name, uint64_t start, uint64_t end);
+    // Rate of Now(), estimated against steady_clock since the profiler started
+    static double GetTicksPerSecond();
+
+    // Writes every recorded event in the Chrome trace event format, open it in
+    // chrome://tracing or ui.perfetto.dev. Should be called while no thread records.
+    static bool WriteChromeTrace(const char* path);
+};
+
+class ProfileScope
+{
+public:
+    explicit ProfileScope(const char* name)
+        : m_name(name), m_start(Profiler::Now())
+    {
+    }
+    ~ProfileScope()
+    {
+        Profiler::Record(m_name, m_start, Profiler::Now());
+    }
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+private:
+    const char* m_name;
+    uint64_t m_start;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+#ifndef PROFILER_DISABLED
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#else
+#define PROFILE_SCOPE(name) ((void)0)
+#endif
@@ -28,9 +28,85 @@ struct SceneBuffer {
 	DirectX::XMVECTOR objects;
 };
 
+struct AmbientBuffer {
+	ShCoefficients irradiance;
+	// x scales the ambient term in, 0 leaves textures unlit; y reflectance at
+	// normal incidence, z prefiltered level to reflect from, w reflection weight
+	DirectX::XMVECTOR params;
+};
+
 struct ViewBuffer {
 	DirectX::XMMATRIX vp;
 	DirectX::XMVECTOR cameraPosition;
+	DirectX::XMMATRIX invVp;
+};
+
+struct UpscaleBuffer {
+	// xy: rendered size over the scene target size, zw: one over the back buffer size
+	DirectX::XMFLOAT4 uvScale;
+	// xy: last texel center inside the rendered area
+	DirectX::XMFLOAT4 uvClamp;
+};
+
+// Dielectric, most of the reflection shows at grazing angles
+static const float ReflectionF0 = 0.04f;
+
+enum DrawPass : UINT32 {
+	DrawPassOpaque = 0,
+	DrawPassSkybox,
+	DrawPassTransparent,
+};
+
+enum DrawShader : UINT32 {
+	DrawShaderTexture = 0,
+	DrawShaderTransTexture,
+	DrawShaderTransTextureOit,
+};
+
+enum DrawTexture : UINT32 {
+	DrawTextureKit = 0,
+};
+
+static const TextureVertex CubeVertices[] = {
+	{-1.0, -1.0, -1.0 , 0.0, 1.0},
+	{-1.0,  1.0, -1.0, 0.0, 0.0},
+	{ 1.0,  1.0, -1.0, 1.0, 0.0},
+	{ 1.0, -1.0, -1.0, 1.0, 1.0},
+
+	{ 1.0, -1.0,  1.0, 0.0, 1.0},
+	{ 1.0,  1.0,  1.0, 0.0, 0.0},
+	{-1.0,  1.0,  1.0, 1.0, 0.0},
+	{-1.0, -1.0,  1.0, 1.0, 1.0},
+
+	{-1.0, -1.0,  1.0, 0.0, 1.0},
+	{-1.0,  1.0,  1.0, 0.0, 0.0},
+	{-1.0,  1.0, -1.0, 1.0, 0.0},
+	{-1.0, -1.0, -1.0, 1.0, 1.0},
+
+	{ 1.0, -1.0, -1.0, 0.0, 1.0},
+	{ 1.0,  1.0, -1.0, 0.0, 0.0},
+	{ 1.0,  1.0,  1.0, 1.0, 0.0},
+	{ 1.0, -1.0,  1.0, 1.0, 1.0},
+
+	{-1.0,  1.0, -1.0, 0.0, 1.0},
+	{-1.0,  1.0,  1.0, 0.0, 0.0},
+	{ 1.0,  1.0,  1.0, 1.0, 0.0},
+	{ 1.0,  1.0, -1.0, 1.0, 1.0},
+
+	{-1.0, -1.0,  1.0, 0.0, 1.0},
+	{-1.0, -1.0, -1.0, 0.0, 0.0},
+	{ 1.0, -1.0, -1.0, 1.0, 0.0},
+	{ 1.0, -1.0,  1.0, 1.0, 1.0},
+
+};
+
+static const USHORT CubeIndices[] = {
+	0, 1, 2, 2, 3, 0,
+	4, 5, 6, 6, 7, 4,
+	8, 9, 10, 10, 11, 8,
+	12, 13, 14, 14, 15, 12,
+	16, 17, 18, 18, 19, 16,
+	20, 21, 22, 22, 23, 20,
 };
 
 UINT32 Up(UINT32 a, UINT32 b)
@@ -45,13 +121,33 @@ std::string ws2s(const std::wstring& wstr) {
 	return converterX.to_bytes(wstr);
 }
 
+static const UINT SwapChainFlags = DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT;
+
 inline HRESULT SetResourceName(ID3D11DeviceChild* pDevice, const std::string& name)
 {
 	return pDevice->SetPrivateData(WKPDID_D3DDebugObjectName, (UINT)name.length(), name.c_str());
 }
 
+template <typename T>
+HRESULT Renderer::RegisterResource(T* pObject, ResourceHandle<T>& handle, const std::string& name)
+{
+	handle = m_resources.Add(pObject, name.c_str());
+	return SetResourceName(pObject, name);
+}
+
+template <typename Shader>
+HRESULT Renderer::LoadShader(const std::wstring& path, ResourceHandle<Shader>& shader, const std::string& ext, ID3DBlob** ppCode)
+{
+	Shader* pShader = nullptr;
+	HRESULT result = CompileShader(path, (ID3D11DeviceChild**)&pShader, ext, ppCode);
+	if (pShader != nullptr)
+		shader = m_resources.Add(pShader, ws2s(path).c_str());
+	return result;
+}
+
 bool Renderer::Init(HWND hWnd)
 {
+	PROFILE_SCOPE("Renderer::Init");
 	// Create a DirectX graphics interface factory.
 	IDXGIFactory* pFactory = nullptr;
 	HRESULT result = CreateDXGIFactory(__uuidof(IDXGIFactory), (void**)&pFactory);
@@ -109,13 +205,43 @@ bool Renderer::Init(HWND hWnd)
 	swapChainDesc.BufferDesc.ScanlineOrdering = DXGI_MODE_SCANLINE_ORDER_UNSPECIFIED;
 	swapChainDesc.BufferDesc.Scaling = DXGI_MODE_SCALING_UNSPECIFIED;
 	swapChainDesc.SwapEffect = DXGI_SWAP_EFFECT_FLIP_DISCARD;
-	swapChainDesc.Flags = 0;
+	swapChainDesc.Flags = SwapChainFlags;
 
 	result = pFactory->CreateSwapChain(m_pDevice, &swapChainDesc, &m_pSwapChain);
 	if (!SUCCEEDED(result))
 		return false;
 
-	result = SetupDepthBlend();
+	// At most one frame queued ahead, the CPU waits for the swap chain instead of inside Present
+	IDXGISwapChain2* pSwapChain2 = nullptr;
+	result = m_pSwapChain->QueryInterface(__uuidof(IDXGISwapChain2), (void**)&pSwapChain2);
+	if (SUCCEEDED(result))
+	{
+		pSwapChain2->SetMaximumFrameLatency(1);
+		m_frameLatencyWaitableObject = pSwapChain2->GetFrameLatencyWaitableObject();
+		SafeRelease(pSwapChain2);
+	}
+
+	// Default Sleep granularity is ~15.6 ms, too coarse for frame pacing
+	m_timerPeriodSet = timeBeginPeriod(1) == TIMERR_NOERROR;
+	DEVMODE displayMode = {};
+	displayMode.dmSize = sizeof(displayMode);
+	if (EnumDisplaySettings(nullptr, ENUM_CURRENT_SETTINGS, &displayMode) && displayMode.dmDisplayFrequency > 1)
+		m_framePacer.SetTargetFps(displayMode.dmDisplayFrequency);
+	else
+		m_framePacer.SetTargetFps(60.0);
+
+	m_frameGraphBackend.SetDevice(m_pDevice);
+
+	result = m_deferredContexts.Init(m_pDevice, m_pDeviceContext, MaxRecordingSlots);
+	if (!SUCCEEDED(result))
+		return false;
+	m_parallelRecorder.Start(min(3u, max(1u, std::thread::hardware_concurrency() - 1)));
+	// GPU timings are optional, the profiler turns itself off if queries can't be created
+	m_gpuQueryBackend.SetDevice(m_pDevice, m_pDeviceContext);
+	m_gpuProfiler.Init(m_gpuQueryBackend);
+	m_occlusionBuffer.Resize(OcclusionBufferWidth, OcclusionBufferHeight);
+	m_transparencyModeStart = std::chrono::steady_clock::now();
+
 	result = SetupBackBuffer();
 	if (!SUCCEEDED(result))
 		return false;
@@ -125,6 +251,10 @@ bool Renderer::Init(HWND hWnd)
 		return false;
 
 	result = InitShaders();
+	if (SUCCEEDED(result))
+	{
+		result = InitPipelineStates();
+	}
 
 	SafeRelease(pSelectedAdapter);
 	SafeRelease(pFactory);
@@ -141,59 +271,94 @@ Renderer::~Renderer() {
 	Clean();
 }
 
-HRESULT Renderer::SetupDepthBlend() {
-	HRESULT result = S_OK;
-	{
-		D3D11_DEPTH_STENCIL_DESC desc = {};
-		desc.DepthEnable = TRUE;
-		desc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ALL;
-		desc.DepthFunc = D3D11_COMPARISON_GREATER_EQUAL;
-		desc.StencilEnable = FALSE;
-
-		result = m_pDevice->CreateDepthStencilState(&desc, &m_pDepthStateReadWrite);
-		if (SUCCEEDED(result))
-		{
-			result = SetResourceName(m_pDepthStateReadWrite, "DepthStateReadWrite");
-		}
-
-	}
-	{
-		D3D11_DEPTH_STENCIL_DESC desc = {};
-		desc.DepthEnable = TRUE;
-		desc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ZERO;
-		desc.DepthFunc = D3D11_COMPARISON_GREATER_EQUAL;
-		desc.StencilEnable = FALSE;
-
-		result = m_pDevice->CreateDepthStencilState(&desc, &m_pDepthStateRead);
-		if (SUCCEEDED(result))
-		{
-			result = SetResourceName(m_pDepthStateRead, "DepthStateRead");
-		}
-	}
+HRESULT Renderer::InitPipelineStates() {
+	m_pipelineStates.SetDevice(m_pDevice);
+
+	// Reversed depth: the buffer is cleared to 0 and nearer fragments are greater
+	PipelineStateDesc opaque;
+	opaque.pVS = m_resources.Get(m_textureVS);
+	opaque.pPS = m_resources.Get(m_texturePS);
+	opaque.pInputLayout = m_resources.Get(m_textureInputLayout);
+	opaque.depthStencil.DepthFunc = D3D11_COMPARISON_GREATER_EQUAL;
+	m_pOpaqueState = m_pipelineStates.Get(opaque);
+
+	PipelineStateDesc skybox = opaque;
+	skybox.pVS = m_resources.Get(m_skyboxVS);
+	skybox.pPS = m_resources.Get(m_skyboxPS);
+	skybox.pInputLayout = m_resources.Get(m_skyboxInputLayout);
+	skybox.depthStencil.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ZERO;
+	// The sphere faces outward and the camera sits inside it
+	skybox.rasterizer.CullMode = D3D11_CULL_FRONT;
+	m_pSkyboxState = m_pipelineStates.Get(skybox);
+
+	// Fullscreen triangle at depth 0, the equal test shades only pixels still at the clear value
+	PipelineStateDesc skyboxRays = skybox;
+	skyboxRays.pVS = m_resources.Get(m_skyboxRayVS);
+	skyboxRays.pInputLayout = nullptr;
+	skyboxRays.depthStencil.DepthFunc = D3D11_COMPARISON_EQUAL;
+	skyboxRays.rasterizer.CullMode = D3D11_CULL_BACK;
+	m_pSkyboxRayState = m_pipelineStates.Get(skyboxRays);
+
+	PipelineStateDesc transparent = skybox;
+	transparent.pVS = m_resources.Get(m_transTextureVS);
+	transparent.pPS = m_resources.Get(m_transTexturePS);
+	transparent.pInputLayout = m_resources.Get(m_transTextureInputLayout);
+	transparent.rasterizer.CullMode = D3D11_CULL_BACK;
+	D3D11_RENDER_TARGET_BLEND_DESC& alphaBlend = transparent.blend.RenderTarget[0];
+	alphaBlend.BlendEnable = TRUE;
+	alphaBlend.SrcBlend = D3D11_BLEND_SRC_ALPHA;
+	alphaBlend.DestBlend = D3D11_BLEND_INV_SRC_ALPHA;
+	alphaBlend.SrcBlendAlpha = D3D11_BLEND_ONE;
+	alphaBlend.DestBlendAlpha = D3D11_BLEND_ZERO;
+	alphaBlend.RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_RED | D3D11_COLOR_WRITE_ENABLE_GREEN | D3D11_COLOR_WRITE_ENABLE_BLUE;
+	m_pTransparentState = m_pipelineStates.Get(transparent);
+
+	// Target 0 sums weighted premultiplied color, target 1 multiplies revealage by (1 - alpha)
+	PipelineStateDesc transparentOit = transparent;
+	transparentOit.pPS = m_resources.Get(m_transTextureOitPS);
+	transparentOit.blend.IndependentBlendEnable = TRUE;
+	D3D11_RENDER_TARGET_BLEND_DESC& accum = transparentOit.blend.RenderTarget[0];
+	accum.BlendEnable = TRUE;
+	accum.SrcBlend = D3D11_BLEND_ONE;
+	accum.DestBlend = D3D11_BLEND_ONE;
+	accum.SrcBlendAlpha = D3D11_BLEND_ONE;
+	accum.DestBlendAlpha = D3D11_BLEND_ONE;
+	accum.RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_ALL;
+	D3D11_RENDER_TARGET_BLEND_DESC& revealage = transparentOit.blend.RenderTarget[1];
+	revealage.BlendEnable = TRUE;
+	revealage.SrcBlend = D3D11_BLEND_ZERO;
+	revealage.DestBlend = D3D11_BLEND_INV_SRC_COLOR;
+	revealage.SrcBlendAlpha = D3D11_BLEND_ZERO;
+	revealage.DestBlendAlpha = D3D11_BLEND_INV_SRC_ALPHA;
+	revealage.RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_RED;
+	m_pTransparentOitState = m_pipelineStates.Get(transparentOit);
+
+	// Fullscreen triangle from SV_VertexID, blended over the back buffer without depth
+	PipelineStateDesc oitResolve = transparent;
+	oitResolve.pVS = m_resources.Get(m_oitResolveVS);
+	oitResolve.pPS = m_resources.Get(m_oitResolvePS);
+	oitResolve.pInputLayout = nullptr;
+	oitResolve.depthStencil.DepthEnable = FALSE;
+	oitResolve.depthStencil.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ZERO;
+	m_pOitResolveState = m_pipelineStates.Get(oitResolve);
+
+	// Same triangle, the scene replaces the back buffer
+	PipelineStateDesc upscale = oitResolve;
+	upscale.pPS = m_resources.Get(m_upscalePS);
+	upscale.blend.RenderTarget[0].BlendEnable = FALSE;
+	upscale.blend.RenderTarget[0].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_ALL;
+	m_pUpscaleState = m_pipelineStates.Get(upscale);
+
+	if (m_pOpaqueState == nullptr || m_pSkyboxState == nullptr || m_pSkyboxRayState == nullptr || m_pTransparentState == nullptr ||
+		m_pTransparentOitState == nullptr || m_pOitResolveState == nullptr || m_pUpscaleState == nullptr)
 	{
-		D3D11_BLEND_DESC desc = {};
-		desc.AlphaToCoverageEnable = FALSE;
-		desc.IndependentBlendEnable = FALSE;
-		desc.RenderTarget[0].BlendEnable = TRUE;
-		desc.RenderTarget[0].BlendOp = D3D11_BLEND_OP_ADD;
-		desc.RenderTarget[0].DestBlend = D3D11_BLEND_INV_SRC_ALPHA;
-		desc.RenderTarget[0].SrcBlend = D3D11_BLEND_SRC_ALPHA;
-		desc.RenderTarget[0].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_RED | D3D11_COLOR_WRITE_ENABLE_GREEN | D3D11_COLOR_WRITE_ENABLE_BLUE;
-		desc.RenderTarget[0].BlendOpAlpha = D3D11_BLEND_OP_ADD;
-		desc.RenderTarget[0].DestBlendAlpha = D3D11_BLEND_ZERO;
-		desc.RenderTarget[0].SrcBlendAlpha = D3D11_BLEND_ONE;
-		result = m_pDevice->CreateBlendState(&desc, &m_pTransBlendState);
-
-		if (SUCCEEDED(result))
-		{
-			result = SetResourceName(m_pTransBlendState, "TransBlendState");
-		}
+		return E_FAIL;
 	}
-	assert(SUCCEEDED(result));
-	return result;
+	return S_OK;
 }
 
 HRESULT Renderer::InitTextures() {
+	PROFILE_SCOPE("Renderer::InitTextures");
 	TextureDesc textureDesc;
 	HRESULT result;
 	{
@@ -228,10 +393,11 @@ HRESULT Renderer::InitTextures() {
 			blockWidth = max(1u, blockWidth / 2);
 			pitch = blockWidth * UINT32(GetBytesPerBlock(desc.Format));
 		}
-		result = m_pDevice->CreateTexture2D(&desc, data.data(), &m_pKitTexture);
+		ID3D11Texture2D* pTexture = nullptr;
+		result = m_pDevice->CreateTexture2D(&desc, data.data(), &pTexture);
 
 		if (SUCCEEDED(result))
-			result = SetResourceName(m_pKitTexture, ws2s(TextureName));
+			result = RegisterResource(pTexture, m_kitTexture, ws2s(TextureName));
 	}
 	{
 		D3D11_SHADER_RESOURCE_VIEW_DESC desc = {};
@@ -239,10 +405,11 @@ HRESULT Renderer::InitTextures() {
 		desc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
 		desc.Texture2D.MipLevels = textureDesc.mipmapsCount;
 		desc.Texture2D.MostDetailedMip = 0;
-		result = m_pDevice->CreateShaderResourceView(m_pKitTexture, &desc, &m_pKitTextureView);
+		ID3D11ShaderResourceView* pView = nullptr;
+		result = m_pDevice->CreateShaderResourceView(m_resources.Get(m_kitTexture), &desc, &pView);
 		assert(SUCCEEDED(result));
 		if (SUCCEEDED(result)) {
-			result = SetResourceName(m_pKitTextureView, "KitTexture");
+			result = RegisterResource(pView, m_kitTextureView, "KitTexture");
 		}
 	}
 	{
@@ -257,12 +424,33 @@ HRESULT Renderer::InitTextures() {
 		desc.MaxAnisotropy = 16;
 		desc.ComparisonFunc = D3D11_COMPARISON_NEVER;
 		desc.BorderColor[0] = desc.BorderColor[1] = desc.BorderColor[2] = desc.BorderColor[3] = 1.0f;
-		result = m_pDevice->CreateSamplerState(&desc, &m_pTextureSampler);
+		ID3D11SamplerState* pSampler = nullptr;
+		result = m_pDevice->CreateSamplerState(&desc, &pSampler);
 		assert(SUCCEEDED(result));
 		if (SUCCEEDED(result)) {
-			result = SetResourceName(m_pTextureSampler, "TextureSampler");
+			result = RegisterResource(pSampler, m_textureSampler, "TextureSampler");
 		}
 	}
+	{
+		// Bilinear upscale, clamped so the left and top edges don't wrap around
+		D3D11_SAMPLER_DESC desc = {};
+		desc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
+		desc.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
+		desc.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
+		desc.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
+		desc.MinLOD = -FLT_MAX;
+		desc.MaxLOD = FLT_MAX;
+		desc.ComparisonFunc = D3D11_COMPARISON_NEVER;
+		ID3D11SamplerState* pSampler = nullptr;
+		result = m_pDevice->CreateSamplerState(&desc, &pSampler);
+		assert(SUCCEEDED(result));
+		if (SUCCEEDED(result)) {
+			result = RegisterResource(pSampler, m_upscaleSampler, "UpscaleSampler");
+		}
+	}
+
+	if (SUCCEEDED(result))
+		result = InitSpecularCubemap();
 
 	DXGI_FORMAT textureFmt;
 	{
@@ -299,11 +487,14 @@ HRESULT Renderer::InitTextures() {
 			data[i].SysMemPitch = pitch;
 			data[i].SysMemSlicePitch = 0;
 		}
-		result = m_pDevice->CreateTexture2D(&desc, data, &m_pCubemapTexture);
+		ID3D11Texture2D* pTexture = nullptr;
+		result = m_pDevice->CreateTexture2D(&desc, data, &pTexture);
 		assert(SUCCEEDED(result));
 		if (SUCCEEDED(result)) {
-			result = SetResourceName(m_pCubemapTexture, "CubemapTexture");
+			result = RegisterResource(pTexture, m_cubemapTexture, "CubemapTexture");
 		}
+		if (SUCCEEDED(result) && ddsRes)
+			result = InitSkyIrradiance(texDescs);
 	}
 	{
 		D3D11_SHADER_RESOURCE_VIEW_DESC desc;
@@ -312,122 +503,255 @@ HRESULT Renderer::InitTextures() {
 		desc.TextureCube.MipLevels = 1;
 		desc.TextureCube.MostDetailedMip = 0;
 
-		result = m_pDevice->CreateShaderResourceView(m_pCubemapTexture, &desc, &m_pCubemapTextureView);
+		ID3D11ShaderResourceView* pView = nullptr;
+		result = m_pDevice->CreateShaderResourceView(m_resources.Get(m_cubemapTexture), &desc, &pView);
 		assert(SUCCEEDED(result));
 		if (SUCCEEDED(result))
 		{
-			result = SetResourceName(m_pCubemapTextureView, "CubemapTextureView");
+			result = RegisterResource(pView, m_cubemapTextureView, "CubemapTextureView");
 		}
 	}
 	return result;
 }
 
-HRESULT Renderer::InitShaders() {
-	std::vector<Vertex> sphereVertices;
-	std::vector<USHORT> sphereIndices;
-	int hRes = 18;
-	int wRes = 8;
-	float rad = 1.1f;
+HRESULT Renderer::InitSkyIrradiance(const TextureDesc (&faces)[6])
+{
+	PROFILE_SCOPE("Renderer::InitSkyIrradiance");
+	// Ambient light comes from the sky's spherical harmonics, cached next to the faces
+	static const char CachePath[] = "src/skybox_sh.bin";
+	CubemapFaces cubemap = {};
+	cubemap.size = faces[0].width;
+	cubemap.format = faces[0].fmt == DXGI_FORMAT_R8G8B8A8_UNORM ? CubemapFormatRGBA8 : CubemapFormatBC1;
+	for (int i = 0; i < 6; i++)
+	{
+		cubemap.pFaces[i] = faces[i].pData;
+	}
 
-	for (int w = 0; w <= wRes; w++)
+	AmbientBuffer ambient = {};
+	ambient.params = GetAmbientParams();
+	if ((faces[0].fmt == DXGI_FORMAT_BC1_UNORM || faces[0].fmt == DXGI_FORMAT_R8G8B8A8_UNORM) && faces[0].width == faces[0].height)
 	{
-		for (int h = 0; h <= hRes; h++)
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		const uint64_t hash = HashCubemapFaces(cubemap);
+		ShCoefficients radiance;
+		const bool cached = ReadShCache(CachePath, hash, radiance);
+		if (!cached)
 		{
-			float alpha = float(M_PI) * 2.0f * h / hRes;
-			float beta = float(M_PI) * 1.0f * w / wRes;
-			float x = rad * sinf(beta) * cosf(alpha);
-			float z = rad * sinf(beta) * sinf(alpha);
-			float y = rad * cosf(beta);
-			sphereVertices.push_back({ x, y, z });
+			ProjectCubemapSh(cubemap, radiance, &m_workerPool);
+			WriteShCache(CachePath, hash, radiance);
 		}
+		ShRadianceToIrradiance(radiance, ambient.irradiance);
+
+		char message[128];
+		sprintf_s(message, "Sky irradiance %s in %.3f ms\n", cached ? "read from cache" : "projected",
+			std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+		OutputDebugStringA(message);
+	}
+	else
+	{
+		// Formats the projection doesn't decode get a flat white ambient, textures look unlit
+		ambient.irradiance.c[0][0] = ambient.irradiance.c[0][1] = ambient.irradiance.c[0][2] = 1.0f;
+	}
+	m_skyIrradiance = ambient.irradiance;
+
+	D3D11_BUFFER_DESC desc = {};
+	desc.ByteWidth = sizeof(AmbientBuffer);
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	D3D11_SUBRESOURCE_DATA data = { &ambient, 0, 0 };
+
+	ID3D11Buffer* pBuffer = nullptr;
+	HRESULT result = m_pDevice->CreateBuffer(&desc, &data, &pBuffer);
+	if (SUCCEEDED(result))
+		result = RegisterResource(pBuffer, m_ambientBuffer, "AmbientBuffer");
+	return result;
+}
+
+HRESULT Renderer::InitSpecularCubemap()
+{
+	TextureDesc prefiltered;
+	if (!LoadDDS(L"src/skybox_prefiltered.dds", prefiltered) || prefiltered.fmt != DXGI_FORMAT_R8G8B8A8_UNORM
+		|| prefiltered.width != prefiltered.height || prefiltered.mipmapsCount == 0)
+	{
+		OutputDebugStringA("No prefiltered sky, reflections sample the skybox\n");
+		return S_OK;
 	}
 
-	for (int w = 0; w < wRes; w++)
+	// The file goes face by face, each from the largest level down, the same order as the subresources
+	const UINT32 mipCount = prefiltered.mipmapsCount;
+	std::vector<D3D11_SUBRESOURCE_DATA> data(6 * mipCount);
+	const uint8_t* pTexels = static_cast<const uint8_t*>(prefiltered.pData);
+	for (UINT32 face = 0; face < 6; face++)
 	{
-		for (int h = 0; h < hRes; h++)
+		for (UINT32 mip = 0; mip < mipCount; mip++)
 		{
-			int i = w * (hRes + 1) + h;
-			int iNext = i + (hRes + 1);
-			if (w != 0)
-			{
-				sphereIndices.push_back(iNext + 1);
-				sphereIndices.push_back(i + 1);
-				sphereIndices.push_back(i);
-			}
-			if (w + 1 != wRes)
-			{
-				sphereIndices.push_back(i);
-				sphereIndices.push_back(iNext);
-				sphereIndices.push_back(iNext + 1);
-			}
-
+			const UINT32 size = max(prefiltered.width >> mip, 1u);
+			D3D11_SUBRESOURCE_DATA& subresource = data[face * mipCount + mip];
+			subresource.pSysMem = pTexels;
+			subresource.SysMemPitch = size * 4;
+			subresource.SysMemSlicePitch = 0;
+			pTexels += size_t(size) * size * 4;
 		}
 	}
 
+	D3D11_TEXTURE2D_DESC desc = {};
+	desc.Format = prefiltered.fmt;
+	desc.ArraySize = 6;
+	desc.MipLevels = mipCount;
+	desc.Usage = D3D11_USAGE_IMMUTABLE;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	desc.MiscFlags = D3D11_RESOURCE_MISC_TEXTURECUBE;
+	desc.SampleDesc.Count = 1;
+	desc.Height = prefiltered.height;
+	desc.Width = prefiltered.width;
+	ID3D11Texture2D* pTexture = nullptr;
+	HRESULT result = m_pDevice->CreateTexture2D(&desc, data.data(), &pTexture);
+	if (SUCCEEDED(result))
+		result = RegisterResource(pTexture, m_specularTexture, "SpecularTexture");
+	if (SUCCEEDED(result))
+	{
+		D3D11_SHADER_RESOURCE_VIEW_DESC viewDesc = {};
+		viewDesc.Format = desc.Format;
+		viewDesc.ViewDimension = D3D_SRV_DIMENSION_TEXTURECUBE;
+		viewDesc.TextureCube.MipLevels = mipCount;
+		viewDesc.TextureCube.MostDetailedMip = 0;
+		ID3D11ShaderResourceView* pView = nullptr;
+		result = m_pDevice->CreateShaderResourceView(m_resources.Get(m_specularTexture), &viewDesc, &pView);
+		if (SUCCEEDED(result))
+			result = RegisterResource(pView, m_specularTextureView, "SpecularTextureView");
+	}
+	if (SUCCEEDED(result))
+		m_specularMipCount = mipCount;
+	return result;
+}
 
-	static const TextureVertex Vertices[] = {
-		{-1.0, -1.0, -1.0 , 0.0, 1.0},
-		{-1.0,  1.0, -1.0, 0.0, 0.0},
-		{ 1.0,  1.0, -1.0, 1.0, 0.0},
-		{ 1.0, -1.0, -1.0, 1.0, 1.0},
-
-		{ 1.0, -1.0,  1.0, 0.0, 1.0},
-		{ 1.0,  1.0,  1.0, 0.0, 0.0},
-		{-1.0,  1.0,  1.0, 1.0, 0.0},
-		{-1.0, -1.0,  1.0, 1.0, 1.0},
-
-		{-1.0, -1.0,  1.0, 0.0, 1.0},
-		{-1.0,  1.0,  1.0, 0.0, 0.0},
-		{-1.0,  1.0, -1.0, 1.0, 0.0},
-		{-1.0, -1.0, -1.0, 1.0, 1.0},
+DirectX::XMVECTOR Renderer::GetAmbientParams() const
+{
+	// Roughness maps linearly onto the levels, as GetPrefilterRoughness filtered them;
+	// diffuse and reflected sky light switch on independently
+	return DirectX::XMVectorSet(m_useAmbientLight ? 1.0f : 0.0f, ReflectionF0, m_reflectionRoughness * float(m_specularMipCount - 1),
+		m_useSkyReflections ? 1.0f : 0.0f);
+}
 
-		{ 1.0, -1.0, -1.0, 0.0, 1.0},
-		{ 1.0,  1.0, -1.0, 0.0, 0.0},
-		{ 1.0,  1.0,  1.0, 1.0, 0.0},
-		{ 1.0, -1.0,  1.0, 1.0, 1.0},
+static void ReportQuantization(const char* mesh, size_t vertexCount, size_t sourceStride, size_t packedStride, const QuantizationError& error)
+{
+	char message[256];
+	sprintf_s(message, "%s: %zu vertices, %zu -> %zu bytes each, position error max %.3g rms %.3g (%.3g of extent), uv error max %.3g\n",
+		mesh, vertexCount, sourceStride, packedStride, error.maxPosition, error.rmsPosition, error.maxRelativePosition, error.maxUV);
+	OutputDebugStringA(message);
+}
 
-		{-1.0,  1.0, -1.0, 0.0, 1.0},
-		{-1.0,  1.0,  1.0, 0.0, 0.0},
-		{ 1.0,  1.0,  1.0, 1.0, 0.0},
-		{ 1.0,  1.0, -1.0, 1.0, 1.0},
+static void ReportIndexOptimization(const char* mesh, const VertexCacheStats& before, const VertexCacheStats& after)
+{
+	char message[256];
+	sprintf_s(message, "%s: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", mesh, before.acmr, after.acmr, before.atvr, after.atvr);
+	OutputDebugStringA(message);
+}
 
-		{-1.0, -1.0,  1.0, 0.0, 1.0},
-		{-1.0, -1.0, -1.0, 0.0, 0.0},
-		{ 1.0, -1.0, -1.0, 1.0, 0.0},
-		{ 1.0, -1.0,  1.0, 1.0, 1.0},
+HRESULT Renderer::CreateMeshBuffer(const VertexQuantization& quantization, ResourceHandle<ID3D11Buffer>& buffer, const std::string& name)
+{
+	D3D11_BUFFER_DESC desc = {};
+	desc.ByteWidth = sizeof(VertexQuantization);
+	desc.Usage = D3D11_USAGE_IMMUTABLE;
+	desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	D3D11_SUBRESOURCE_DATA data = { &quantization, 0, 0 };
+
+	ID3D11Buffer* pBuffer = nullptr;
+	HRESULT result = m_pDevice->CreateBuffer(&desc, &data, &pBuffer);
+	if (SUCCEEDED(result))
+		result = RegisterResource(pBuffer, buffer, name);
+	return result;
+}
 
-	};
+HRESULT Renderer::InitShaders() {
+	PROFILE_SCOPE("Renderer::InitShaders");
+	// Skybox sphere; seen from inside, so its pipeline state culls front faces
+	GeneratedMesh<USHORT> sphere;
+	if (!GenerateUVSphere(1.1f, 8, 18, sphere))
+		return E_FAIL;
+	std::vector<MeshVertex>& sphereVertices = sphere.vertices;
+	std::vector<USHORT>& sphereIndices = sphere.indices;
+
+	std::vector<UINT32> sphereSourceIndices(sphereIndices.begin(), sphereIndices.end());
+	// Rings come out in scan order, reorder for the post-transform cache, overdraw and fetch locality
+	VertexCacheStats sphereCacheBefore = AnalyzeVertexCache(sphereSourceIndices.data(), sphereSourceIndices.size(), sphereVertices.size());
+	sphereVertices.resize(OptimizeMesh(sphereSourceIndices.data(), sphereSourceIndices.size(), sphereVertices.data(), sphereVertices.size(), sizeof(MeshVertex)));
+	ReportIndexOptimization("Sphere", sphereCacheBefore, AnalyzeVertexCache(sphereSourceIndices.data(), sphereSourceIndices.size(), sphereVertices.size()));
+	m_sphereLods.Build(&sphereVertices[0].x, sphereVertices.size(), sizeof(MeshVertex), sphereSourceIndices.data(), sphereSourceIndices.size());
+	// All levels share one index buffer, each drawn from its own offset
+	sphereIndices.assign(m_sphereLods.GetIndices().begin(), m_sphereLods.GetIndices().end());
+
+	// Vertex buffers hold 16 bit snorm positions and half float UVs, the vertex
+	// shaders decode positions with the mesh's scale and bias
+	VertexQuantization sphereQuantization = ComputeQuantization(&sphereVertices[0].x, sphereVertices.size(), sizeof(MeshVertex));
+	std::vector<PackedPosition> spherePacked(sphereVertices.size());
+	PackPositions(&sphereVertices[0].x, sphereVertices.size(), sizeof(MeshVertex), sphereQuantization, spherePacked.data());
+	ReportQuantization("Sphere", sphereVertices.size(), sizeof(Vertex), sizeof(PackedPosition),
+		MeasureQuantizationError(&sphereVertices[0].x, sphereVertices.size(), sizeof(MeshVertex), sphereQuantization, spherePacked.data()));
+
+	// The cube is drawn straight from the mapped mesh file, the built in one stands in when it's missing
+	VertexQuantization cubeQuantization;
+	PackedTextureVertex cubePacked[ARRAYSIZE(CubeVertices)];
+	const void* pCubeVertices = cubePacked;
+	UINT32 cubeVertexBytes = sizeof(cubePacked);
+	const void* pCubeIndices = CubeIndices;
+	UINT32 cubeIndexBytes = sizeof(CubeIndices);
+	const MeshLodLevel builtinCubeLod = { 0, UINT32(ARRAYSIZE(CubeIndices)), 0.0f };
+	m_cubeLods.SetLevels(&builtinCubeLod, 1, sqrtf(3.0f));
+	m_cubeIndexFormat = DXGI_FORMAT_R16_UINT;
+
+	std::chrono::steady_clock::time_point loadStart = std::chrono::steady_clock::now();
+	MeshFile cubeFile;
+	const MeshFileStream* pCubeStream = nullptr;
+	if (cubeFile.Open("src/cube.mesh"))
+		pCubeStream = cubeFile.FindStream(MeshStreamPackedTextureVertex);
+	if (pCubeStream != nullptr)
+	{
+		const MeshFileHeader& header = cubeFile.GetHeader();
+		cubeQuantization = header.quantization;
+		pCubeVertices = cubeFile.GetStreamData(*pCubeStream);
+		cubeVertexBytes = pCubeStream->size;
+		pCubeIndices = cubeFile.GetIndices();
+		cubeIndexBytes = header.indexCount * header.indexSize;
+		m_cubeLods.SetLevels(header.lods, header.lodCount, header.boundingSphere[3]);
+		m_cubeIndexFormat = header.indexSize == 2 ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
+
+		char buffer[128];
+		sprintf_s(buffer, "Cube: %u vertices from src/cube.mesh in %.3f ms\n", header.vertexCount,
+			std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - loadStart).count());
+		OutputDebugStringA(buffer);
+	}
+	else
+	{
+		cubeQuantization = ComputeQuantization(&CubeVertices[0].x, ARRAYSIZE(CubeVertices), sizeof(TextureVertex));
+		PackTextureVertices(&CubeVertices[0].x, &CubeVertices[0].u, ARRAYSIZE(CubeVertices), sizeof(TextureVertex), cubeQuantization, cubePacked);
+		ReportQuantization("Cube", ARRAYSIZE(CubeVertices), sizeof(TextureVertex), sizeof(PackedTextureVertex),
+			MeasureQuantizationError(&CubeVertices[0].x, &CubeVertices[0].u, ARRAYSIZE(CubeVertices), sizeof(TextureVertex), cubeQuantization, cubePacked));
+	}
 
-	static const USHORT Indices[] = {
-		0, 1, 2, 2, 3, 0,
-		4, 5, 6, 6, 7, 4,
-		8, 9, 10, 10, 11, 8,
-		12, 13, 14, 14, 15, 12,
-		16, 17, 18, 18, 19, 16,
-		20, 21, 22, 22, 23, 20,
-	};
 	HRESULT result;
 	{
 		D3D11_BUFFER_DESC desc = {};
-		desc.ByteWidth = sizeof(Vertex) * UINT32(sphereVertices.size());
+		desc.ByteWidth = sizeof(PackedPosition) * UINT32(spherePacked.size());
 		desc.Usage = D3D11_USAGE_IMMUTABLE;
 		desc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
 		desc.CPUAccessFlags = 0;
 		desc.MiscFlags = 0;
 		desc.StructureByteStride = 0;
 		D3D11_SUBRESOURCE_DATA data;
-		data.pSysMem = sphereVertices.data();
-		data.SysMemPitch = sizeof(Vertex) * UINT32(sphereVertices.size());
+		data.pSysMem = spherePacked.data();
+		data.SysMemPitch = sizeof(PackedPosition) * UINT32(spherePacked.size());
 		data.SysMemSlicePitch = 0;
 
-		result = m_pDevice->CreateBuffer(&desc, &data, &m_pSphereVertexBuffer);
+		ID3D11Buffer* pBuffer = nullptr;
+		result = m_pDevice->CreateBuffer(&desc, &data, &pBuffer);
 		if (SUCCEEDED(result)) {
-			result = SetResourceName(m_pSphereVertexBuffer, "SphereVertexBuffer");
+			result = RegisterResource(pBuffer, m_sphereVertexBuffer, "SphereVertexBuffer");
 		}
 	}
 	{
 		D3D11_BUFFER_DESC desc = {};
-		desc.ByteWidth = sizeof(UINT32) * UINT32(sphereIndices.size());
+		desc.ByteWidth = sizeof(USHORT) * UINT32(sphereIndices.size());
 		desc.Usage = D3D11_USAGE_IMMUTABLE;
 		desc.BindFlags = D3D11_BIND_INDEX_BUFFER;
 		desc.CPUAccessFlags = 0;
@@ -435,32 +759,38 @@ HRESULT Renderer::InitShaders() {
 		desc.StructureByteStride = 0;
 		D3D11_SUBRESOURCE_DATA data;
 		data.pSysMem = sphereIndices.data();
-		data.SysMemPitch = sizeof(UINT32) * UINT32(sphereIndices.size());
+		data.SysMemPitch = sizeof(USHORT) * UINT32(sphereIndices.size());
 		data.SysMemSlicePitch = 0;
 
-		result = m_pDevice->CreateBuffer(&desc, &data, &m_pSphereIndexBuffer);
+		ID3D11Buffer* pBuffer = nullptr;
+		result = m_pDevice->CreateBuffer(&desc, &data, &pBuffer);
 		if (SUCCEEDED(result)) {
-			result = SetResourceName(m_pSphereIndexBuffer, "SphereIndexBuffer");
+			result = RegisterResource(pBuffer, m_sphereIndexBuffer, "SphereIndexBuffer");
 		}
 	}
 	{
 		D3D11_BUFFER_DESC desc = {};
-		desc.ByteWidth = sizeof(Vertices);
+		desc.ByteWidth = cubeVertexBytes;
 		desc.Usage = D3D11_USAGE_IMMUTABLE;
 		desc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
 		desc.CPUAccessFlags = 0;
 		desc.MiscFlags = 0;
 		desc.StructureByteStride = 0;
 		D3D11_SUBRESOURCE_DATA data;
-		data.pSysMem = &Vertices;
-		data.SysMemPitch = sizeof(Vertices);
+		data.pSysMem = pCubeVertices;
+		data.SysMemPitch = cubeVertexBytes;
 		data.SysMemSlicePitch = 0;
 
-		result = m_pDevice->CreateBuffer(&desc, &data, &m_pCubeVertexBuffer);
+		ID3D11Buffer* pBuffer = nullptr;
+		result = m_pDevice->CreateBuffer(&desc, &data, &pBuffer);
 		if (SUCCEEDED(result)) {
-			result = SetResourceName(m_pCubeVertexBuffer, "CubeVertexBuffer");
+			result = RegisterResource(pBuffer, m_cubeVertexBuffer, "CubeVertexBuffer");
 		}
 	}
+	if (SUCCEEDED(result))
+		result = CreateMeshBuffer(sphereQuantization, m_sphereMeshBuffer, "SphereMeshBuffer");
+	if (SUCCEEDED(result))
+		result = CreateMeshBuffer(cubeQuantization, m_cubeMeshBuffer, "CubeMeshBuffer");
 	{
 		ObjectColor objColor = { 0.7f, 1.0f, 0.5f, 0.6f };
 		D3D11_BUFFER_DESC desc = {};
@@ -472,27 +802,29 @@ HRESULT Renderer::InitShaders() {
 		desc.StructureByteStride = 0;
 		D3D11_SUBRESOURCE_DATA data = { &objColor, 0, 0 };
 
-		result = m_pDevice->CreateBuffer(&desc, &data, &m_pColorBuffer);
+		ID3D11Buffer* pBuffer = nullptr;
+		result = m_pDevice->CreateBuffer(&desc, &data, &pBuffer);
 		if (SUCCEEDED(result)) {
-			result = SetResourceName(m_pColorBuffer, "colorBuffer");
+			result = RegisterResource(pBuffer, m_colorBuffer, "colorBuffer");
 		}
 	}
 	{
 		D3D11_BUFFER_DESC desc = {};
-		desc.ByteWidth = sizeof(Indices);
+		desc.ByteWidth = cubeIndexBytes;
 		desc.Usage = D3D11_USAGE_IMMUTABLE;
 		desc.BindFlags = D3D11_BIND_INDEX_BUFFER;
 		desc.CPUAccessFlags = 0;
 		desc.MiscFlags = 0;
 		desc.StructureByteStride = 0;
 		D3D11_SUBRESOURCE_DATA data;
-		data.pSysMem = &Indices;
-		data.SysMemPitch = sizeof(Indices);
+		data.pSysMem = pCubeIndices;
+		data.SysMemPitch = cubeIndexBytes;
 		data.SysMemSlicePitch = 0;
 
-		result = m_pDevice->CreateBuffer(&desc, &data, &m_pCubeIndexBuffer);
+		ID3D11Buffer* pBuffer = nullptr;
+		result = m_pDevice->CreateBuffer(&desc, &data, &pBuffer);
 		if (SUCCEEDED(result)) {
-			result = SetResourceName(m_pCubeIndexBuffer, "CubeIndexBuffer");
+			result = RegisterResource(pBuffer, m_cubeIndexBuffer, "CubeIndexBuffer");
 		}
 	}
 	result = InitTextures();
@@ -506,11 +838,12 @@ HRESULT Renderer::InitShaders() {
 		desc.MiscFlags = 0;
 		desc.StructureByteStride = 0;
 
-		result = m_pDevice->CreateBuffer(&desc, nullptr, &m_pSceneBuffer);
+		ID3D11Buffer* pBuffer = nullptr;
+		result = m_pDevice->CreateBuffer(&desc, nullptr, &pBuffer);
 		assert(SUCCEEDED(result));
 		if (SUCCEEDED(result))
 		{
-			result = SetResourceName(m_pSceneBuffer, "SceneBuffer");
+			result = RegisterResource(pBuffer, m_sceneBuffer, "SceneBuffer");
 		}
 	}
 	{
@@ -521,85 +854,188 @@ HRESULT Renderer::InitShaders() {
 		desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
 		desc.MiscFlags = 0;
 		desc.StructureByteStride = 0;
-		result = m_pDevice->CreateBuffer(&desc, nullptr, &m_pViewBuffer);
+		ID3D11Buffer* pBuffer = nullptr;
+		result = m_pDevice->CreateBuffer(&desc, nullptr, &pBuffer);
+		assert(SUCCEEDED(result));
+		if (SUCCEEDED(result))
+		{
+			result = RegisterResource(pBuffer, m_viewBuffer, "ViewBuffer");
+		}
+	}
+	{
+		D3D11_BUFFER_DESC desc = {};
+		desc.ByteWidth = sizeof(UpscaleBuffer);
+		desc.Usage = D3D11_USAGE_DYNAMIC;
+		desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+		desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+		ID3D11Buffer* pBuffer = nullptr;
+		result = m_pDevice->CreateBuffer(&desc, nullptr, &pBuffer);
 		assert(SUCCEEDED(result));
 		if (SUCCEEDED(result))
 		{
-			result = SetResourceName(m_pViewBuffer, "ViewBuffer");
+			result = RegisterResource(pBuffer, m_upscaleBuffer, "UpscaleBuffer");
 		}
 	}
 
 	// texture shader
 	ID3DBlob* pVertexShaderCode = nullptr;
 	if (SUCCEEDED(result)) {
-		result = CompileShader(L"Texture_VS.hlsl", (ID3D11DeviceChild**)&m_pTextureVS, "vs", &pVertexShaderCode);
+		result = LoadShader(L"Texture_VS.hlsl", m_textureVS, "vs", &pVertexShaderCode);
 	}
 	if (SUCCEEDED(result)) {
-		result = CompileShader(L"Texture_PS.hlsl", (ID3D11DeviceChild**)&m_pTexturePS, "ps");
+		result = LoadShader(L"Texture_PS.hlsl", m_texturePS, "ps");
 	}
 
 	static const D3D11_INPUT_ELEMENT_DESC TextureInputDesc[] = {
-	{"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0},
-	{"TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0}
+	{"POSITION", 0, DXGI_FORMAT_R16G16B16A16_SNORM, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0},
+	{"TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT, 0, 8, D3D11_INPUT_PER_VERTEX_DATA, 0}
 	};
 
-	result = m_pDevice->CreateInputLayout(TextureInputDesc, 2, pVertexShaderCode->GetBufferPointer(), pVertexShaderCode->GetBufferSize(), &m_pTextureInputLayout);
+	ID3D11InputLayout* pInputLayout = nullptr;
+	result = m_pDevice->CreateInputLayout(TextureInputDesc, 2, pVertexShaderCode->GetBufferPointer(), pVertexShaderCode->GetBufferSize(), &pInputLayout);
 	if (SUCCEEDED(result))
 	{
-		result = SetResourceName(m_pTextureInputLayout, "TextureInputLayout");
+		result = RegisterResource(pInputLayout, m_textureInputLayout, "TextureInputLayout");
 	}
 	SafeRelease(pVertexShaderCode);
 	// 
 	static const D3D11_INPUT_ELEMENT_DESC TransTextureInputDesc[] = {
-	{"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0},
-	{"TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0}
+	{"POSITION", 0, DXGI_FORMAT_R16G16B16A16_SNORM, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0},
+	{"TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT, 0, 8, D3D11_INPUT_PER_VERTEX_DATA, 0}
 	};
 	if (SUCCEEDED(result))
 	{
-		result = CompileShader(L"TransTexture_VS.hlsl", (ID3D11DeviceChild**)&m_pSimpleTransTextureVertexShader, "vs", &pVertexShaderCode);
+		result = LoadShader(L"TransTexture_VS.hlsl", m_transTextureVS, "vs", &pVertexShaderCode);
 	}
 	if (SUCCEEDED(result))
 	{
-		result = CompileShader(L"TransTexture_PS.hlsl", (ID3D11DeviceChild**)&m_pSimpleTransTexturePixelShader, "ps");
+		result = LoadShader(L"TransTexture_PS.hlsl", m_transTexturePS, "ps");
 	}
 
 	if (SUCCEEDED(result))
 	{
-		result = m_pDevice->CreateInputLayout(TransTextureInputDesc, 2, pVertexShaderCode->GetBufferPointer(), pVertexShaderCode->GetBufferSize(), &m_pSimpleTransTextureInputLayout);
+		pInputLayout = nullptr;
+		result = m_pDevice->CreateInputLayout(TransTextureInputDesc, 2, pVertexShaderCode->GetBufferPointer(), pVertexShaderCode->GetBufferSize(), &pInputLayout);
 		if (SUCCEEDED(result))
 		{
-			result = SetResourceName(m_pSimpleTransTextureInputLayout, "TransTextureInputLayout");
+			result = RegisterResource(pInputLayout, m_transTextureInputLayout, "TransTextureInputLayout");
 		}
 	}
 	SafeRelease(pVertexShaderCode);
+	if (SUCCEEDED(result))
+	{
+		result = LoadShader(L"TransTextureOit_PS.hlsl", m_transTextureOitPS, "ps");
+	}
+	if (SUCCEEDED(result))
+	{
+		result = LoadShader(L"OitResolve_VS.hlsl", m_oitResolveVS, "vs");
+	}
+	if (SUCCEEDED(result))
+	{
+		result = LoadShader(L"OitResolve_PS.hlsl", m_oitResolvePS, "ps");
+	}
+	if (SUCCEEDED(result))
+	{
+		result = LoadShader(L"Upscale_PS.hlsl", m_upscalePS, "ps");
+	}
 
 	// skybox
 	static const D3D11_INPUT_ELEMENT_DESC SkyboxInputDesc[] = {
-	{"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0}
+	{"POSITION", 0, DXGI_FORMAT_R16G16B16A16_SNORM, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0}
 	};
 
 	if (SUCCEEDED(result))
 	{
-		result = CompileShader(L"Skybox_VS.hlsl", (ID3D11DeviceChild**)&m_pSkyboxVS, "vs", &pVertexShaderCode);
+		result = LoadShader(L"Skybox_VS.hlsl", m_skyboxVS, "vs", &pVertexShaderCode);
 	}
 	if (SUCCEEDED(result))
 	{
-		result = CompileShader(L"Skybox_PS.hlsl", (ID3D11DeviceChild**)&m_pSkyboxPS, "ps");
+		result = LoadShader(L"Skybox_PS.hlsl", m_skyboxPS, "ps");
 	}
 
 	if (SUCCEEDED(result))
 	{
-		result = m_pDevice->CreateInputLayout(SkyboxInputDesc, 1, pVertexShaderCode->GetBufferPointer(), pVertexShaderCode->GetBufferSize(), &m_pSkyboxInputLayout);
+		pInputLayout = nullptr;
+		result = m_pDevice->CreateInputLayout(SkyboxInputDesc, 1, pVertexShaderCode->GetBufferPointer(), pVertexShaderCode->GetBufferSize(), &pInputLayout);
 		if (SUCCEEDED(result))
 		{
-			result = SetResourceName(m_pSkyboxInputLayout, "SimpleSkyboxInputLayout");
+			result = RegisterResource(pInputLayout, m_skyboxInputLayout, "SimpleSkyboxInputLayout");
 		}
 	}
 	SafeRelease(pVertexShaderCode);
+	if (SUCCEEDED(result))
+	{
+		result = LoadShader(L"SkyboxRay_VS.hlsl", m_skyboxRayVS, "vs");
+	}
+	for (UINT i = 0; i < SkyboxQueryCount && SUCCEEDED(result); i++)
+	{
+		D3D11_QUERY_DESC desc = { D3D11_QUERY_PIPELINE_STATISTICS, 0 };
+		ID3D11Query* pQuery = nullptr;
+		result = m_pDevice->CreateQuery(&desc, &pQuery);
+		if (SUCCEEDED(result))
+		{
+			result = RegisterResource(pQuery, m_skyboxQueries[i], "SkyboxQuery");
+		}
+	}
 
 	return result;
 }
 
+HRESULT Renderer::InitClusterMesh()
+{
+	PROFILE_SCOPE("Renderer::InitClusterMesh");
+	GeneratedMesh<UINT32> torus;
+	if (!GenerateTorus(3.0f, 0.4f, 768, 192, torus, &m_workerPool))
+		return E_FAIL;
+	std::vector<MeshVertex>& vertices = torus.vertices;
+
+	// Meshlets are filled in index order, cache order keeps them compact
+	std::vector<UINT32> indices(torus.indices.size());
+	OptimizeVertexCache(torus.indices.data(), torus.indices.size(), vertices.size(), indices.data());
+	vertices.resize(OptimizeVertexFetch(indices.data(), indices.size(), vertices.data(), vertices.size(), sizeof(MeshVertex)));
+	BuildMeshlets(indices.data(), indices.size(), &vertices[0].x, vertices.size(), sizeof(MeshVertex), m_clusterMeshlets);
+	m_meshletCuller.SetMesh(&m_clusterMeshlets);
+
+	char message[128];
+	sprintf_s(message, "Cluster mesh: %zu triangles in %zu meshlets\n", indices.size() / 3, m_clusterMeshlets.meshlets.size());
+	OutputDebugStringA(message);
+
+	VertexQuantization quantization = ComputeQuantization(&vertices[0].x, vertices.size(), sizeof(MeshVertex));
+	std::vector<PackedTextureVertex> packed(vertices.size());
+	PackTextureVertices(&vertices[0].x, &vertices[0].u, vertices.size(), sizeof(MeshVertex), quantization, packed.data());
+
+	HRESULT result;
+	{
+		D3D11_BUFFER_DESC desc = {};
+		desc.ByteWidth = sizeof(PackedTextureVertex) * UINT32(packed.size());
+		desc.Usage = D3D11_USAGE_IMMUTABLE;
+		desc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+		D3D11_SUBRESOURCE_DATA data = { packed.data(), desc.ByteWidth, 0 };
+
+		ID3D11Buffer* pBuffer = nullptr;
+		result = m_pDevice->CreateBuffer(&desc, &data, &pBuffer);
+		if (SUCCEEDED(result))
+			result = RegisterResource(pBuffer, m_clusterVertexBuffer, "ClusterVertexBuffer");
+	}
+	if (SUCCEEDED(result))
+	{
+		// Room for every triangle, the frame's survivors are written over the start
+		D3D11_BUFFER_DESC desc = {};
+		desc.ByteWidth = sizeof(UINT32) * UINT32(indices.size());
+		desc.Usage = D3D11_USAGE_DYNAMIC;
+		desc.BindFlags = D3D11_BIND_INDEX_BUFFER;
+		desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+
+		ID3D11Buffer* pBuffer = nullptr;
+		result = m_pDevice->CreateBuffer(&desc, nullptr, &pBuffer);
+		if (SUCCEEDED(result))
+			result = RegisterResource(pBuffer, m_clusterIndexBuffer, "ClusterIndexBuffer");
+	}
+	if (SUCCEEDED(result))
+		result = CreateMeshBuffer(quantization, m_clusterMeshBuffer, "ClusterMeshBuffer");
+	return result;
+}
+
 HRESULT Renderer::CompileShader(const std::wstring& path, ID3D11DeviceChild** ppShader, const std::string& ext, ID3DBlob** ppCode) {
 	FILE* pFile = nullptr;
 	_wfopen_s(&pFile, path.c_str(), L"rb");
@@ -654,58 +1090,56 @@ HRESULT Renderer::CompileShader(const std::wstring& path, ID3D11DeviceChild** pp
 }
 
 void Renderer::Clean() {
-	SafeRelease(m_pTextureSampler);
-	SafeRelease(m_pKitTextureView);
-	SafeRelease(m_pKitTexture);
-	SafeRelease(m_pCubemapTextureView);
-	SafeRelease(m_pCubemapTexture);
-
-	SafeRelease(m_pSkyboxInputLayout);
-	SafeRelease(m_pSkyboxPS);
-	SafeRelease(m_pSkyboxVS);
-
-	SafeRelease(m_pSimpleTransTextureInputLayout);
-	SafeRelease(m_pSimpleTransTexturePixelShader);
-	SafeRelease(m_pSimpleTransTextureVertexShader);
-
-	SafeRelease(m_pDepthBuffer);
-	SafeRelease(m_pDepthBufferDSV);
-	SafeRelease(m_pViewBuffer);
-	SafeRelease(m_pSceneBuffer);
-
-	SafeRelease(m_pSphereIndexBuffer);
-	SafeRelease(m_pSphereVertexBuffer);
-	SafeRelease(m_pCubeIndexBuffer);
-	SafeRelease(m_pCubeVertexBuffer);
-	SafeRelease(m_pColorBuffer);
-
-	SafeRelease(m_pTransBlendState);
-	SafeRelease(m_pDepthStateRead);
-	SafeRelease(m_pDepthStateReadWrite);
-	SafeRelease(m_pBackBufferRTV);
-	SafeRelease(m_pSwapChain);
-	SafeRelease(m_pDeviceContext);
+	m_frameGraph.ReleasePool(m_frameGraphBackend);
+	m_gpuProfiler.Release();
+	m_parallelRecorder.Stop();
+	m_deferredContexts.Clean();
 
-	SafeRelease(m_pTextureInputLayout);
-	SafeRelease(m_pTexturePS);
-	SafeRelease(m_pTextureVS);
+	m_pipelineStates.Clear();
+	// Nothing may stay bound, otherwise the reference counts below are not final
 	if (NULL != m_pDeviceContext)
 		m_pDeviceContext->ClearState();
+	for (const std::string& name : m_resources.ReleaseAll())
+	{
+		OutputDebugStringA(("Resource still referenced after release: " + name + "\n").c_str());
+	}
+	if (m_frameLatencyWaitableObject != NULL)
+	{
+		CloseHandle(m_frameLatencyWaitableObject);
+		m_frameLatencyWaitableObject = NULL;
+	}
+	SafeRelease(m_pSwapChain);
+	if (m_timerPeriodSet)
+	{
+		timeEndPeriod(1);
+		m_timerPeriodSet = false;
+	}
 	SafeRelease(m_pDeviceContext);
 
 	SafeRelease(m_pDevice);
 	m_isRunning = false;
 }
 
+void Renderer::WaitForFrame()
+{
+	m_framePacer.WaitForNextFrame();
+	if (m_frameLatencyWaitableObject != NULL)
+		WaitForSingleObjectEx(m_frameLatencyWaitableObject, 1000, TRUE);
+}
+
 bool Renderer::Render()
 {
 	if (!m_isRunning)
 	{
 		return false;
 	}
+	PROFILE_SCOPE("Renderer::Render");
 	m_pDeviceContext->ClearState();
+	m_gpuProfiler.BeginFrame();
+	ReadSkyboxQuery();
 
 	DirectX::XMMATRIX v = DirectX::XMMatrixInverse(nullptr, pSceneManager.m_cameraTransform);
+	m_viewTransform = v;
 	float f = 100.0f;
 	float n = 0.1f;
 	float fov = 3.14f / 3;
@@ -715,172 +1149,831 @@ bool Renderer::Render()
 	float width = n * tanf(fov / 2) * 2;
 	float height = aspectRatio * width;
 	float skyboxRad = sqrtf(powf(n, 2) + powf(width / 2, 2) + powf(height / 2, 2)) * 1.1f;
-	DirectX::XMMATRIX skyboxScale = DirectX::XMMatrixScaling(skyboxRad, skyboxRad, skyboxRad);
+	m_skyboxScale = DirectX::XMMatrixScaling(skyboxRad, skyboxRad, skyboxRad);
 
 	DirectX::XMMATRIX p = DirectX::XMMatrixPerspectiveLH(tanf(fov / 2) * 2 * f, tanf(fov / 2) * 2 * f * aspectRatio, f, n);
+	m_projScaleY = DirectX::XMVectorGetY(p.r[1]);
+	DirectX::XMMATRIX vp = DirectX::XMMatrixMultiply(v, p);
 
+	DirectX::XMFLOAT4X4 viewProj;
+	DirectX::XMStoreFloat4x4(&viewProj, vp);
+	{
+		PROFILE_SCOPE("Culling");
+		FrustumPlanes frustum;
+		ExtractFrustumPlanes(&viewProj.m[0][0], frustum);
+		CullObjects(frustum, pSceneManager.m_opaqueObjects, pSceneManager.m_opaqueBvh, m_opaqueBounds, m_opaqueVisible);
+		CullObjects(frustum, pSceneManager.m_transparentObjects, pSceneManager.m_transparentBvh, m_transparentBounds, m_transparentVisible);
+		CullOccluded(vp, viewProj);
+		if (m_useClusterMesh)
+			CullClusters(vp);
+	}
 
 	D3D11_MAPPED_SUBRESOURCE subresource;
-	HRESULT result = m_pDeviceContext->Map(m_pViewBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &subresource);
+	ID3D11Buffer* pViewBuffer = m_resources.Get(m_viewBuffer);
+	HRESULT result = m_pDeviceContext->Map(pViewBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &subresource);
 	assert(SUCCEEDED(result));
 	if (SUCCEEDED(result)) {
 		ViewBuffer& sceneBuffer = *reinterpret_cast<ViewBuffer*>(subresource.pData);
 
-		sceneBuffer.vp = DirectX::XMMatrixMultiply(v, p);
+		sceneBuffer.vp = vp;
 		sceneBuffer.cameraPosition = pSceneManager.m_cameraTransform.r[3];
-		m_pDeviceContext->Unmap(m_pViewBuffer, 0);
+		sceneBuffer.invVp = DirectX::XMMatrixInverse(nullptr, vp);
+		m_pDeviceContext->Unmap(pViewBuffer, 0);
+		m_frameCounters.Add(0, 0, sizeof(ViewBuffer));
+	}
+
+	FrameGraphD3D11Texture backBuffer;
+	backBuffer.pRTV = m_resources.Get(m_backBufferRTV);
+	FrameGraphD3D11Texture depthBuffer;
+	depthBuffer.pTexture = m_resources.Get(m_depthBuffer);
+	depthBuffer.pDSV = m_resources.Get(m_depthBufferDSV);
+
+	UpdateRenderSize();
+
+	m_frameGraph.Reset();
+	FrameGraphResource backBufferRes = m_frameGraph.Import("BackBuffer", &backBuffer);
+	FrameGraphResource depthRes = m_frameGraph.Import("Depth", &depthBuffer);
+
+	// With dynamic resolution the scene goes to a full size target of its own, only the
+	// render size of it is drawn, and the upscale pass fills the back buffer from it
+	FrameGraphResource colorRes = backBufferRes;
+	m_frameGraph.AddPass("Opaque",
+		[&](FrameGraphBuilder& builder) {
+			if (m_useDynamicResolution)
+			{
+				FrameGraphTextureDesc desc;
+				desc.width = m_width;
+				desc.height = m_height;
+				desc.bindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+				desc.format = DXGI_FORMAT_R8G8B8A8_UNORM;
+				colorRes = builder.Create("SceneColor", desc);
+			}
+			builder.Write(colorRes);
+			builder.Write(depthRes);
+		},
+		[this, &colorRes, depthRes](const FrameGraph& graph, void* pContext) {
+			ID3D11DeviceContext* pDeviceContext = static_cast<ID3D11DeviceContext*>(pContext);
+			GpuProfileScope gpuScope(m_gpuProfiler, "Opaque", pContext);
+			FrameGraphD3D11Texture* pColor = static_cast<FrameGraphD3D11Texture*>(graph.GetResource(colorRes));
+			FrameGraphD3D11Texture* pDepth = static_cast<FrameGraphD3D11Texture*>(graph.GetResource(depthRes));
+
+			static const FLOAT BackColor[4] = { 0.1f, 0.1f, 0.1f, 0.1f };
+			pDeviceContext->ClearRenderTargetView(pColor->pRTV, BackColor);
+			pDeviceContext->ClearDepthStencilView(pDepth->pDSV, D3D11_CLEAR_DEPTH, 0.0f, 0);
+			SetupPassTargets(pDeviceContext, pColor->pRTV, pDepth->pDSV);
+			RenderOpaque(pDeviceContext);
+		});
+	if (m_skyboxVisible)
+	{
+		m_frameGraph.AddPass("Skybox",
+			[&](FrameGraphBuilder& builder) {
+				builder.Read(depthRes);
+				builder.Write(colorRes);
+			},
+			[this, colorRes, depthRes](const FrameGraph& graph, void* pContext) {
+				ID3D11DeviceContext* pDeviceContext = static_cast<ID3D11DeviceContext*>(pContext);
+				GpuProfileScope gpuScope(m_gpuProfiler, "Skybox", pContext);
+				FrameGraphD3D11Texture* pColor = static_cast<FrameGraphD3D11Texture*>(graph.GetResource(colorRes));
+				FrameGraphD3D11Texture* pDepth = static_cast<FrameGraphD3D11Texture*>(graph.GetResource(depthRes));
+
+				SetupPassTargets(pDeviceContext, pColor->pRTV, pDepth->pDSV);
+				RenderSkybox(pDeviceContext);
+			});
+	}
+	if (m_useOit)
+	{
+		// Handles are filled by the setup callbacks, execution happens before they go out of scope
+		FrameGraphResource accumRes = InvalidFrameGraphResource;
+		FrameGraphResource revealageRes = InvalidFrameGraphResource;
+		m_frameGraph.AddPass("TransparentAccum",
+			[&](FrameGraphBuilder& builder) {
+				FrameGraphTextureDesc desc;
+				desc.width = m_width;
+				desc.height = m_height;
+				desc.bindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+				desc.format = DXGI_FORMAT_R16G16B16A16_FLOAT;
+				accumRes = builder.Write(builder.Create("OitAccum", desc));
+				desc.format = DXGI_FORMAT_R16_FLOAT;
+				revealageRes = builder.Write(builder.Create("OitRevealage", desc));
+				builder.Read(depthRes);
+			},
+			[this, &accumRes, &revealageRes, depthRes](const FrameGraph& graph, void* pContext) {
+				ID3D11DeviceContext* pDeviceContext = static_cast<ID3D11DeviceContext*>(pContext);
+				GpuProfileScope gpuScope(m_gpuProfiler, "TransparentAccum", pContext);
+				FrameGraphD3D11Texture* pAccum = static_cast<FrameGraphD3D11Texture*>(graph.GetResource(accumRes));
+				FrameGraphD3D11Texture* pRevealage = static_cast<FrameGraphD3D11Texture*>(graph.GetResource(revealageRes));
+				FrameGraphD3D11Texture* pDepth = static_cast<FrameGraphD3D11Texture*>(graph.GetResource(depthRes));
+
+				static const FLOAT AccumClear[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+				static const FLOAT RevealageClear[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+				pDeviceContext->ClearRenderTargetView(pAccum->pRTV, AccumClear);
+				pDeviceContext->ClearRenderTargetView(pRevealage->pRTV, RevealageClear);
+				ID3D11RenderTargetView* views[] = { pAccum->pRTV, pRevealage->pRTV };
+				SetupPassTargets(pDeviceContext, 2, views, pDepth->pDSV);
+				RenderTransparent(pDeviceContext);
+			});
+		m_frameGraph.AddPass("OitResolve",
+			[&](FrameGraphBuilder& builder) {
+				builder.Read(accumRes);
+				builder.Read(revealageRes);
+				builder.Write(colorRes);
+			},
+			[this, &accumRes, &revealageRes, colorRes](const FrameGraph& graph, void* pContext) {
+				ID3D11DeviceContext* pDeviceContext = static_cast<ID3D11DeviceContext*>(pContext);
+				GpuProfileScope gpuScope(m_gpuProfiler, "OitResolve", pContext);
+				FrameGraphD3D11Texture* pAccum = static_cast<FrameGraphD3D11Texture*>(graph.GetResource(accumRes));
+				FrameGraphD3D11Texture* pRevealage = static_cast<FrameGraphD3D11Texture*>(graph.GetResource(revealageRes));
+				FrameGraphD3D11Texture* pColor = static_cast<FrameGraphD3D11Texture*>(graph.GetResource(colorRes));
+
+				SetupPassTargets(pDeviceContext, pColor->pRTV, nullptr);
+				ResolveOit(pDeviceContext, pAccum->pSRV, pRevealage->pSRV);
+			});
+	}
+	else
+	{
+		m_frameGraph.AddPass("Transparent",
+			[&](FrameGraphBuilder& builder) {
+				builder.Read(depthRes);
+				builder.Write(colorRes);
+			},
+			[this, colorRes, depthRes](const FrameGraph& graph, void* pContext) {
+				ID3D11DeviceContext* pDeviceContext = static_cast<ID3D11DeviceContext*>(pContext);
+				GpuProfileScope gpuScope(m_gpuProfiler, "Transparent", pContext);
+				FrameGraphD3D11Texture* pColor = static_cast<FrameGraphD3D11Texture*>(graph.GetResource(colorRes));
+				FrameGraphD3D11Texture* pDepth = static_cast<FrameGraphD3D11Texture*>(graph.GetResource(depthRes));
+
+				SetupPassTargets(pDeviceContext, pColor->pRTV, pDepth->pDSV);
+				RenderTransparent(pDeviceContext);
+			});
+	}
+	if (m_useDynamicResolution)
+	{
+		m_frameGraph.AddPass("Upscale",
+			[&](FrameGraphBuilder& builder) {
+				builder.Read(colorRes);
+				builder.Write(backBufferRes);
+			},
+			[this, colorRes, backBufferRes](const FrameGraph& graph, void* pContext) {
+				ID3D11DeviceContext* pDeviceContext = static_cast<ID3D11DeviceContext*>(pContext);
+				GpuProfileScope gpuScope(m_gpuProfiler, "Upscale", pContext);
+				FrameGraphD3D11Texture* pScene = static_cast<FrameGraphD3D11Texture*>(graph.GetResource(colorRes));
+				FrameGraphD3D11Texture* pColor = static_cast<FrameGraphD3D11Texture*>(graph.GetResource(backBufferRes));
+
+				Upscale(pDeviceContext, pColor->pRTV, pScene->pSRV);
+			});
+	}
+
+	if (m_frameGraph.Compile())
+	{
+		PROFILE_SCOPE("FrameGraph::Execute");
+		if (m_useDeferredContexts)
+		{
+			// Every pass records into its own deferred context on a worker,
+			// command lists are executed on the immediate context in pass order
+			std::vector<ParallelRecorder::RecordFunc> jobs;
+			for (int passIdx : m_frameGraph.GetPassOrder())
+			{
+				jobs.push_back([this, passIdx](void* pContext) { m_frameGraph.ExecutePass(passIdx, pContext); });
+			}
+			assert(jobs.size() <= MaxRecordingSlots);
+			m_frameGraph.BeginExecute(m_frameGraphBackend);
+			m_parallelRecorder.Record(m_deferredContexts, jobs);
+			m_frameGraph.EndExecute();
+		}
+		else
+		{
+			m_frameGraph.Execute(m_frameGraphBackend, m_pDeviceContext);
+		}
 	}
 
-	ID3D11RenderTargetView* views[] = { m_pBackBufferRTV };
-	m_pDeviceContext->OMSetRenderTargets(1, views, m_pDepthBufferDSV);
+	m_gpuProfiler.EndFrame();
+	{
+		PROFILE_SCOPE("Present");
+		result = m_pSwapChain->Present(0, 0);
+	}
+	m_resources.EndFrame();
+	m_transparencyModeFrames++;
+	m_skyboxQueryFrame++;
 
-	static const FLOAT BackColor[4] = { 0.1f, 0.1f, 0.1f, 0.1f };
-	m_pDeviceContext->ClearRenderTargetView(m_pBackBufferRTV, BackColor);
-	m_pDeviceContext->ClearDepthStencilView(m_pDepthBufferDSV, D3D11_CLEAR_DEPTH, 0.0f, 0);
+	return SUCCEEDED(result);
+}
+
+void Renderer::SetupPassTargets(ID3D11DeviceContext* pContext, ID3D11RenderTargetView* pRTV, ID3D11DepthStencilView* pDSV)
+{
+	ID3D11RenderTargetView* views[] = { pRTV };
+	SetupPassTargets(pContext, 1, views, pDSV);
+}
+
+void Renderer::SetupPassTargets(ID3D11DeviceContext* pContext, UINT count, ID3D11RenderTargetView* const* ppRTVs, ID3D11DepthStencilView* pDSV)
+{
+	pContext->OMSetRenderTargets(count, ppRTVs, pDSV);
 
 	D3D11_VIEWPORT viewport;
 	viewport.TopLeftX = 0;
 	viewport.TopLeftY = 0;
-	viewport.Width = (FLOAT)m_width;
-	viewport.Height = (FLOAT)m_height;
+	viewport.Width = (FLOAT)m_renderWidth;
+	viewport.Height = (FLOAT)m_renderHeight;
 	viewport.MinDepth = 0.0f;
 	viewport.MaxDepth = 1.0f;
-	m_pDeviceContext->RSSetViewports(1, &viewport);
+	pContext->RSSetViewports(1, &viewport);
 
 	D3D11_RECT rect;
 	rect.left = 0;
 	rect.top = 0;
-	rect.right = m_width;
-	rect.bottom = m_height;
-	m_pDeviceContext->RSSetScissorRects(1, &rect);
-	const int indexCountCubes = 36;
-	{
-		//Texture
-		m_pDeviceContext->OMSetDepthStencilState(m_pDepthStateReadWrite, 0);
-		m_pDeviceContext->OMSetBlendState(nullptr, nullptr, 0xFFFFFFFF);
-		m_pDeviceContext->IASetInputLayout(m_pTextureInputLayout);
-		m_pDeviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-		m_pDeviceContext->VSSetShader(m_pTextureVS, nullptr, 0);
-		m_pDeviceContext->PSSetShader(m_pTexturePS, nullptr, 0);
-
-		m_pDeviceContext->VSSetConstantBuffers(0, 1, &m_pViewBuffer);
-		m_pDeviceContext->VSSetConstantBuffers(1, 1, &m_pSceneBuffer);
-
-		ID3D11SamplerState* samplers[] = { m_pTextureSampler };
-		m_pDeviceContext->PSSetSamplers(0, 1, samplers);
-
-		std::vector<SceneBuffer> sceneTransformsBuffer;
-		sceneTransformsBuffer.push_back({ pSceneManager.m_modelTransform });
-		auto tmpp = DirectX::XMMatrixTranslation(-2.8f, 1.0f, -1.8f);
-		sceneTransformsBuffer.push_back({ tmpp });
-
-		ID3D11ShaderResourceView* resources[] = { m_pKitTextureView };
-		m_pDeviceContext->PSSetShaderResources(0, 1, resources);
-		m_pDeviceContext->IASetIndexBuffer(m_pCubeIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
-		ID3D11Buffer* vertexBuffers[] = { m_pCubeVertexBuffer };
-		UINT strides[] = { sizeof(TextureVertex) };
+	rect.right = m_renderWidth;
+	rect.bottom = m_renderHeight;
+	pContext->RSSetScissorRects(1, &rect);
+}
+
+void Renderer::RenderOpaque(ID3D11DeviceContext* pContext)
+{
+	PROFILE_SCOPE("Renderer::RenderOpaque");
+	ID3D11Buffer* constantBuffers[] = { m_resources.Get(m_viewBuffer), m_resources.Get(m_sceneBuffer), m_resources.Get(m_cubeMeshBuffer) };
+	pContext->VSSetConstantBuffers(0, 3, constantBuffers);
+
+	ID3D11Buffer* psConstantBuffers[] = { m_resources.Get(m_ambientBuffer), m_resources.Get(m_viewBuffer) };
+	pContext->PSSetConstantBuffers(0, 2, psConstantBuffers);
+
+	ID3D11SamplerState* samplers[] = { m_resources.Get(m_textureSampler) };
+	pContext->PSSetSamplers(0, 1, samplers);
+	// The object textures go to t0 per draw
+	ID3D11ShaderResourceView* pSpecularView = m_resources.Get(m_specularTextureView);
+	ID3D11ShaderResourceView* specularResources[] = { pSpecularView != nullptr ? pSpecularView : m_resources.Get(m_cubemapTextureView) };
+	pContext->PSSetShaderResources(1, 1, specularResources);
+
+	pContext->IASetIndexBuffer(m_resources.Get(m_cubeIndexBuffer), m_cubeIndexFormat, 0);
+	ID3D11Buffer* vertexBuffers[] = { m_resources.Get(m_cubeVertexBuffer) };
+	UINT strides[] = { sizeof(PackedTextureVertex) };
+	UINT offsets[] = { 0 };
+	pContext->IASetVertexBuffers(0, 1, vertexBuffers, strides, offsets);
+
+	const std::vector<DirectX::XMMATRIX>& objects = pSceneManager.m_opaqueObjects;
+	m_opaqueQueue.Clear();
+	for (UINT32 i : m_opaqueVisible)
+	{
+		m_opaqueQueue.Submit(DrawKey::MakeOpaque(DrawPassOpaque, DrawShaderTexture, DrawTextureKit, GetViewDepth(objects[i])), i);
+	}
+	m_opaqueQueue.Sort();
+	SubmitDrawQueue(pContext, m_opaqueQueue, objects);
+	RenderClusterMesh(pContext);
+}
+
+void Renderer::RenderClusterMesh(ID3D11DeviceContext* pContext)
+{
+	if (!m_useClusterMesh || m_clusterIndexCount == 0)
+		return;
+	PROFILE_SCOPE("Renderer::RenderClusterMesh");
+	PipelineStateBinder binder(pContext);
+	UINT32 stateChanges = binder.Bind(m_pOpaqueState);
+
+	ID3D11Buffer* pSceneBuffer = m_resources.Get(m_sceneBuffer);
+	ID3D11Buffer* constantBuffers[] = { m_resources.Get(m_viewBuffer), pSceneBuffer, m_resources.Get(m_clusterMeshBuffer) };
+	pContext->VSSetConstantBuffers(0, 3, constantBuffers);
+	ID3D11ShaderResourceView* resources[] = { m_resources.Get(m_kitTextureView) };
+	pContext->PSSetShaderResources(0, 1, resources);
+
+	pContext->IASetIndexBuffer(m_resources.Get(m_clusterIndexBuffer), DXGI_FORMAT_R32_UINT, 0);
+	ID3D11Buffer* vertexBuffers[] = { m_resources.Get(m_clusterVertexBuffer) };
+	UINT strides[] = { sizeof(PackedTextureVertex) };
+	UINT offsets[] = { 0 };
+	pContext->IASetVertexBuffers(0, 1, vertexBuffers, strides, offsets);
+
+	SceneBuffer sceneBuffer = { pSceneManager.m_clusterMeshTransform };
+	pContext->UpdateSubresource(pSceneBuffer, 0, nullptr, &sceneBuffer, 0, 0);
+	pContext->DrawIndexed(m_clusterIndexCount, 0, 0);
+	m_frameCounters.Add(1, stateChanges + 3, sizeof(SceneBuffer));
+}
+
+void Renderer::RenderSkybox(ID3D11DeviceContext* pContext)
+{
+	PROFILE_SCOPE("Renderer::RenderSkybox");
+	PipelineStateBinder binder(pContext);
+	UINT32 stateChanges = binder.Bind(m_useSkyboxRays ? m_pSkyboxRayState : m_pSkyboxState);
+
+	ID3D11SamplerState* samplers[] = { m_resources.Get(m_textureSampler) };
+	pContext->PSSetSamplers(0, 1, samplers);
+	ID3D11ShaderResourceView* resources[] = { m_resources.Get(m_cubemapTextureView) };
+	pContext->PSSetShaderResources(0, 1, resources);
+
+	const UINT querySlot = UINT(m_skyboxQueryFrame % SkyboxQueryCount);
+	ID3D11Query* pQuery = m_resources.Get(m_skyboxQueries[querySlot]);
+	pContext->Begin(pQuery);
+	if (m_useSkyboxRays)
+	{
+		ID3D11Buffer* constantBuffers[] = { m_resources.Get(m_viewBuffer) };
+		pContext->VSSetConstantBuffers(0, 1, constantBuffers);
+		pContext->Draw(3, 0);
+		m_frameCounters.Add(1, stateChanges + 1, 0);
+	}
+	else
+	{
+		ID3D11Buffer* pSceneBuffer = m_resources.Get(m_sceneBuffer);
+		ID3D11Buffer* constantBuffers[] = { m_resources.Get(m_viewBuffer), pSceneBuffer, m_resources.Get(m_sphereMeshBuffer) };
+		pContext->VSSetConstantBuffers(0, 3, constantBuffers);
+		SceneBuffer sceneTransformsBuffer = { m_skyboxScale };
+
+		pContext->IASetIndexBuffer(m_resources.Get(m_sphereIndexBuffer), DXGI_FORMAT_R16_UINT, 0);
+		ID3D11Buffer* vertexBuffers[] = { m_resources.Get(m_sphereVertexBuffer) };
+		UINT strides[] = { sizeof(PackedPosition) };
 		UINT offsets[] = { 0 };
-		m_pDeviceContext->IASetVertexBuffers(0, 1, vertexBuffers, strides, offsets);
+		pContext->IASetVertexBuffers(0, 1, vertexBuffers, strides, offsets);
+
+		pContext->UpdateSubresource(pSceneBuffer, 0, nullptr, &sceneTransformsBuffer, 0, 0);
+		// The vertex shader moves the skybox to the camera, LOD selection has to see it there too
+		DirectX::XMMATRIX skyboxModel = m_skyboxScale * DirectX::XMMatrixTranslationFromVector(pSceneManager.m_cameraTransform.r[3]);
+		const MeshLodLevel& lod = m_sphereLods.GetLevel(SelectLod(m_sphereLods, skyboxModel));
+		pContext->DrawIndexed(lod.indexCount, lod.firstIndex, 0);
+		m_frameCounters.Add(1, stateChanges + 1, sizeof(SceneBuffer));
+	}
+	pContext->End(pQuery);
+	m_skyboxQueryIssued[querySlot] = true;
+	m_skyboxQueryRays[querySlot] = m_useSkyboxRays;
+}
 
-		m_pDeviceContext->UpdateSubresource(m_pSceneBuffer, 0, nullptr, &sceneTransformsBuffer[1], 0, 0);
-		m_pDeviceContext->DrawIndexed(indexCountCubes, 0, 0);
-		m_pDeviceContext->UpdateSubresource(m_pSceneBuffer, 0, nullptr, &sceneTransformsBuffer[0], 0, 0);
-		m_pDeviceContext->DrawIndexed(indexCountCubes, 0, 0);
+void Renderer::ReadSkyboxQuery()
+{
+	const UINT querySlot = UINT(m_skyboxQueryFrame % SkyboxQueryCount);
+	if (!m_skyboxQueryIssued[querySlot])
+		return;
+	// Still in flight after SkyboxQueryCount frames means the sample is dropped, the slot is needed now
+	D3D11_QUERY_DATA_PIPELINE_STATISTICS data;
+	if (m_pDeviceContext->GetData(m_resources.Get(m_skyboxQueries[querySlot]), &data, sizeof(data), D3D11_ASYNC_GETDATA_DONOTFLUSH) == S_OK)
+	{
+		SkyboxDrawStats& stats = m_skyboxStats[m_skyboxQueryRays[querySlot] ? 1 : 0];
+		stats.frames++;
+		stats.vertices += data.VSInvocations;
+		stats.primitives += data.CPrimitives;
+		stats.pixels += data.PSInvocations;
 	}
+	m_skyboxQueryIssued[querySlot] = false;
+}
+
+void Renderer::RenderTransparent(ID3D11DeviceContext* pContext)
+{
+	PROFILE_SCOPE("Renderer::RenderTransparent");
+	ID3D11Buffer* pSceneBuffer = m_resources.Get(m_sceneBuffer);
+	ID3D11Buffer* vsConstantBuffers[] = { m_resources.Get(m_viewBuffer), pSceneBuffer, m_resources.Get(m_cubeMeshBuffer) };
+	ID3D11Buffer* psConstantBuffers[] = { m_resources.Get(m_colorBuffer), pSceneBuffer };
+	pContext->VSSetConstantBuffers(0, 3, vsConstantBuffers);
+	pContext->PSSetConstantBuffers(0, 2, psConstantBuffers);
+
+	ID3D11SamplerState* samplers[] = { m_resources.Get(m_textureSampler) };
+	pContext->PSSetSamplers(0, 1, samplers);
+
+	pContext->IASetIndexBuffer(m_resources.Get(m_cubeIndexBuffer), m_cubeIndexFormat, 0);
+	ID3D11Buffer* vertexBuffers[] = { m_resources.Get(m_cubeVertexBuffer) };
+	UINT strides[] = { sizeof(PackedTextureVertex) };
+	UINT offsets[] = { 0 };
+	pContext->IASetVertexBuffers(0, 1, vertexBuffers, strides, offsets);
+
+	const std::vector<DirectX::XMMATRIX>& objects = pSceneManager.m_transparentObjects;
+	m_transparentQueue.Clear();
+	if (m_useOit)
 	{
-		//skybox
-		m_pDeviceContext->OMSetDepthStencilState(m_pDepthStateRead, 0);
-		m_pDeviceContext->OMSetBlendState(nullptr, nullptr, 0xFFFFFFFF);
-		m_pDeviceContext->IASetInputLayout(m_pSkyboxInputLayout);
-		m_pDeviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-		m_pDeviceContext->VSSetShader(m_pSkyboxVS, nullptr, 0);
-		m_pDeviceContext->PSSetShader(m_pSkyboxPS, nullptr, 0);
+		// Blending is order independent, draws go in visibility order
+		for (UINT32 i : m_transparentVisible)
+		{
+			m_transparentQueue.Submit(DrawKey::MakeTransparent(DrawPassTransparent, DrawShaderTransTextureOit, DrawTextureKit, 0.0f), i);
+		}
+		SubmitDrawQueue(pContext, m_transparentQueue, objects);
+		return;
+	}
 
-		m_pDeviceContext->VSSetConstantBuffers(0, 1, &m_pViewBuffer);
-		m_pDeviceContext->VSSetConstantBuffers(1, 1, &m_pSceneBuffer);
+	m_transparencySorter.Resize(objects.size());
+	for (size_t i = 0; i < objects.size(); i++)
+	{
+		DirectX::XMFLOAT3 position;
+		DirectX::XMStoreFloat3(&position, objects[i].r[3]);
+		m_transparencySorter.SetPosition(i, position.x, position.y, position.z);
+	}
+	DirectX::XMFLOAT4X4 view;
+	DirectX::XMStoreFloat4x4(&view, m_viewTransform);
+	const std::vector<UINT32>& order = m_transparencySorter.Sort(&view.m[0][0], m_transparentVisible.data(), m_transparentVisible.size());
 
-		ID3D11SamplerState* samplers[] = { m_pTextureSampler };
-		m_pDeviceContext->PSSetSamplers(0, 1, samplers);
-		SceneBuffer sceneTransformsBuffer = { skyboxScale };
+	// Packets go in already back to front, the queue isn't sorted again
+	for (UINT32 i : order)
+	{
+		m_transparentQueue.Submit(DrawKey::MakeTransparent(DrawPassTransparent, DrawShaderTransTexture, DrawTextureKit, m_transparencySorter.GetDepth(i)), i);
+	}
+	SubmitDrawQueue(pContext, m_transparentQueue, objects);
+}
 
-		ID3D11ShaderResourceView* resources[] = { m_pCubemapTextureView };
-		m_pDeviceContext->PSSetShaderResources(0, 1, resources);
+void Renderer::ResolveOit(ID3D11DeviceContext* pContext, ID3D11ShaderResourceView* pAccumSRV, ID3D11ShaderResourceView* pRevealageSRV)
+{
+	PROFILE_SCOPE("Renderer::ResolveOit");
+	PipelineStateBinder binder(pContext);
+	UINT32 stateChanges = binder.Bind(m_pOitResolveState);
+
+	ID3D11ShaderResourceView* resources[] = { pAccumSRV, pRevealageSRV };
+	pContext->PSSetShaderResources(0, 2, resources);
+	pContext->Draw(3, 0);
+	m_frameCounters.Add(1, stateChanges + 1, 0);
+
+	// Both targets are rendered to again next frame
+	ID3D11ShaderResourceView* nullResources[] = { nullptr, nullptr };
+	pContext->PSSetShaderResources(0, 2, nullResources);
+}
 
-		m_pDeviceContext->IASetIndexBuffer(m_pSphereIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
-		ID3D11Buffer* vertexBuffers[] = { m_pSphereVertexBuffer };
-		UINT strides[] = { sizeof(Vertex) };
-		UINT offsets[] = { 0 };
-		m_pDeviceContext->IASetVertexBuffers(0, 1, vertexBuffers, strides, offsets);
+void Renderer::UpdateRenderSize()
+{
+	// Timings come back a few frames late, each one is fed once. Only the
+	// span of the passes counts: the frame timestamp is written before culling
+	// and setup, which the GPU may spend idle and resolution can't shorten.
+	// The budget follows the frame limiter, 60 fps when it is off. Statistics
+	// are kept either way so 'D' can compare both modes.
+	const double targetFps = m_framePacer.GetTargetFps();
+	m_dynamicResolution.SetTargetFrameTime(1.0 / (targetFps > 0.0 ? targetFps : 60.0));
+	if (m_gpuProfiler.GetMeasuredFrames() != m_dynamicResolutionMeasured)
+	{
+		m_dynamicResolutionMeasured = m_gpuProfiler.GetMeasuredFrames();
+		const double gpuTime = m_gpuProfiler.GetLastPassSpan();
+		if (m_useDynamicResolution)
+			m_dynamicResolution.Update(gpuTime);
+		m_dynamicScaleSum += m_useDynamicResolution ? m_dynamicResolution.GetScale() : 1.0;
+		m_dynamicGpuTimeSum += gpuTime;
+		m_dynamicFramesOverTarget += gpuTime > m_dynamicResolution.GetSettings().targetFrameTime ? 1 : 0;
+		m_dynamicFrames++;
+	}
+	if (!m_useDynamicResolution)
+	{
+		m_renderWidth = m_width;
+		m_renderHeight = m_height;
+		return;
+	}
+	m_dynamicResolution.GetRenderSize(m_width, m_height, m_renderWidth, m_renderHeight);
+
+	D3D11_MAPPED_SUBRESOURCE subresource;
+	ID3D11Buffer* pUpscaleBuffer = m_resources.Get(m_upscaleBuffer);
+	HRESULT result = m_pDeviceContext->Map(pUpscaleBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &subresource);
+	assert(SUCCEEDED(result));
+	if (SUCCEEDED(result)) {
+		UpscaleBuffer& upscale = *reinterpret_cast<UpscaleBuffer*>(subresource.pData);
+		upscale.uvScale = DirectX::XMFLOAT4((float)m_renderWidth / m_width, (float)m_renderHeight / m_height, 1.0f / m_width, 1.0f / m_height);
+		upscale.uvClamp = DirectX::XMFLOAT4((m_renderWidth - 0.5f) / m_width, (m_renderHeight - 0.5f) / m_height, 0.0f, 0.0f);
+		m_pDeviceContext->Unmap(pUpscaleBuffer, 0);
+		m_frameCounters.Add(0, 0, sizeof(UpscaleBuffer));
+	}
+}
+
+void Renderer::Upscale(ID3D11DeviceContext* pContext, ID3D11RenderTargetView* pTarget, ID3D11ShaderResourceView* pSceneSRV)
+{
+	PROFILE_SCOPE("Renderer::Upscale");
+	PipelineStateBinder binder(pContext);
+	UINT32 stateChanges = binder.Bind(m_pUpscaleState);
+
+	// The whole back buffer, unlike the scene passes
+	pContext->OMSetRenderTargets(1, &pTarget, nullptr);
+	D3D11_VIEWPORT viewport = { 0.0f, 0.0f, (FLOAT)m_width, (FLOAT)m_height, 0.0f, 1.0f };
+	pContext->RSSetViewports(1, &viewport);
+	D3D11_RECT rect = { 0, 0, (LONG)m_width, (LONG)m_height };
+	pContext->RSSetScissorRects(1, &rect);
+
+	ID3D11Buffer* constantBuffers[] = { m_resources.Get(m_upscaleBuffer) };
+	pContext->PSSetConstantBuffers(0, 1, constantBuffers);
+	ID3D11SamplerState* samplers[] = { m_resources.Get(m_upscaleSampler) };
+	pContext->PSSetSamplers(0, 1, samplers);
+	ID3D11ShaderResourceView* resources[] = { pSceneSRV };
+	pContext->PSSetShaderResources(0, 1, resources);
+	pContext->Draw(3, 0);
+	m_frameCounters.Add(1, stateChanges + 3, 0);
+
+	// The scene target is rendered to again next frame
+	ID3D11ShaderResourceView* nullResources[] = { nullptr };
+	pContext->PSSetShaderResources(0, 1, nullResources);
+}
 
-		m_pDeviceContext->UpdateSubresource(m_pSceneBuffer, 0, nullptr, &sceneTransformsBuffer, 0, 0);
-		m_pDeviceContext->DrawIndexed(756, 0, 0);
+void Renderer::CullObjects(const FrustumPlanes& frustum, const std::vector<DirectX::XMMATRIX>& objects, const Bvh& bvh, CullingBounds& bounds, std::vector<UINT32>& visible)
+{
+	// Large scenes go through the hierarchy, a flat SIMD pass is cheaper for a handful of objects
+	if (objects.size() >= BvhCullingThreshold && bvh.GetObjectCount() == objects.size())
+	{
+		bvh.QueryFrustum(frustum, visible);
+		return;
 	}
+
+	// Objects are unit cubes, bound them with the sphere around the transformed cube
+	bounds.Resize(objects.size());
+	for (size_t i = 0; i < objects.size(); i++)
 	{
-		m_pDeviceContext->OMSetDepthStencilState(m_pDepthStateRead, 0);
-		m_pDeviceContext->OMSetBlendState(m_pTransBlendState, nullptr, 0xFFFFFFFF);
-		m_pDeviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-		m_pDeviceContext->VSSetShader(m_pSimpleTransTextureVertexShader, nullptr, 0);
-		m_pDeviceContext->PSSetShader(m_pSimpleTransTexturePixelShader, nullptr, 0);
-		m_pDeviceContext->PSSetConstantBuffers(0, 1, &m_pColorBuffer);
+		const DirectX::XMMATRIX& model = objects[i];
+		float scale = max(DirectX::XMVectorGetX(DirectX::XMVector3Length(model.r[0])),
+			max(DirectX::XMVectorGetX(DirectX::XMVector3Length(model.r[1])), DirectX::XMVectorGetX(DirectX::XMVector3Length(model.r[2]))));
+		DirectX::XMFLOAT3 center;
+		DirectX::XMStoreFloat3(&center, model.r[3]);
+		bounds.SetSphere(i, center.x, center.y, center.z, scale * sqrtf(3.0f));
+	}
+	CullSpheres(frustum, bounds, visible);
+}
+
+void Renderer::CullOccluded(const DirectX::XMMATRIX& vp, const DirectX::XMFLOAT4X4& viewProj)
+{
+	m_skyboxVisible = true;
+	if (!m_useOcclusionCulling)
+		return;
 
-		m_pDeviceContext->VSSetConstantBuffers(0, 1, &m_pViewBuffer);
-		m_pDeviceContext->VSSetConstantBuffers(1, 1, &m_pSceneBuffer);
-		m_pDeviceContext->PSSetConstantBuffers(1, 1, &m_pSceneBuffer);
+	// Frustum-visible opaque cubes are the occluders, everything is then tested against them
+	m_occlusionBuffer.Clear();
+	for (UINT32 i : m_opaqueVisible)
+	{
+		DirectX::XMFLOAT4X4 modelViewProj;
+		DirectX::XMStoreFloat4x4(&modelViewProj, DirectX::XMMatrixMultiply(pSceneManager.m_opaqueObjects[i], vp));
+		m_occlusionBuffer.AddOccluder(&CubeVertices[0].x, ARRAYSIZE(CubeVertices), sizeof(TextureVertex),
+			CubeIndices, ARRAYSIZE(CubeIndices), &modelViewProj.m[0][0]);
+	}
+	m_occlusionBuffer.Rasterize(m_workerPool);
+	m_occlusionBuffer.BuildHiZ();
 
-		ID3D11SamplerState* samplers[] = { m_pTextureSampler };
-		m_pDeviceContext->PSSetSamplers(0, 1, samplers);
+	CullOccludedObjects(viewProj, pSceneManager.m_opaqueObjects, m_opaqueVisible);
+	CullOccludedObjects(viewProj, pSceneManager.m_transparentObjects, m_transparentVisible);
+	// Skybox is drawn at the far plane, it is hidden once occluders cover the whole screen
+	m_skyboxVisible = m_occlusionBuffer.IsRectVisible(0.0f, 0.0f, FLOAT(OcclusionBufferWidth), FLOAT(OcclusionBufferHeight), 0.0f);
+}
 
-		std::vector<SceneBuffer> sceneBuffer;
-		sceneBuffer.push_back({ DirectX::XMMatrixTranslation(4.5f, 3.0f, 0.7f) });
-		sceneBuffer.push_back({ DirectX::XMMatrixTranslation(-2.5f, 1.0f, 1.7f) });
-		sceneBuffer.push_back({ DirectX::XMMatrixTranslation(0.5f, 3.0f, -0.7f) });
+void Renderer::CullClusters(const DirectX::XMMATRIX& vp)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	size_t indexCount;
+	if (m_useClusterCulling)
+	{
+		// Both tests run in mesh space: planes from model * vp, the camera moved by the inverse model
+		const DirectX::XMMATRIX& model = pSceneManager.m_clusterMeshTransform;
+		DirectX::XMFLOAT4X4 modelViewProj;
+		DirectX::XMStoreFloat4x4(&modelViewProj, DirectX::XMMatrixMultiply(model, vp));
+		DirectX::XMFLOAT3 cameraPosition;
+		DirectX::XMStoreFloat3(&cameraPosition, DirectX::XMVector3Transform(pSceneManager.m_cameraTransform.r[3], DirectX::XMMatrixInverse(nullptr, model)));
+		indexCount = m_meshletCuller.Cull(&modelViewProj.m[0][0], &cameraPosition.x, &m_workerPool);
+	}
+	else
+	{
+		indexCount = m_meshletCuller.CullNone(&m_workerPool);
+	}
 
-		std::vector<std::pair<int, float>> cameraDist;
-		for (int i = 0; i < sceneBuffer.size(); i++)
+	// Written on the immediate context before any pass records, deferred contexts included
+	m_clusterIndexCount = UINT32(indexCount);
+	if (indexCount > 0)
+	{
+		D3D11_MAPPED_SUBRESOURCE subresource;
+		ID3D11Buffer* pIndexBuffer = m_resources.Get(m_clusterIndexBuffer);
+		HRESULT result = m_pDeviceContext->Map(pIndexBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &subresource);
+		assert(SUCCEEDED(result));
+		if (SUCCEEDED(result))
 		{
-			float dist = DirectX::XMVectorGetZ((sceneBuffer[i].model * pSceneManager.m_cameraTransform).r[3]);
-			cameraDist.push_back({ i, dist });
+			memcpy(subresource.pData, m_meshletCuller.GetIndices().data(), indexCount * sizeof(UINT32));
+			m_pDeviceContext->Unmap(pIndexBuffer, 0);
+			m_frameCounters.Add(0, 0, indexCount * sizeof(UINT32));
 		}
-		std::stable_sort(cameraDist.begin(), cameraDist.end(), [](const std::pair<int, float>& a, const std::pair<int, float>& b)
-			{
-				return a.second > b.second;
-			});
-
-
-		ID3D11ShaderResourceView* resources[] = { m_pKitTextureView };
-		m_pDeviceContext->PSSetShaderResources(0, 1, resources);
-		m_pDeviceContext->IASetIndexBuffer(m_pCubeIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
-		ID3D11Buffer* vertexBuffers[] = { m_pCubeVertexBuffer };
-		UINT strides[] = { sizeof(TextureVertex) };
-		UINT offsets[] = { 0 };
-		m_pDeviceContext->IASetVertexBuffers(0, 1, vertexBuffers, strides, offsets);
+		else
+		{
+			m_clusterIndexCount = 0;
+		}
+	}
+	m_clusterCullTime += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	m_clusterCullFrames++;
+}
 
-		for (int i = 0; i < cameraDist.size(); i++)
+void Renderer::CullOccludedObjects(const DirectX::XMFLOAT4X4& viewProj, const std::vector<DirectX::XMMATRIX>& objects, std::vector<UINT32>& visible)
+{
+	size_t count = 0;
+	for (UINT32 i : visible)
+	{
+		BvhAabb bounds = SceneManager::GetCubeBounds(objects[i]);
+		if (m_occlusionBuffer.IsVisible(bounds.min, bounds.max, &viewProj.m[0][0]))
 		{
-			m_pDeviceContext->UpdateSubresource(m_pSceneBuffer, 0, nullptr, &sceneBuffer[cameraDist[i].first], 0, 0);
-			m_pDeviceContext->DrawIndexed(indexCountCubes, 0, 0);
+			visible[count++] = i;
 		}
+	}
+	visible.resize(count);
+}
 
-		ID3D11Buffer* colorBuffer;
+float Renderer::GetViewDepth(const DirectX::XMMATRIX& model) const
+{
+	return DirectX::XMVectorGetZ(DirectX::XMVector3Transform(model.r[3], m_viewTransform));
+}
 
+UINT32 Renderer::SelectLod(const MeshLodChain& lods, const DirectX::XMMATRIX& model) const
+{
+	float scale = max(DirectX::XMVectorGetX(DirectX::XMVector3Length(model.r[0])),
+		max(DirectX::XMVectorGetX(DirectX::XMVector3Length(model.r[1])), DirectX::XMVectorGetX(DirectX::XMVector3Length(model.r[2]))));
+	float projectedRadius = GetProjectedRadius(lods.GetRadius() * scale, GetViewDepth(model), m_projScaleY, (float)m_renderHeight);
+	return lods.SelectLevel(projectedRadius, MaxLodPixelError);
+}
 
-	}
+void Renderer::SubmitDrawQueue(ID3D11DeviceContext* pContext, const DrawQueue& queue, const std::vector<DirectX::XMMATRIX>& objects)
+{
+	ID3D11Buffer* pSceneBuffer = m_resources.Get(m_sceneBuffer);
+	// Keys are sorted by state, the binder only touches what differs from the previous packet
+	PipelineStateBinder binder(pContext);
+	UINT32 boundShader = UINT32(-1);
+	UINT32 boundTexture = UINT32(-1);
+	UINT32 stateChanges = 0;
+	for (size_t i = 0; i < queue.GetSize(); i++)
+	{
+		const DrawPacket& packet = queue[i];
+		UINT32 shader = DrawKey::GetShader(packet.key);
+		if (shader != boundShader)
+		{
+			const PipelineState* pState = nullptr;
+			switch (shader)
+			{
+			case DrawShaderTexture:
+				pState = m_pOpaqueState;
+				break;
+			case DrawShaderTransTexture:
+				pState = m_pTransparentState;
+				break;
+			case DrawShaderTransTextureOit:
+				pState = m_pTransparentOitState;
+				break;
+			}
+			stateChanges += binder.Bind(pState);
+			boundShader = shader;
+		}
+		UINT32 texture = DrawKey::GetTexture(packet.key);
+		if (texture != boundTexture)
+		{
+			ID3D11ShaderResourceView* resources[] = { m_resources.Get(m_kitTextureView) };
+			pContext->PSSetShaderResources(0, 1, resources);
+			boundTexture = texture;
+			stateChanges++;
+		}
 
-	result = m_pSwapChain->Present(0, 0);
+		SceneBuffer sceneBuffer = { objects[packet.drawIdx] };
+		pContext->UpdateSubresource(pSceneBuffer, 0, nullptr, &sceneBuffer, 0, 0);
+		const MeshLodLevel& lod = m_cubeLods.GetLevel(SelectLod(m_cubeLods, objects[packet.drawIdx]));
+		pContext->DrawIndexed(lod.indexCount, lod.firstIndex, 0);
+	}
+	// Passes may record on several threads, counters are added once per queue
+	m_frameCounters.Add(UINT32(queue.GetSize()), stateChanges, queue.GetSize() * sizeof(SceneBuffer));
+}
 
-	return SUCCEEDED(result);
+void Renderer::RecordFrameStats(double cpuTime)
+{
+	FrameSample sample;
+	sample.cpuTime = cpuTime;
+	sample.drawCalls = m_frameCounters.drawCalls.load();
+	sample.stateChanges = m_frameCounters.stateChanges.load();
+	sample.bytesUploaded = m_frameCounters.bytesUploaded.load();
+	m_frameStats.Record(sample);
+	m_frameCounters.Reset();
 }
 
+void Renderer::OnKeyDown(WPARAM wParam)
+{
+	switch (wParam)
+	{
+	case 'M':
+		m_useDeferredContexts = !m_useDeferredContexts;
+		OutputDebugStringA(m_useDeferredContexts ? "Deferred context recording\n" : "Immediate context recording\n");
+		break;
+	case 'T':
+	{
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		double elapsed = std::chrono::duration<double, std::milli>(now - m_transparencyModeStart).count();
+		char message[128];
+		sprintf_s(message, "%s transparency: %.3f ms/frame over %u frames\n", m_useOit ? "Weighted blended" : "Sorted",
+			m_transparencyModeFrames > 0 ? elapsed / m_transparencyModeFrames : 0.0, m_transparencyModeFrames);
+		OutputDebugStringA(message);
+		m_useOit = !m_useOit;
+		m_transparencyModeStart = now;
+		m_transparencyModeFrames = 0;
+		break;
+	}
+	case 'L':
+	{
+		// Cycles the limiter: 60, 144, off
+		FramePacingStats stats = m_framePacer.GetStats();
+		char message[160];
+		sprintf_s(message, "Pacing at %.0f fps: %.3f ms/frame, jitter %.3f ms, sleep %.2f s, spin %.2f s\n", m_framePacer.GetTargetFps(),
+			stats.averageInterval * 1000.0, stats.jitter * 1000.0, stats.sleepTime, stats.spinTime);
+		OutputDebugStringA(message);
+		double target = m_framePacer.GetTargetFps();
+		m_framePacer.SetTargetFps(target == 0.0 ? 60.0 : (target < 144.0 ? 144.0 : 0.0));
+		m_framePacer.ResetStats();
+		break;
+	}
+	case 'G':
+	{
+		// Timings lag a few frames behind, the queries are read back without waiting
+		char message[128];
+		sprintf_s(message, "GPU frame %.3f ms (%llu measured, %llu skipped, %llu disjoint)\n", m_gpuProfiler.GetLastFrameDuration() * 1000.0,
+			m_gpuProfiler.GetMeasuredFrames(), m_gpuProfiler.GetSkippedFrames(), m_gpuProfiler.GetDisjointFrames());
+		OutputDebugStringA(message);
+		for (const GpuPassTiming& timing : m_gpuProfiler.GetLastFrame())
+		{
+			sprintf_s(message, "  %-16s %.3f ms\n", timing.name, timing.duration * 1000.0);
+			OutputDebugStringA(message);
+		}
+		break;
+	}
+	case 'C':
+	{
+		const MeshletCullStats& stats = m_meshletCuller.GetStats();
+		char message[224];
+		sprintf_s(message, "Cluster culling %s: %.3f ms/frame over %u frames, %zu of %zu meshlets drawn (%zu off frustum, %zu back facing), %zu triangles\n",
+			m_useClusterCulling ? "on" : "off", m_clusterCullFrames > 0 ? m_clusterCullTime / m_clusterCullFrames : 0.0, m_clusterCullFrames,
+			stats.visible, m_clusterMeshlets.meshlets.size(), stats.frustumCulled, stats.backfaceCulled, stats.triangles);
+		OutputDebugStringA(message);
+		m_useClusterCulling = !m_useClusterCulling;
+		m_clusterCullTime = 0.0;
+		m_clusterCullFrames = 0;
+		break;
+	}
+	case 'K':
+	{
+		// Both modes shade the same sky pixels, the sphere pays for its vertices and the quads along its
+		// edges; tools/SkyboxCoverage counts both on the CPU
+		char message[160];
+		const char* names[] = { "Sphere", "Rays" };
+		for (int mode = 0; mode < 2; mode++)
+		{
+			const SkyboxDrawStats& stats = m_skyboxStats[mode];
+			const double frames = double(max(stats.frames, 1ull));
+			sprintf_s(message, "%s skybox: %.0f vertices, %.0f primitives, %.0f pixels shaded per frame over %llu frames (%u x %u target)\n", names[mode],
+				stats.vertices / frames, stats.primitives / frames, stats.pixels / frames, stats.frames, m_width, m_height);
+			OutputDebugStringA(message);
+		}
+		m_useSkyboxRays = !m_useSkyboxRays;
+		break;
+	}
+	case 'H':
+	{
+		m_useAmbientLight = !m_useAmbientLight;
+		AmbientBuffer ambient = { m_skyIrradiance, GetAmbientParams() };
+		m_pDeviceContext->UpdateSubresource(m_resources.Get(m_ambientBuffer), 0, nullptr, &ambient, 0, 0);
+		OutputDebugStringA(m_useAmbientLight ? "Sky ambient light on\n" : "Sky ambient light off\n");
+		break;
+	}
+	case 'F':
+	{
+		m_useSkyReflections = !m_useSkyReflections;
+		AmbientBuffer ambient = { m_skyIrradiance, GetAmbientParams() };
+		m_pDeviceContext->UpdateSubresource(m_resources.Get(m_ambientBuffer), 0, nullptr, &ambient, 0, 0);
+		OutputDebugStringA(m_useSkyReflections ? "Sky reflections on\n" : "Sky reflections off\n");
+		break;
+	}
+	case 'R':
+	{
+		if (!m_useSkyReflections)
+		{
+			OutputDebugStringA("Sky reflections are off, 'F' switches them on\n");
+			break;
+		}
+		// 0, 0.25 ... 1, then back to a mirror
+		m_reflectionRoughness = m_reflectionRoughness >= 1.0f ? 0.0f : m_reflectionRoughness + 0.25f;
+		AmbientBuffer ambient = { m_skyIrradiance, GetAmbientParams() };
+		m_pDeviceContext->UpdateSubresource(m_resources.Get(m_ambientBuffer), 0, nullptr, &ambient, 0, 0);
+		char message[96];
+		sprintf_s(message, "Reflection roughness %.2f, level %.2f of %u\n", m_reflectionRoughness,
+			m_reflectionRoughness * float(m_specularMipCount - 1), m_specularMipCount);
+		OutputDebugStringA(message);
+		break;
+	}
+	case 'D':
+	{
+		char message[192];
+		const double frames = double(max(m_dynamicFrames, 1u));
+		sprintf_s(message, "Dynamic resolution %s: scale %.3f, GPU passes %.3f ms/frame against %.3f ms, %u of %u measured frames over\n",
+			m_useDynamicResolution ? "on" : "off", m_dynamicScaleSum / frames, m_dynamicGpuTimeSum / frames * 1000.0,
+			m_dynamicResolution.GetSettings().targetFrameTime * 1000.0, m_dynamicFramesOverTarget, m_dynamicFrames);
+		OutputDebugStringA(message);
+		m_useDynamicResolution = !m_useDynamicResolution;
+		m_dynamicResolution.Reset();
+		m_dynamicScaleSum = 0.0;
+		m_dynamicGpuTimeSum = 0.0;
+		m_dynamicFrames = 0;
+		m_dynamicFramesOverTarget = 0;
+		break;
+	}
+	case 'O':
+		m_useOcclusionCulling = !m_useOcclusionCulling;
+		OutputDebugStringA(m_useOcclusionCulling ? "Occlusion culling on\n" : "Occlusion culling off\n");
+		break;
+	case 'U':
+		// The torus is built the first time it is switched on, a failed build isn't retried
+		if (!m_useClusterMesh && !m_clusterMeshBuffer.IsValid() && (!m_clusterMeshlets.meshlets.empty() || FAILED(InitClusterMesh())))
+		{
+			OutputDebugStringA("Cluster mesh unavailable\n");
+			break;
+		}
+		m_useClusterMesh = !m_useClusterMesh;
+		m_clusterCullTime = 0.0;
+		m_clusterCullFrames = 0;
+		OutputDebugStringA(m_useClusterMesh ? "Cluster mesh on\n" : "Cluster mesh off\n");
+		break;
+	}
+}
 
 bool Renderer::Resize(UINT width, UINT height)
 {
 	if (width != m_width || height != m_height)
 	{
-		SafeRelease(m_pBackBufferRTV);
-		SafeRelease(m_pDepthBufferDSV);
-		SafeRelease(m_pDepthBuffer);
+		// ResizeBuffers fails while the back buffer is referenced, the depth
+		// buffer may still be in use by queued frames and waits for them
+		m_resources.DestroyNow(m_backBufferRTV);
+		m_resources.Destroy(m_depthBufferDSV);
+		m_resources.Destroy(m_depthBuffer);
 
-		HRESULT result = m_pSwapChain->ResizeBuffers(2, width, height, DXGI_FORMAT_R8G8B8A8_UNORM, 0);
+		HRESULT result = m_pSwapChain->ResizeBuffers(2, width, height, DXGI_FORMAT_R8G8B8A8_UNORM, SwapChainFlags);
 		if (!SUCCEEDED(result))
 			return false;
 		m_width = width;
@@ -897,8 +1990,8 @@ bool Renderer::Resize(UINT width, UINT height)
 
 HRESULT Renderer::SetupDepthBuffer()
 {
-	SafeRelease(m_pDepthBufferDSV);
-	SafeRelease(m_pDepthBuffer);
+	m_resources.Destroy(m_depthBufferDSV);
+	m_resources.Destroy(m_depthBuffer);
 	HRESULT result = S_OK;
 	if (SUCCEEDED(result))
 	{
@@ -914,20 +2007,22 @@ HRESULT Renderer::SetupDepthBuffer()
 		desc.Height = m_height;
 		desc.Width = m_width;
 		desc.MipLevels = 1;
-		result = m_pDevice->CreateTexture2D(&desc, nullptr, &m_pDepthBuffer);
+		ID3D11Texture2D* pTexture = nullptr;
+		result = m_pDevice->CreateTexture2D(&desc, nullptr, &pTexture);
 		assert(SUCCEEDED(result));
 		if (SUCCEEDED(result))
 		{
-			result = SetResourceName(m_pDepthBuffer, "DepthBuffer");
+			result = RegisterResource(pTexture, m_depthBuffer, "DepthBuffer");
 		}
 	}
 	if (SUCCEEDED(result))
 	{
-		result = m_pDevice->CreateDepthStencilView(m_pDepthBuffer, nullptr, &m_pDepthBufferDSV);
+		ID3D11DepthStencilView* pView = nullptr;
+		result = m_pDevice->CreateDepthStencilView(m_resources.Get(m_depthBuffer), nullptr, &pView);
 		assert(SUCCEEDED(result));
 		if (SUCCEEDED(result))
 		{
-			result = SetResourceName(m_pDepthBufferDSV, "pDepthBufferDSV");
+			result = RegisterResource(pView, m_depthBufferDSV, "pDepthBufferDSV");
 		}
 	}
 	return result;
@@ -935,14 +2030,17 @@ HRESULT Renderer::SetupDepthBuffer()
 
 HRESULT Renderer::SetupBackBuffer()
 {
-	SafeRelease(m_pBackBufferRTV);
+	m_resources.DestroyNow(m_backBufferRTV);
 	ID3D11Texture2D* pBackBuffer = NULL;
 	HRESULT result = m_pSwapChain->GetBuffer(0, __uuidof(ID3D11Texture2D), (LPVOID*)&pBackBuffer);
 	assert(SUCCEEDED(result));
 	if (SUCCEEDED(result))
 	{
-		result = m_pDevice->CreateRenderTargetView(pBackBuffer, NULL, &m_pBackBufferRTV);
+		ID3D11RenderTargetView* pView = NULL;
+		result = m_pDevice->CreateRenderTargetView(pBackBuffer, NULL, &pView);
 		assert(SUCCEEDED(result));
+		if (SUCCEEDED(result))
+			m_backBufferRTV = m_resources.Add(pView, "BackBufferRTV");
 		SafeRelease(pBackBuffer);
 	}
 	return result;
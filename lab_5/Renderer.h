@@ -5,9 +5,33 @@
 #include <vector>
 #include <locale>
 #include <codecvt>
+#include <chrono>
 #include "winerror.h"
+#include <dxgi1_3.h>
+#include <mmsystem.h>
 #include "SceneManager.h"
 #include "LoadDDS.h"
+#include "FrameGraphD3D11.h"
+#include "DrawQueue.h"
+#include "DeferredContextsD3D11.h"
+#include "FrustumCulling.h"
+#include "OcclusionCulling.h"
+#include "WorkerPool.h"
+#include "MeshLod.h"
+#include "TransparencySorter.h"
+#include "FramePacer.h"
+#include "Profiler.h"
+#include "GpuProfilerD3D11.h"
+#include "FrameStats.h"
+#include "PipelineState.h"
+#include "ResourceRegistryD3D11.h"
+#include "MeshPacking.h"
+#include "MeshOptimizer.h"
+#include "MeshGenerator.h"
+#include "MeshFile.h"
+#include "Meshlets.h"
+#include "SphericalHarmonics.h"
+#include "DynamicResolution.h"
 
 class Renderer {
 public:
@@ -22,61 +46,224 @@ public:
     bool Init(HWND hWnd);
     HRESULT InitShaders();
     void Clean();
+    // Blocks until the frame limiter and the swap chain are ready for the next frame
+    void WaitForFrame();
     bool Render();
+    // Closes the frame's counters into the statistics, cpuTime covers update and render
+    void RecordFrameStats(double cpuTime);
+    const FrameStats& GetFrameStats() const { return m_frameStats; }
     bool Resize(UINT width, UINT height);
+    void OnKeyDown(WPARAM wParam);
     bool IsRunning() { return m_isRunning; }
     ~Renderer();
 private:
     Renderer() {};
     HRESULT InitTextures();
+    // Projects the skybox faces (or reads the cached result) into the ambient constant buffer
+    HRESULT InitSkyIrradiance(const TextureDesc (&faces)[6]);
+    // Loads the GGX prefiltered sky baked by tools/PrefilterSky, all six faces with their mips
+    HRESULT InitSpecularCubemap();
+    // Ambient weight, reflectance and the prefiltered level for the ambient constant buffer
+    DirectX::XMVECTOR GetAmbientParams() const;
     HRESULT CompileShader(const std::wstring& path, ID3D11DeviceChild** ppShader, const std::string& ext, ID3DBlob** ppCode = nullptr);
+    // Compiles and registers, the shader stage follows the handle type
+    template <typename Shader>
+    HRESULT LoadShader(const std::wstring& path, ResourceHandle<Shader>& shader, const std::string& ext, ID3DBlob** ppCode = nullptr);
+    // Names the object for the debug layer and hands it to the registry
+    template <typename T>
+    HRESULT RegisterResource(T* pObject, ResourceHandle<T>& handle, const std::string& name);
     HRESULT SetupBackBuffer();
-    HRESULT SetupDepthBlend();
+    // Immutable constant buffer with a mesh's position decode
+    HRESULT CreateMeshBuffer(const VertexQuantization& quantization, ResourceHandle<ID3D11Buffer>& buffer, const std::string& name);
+    HRESULT InitPipelineStates();
+    HRESULT InitClusterMesh();
     bool Update();
 
+    void SetupPassTargets(ID3D11DeviceContext* pContext, ID3D11RenderTargetView* pRTV, ID3D11DepthStencilView* pDSV);
+    void SetupPassTargets(ID3D11DeviceContext* pContext, UINT count, ID3D11RenderTargetView* const* ppRTVs, ID3D11DepthStencilView* pDSV);
+    void RenderOpaque(ID3D11DeviceContext* pContext);
+    void RenderClusterMesh(ID3D11DeviceContext* pContext);
+    void RenderSkybox(ID3D11DeviceContext* pContext);
+    // Collects the statistics of the query slot about to be reused
+    void ReadSkyboxQuery();
+    void RenderTransparent(ID3D11DeviceContext* pContext);
+    void ResolveOit(ID3D11DeviceContext* pContext, ID3D11ShaderResourceView* pAccumSRV, ID3D11ShaderResourceView* pRevealageSRV);
+    // Feeds the latest GPU frame time to the controller and picks this frame's render size
+    void UpdateRenderSize();
+    // Stretches the rendered part of the scene target over the whole back buffer
+    void Upscale(ID3D11DeviceContext* pContext, ID3D11RenderTargetView* pTarget, ID3D11ShaderResourceView* pSceneSRV);
+    void CullObjects(const FrustumPlanes& frustum, const std::vector<DirectX::XMMATRIX>& objects, const Bvh& bvh, CullingBounds& bounds, std::vector<UINT32>& visible);
+    void CullOccluded(const DirectX::XMMATRIX& vp, const DirectX::XMFLOAT4X4& viewProj);
+    // Culls the clustered mesh's meshlets and uploads the indices of the survivors
+    void CullClusters(const DirectX::XMMATRIX& vp);
+    void CullOccludedObjects(const DirectX::XMFLOAT4X4& viewProj, const std::vector<DirectX::XMMATRIX>& objects, std::vector<UINT32>& visible);
+    float GetViewDepth(const DirectX::XMMATRIX& model) const;
+    UINT32 SelectLod(const MeshLodChain& lods, const DirectX::XMMATRIX& model) const;
+    void SubmitDrawQueue(ID3D11DeviceContext* pContext, const DrawQueue& queue, const std::vector<DirectX::XMMATRIX>& objects);
+
     unsigned int m_width = 1280;
     unsigned int m_height = 720;
+    // Scene passes render at this size, the top left of full size targets
+    unsigned int m_renderWidth = 1280;
+    unsigned int m_renderHeight = 720;
     IDXGISwapChain* m_pSwapChain = NULL;
+    HANDLE m_frameLatencyWaitableObject = NULL;
+    FramePacer m_framePacer;
+    bool m_timerPeriodSet = false;
     ID3D11Device* m_pDevice = NULL;
     ID3D11DeviceContext* m_pDeviceContext = NULL;
-    ID3D11RenderTargetView* m_pBackBufferRTV = NULL;
+    // Owns every buffer, texture, view and shader below, Clean releases them in bulk
+    GpuResourceRegistry m_resources;
+    ResourceHandle<ID3D11RenderTargetView> m_backBufferRTV;
 
-    ID3D11Buffer* m_pSphereVertexBuffer = NULL;
-    ID3D11Buffer* m_pSphereIndexBuffer = NULL;
-    ID3D11Buffer* m_pCubeVertexBuffer = NULL;
-    ID3D11Buffer* m_pCubeIndexBuffer = NULL;
-    ID3D11Buffer* m_pColorBuffer = NULL;
+    ResourceHandle<ID3D11Buffer> m_sphereVertexBuffer;
+    ResourceHandle<ID3D11Buffer> m_sphereIndexBuffer;
+    MeshLodChain m_sphereLods;
+    ResourceHandle<ID3D11Buffer> m_cubeVertexBuffer;
+    ResourceHandle<ID3D11Buffer> m_cubeIndexBuffer;
+    // From src/cube.mesh when it loads, the built in cube otherwise; every
+    // object picks its level from its size on screen
+    MeshLodChain m_cubeLods;
+    DXGI_FORMAT m_cubeIndexFormat = DXGI_FORMAT_R16_UINT;
+    ResourceHandle<ID3D11Buffer> m_colorBuffer;
+    ResourceHandle<ID3D11Buffer> m_sphereMeshBuffer;
+    ResourceHandle<ID3D11Buffer> m_cubeMeshBuffer;
+    // Large generated mesh, drawn from an index buffer rewritten every frame
+    // with the triangles of the meshlets that pass culling; off by default,
+    // 'U' builds and switches it on, 'C' then compares culling against none
+    MeshletMesh m_clusterMeshlets;
+    MeshletCuller m_meshletCuller;
+    ResourceHandle<ID3D11Buffer> m_clusterVertexBuffer;
+    ResourceHandle<ID3D11Buffer> m_clusterIndexBuffer;
+    ResourceHandle<ID3D11Buffer> m_clusterMeshBuffer;
+    UINT32 m_clusterIndexCount = 0;
+    bool m_useClusterMesh = false;
+    bool m_useClusterCulling = true;
+    // Culling and upload time of the current mode, reported when it is switched
+    double m_clusterCullTime = 0.0;
+    UINT m_clusterCullFrames = 0;
 
-    ID3D11Buffer* m_pSceneBuffer = NULL;
-    ID3D11Buffer* m_pViewBuffer = NULL;
+    ResourceHandle<ID3D11Buffer> m_sceneBuffer;
+    ResourceHandle<ID3D11Buffer> m_viewBuffer;
 
-    ID3D11PixelShader* m_pTexturePS = NULL;
-    ID3D11VertexShader* m_pTextureVS = NULL;
-    ID3D11InputLayout* m_pTextureInputLayout = NULL;
+    ResourceHandle<ID3D11PixelShader> m_texturePS;
+    ResourceHandle<ID3D11VertexShader> m_textureVS;
+    ResourceHandle<ID3D11InputLayout> m_textureInputLayout;
 
-    ID3D11PixelShader* m_pSkyboxPS = NULL;
-    ID3D11VertexShader* m_pSkyboxVS = NULL;
-    ID3D11InputLayout* m_pSkyboxInputLayout = NULL;
+    ResourceHandle<ID3D11PixelShader> m_skyboxPS;
+    ResourceHandle<ID3D11VertexShader> m_skyboxVS;
+    ResourceHandle<ID3D11InputLayout> m_skyboxInputLayout;
+    // Sky from view rays on a fullscreen triangle instead of the sphere; off
+    // by default, 'K' switches it on
+    ResourceHandle<ID3D11VertexShader> m_skyboxRayVS;
+    bool m_useSkyboxRays = false;
+    // Pipeline statistics of the skybox draw, read back a few frames later without waiting
+    struct SkyboxDrawStats
+    {
+        UINT64 frames = 0;
+        UINT64 vertices = 0;
+        UINT64 primitives = 0;
+        UINT64 pixels = 0;
+    };
+    static const UINT SkyboxQueryCount = 4;
+    ResourceHandle<ID3D11Query> m_skyboxQueries[SkyboxQueryCount];
+    bool m_skyboxQueryIssued[SkyboxQueryCount] = {};
+    bool m_skyboxQueryRays[SkyboxQueryCount] = {};
+    UINT64 m_skyboxQueryFrame = 0;
+    // Sphere, then rays
+    SkyboxDrawStats m_skyboxStats[2];
 
-    ID3D11Texture2D* m_pKitTexture = NULL;
-    ID3D11ShaderResourceView* m_pKitTextureView = NULL;
-    ID3D11SamplerState* m_pTextureSampler = NULL;
+    ResourceHandle<ID3D11Texture2D> m_kitTexture;
+    ResourceHandle<ID3D11ShaderResourceView> m_kitTextureView;
+    ResourceHandle<ID3D11SamplerState> m_textureSampler;
 
-    ID3D11Texture2D* m_pCubemapTexture = NULL;
-    ID3D11ShaderResourceView* m_pCubemapTextureView = NULL;
+    ResourceHandle<ID3D11Texture2D> m_cubemapTexture;
+    ResourceHandle<ID3D11ShaderResourceView> m_cubemapTextureView;
+    // Diffuse sky light for opaque objects as L2 spherical harmonics; off by
+    // default, 'H' switches it on
+    ResourceHandle<ID3D11Buffer> m_ambientBuffer;
+    ShCoefficients m_skyIrradiance = {};
+    bool m_useAmbientLight = false;
+    // Glossy sky reflections, off by default; 'F' switches them on, 'R' then steps the
+    // roughness along the mips. Without the baked file the plain skybox is sampled instead.
+    ResourceHandle<ID3D11Texture2D> m_specularTexture;
+    ResourceHandle<ID3D11ShaderResourceView> m_specularTextureView;
+    UINT32 m_specularMipCount = 1;
+    bool m_useSkyReflections = false;
+    float m_reflectionRoughness = 0.5f;
     //
-    ID3D11Texture2D* m_pDepthBuffer = NULL;
-    ID3D11DepthStencilView* m_pDepthBufferDSV = NULL;
-    ID3D11DepthStencilState* m_pDepthStateReadWrite = NULL;
-    ID3D11DepthStencilState* m_pDepthStateRead = NULL;
+    ResourceHandle<ID3D11Texture2D> m_depthBuffer;
+    ResourceHandle<ID3D11DepthStencilView> m_depthBufferDSV;
 
-    ID3D11PixelShader* m_pSimpleTransTexturePixelShader = NULL;
-    ID3D11VertexShader* m_pSimpleTransTextureVertexShader = NULL;
-    ID3D11InputLayout* m_pSimpleTransTextureInputLayout = NULL;
+    ResourceHandle<ID3D11PixelShader> m_transTexturePS;
+    ResourceHandle<ID3D11VertexShader> m_transTextureVS;
+    ResourceHandle<ID3D11InputLayout> m_transTextureInputLayout;
 
-    ID3D11BlendState* m_pTransBlendState = NULL;
+    // Weighted blended order independent transparency
+    ResourceHandle<ID3D11PixelShader> m_transTextureOitPS;
+    ResourceHandle<ID3D11VertexShader> m_oitResolveVS;
+    ResourceHandle<ID3D11PixelShader> m_oitResolvePS;
+    bool m_useOit = false;
+    // Dynamic resolution: the scale follows the GPU frame time; off by default, 'D' switches it on
+    DynamicResolution m_dynamicResolution;
+    bool m_useDynamicResolution = false;
+    UINT64 m_dynamicResolutionMeasured = 0;
+    ResourceHandle<ID3D11PixelShader> m_upscalePS;
+    ResourceHandle<ID3D11SamplerState> m_upscaleSampler;
+    ResourceHandle<ID3D11Buffer> m_upscaleBuffer;
+    // Per measured GPU frame since the last switch, reported by 'D'
+    double m_dynamicScaleSum = 0.0;
+    double m_dynamicGpuTimeSum = 0.0;
+    UINT m_dynamicFrames = 0;
+    UINT m_dynamicFramesOverTarget = 0;
+    // Shared depth, blend and rasterizer objects live in the cache, the states point into it
+    PipelineStateCache m_pipelineStates;
+    const PipelineState* m_pOpaqueState = nullptr;
+    const PipelineState* m_pSkyboxState = nullptr;
+    const PipelineState* m_pSkyboxRayState = nullptr;
+    const PipelineState* m_pTransparentState = nullptr;
+    const PipelineState* m_pTransparentOitState = nullptr;
+    const PipelineState* m_pOitResolveState = nullptr;
+    const PipelineState* m_pUpscaleState = nullptr;
+    // Frame time of the current transparency mode, reported when it is switched
+    std::chrono::steady_clock::time_point m_transparencyModeStart;
+    UINT m_transparencyModeFrames = 0;
 
     HRESULT SetupDepthBuffer();
 
+    FrameGraph m_frameGraph;
+    FrameGraphD3D11Backend m_frameGraphBackend;
+    DirectX::XMMATRIX m_skyboxScale;
+    DirectX::XMMATRIX m_viewTransform;
+    float m_projScaleY = 1.0f;
+    // Screen space error allowed when picking a LOD, in pixels
+    static constexpr float MaxLodPixelError = 1.0f;
+    DrawQueue m_opaqueQueue;
+    DrawQueue m_transparentQueue;
+    TransparencySorter m_transparencySorter;
+    static const size_t BvhCullingThreshold = 256;
+    CullingBounds m_opaqueBounds;
+    CullingBounds m_transparentBounds;
+    std::vector<UINT32> m_opaqueVisible;
+    std::vector<UINT32> m_transparentVisible;
+
+    static const UINT OcclusionBufferWidth = 320;
+    static const UINT OcclusionBufferHeight = 192;
+    WorkerPool m_workerPool;
+    // Software Hi-Z occlusion of the frustum-visible objects; off by default, 'O' switches it on
+    OcclusionBuffer m_occlusionBuffer;
+    bool m_useOcclusionCulling = false;
+    bool m_skyboxVisible = true;
+
+    static const UINT MaxRecordingSlots = 8;
+    ParallelRecorder m_parallelRecorder;
+    DeferredContextsD3D11 m_deferredContexts;
+    bool m_useDeferredContexts = false;
+
+    GpuQueryD3D11Backend m_gpuQueryBackend;
+    GpuProfiler m_gpuProfiler;
+    FrameCounters m_frameCounters;
+    FrameStats m_frameStats;
+
     bool m_isRunning = false;
 };
\ No newline at end of file
@@ -0,0 +1,331 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+// Typed reference to an object in a ResourcePool: 20 bits of slot index and
+// 12 bits of generation. A slot's generation changes every time its object is
+// removed, so a stale handle no longer resolves. The zero handle is never valid.
+template <typename T>
+class ResourceHandle
+{
+public:
+    static const uint32_t IndexBits = 20;
+    static const uint32_t GenerationBits = 12;
+    static const uint32_t MaxIndex = (1u << IndexBits) - 1;
+    static const uint32_t MaxGeneration = (1u << GenerationBits) - 1;
+
+    ResourceHandle() = default;
+    static ResourceHandle Make(uint32_t index, uint32_t generation)
+    {
+        ResourceHandle handle;
+        handle.m_value = (generation << IndexBits) | index;
+        return handle;
+    }
+
+    bool IsValid() const { return m_value != 0; }
+    uint32_t GetIndex() const { return m_value & MaxIndex; }
+    uint32_t GetGeneration() const { return m_value >> IndexBits; }
+    uint32_t GetValue() const { return m_value; }
+
+    bool operator==(const ResourceHandle& other) const { return m_value == other.m_value; }
+    bool operator!=(const ResourceHandle& other) const { return m_value != other.m_value; }
+private:
+    uint32_t m_value = 0;
+};
+
+// Release hook, the default fits COM objects: returns the references left
+template <typename T>
+inline uint32_t ReleaseResourceObject(T* pObject)
+{
+    return uint32_t(pObject->Release());
+}
+
+// Objects of one type in dense arrays. Handles map through a slot table to the
+// dense position; removal moves the last object into the hole, so add, get and
+// remove are O(1) and walking every object touches contiguous memory.
+template <typename T>
+class ResourcePool
+{
+public:
+    ResourceHandle<T> Add(T* pObject, const char* name)
+    {
+        assert(pObject != nullptr);
+        uint32_t slotIdx;
+        if (!m_freeSlots.empty())
+        {
+            slotIdx = m_freeSlots.back();
+            m_freeSlots.pop_back();
+        }
+        else
+        {
+            assert(m_slots.size() < ResourceHandle<T>::MaxIndex);
+            slotIdx = uint32_t(m_slots.size());
+            // Slot 0 is never handed out, so the zero handle stays invalid
+            if (slotIdx == 0)
+            {
+                m_slots.push_back(Slot());
+                slotIdx = 1;
+            }
+            m_slots.push_back(Slot());
+        }
+        Slot& slot = m_slots[slotIdx];
+        slot.dense = uint32_t(m_objects.size());
+        m_objects.push_back(pObject);
+        m_denseToSlot.push_back(slotIdx);
+        m_names.push_back(name != nullptr ? name : "");
+        return ResourceHandle<T>::Make(slotIdx, slot.generation);
+    }
+
+    T* Get(ResourceHandle<T> handle) const
+    {
+        uint32_t slotIdx = handle.GetIndex();
+        if (slotIdx == 0 || slotIdx >= m_slots.size())
+            return nullptr;
+        const Slot& slot = m_slots[slotIdx];
+        if (slot.generation != handle.GetGeneration() || slot.dense == InvalidDense)
+            return nullptr;
+        return m_objects[slot.dense];
+    }
+
+    // Invalidates the handle right away; the object waits until frame is complete
+    bool Retire(ResourceHandle<T> handle, uint64_t frame)
+    {
+        std::string name;
+        T* pObject = Remove(handle, name);
+        if (pObject == nullptr)
+            return false;
+        m_retired.push_back({ pObject, frame, std::move(name) });
+        return true;
+    }
+
+    // Releases at once, for objects that must be gone before the next call
+    // (swap chain buffers before ResizeBuffers)
+    bool Release(ResourceHandle<T> handle, std::vector<std::string>* pLeaks)
+    {
+        std::string name;
+        T* pObject = Remove(handle, name);
+        if (pObject == nullptr)
+            return false;
+        if (ReleaseResourceObject(pObject) != 0 && pLeaks != nullptr)
+            pLeaks->push_back(name);
+        return true;
+    }
+
+    // Releases retired objects whose frame is at most completedFrame
+    void ReleaseRetired(uint64_t completedFrame, std::vector<std::string>* pLeaks)
+    {
+        // Frames are retired in increasing order, the front is always the oldest
+        while (!m_retired.empty() && m_retired.front().frame <= completedFrame)
+        {
+            if (ReleaseResourceObject(m_retired.front().pObject) != 0 && pLeaks != nullptr)
+                pLeaks->push_back(m_retired.front().name);
+            m_retired.pop_front();
+        }
+    }
+
+    // Releases every object, retired ones included; handles are invalidated.
+    // Objects that still have references afterwards are reported as leaks.
+    void ReleaseAll(std::vector<std::string>* pLeaks)
+    {
+        ReleaseRetired(UINT64_MAX, pLeaks);
+        for (size_t i = 0; i < m_objects.size(); i++)
+        {
+            if (ReleaseResourceObject(m_objects[i]) != 0 && pLeaks != nullptr)
+                pLeaks->push_back(m_names[i]);
+            Slot& slot = m_slots[m_denseToSlot[i]];
+            slot.dense = InvalidDense;
+            slot.generation = NextGeneration(slot.generation);
+            m_freeSlots.push_back(m_denseToSlot[i]);
+        }
+        m_objects.clear();
+        m_denseToSlot.clear();
+        m_names.clear();
+    }
+
+    size_t GetLiveCount() const { return m_objects.size(); }
+    size_t GetRetiredCount() const { return m_retired.size(); }
+    T* const* GetObjects() const { return m_objects.data(); }
+private:
+    static const uint32_t InvalidDense = UINT32_MAX;
+
+    struct Slot
+    {
+        uint32_t generation = 1;
+        uint32_t dense = InvalidDense;
+    };
+
+    struct Retired
+    {
+        T* pObject;
+        uint64_t frame;
+        std::string name;
+    };
+
+    static uint32_t NextGeneration(uint32_t generation)
+    {
+        return generation == ResourceHandle<T>::MaxGeneration ? 1 : generation + 1;
+    }
+
+    T* Remove(ResourceHandle<T> handle, std::string& name)
+    {
+        T* pObject = Get(handle);
+        if (pObject == nullptr)
+            return nullptr;
+        Slot& slot = m_slots[handle.GetIndex()];
+        const uint32_t dense = slot.dense;
+        const uint32_t last = uint32_t(m_objects.size() - 1);
+        name = std::move(m_names[dense]);
+        if (dense != last)
+        {
+            m_objects[dense] = m_objects[last];
+            m_denseToSlot[dense] = m_denseToSlot[last];
+            m_names[dense] = std::move(m_names[last]);
+            m_slots[m_denseToSlot[dense]].dense = dense;
+        }
+        m_objects.pop_back();
+        m_denseToSlot.pop_back();
+        m_names.pop_back();
+        slot.dense = InvalidDense;
+        slot.generation = NextGeneration(slot.generation);
+        m_freeSlots.push_back(handle.GetIndex());
+        return pObject;
+    }
+
+    std::vector<Slot> m_slots;
+    std::vector<uint32_t> m_freeSlots;
+    // Dense arrays, names are cold data kept apart from the objects
+    std::vector<T*> m_objects;
+    std::vector<uint32_t> m_denseToSlot;
+    std::vector<std::string> m_names;
+    std::deque<Retired> m_retired;
+};
+
+// One pool per resource type. Destroy keeps an object alive until framesInFlight
+// more frames were ended, by then the GPU can no longer be using it.
+// ReleaseAll goes through the types last to first, list views after the
+// resources they were created from so they are released before them.
+template <typename... Types>
+class ResourceRegistry
+{
+public:
+    explicit ResourceRegistry(uint32_t framesInFlight = 3)
+        : m_framesInFlight(framesInFlight)
+    {
+    }
+    ResourceRegistry(const ResourceRegistry&) = delete;
+    ResourceRegistry& operator=(const ResourceRegistry&) = delete;
+
+    template <typename T>
+    ResourceHandle<T> Add(T* pObject, const char* name)
+    {
+        return GetPool<T>().Add(pObject, name);
+    }
+
+    template <typename T>
+    T* Get(ResourceHandle<T> handle) const
+    {
+        return GetPool<T>().Get(handle);
+    }
+
+    template <typename T>
+    void Destroy(ResourceHandle<T>& handle)
+    {
+        GetPool<T>().Retire(handle, m_frame);
+        handle = ResourceHandle<T>();
+    }
+
+    template <typename T>
+    void DestroyNow(ResourceHandle<T>& handle)
+    {
+        GetPool<T>().Release(handle, &m_leaks);
+        handle = ResourceHandle<T>();
+    }
+
+    // Objects destroyed framesInFlight frames ago are released
+    void EndFrame()
+    {
+        m_frame++;
+        if (m_frame >= m_framesInFlight)
+        {
+            const uint64_t completedFrame = m_frame - m_framesInFlight;
+            ForEachPool([&](auto& pool) { pool.ReleaseRetired(completedFrame, &m_leaks); });
+        }
+    }
+
+    // Returns the names of objects whose reference count didn't reach zero,
+    // including those found by earlier deferred and immediate releases
+    std::vector<std::string> ReleaseAll()
+    {
+        ForEachPoolReverse([&](auto& pool) { pool.ReleaseAll(&m_leaks); });
+        std::vector<std::string> leaks;
+        leaks.swap(m_leaks);
+        return leaks;
+    }
+
+    size_t GetLiveCount() const
+    {
+        size_t count = 0;
+        ForEachPool([&](const auto& pool) { count += pool.GetLiveCount(); });
+        return count;
+    }
+    size_t GetRetiredCount() const
+    {
+        size_t count = 0;
+        ForEachPool([&](const auto& pool) { count += pool.GetRetiredCount(); });
+        return count;
+    }
+    uint64_t GetFrame() const { return m_frame; }
+
+    template <typename T>
+    ResourcePool<T>& GetPool() { return std::get<ResourcePool<T>>(m_pools); }
+    template <typename T>
+    const ResourcePool<T>& GetPool() const { return std::get<ResourcePool<T>>(m_pools); }
+private:
+    template <typename Func>
+    void ForEachPool(Func func)
+    {
+        ForEachPool(func, std::index_sequence_for<Types...>());
+    }
+    template <typename Func>
+    void ForEachPool(Func func) const
+    {
+        ForEachPool(func, std::index_sequence_for<Types...>());
+    }
+    template <typename Func>
+    void ForEachPoolReverse(Func func)
+    {
+        ForEachPoolReverse(func, std::index_sequence_for<Types...>());
+    }
+
+    // Braced initializer lists are evaluated left to right
+    template <typename Func, size_t... Idx>
+    void ForEachPool(Func& func, std::index_sequence<Idx...>)
+    {
+        int order[] = { 0, (func(std::get<Idx>(m_pools)), 0)... };
+        (void)order;
+    }
+    template <typename Func, size_t... Idx>
+    void ForEachPool(Func& func, std::index_sequence<Idx...>) const
+    {
+        int order[] = { 0, (func(std::get<Idx>(m_pools)), 0)... };
+        (void)order;
+    }
+    template <typename Func, size_t... Idx>
+    void ForEachPoolReverse(Func& func, std::index_sequence<Idx...>)
+    {
+        int order[] = { 0, (func(std::get<sizeof...(Types) - 1 - Idx>(m_pools)), 0)... };
+        (void)order;
+    }
+
+    std::tuple<ResourcePool<Types>...> m_pools;
+    uint32_t m_framesInFlight;
+    uint64_t m_frame = 0;
+    std::vector<std::string> m_leaks;
+};
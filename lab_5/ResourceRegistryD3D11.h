@@ -0,0 +1,18 @@
+#pragma once
+
+#include <d3d11.h>
+#include "ResourceRegistry.h"
+
+// Views come after the resources they are created from, ReleaseAll walks the
+// list backwards and drops them first
+typedef ResourceRegistry<
+    ID3D11Buffer,
+    ID3D11Texture2D,
+    ID3D11SamplerState,
+    ID3D11VertexShader,
+    ID3D11PixelShader,
+    ID3D11InputLayout,
+    ID3D11ShaderResourceView,
+    ID3D11RenderTargetView,
+    ID3D11DepthStencilView,
+    ID3D11Query> GpuResourceRegistry;
@@ -1,7 +1,9 @@
 #include "SceneManager.h"
+#include "Profiler.h"
 
 SceneManager::SceneManager() {
     m_animTime = 0;
+    m_prevAnimTime = 0;
     m_isPlay = true;
     m_isTrapped = false;
     m_zoomScene = 14.0f;
@@ -9,11 +11,52 @@ SceneManager::SceneManager() {
     m_s = false;
     m_cameraXRotation = DirectX::XMMatrixIdentity();
     m_cameraYRotation = DirectX::XMMatrixIdentity();
+
+    m_opaqueObjects.push_back(DirectX::XMMatrixTranslation(-2.8f, 1.0f, -1.8f));
+    m_opaqueObjects.push_back(DirectX::XMMatrixIdentity());
+
+    m_transparentObjects.push_back(DirectX::XMMatrixTranslation(4.5f, 3.0f, 0.7f));
+    m_transparentObjects.push_back(DirectX::XMMatrixTranslation(-2.5f, 1.0f, 1.7f));
+    m_transparentObjects.push_back(DirectX::XMMatrixTranslation(0.5f, 3.0f, -0.7f));
+
+    m_clusterMeshTransform = DirectX::XMMatrixTranslation(0.0f, -1.5f, 0.0f);
+
+    UpdateObjectBounds(m_opaqueObjects);
+    m_opaqueBvh.Build(m_objectBounds);
+    UpdateObjectBounds(m_transparentObjects);
+    m_transparentBvh.Build(m_objectBounds);
     Update(0.0);
+    Interpolate(0.0);
+}
+
+BvhAabb SceneManager::GetCubeBounds(const DirectX::XMMATRIX& model)
+{
+    // Box extent along each world axis is the sum of |row components|
+    DirectX::XMFLOAT4X4 m;
+    DirectX::XMStoreFloat4x4(&m, model);
+    BvhAabb bounds;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        float extent = fabsf(m.m[0][axis]) + fabsf(m.m[1][axis]) + fabsf(m.m[2][axis]);
+        bounds.min[axis] = m.m[3][axis] - extent;
+        bounds.max[axis] = m.m[3][axis] + extent;
+    }
+    return bounds;
+}
+
+void SceneManager::UpdateObjectBounds(const std::vector<DirectX::XMMATRIX>& objects)
+{
+    m_objectBounds.resize(objects.size());
+    for (size_t i = 0; i < objects.size(); i++)
+    {
+        m_objectBounds[i] = GetCubeBounds(objects[i]);
+    }
 }
 
 void SceneManager::Update(double deltaTime)
 {
+    PROFILE_SCOPE("SceneManager::Update");
+    m_prevAnimTime = m_animTime;
     if (m_isPlay)
     {
         m_animTime += deltaTime * 3 * M_PI * 0.25;
@@ -22,9 +65,19 @@ void SceneManager::Update(double deltaTime)
     if (m_s) {
         m_animTime += 0.2;
     }
-    m_modelTransform = DirectX::XMMatrixRotationAxis({ 0, 1, 0 }, m_direction*static_cast<float>(m_animTime));
-    m_modelTransform *= DirectX::XMMatrixTranslation(0.0f, (1.0f + sinf(m_direction*static_cast<float>(m_animTime))) / 10, 0.0f);
+}
+
+void SceneManager::Interpolate(double alpha)
+{
+    PROFILE_SCOPE("SceneManager::Interpolate");
+    float animTime = static_cast<float>(m_prevAnimTime + (m_animTime - m_prevAnimTime) * alpha);
+    m_modelTransform = DirectX::XMMatrixRotationAxis({ 0, 1, 0 }, m_direction*animTime);
+    m_modelTransform *= DirectX::XMMatrixTranslation(0.0f, (1.0f + sinf(m_direction*animTime)) / 10, 0.0f);
+    m_opaqueObjects[1] = m_modelTransform;
+    UpdateObjectBounds(m_opaqueObjects);
+    m_opaqueBvh.Refit(m_objectBounds);
 
+    // Camera follows the mouse, it is updated every rendered frame rather than per step
     m_cameraTransform = DirectX::XMMatrixTranslation(0, 0, -m_zoomScene);
     m_cameraTransform *= m_cameraYRotation;
     if (m_isTrapped)
@@ -1,6 +1,9 @@
 #pragma once
 
 #include "framework.h"
+#include <vector>
+
+#include "Bvh.h"
 
 class SceneManager
 {
@@ -8,6 +11,7 @@ class SceneManager
     DirectX::XMMATRIX m_cameraYRotation;
 
     double m_animTime;
+    double m_prevAnimTime;
     float m_direction;
     bool m_s;
     bool m_isPlay;
@@ -15,14 +19,29 @@ class SceneManager
     float m_zoomScene;
     POINT m_trapStart;
     POINT m_trapLast;
+    std::vector<BvhAabb> m_objectBounds;
+
+    void UpdateObjectBounds(const std::vector<DirectX::XMMATRIX>& objects);
 
 public:
     const float m_angelDel = 150.f;
     DirectX::XMMATRIX m_modelTransform;
     DirectX::XMMATRIX m_cameraTransform;
+    std::vector<DirectX::XMMATRIX> m_opaqueObjects;
+    std::vector<DirectX::XMMATRIX> m_transparentObjects;
+    // Placement of the large clustered mesh, culled per meshlet rather than as an object
+    DirectX::XMMATRIX m_clusterMeshTransform;
+    // Hierarchies over the object AABBs, rebuilt when objects are added and refitted in Update
+    Bvh m_opaqueBvh;
+    Bvh m_transparentBvh;
 
     SceneManager();
+    // Advances the simulation by one fixed step
     void Update(double deltaTime);
+    // Builds the transforms to render, alpha blends the last two simulated states
+    void Interpolate(double alpha);
+    // Objects are unit cubes, this is the world AABB of one placed with model
+    static BvhAabb GetCubeBounds(const DirectX::XMMATRIX& model);
     void OnLButtonDown(WPARAM wParam, LPARAM lParam);
     void OnLButtonUp(WPARAM wParam, LPARAM lParam);
     void OnMouseMove(WPARAM wParam, LPARAM lParam);
@@ -0,0 +1,27 @@
+cbuffer ViewBuffer : register (b0)
+{
+    float4x4 vp;
+    float4 cameraPosition;
+    float4x4 invVp;
+};
+
+struct VSOutput
+{
+    float4 pos : SV_Position;
+    float3 localPos : POSITION1;
+};
+
+VSOutput vs(uint vertexId : SV_VertexID) {
+    VSOutput result;
+    // One triangle covering the screen: (-1, 1), (3, 1), (-1, -3)
+    float2 uv = float2((vertexId << 1) & 2, vertexId & 2);
+    float2 ndc = uv * float2(2.0, -2.0) + float2(-1.0, 1.0);
+    // Depth 0 is the far plane and the clear value, the equal test leaves
+    // only the pixels no geometry was drawn to
+    result.pos = float4(ndc, 0.0, 1.0);
+    // w of the unprojected point doesn't vary over the screen, so the
+    // direction to it interpolates linearly; the cube lookup needs no normalize
+    float4 farPos = mul(invVp, float4(ndc, 0.0, 1.0));
+    result.localPos = farPos.xyz / farPos.w - cameraPosition.xyz;
+    return result;
+}
@@ -9,9 +9,16 @@ cbuffer SceneBuffer : register (b1)
     float4x4 model;
 };
 
+cbuffer MeshBuffer : register (b2)
+{
+    float4 positionScale;
+    float4 positionBias;
+};
+
 struct VSInput
 {
-    float3 pos : POSITION;
+    // 16 bit snorm, decoded with the mesh's scale and bias
+    float4 pos : POSITION;
 };
 
 struct VSOutput
@@ -22,9 +29,10 @@ struct VSOutput
 
 VSOutput vs(VSInput vertex) {
     VSOutput result;
-    float4 pos = mul(model, float4(vertex.pos, 1.0)) + float4(cameraPosition.xyz, 0.0);
+    float3 localPos = vertex.pos.xyz * positionScale.xyz + positionBias.xyz;
+    float4 pos = mul(model, float4(localPos, 1.0)) + float4(cameraPosition.xyz, 0.0);
     result.pos = mul(vp, pos);
     result.pos.z = 0.0;
-    result.localPos = vertex.pos;
+    result.localPos = localPos;
     return result;
 }
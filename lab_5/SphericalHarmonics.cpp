@@ -0,0 +1,262 @@
+#include "SphericalHarmonics.h"
+#include "WorkerPool.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <xmmintrin.h>
+
+namespace
+{
+    // Rows per task, a multiple of the BC1 block height
+    const uint32_t BandRows = 64;
+    const double Pi = 3.14159265358979;
+
+    // Normalization of the real basis functions, by band and order
+    const float ShK0 = 0.282095f;  // 1 / (2 sqrt(pi))
+    const float ShK1 = 0.488603f;  // sqrt(3 / (4 pi))
+    const float ShK2 = 1.092548f;  // sqrt(15 / (4 pi))
+    const float ShK3 = 0.315392f;  // sqrt(5 / (16 pi))
+    const float ShK4 = 0.546274f;  // sqrt(15 / (16 pi))
+
+    const uint32_t ShCacheMagic = 0x324C4853; // "SHL2"
+    const uint32_t ShCacheVersion = 1;
+
+    struct ShCacheFile
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t sourceHash;
+        ShCoefficients coefficients;
+    };
+
+    // Weighted sums of one band, 9 coefficients x RGB and the total weight
+    struct BandSums
+    {
+        double sums[27];
+        double weight;
+    };
+
+    float HorizontalSum(__m128 value)
+    {
+        __m128 shuffled = _mm_shuffle_ps(value, value, _MM_SHUFFLE(2, 3, 0, 1));
+        __m128 sums = _mm_add_ps(value, shuffled);
+        shuffled = _mm_movehl_ps(shuffled, sums);
+        return _mm_cvtss_f32(_mm_add_ss(sums, shuffled));
+    }
+
+    void ProjectBand(const CubemapFaces& faces, uint32_t face, uint32_t firstRow, uint32_t rowCount, BandSums& result)
+    {
+        memset(&result, 0, sizeof(result));
+        const uint32_t size = faces.size;
+        std::vector<float> texels(size_t(rowCount) * size * 4);
+        DecodeCubemapRows(faces, face, firstRow, rowCount, texels.data());
+
+        // Face directions are linear in u and v: origin + u * right + v * down
+        float origin[3], right[3], down[3];
+        GetCubemapDirection(face, 0.0f, 0.0f, origin);
+        GetCubemapDirection(face, 1.0f, 0.0f, right);
+        GetCubemapDirection(face, 0.0f, 1.0f, down);
+        for (int axis = 0; axis < 3; axis++)
+        {
+            right[axis] -= origin[axis];
+            down[axis] -= origin[axis];
+        }
+
+        const float texelSize = 2.0f / float(size);
+        // Solid angle of a texel at distance r is its area over r^3
+        const __m128 texelArea = _mm_set1_ps(texelSize * texelSize);
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 three = _mm_set1_ps(3.0f);
+        const __m128 k1 = _mm_set1_ps(ShK1);
+        const __m128 k2 = _mm_set1_ps(ShK2);
+        const __m128 k3 = _mm_set1_ps(ShK3);
+        const __m128 k4 = _mm_set1_ps(ShK4);
+        const __m128 uStep = _mm_set1_ps(4.0f * texelSize);
+        const __m128 uFirst = _mm_setr_ps(0.5f * texelSize - 1.0f, 1.5f * texelSize - 1.0f, 2.5f * texelSize - 1.0f, 3.5f * texelSize - 1.0f);
+
+        for (uint32_t row = 0; row < rowCount; row++)
+        {
+            const float v = (float(firstRow + row) + 0.5f) * texelSize - 1.0f;
+            const __m128 vv = _mm_set1_ps(v);
+            const __m128 baseX = _mm_set1_ps(origin[0] + v * down[0]);
+            const __m128 baseY = _mm_set1_ps(origin[1] + v * down[1]);
+            const __m128 baseZ = _mm_set1_ps(origin[2] + v * down[2]);
+            const __m128 rightX = _mm_set1_ps(right[0]);
+            const __m128 rightY = _mm_set1_ps(right[1]);
+            const __m128 rightZ = _mm_set1_ps(right[2]);
+            const float* pRow = &texels[size_t(row) * size * 4];
+
+            // A row is at most a few thousand texels, float lanes are exact enough before the double sum
+            __m128 sums[27];
+            for (__m128& sum : sums)
+            {
+                sum = _mm_setzero_ps();
+            }
+            __m128 weightSum = _mm_setzero_ps();
+            __m128 u = uFirst;
+            for (uint32_t x = 0; x < size; x += 4, u = _mm_add_ps(u, uStep))
+            {
+                const __m128 r2 = _mm_add_ps(one, _mm_add_ps(_mm_mul_ps(u, u), _mm_mul_ps(vv, vv)));
+                const __m128 invLength = _mm_div_ps(one, _mm_sqrt_ps(r2));
+                const __m128 weight = _mm_mul_ps(texelArea, _mm_mul_ps(invLength, _mm_mul_ps(invLength, invLength)));
+                const __m128 dx = _mm_mul_ps(_mm_add_ps(baseX, _mm_mul_ps(u, rightX)), invLength);
+                const __m128 dy = _mm_mul_ps(_mm_add_ps(baseY, _mm_mul_ps(u, rightY)), invLength);
+                const __m128 dz = _mm_mul_ps(_mm_add_ps(baseZ, _mm_mul_ps(u, rightZ)), invLength);
+
+                __m128 basis[9];
+                basis[0] = _mm_set1_ps(ShK0);
+                basis[1] = _mm_mul_ps(k1, dy);
+                basis[2] = _mm_mul_ps(k1, dz);
+                basis[3] = _mm_mul_ps(k1, dx);
+                basis[4] = _mm_mul_ps(k2, _mm_mul_ps(dx, dy));
+                basis[5] = _mm_mul_ps(k2, _mm_mul_ps(dy, dz));
+                basis[6] = _mm_mul_ps(k3, _mm_sub_ps(_mm_mul_ps(three, _mm_mul_ps(dz, dz)), one));
+                basis[7] = _mm_mul_ps(k2, _mm_mul_ps(dx, dz));
+                basis[8] = _mm_mul_ps(k4, _mm_sub_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)));
+
+                // Four RGBA texels into R, G and B lanes
+                __m128 red = _mm_loadu_ps(pRow + x * 4);
+                __m128 green = _mm_loadu_ps(pRow + x * 4 + 4);
+                __m128 blue = _mm_loadu_ps(pRow + x * 4 + 8);
+                __m128 alpha = _mm_loadu_ps(pRow + x * 4 + 12);
+                _MM_TRANSPOSE4_PS(red, green, blue, alpha);
+                red = _mm_mul_ps(red, weight);
+                green = _mm_mul_ps(green, weight);
+                blue = _mm_mul_ps(blue, weight);
+
+                for (int k = 0; k < 9; k++)
+                {
+                    sums[k * 3] = _mm_add_ps(sums[k * 3], _mm_mul_ps(basis[k], red));
+                    sums[k * 3 + 1] = _mm_add_ps(sums[k * 3 + 1], _mm_mul_ps(basis[k], green));
+                    sums[k * 3 + 2] = _mm_add_ps(sums[k * 3 + 2], _mm_mul_ps(basis[k], blue));
+                }
+                weightSum = _mm_add_ps(weightSum, weight);
+            }
+            for (int i = 0; i < 27; i++)
+            {
+                result.sums[i] += HorizontalSum(sums[i]);
+            }
+            result.weight += HorizontalSum(weightSum);
+        }
+    }
+}
+
+void ProjectCubemapSh(const CubemapFaces& faces, ShCoefficients& radiance, WorkerPool* pPool)
+{
+    memset(&radiance, 0, sizeof(radiance));
+    // The SIMD loop takes four texels at a time, which BC1 faces satisfy anyway
+    if (faces.size == 0 || faces.size % 4 != 0)
+        return;
+
+    const uint32_t bandRows = faces.size < BandRows ? faces.size : BandRows;
+    const uint32_t bandsPerFace = (faces.size + bandRows - 1) / bandRows;
+    const size_t bandCount = size_t(bandsPerFace) * 6;
+    std::vector<BandSums> bands(bandCount);
+    auto projectBand = [&](size_t idx)
+    {
+        const uint32_t face = uint32_t(idx / bandsPerFace);
+        const uint32_t firstRow = uint32_t(idx % bandsPerFace) * bandRows;
+        const uint32_t rowCount = faces.size - firstRow < bandRows ? faces.size - firstRow : bandRows;
+        ProjectBand(faces, face, firstRow, rowCount, bands[idx]);
+    };
+    if (pPool != nullptr)
+    {
+        pPool->ParallelFor(bandCount, projectBand);
+    }
+    else
+    {
+        for (size_t i = 0; i < bandCount; i++)
+        {
+            projectBand(i);
+        }
+    }
+
+    // Summed in band order, the result doesn't depend on the thread count
+    BandSums total = {};
+    for (const BandSums& band : bands)
+    {
+        for (int i = 0; i < 27; i++)
+        {
+            total.sums[i] += band.sums[i];
+        }
+        total.weight += band.weight;
+    }
+    // The per texel solid angle is an approximation, rescale so the sphere adds up to 4 pi
+    const double scale = total.weight > 0.0 ? 4.0 * Pi / total.weight : 0.0;
+    for (int k = 0; k < 9; k++)
+    {
+        for (int channel = 0; channel < 3; channel++)
+        {
+            radiance.c[k][channel] = float(total.sums[k * 3 + channel] * scale);
+        }
+    }
+}
+
+void ShRadianceToIrradiance(const ShCoefficients& radiance, ShCoefficients& irradiance)
+{
+    // Cosine lobe per band over pi (1, 2/3, 1/4) times the basis constant
+    const float factors[9] = {
+        ShK0,
+        ShK1 * 2.0f / 3.0f, ShK1 * 2.0f / 3.0f, ShK1 * 2.0f / 3.0f,
+        ShK2 * 0.25f, ShK2 * 0.25f, ShK3 * 0.25f, ShK2 * 0.25f, ShK4 * 0.25f
+    };
+    for (int k = 0; k < 9; k++)
+    {
+        for (int channel = 0; channel < 3; channel++)
+        {
+            irradiance.c[k][channel] = radiance.c[k][channel] * factors[k];
+        }
+        irradiance.c[k][3] = 0.0f;
+    }
+}
+
+void EvaluateShIrradiance(const ShCoefficients& irradiance, const float n[3], float rgb[3])
+{
+    const float x = n[0], y = n[1], z = n[2];
+    const float polynomial[9] = { 1.0f, y, z, x, x * y, y * z, 3.0f * z * z - 1.0f, x * z, x * x - y * y };
+    for (int channel = 0; channel < 3; channel++)
+    {
+        float sum = 0.0f;
+        for (int k = 0; k < 9; k++)
+        {
+            sum += irradiance.c[k][channel] * polynomial[k];
+        }
+        rgb[channel] = sum;
+    }
+}
+
+bool ReadShCache(const char* path, uint64_t sourceHash, ShCoefficients& coefficients)
+{
+    FILE* pFile = nullptr;
+#ifdef _MSC_VER
+    fopen_s(&pFile, path, "rb");
+#else
+    pFile = fopen(path, "rb");
+#endif
+    if (pFile == nullptr)
+        return false;
+    ShCacheFile file;
+    const bool read = fread(&file, sizeof(file), 1, pFile) == 1;
+    fclose(pFile);
+    if (!read || file.magic != ShCacheMagic || file.version != ShCacheVersion || file.sourceHash != sourceHash)
+        return false;
+    coefficients = file.coefficients;
+    return true;
+}
+
+bool WriteShCache(const char* path, uint64_t sourceHash, const ShCoefficients& coefficients)
+{
+    ShCacheFile file = { ShCacheMagic, ShCacheVersion, sourceHash, coefficients };
+    FILE* pFile = nullptr;
+#ifdef _MSC_VER
+    fopen_s(&pFile, path, "wb");
+#else
+    pFile = fopen(path, "wb");
+#endif
+    if (pFile == nullptr)
+        return false;
+    const bool written = fwrite(&file, sizeof(file), 1, pFile) == 1;
+    return fclose(pFile) == 0 && written;
+}
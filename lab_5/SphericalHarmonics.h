@@ -0,0 +1,33 @@
+#pragma once
+
+#include "Cubemap.h"
+
+#include <cstdint>
+
+class WorkerPool;
+
+// Order 2 (L2) spherical harmonics, nine RGB coefficients in the usual real
+// basis order: 1, y, z, x, xy, yz, 3z^2 - 1, xz, x^2 - y^2. One float4 each,
+// w unused, so the block uploads as a constant buffer as is.
+struct ShCoefficients
+{
+    float c[9][4];
+};
+
+// Radiance of the cubemap projected onto the basis. Every texel is weighted
+// by the solid angle it covers; faces are split into bands of rows that run
+// in parallel on the pool when there is one, four texels at a time.
+void ProjectCubemapSh(const CubemapFaces& faces, ShCoefficients& radiance, WorkerPool* pPool = nullptr);
+
+// Convolves with the clamped cosine lobe and folds in 1 / pi and the basis
+// constants: reflected radiance off a white diffuse surface with normal n is
+// the plain polynomial c0 + c1 y + c2 z + c3 x + c4 xy + c5 yz + c6 (3z^2 - 1) + c7 xz + c8 (x^2 - y^2)
+void ShRadianceToIrradiance(const ShCoefficients& radiance, ShCoefficients& irradiance);
+
+// Evaluates irradiance coefficients the way the shaders do, n is unit length
+void EvaluateShIrradiance(const ShCoefficients& irradiance, const float n[3], float rgb[3]);
+
+// Small binary file next to the cubemap keyed by HashCubemapFaces. Read fails
+// on a missing or damaged file or when the hash doesn't match.
+bool ReadShCache(const char* path, uint64_t sourceHash, ShCoefficients& coefficients);
+bool WriteShCache(const char* path, uint64_t sourceHash, const ShCoefficients& coefficients);
@@ -1,13 +1,50 @@
 Texture2D colorTexture : register (t0);
+// GGX prefiltered sky, roughness grows along the mips
+TextureCube specularTexture : register (t1);
 
 SamplerState colorSampler : register(s0);
 
+cbuffer AmbientBuffer : register (b0)
+{
+    // L2 spherical harmonics of the sky with the cosine lobe and 1 / pi folded in
+    float4 irradiance[9];
+    // x: ambient weight, 0 leaves the texture unlit
+    // y: reflectance at normal incidence, z: prefiltered level for the roughness
+    // w: reflection weight, 0 skips the sky lookup
+    float4 ambientParams;
+};
+
+cbuffer ViewBuffer : register (b1)
+{
+    float4x4 vp;
+    float4 cameraPosition;
+};
+
 struct VSOutput {
     float4 pos : SV_Position;
     float2 uv : TEXCOORD;
+    float3 worldPos : POSITION1;
 };
 
-float4 ps(VSOutput pixel) : SV_Target0{
-    return float4(colorTexture.Sample(colorSampler, pixel.uv).xyz, 1.0);
+float3 EvaluateIrradiance(float3 n) {
+    return irradiance[0].rgb
+        + irradiance[1].rgb * n.y + irradiance[2].rgb * n.z + irradiance[3].rgb * n.x
+        + irradiance[4].rgb * (n.x * n.y) + irradiance[5].rgb * (n.y * n.z)
+        + irradiance[6].rgb * (3.0 * n.z * n.z - 1.0)
+        + irradiance[7].rgb * (n.x * n.z) + irradiance[8].rgb * (n.x * n.x - n.y * n.y);
 }
 
+float4 ps(VSOutput pixel) : SV_Target0{
+    // Face normal from the screen space derivatives, the vertices carry none
+    float3 n = normalize(cross(ddx(pixel.worldPos), ddy(pixel.worldPos)));
+    float3 ambient = lerp(float3(1.0, 1.0, 1.0), max(EvaluateIrradiance(n), 0.0), ambientParams.x);
+    float3 diffuse = colorTexture.Sample(colorSampler, pixel.uv).xyz * ambient;
+    [branch] if (ambientParams.w <= 0.0)
+        return float4(diffuse, 1.0);
+
+    // Sky reflection with Schlick's Fresnel, the level stands in for the roughness
+    float3 v = normalize(cameraPosition.xyz - pixel.worldPos);
+    float3 reflection = specularTexture.SampleLevel(colorSampler, reflect(-v, n), ambientParams.z).rgb;
+    float fresnel = ambientParams.y + (1.0 - ambientParams.y) * pow(1.0 - saturate(dot(n, v)), 5.0);
+    return float4(lerp(diffuse, reflection, fresnel * ambientParams.w), 1.0);
+}
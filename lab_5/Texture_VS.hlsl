@@ -9,20 +9,31 @@ cbuffer SceneBuffer : register (b1)
     float4x4 model;
 };
 
+cbuffer MeshBuffer : register (b2)
+{
+    float4 positionScale;
+    float4 positionBias;
+};
+
 struct VSInput {
-    float3 pos : POSITION;
+    // 16 bit snorm, decoded with the mesh's scale and bias
+    float4 pos : POSITION;
     float2 uv : TEXCOORD;
 };
 
 struct VSOutput {
     float4 pos : SV_Position;
     float2 uv : TEXCOORD;
+    float3 worldPos : POSITION1;
 };
 
 VSOutput vs(VSInput vertex) {
     VSOutput result;
 
-    result.pos = mul(vp, mul(model, float4(vertex.pos, 1.0)));
+    float3 pos = vertex.pos.xyz * positionScale.xyz + positionBias.xyz;
+    float4 worldPos = mul(model, float4(pos, 1.0));
+    result.pos = mul(vp, worldPos);
     result.uv = vertex.uv;
+    result.worldPos = worldPos.xyz;
     return result;
 }
@@ -0,0 +1,27 @@
+cbuffer ColorBuffer : register(b0)
+{
+    float4 color;
+};
+
+struct VSOutput
+{
+    float4 pos : SV_Position;
+    float2 uv : TEXCOORD;
+};
+
+struct PSOutput
+{
+    float4 accum : SV_Target0;
+    float revealage : SV_Target1;
+};
+
+PSOutput ps(VSOutput pixel)
+{
+    PSOutput result;
+    // Weighted blended OIT, depth weight from McGuire and Bavoil (eq. 7); pos.w is view depth
+    float z = pixel.pos.w;
+    float weight = clamp(10.0 / (1e-5 + pow(z / 5.0, 2.0) + pow(z / 200.0, 6.0)), 1e-2, 3e3);
+    result.accum = float4(color.rgb * color.a, color.a) * weight;
+    result.revealage = color.a;
+    return result;
+}
@@ -7,10 +7,16 @@ cbuffer SceneBuffer : register (b1) {
     float4 color;
 };
 
+cbuffer MeshBuffer : register (b2) {
+    float4 positionScale;
+    float4 positionBias;
+};
+
 
 struct VSInput
 {
-    float3 pos : POSITION;
+    // 16 bit snorm, decoded with the mesh's scale and bias
+    float4 pos : POSITION;
     float2 uv : TEXCOORD;
 };
 
@@ -23,7 +29,8 @@ struct VSOutput
 VSOutput vs(VSInput vertex) {
     VSOutput result;
 
-    result.pos = mul(vp, mul(model, float4(vertex.pos, 1.0)));
+    float3 pos = vertex.pos.xyz * positionScale.xyz + positionBias.xyz;
+    result.pos = mul(vp, mul(model, float4(pos, 1.0)));
     result.uv = vertex.uv;
 
     return result;
@@ -0,0 +1,171 @@
+#include "TransparencySorter.h"
+
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+
+#include <xmmintrin.h>
+
+static const int RadixBits = 11;
+static const uint32_t RadixSize = 1u << RadixBits;
+static const int RadixPasses = (32 + RadixBits - 1) / RadixBits;
+static const size_t IncrementalMovesPerObject = 4;
+
+// Ascending order of the result is decreasing depth
+static uint32_t DepthToKey(float depth)
+{
+    uint32_t bits;
+    memcpy(&bits, &depth, sizeof(bits));
+    uint32_t ordered = (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u);
+    return ~ordered;
+}
+
+void TransparencySorter::Resize(size_t count)
+{
+    size_t padded = (count + 3) / 4 * 4;
+    m_x.Resize(padded, 0.0f);
+    m_y.Resize(padded, 0.0f);
+    m_z.Resize(padded, 0.0f);
+    m_depth.Resize(padded, 0.0f);
+    m_visibleStamp.resize(count, 0);
+    m_count = count;
+}
+
+void TransparencySorter::SetPosition(size_t idx, float x, float y, float z)
+{
+    assert(idx < m_count);
+    m_x[idx] = x;
+    m_y[idx] = y;
+    m_z[idx] = z;
+}
+
+void TransparencySorter::ComputeDepths(const float view[16])
+{
+    // Depth is the z row of the view transform applied to every position
+    const __m128 mx = _mm_set1_ps(view[2]);
+    const __m128 my = _mm_set1_ps(view[6]);
+    const __m128 mz = _mm_set1_ps(view[10]);
+    const __m128 mw = _mm_set1_ps(view[14]);
+    const size_t padded = (m_count + 3) / 4 * 4;
+    for (size_t i = 0; i < padded; i += 4)
+    {
+        __m128 depth = _mm_add_ps(_mm_mul_ps(_mm_load_ps(m_x.GetData() + i), mx), mw);
+        depth = _mm_add_ps(depth, _mm_mul_ps(_mm_load_ps(m_y.GetData() + i), my));
+        depth = _mm_add_ps(depth, _mm_mul_ps(_mm_load_ps(m_z.GetData() + i), mz));
+        _mm_store_ps(m_depth.GetData() + i, depth);
+    }
+}
+
+bool TransparencySorter::InsertionSort(size_t maxMoves)
+{
+    size_t moves = 0;
+    for (size_t i = 1; i < m_order.size(); i++)
+    {
+        uint32_t key = m_keys[i];
+        uint32_t object = m_order[i];
+        size_t j = i;
+        while (j > 0 && m_keys[j - 1] > key)
+        {
+            m_keys[j] = m_keys[j - 1];
+            m_order[j] = m_order[j - 1];
+            j--;
+        }
+        m_keys[j] = key;
+        m_order[j] = object;
+        moves += i - j;
+        if (moves > maxMoves)
+            return false;
+    }
+    return true;
+}
+
+void TransparencySorter::RadixSort()
+{
+    const size_t count = m_order.size();
+    m_scratchOrder.resize(count);
+    m_scratchKeys.resize(count);
+    uint32_t histograms[RadixPasses][RadixSize];
+    memset(histograms, 0, sizeof(histograms));
+    for (size_t i = 0; i < count; i++)
+    {
+        for (int pass = 0; pass < RadixPasses; pass++)
+            histograms[pass][(m_keys[i] >> (pass * RadixBits)) & (RadixSize - 1)]++;
+    }
+
+    for (int pass = 0; pass < RadixPasses; pass++)
+    {
+        uint32_t* histogram = histograms[pass];
+        // All keys share this digit, the pass wouldn't move anything
+        if (histogram[(m_keys[0] >> (pass * RadixBits)) & (RadixSize - 1)] == count)
+            continue;
+        uint32_t offset = 0;
+        for (uint32_t digit = 0; digit < RadixSize; digit++)
+        {
+            uint32_t digitCount = histogram[digit];
+            histogram[digit] = offset;
+            offset += digitCount;
+        }
+        for (size_t i = 0; i < count; i++)
+        {
+            uint32_t dst = histogram[(m_keys[i] >> (pass * RadixBits)) & (RadixSize - 1)]++;
+            m_scratchKeys[dst] = m_keys[i];
+            m_scratchOrder[dst] = m_order[i];
+        }
+        m_keys.swap(m_scratchKeys);
+        m_order.swap(m_scratchOrder);
+    }
+}
+
+const std::vector<uint32_t>& TransparencySorter::Sort(const float view[16], const uint32_t* pVisible, size_t visibleCount)
+{
+    ComputeDepths(view);
+
+    // Two stamps per frame: visible this frame, and already placed in the order
+    if (m_frame > UINT32_MAX - 2)
+    {
+        std::fill(m_visibleStamp.begin(), m_visibleStamp.end(), 0);
+        m_frame = 0;
+    }
+    m_frame += 2;
+    const uint32_t visibleStamp = m_frame;
+    const uint32_t placedStamp = m_frame + 1;
+    for (size_t i = 0; i < visibleCount; i++)
+    {
+        assert(pVisible[i] < m_count);
+        m_visibleStamp[pVisible[i]] = visibleStamp;
+    }
+
+    // Last frame's order minus the objects gone since, then the newly visible ones
+    size_t kept = 0;
+    for (uint32_t object : m_order)
+    {
+        if (object < m_count && m_visibleStamp[object] == visibleStamp)
+        {
+            m_visibleStamp[object] = placedStamp;
+            m_order[kept++] = object;
+        }
+    }
+    m_order.resize(kept);
+    for (size_t i = 0; i < visibleCount; i++)
+    {
+        if (m_visibleStamp[pVisible[i]] == visibleStamp)
+        {
+            m_visibleStamp[pVisible[i]] = placedStamp;
+            m_order.push_back(pVisible[i]);
+        }
+    }
+
+    m_keys.resize(m_order.size());
+    for (size_t i = 0; i < m_order.size(); i++)
+    {
+        m_keys[i] = DepthToKey(m_depth[m_order[i]]);
+    }
+
+    // A few moves per object is what a coherent frame costs; past that radix sort is cheaper
+    m_incremental = kept > 0 && InsertionSort(m_order.size() * IncrementalMovesPerObject + 64);
+    if (!m_incremental && !m_order.empty())
+        RadixSort();
+    return m_order;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "FrustumCulling.h"
+
+// Back-to-front ordering for transparent objects. View depths are computed for
+// all objects in one SIMD pass over SoA positions, then the visible subset is
+// sorted. The previous frame's order is the starting point: with a steady camera
+// it is almost sorted already and an insertion sort finishes it in linear time;
+// when that takes too many moves the sorter falls back to an LSD radix sort on
+// the float depth bits. All buffers are kept between frames.
+class TransparencySorter
+{
+public:
+    void Resize(size_t count);
+    size_t GetSize() const { return m_count; }
+    void SetPosition(size_t idx, float x, float y, float z);
+
+    // view: row-major view matrix for row vectors, as DirectXMath builds it.
+    // Returns indices from pVisible ordered by decreasing view depth.
+    const std::vector<uint32_t>& Sort(const float view[16], const uint32_t* pVisible, size_t visibleCount);
+
+    float GetDepth(size_t idx) const { return m_depth[idx]; }
+    // How the last Sort finished, for statistics
+    bool WasIncremental() const { return m_incremental; }
+private:
+    void ComputeDepths(const float view[16]);
+    bool InsertionSort(size_t maxMoves);
+    void RadixSort();
+
+    size_t m_count = 0;
+    AlignedFloatArray m_x;
+    AlignedFloatArray m_y;
+    AlignedFloatArray m_z;
+    AlignedFloatArray m_depth;
+
+    std::vector<uint32_t> m_order;
+    std::vector<uint32_t> m_keys;
+    std::vector<uint32_t> m_scratchOrder;
+    std::vector<uint32_t> m_scratchKeys;
+    // Frame stamp per object, tells which objects of last frame's order are still visible
+    std::vector<uint32_t> m_visibleStamp;
+    uint32_t m_frame = 0;
+    bool m_incremental = false;
+};
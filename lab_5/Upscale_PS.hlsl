@@ -0,0 +1,23 @@
+Texture2D sceneTexture : register (t0);
+
+SamplerState linearSampler : register(s0);
+
+cbuffer UpscaleBuffer : register (b0)
+{
+    // xy: rendered size over the scene target size, zw: one over the back buffer size
+    float4 uvScale;
+    // xy: last texel center inside the rendered area
+    float4 uvClamp;
+};
+
+struct VSOutput
+{
+    float4 pos : SV_Position;
+};
+
+float4 ps(VSOutput pixel) : SV_Target0
+{
+    // The scene covers the top left of its target, texels past it are left from larger frames
+    float2 uv = min(pixel.pos.xy * uvScale.zw * uvScale.xy, uvClamp.xy);
+    return float4(sceneTexture.SampleLevel(linearSampler, uv, 0).rgb, 1.0);
+}
@@ -0,0 +1,87 @@
+#include "WorkerPool.h"
+#include "Profiler.h"
+
+WorkerPool::WorkerPool(unsigned int threadCount)
+    : m_next(0)
+{
+    if (threadCount == 0)
+        threadCount = std::thread::hardware_concurrency();
+    for (unsigned int i = 1; i < threadCount; i++)
+    {
+        m_workers.push_back(std::thread(&WorkerPool::WorkerLoop, this));
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_exit = true;
+    }
+    m_wake.notify_all();
+    for (std::thread& worker : m_workers)
+    {
+        worker.join();
+    }
+}
+
+void WorkerPool::RunTasks()
+{
+    for (;;)
+    {
+        size_t idx = m_next.fetch_add(1);
+        if (idx >= m_count)
+            return;
+        (*m_pFunc)(idx);
+    }
+}
+
+void WorkerPool::WorkerLoop()
+{
+    Profiler::SetThreadName("Worker");
+    unsigned long long seenGeneration = 0;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;)
+    {
+        m_wake.wait(lock, [&]() { return m_exit || m_generation != seenGeneration; });
+        if (m_exit)
+            return;
+        seenGeneration = m_generation;
+        m_busyWorkers++;
+        lock.unlock();
+
+        RunTasks();
+
+        lock.lock();
+        if (--m_busyWorkers == 0)
+            m_done.notify_all();
+    }
+}
+
+void WorkerPool::ParallelFor(size_t count, const TaskFunc& func)
+{
+    if (count == 0)
+        return;
+    if (m_workers.empty() || count == 1)
+    {
+        for (size_t i = 0; i < count; i++)
+            func(i);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pFunc = &func;
+        m_count = count;
+        m_next = 0;
+        m_generation++;
+    }
+    m_wake.notify_all();
+
+    RunTasks();
+
+    // Workers that woke up late find no indices left and leave right away
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [this]() { return m_busyWorkers == 0; });
+    m_pFunc = nullptr;
+}
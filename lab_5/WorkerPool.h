@@ -0,0 +1,42 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent threads for data-parallel CPU work. ParallelFor hands out indices
+// through an atomic counter; the calling thread takes part and returns once
+// every index has been processed.
+class WorkerPool
+{
+public:
+    typedef std::function<void(size_t idx)> TaskFunc;
+
+    // threadCount counts the calling thread, 0 picks one per hardware thread
+    explicit WorkerPool(unsigned int threadCount = 0);
+    ~WorkerPool();
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    unsigned int GetThreadCount() const { return static_cast<unsigned int>(m_workers.size() + 1); }
+    void ParallelFor(size_t count, const TaskFunc& func);
+private:
+    void WorkerLoop();
+    void RunTasks();
+
+    std::vector<std::thread> m_workers;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+
+    const TaskFunc* m_pFunc = nullptr;
+    size_t m_count = 0;
+    std::atomic<size_t> m_next;
+    size_t m_busyWorkers = 0;
+    unsigned long long m_generation = 0;
+    bool m_exit = false;
+};
@@ -2,6 +2,8 @@
 #include "framework.h"
 #include "lab_2.h"
 #include "Renderer.h"
+#include "FrameClock.h"
+#include "Profiler.h"
 
 #define MAX_LOADSTRING 100
 
@@ -21,6 +23,7 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
 {
     UNREFERENCED_PARAMETER(hPrevInstance);
     UNREFERENCED_PARAMETER(lpCmdLine);
+    Profiler::SetThreadName("Main");
 
     LoadStringW(hInstance, IDS_APP_TITLE, szTitle, MAX_LOADSTRING);
     LoadStringW(hInstance, IDC_LAB2, szWindowClass, MAX_LOADSTRING);
@@ -38,11 +41,14 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
     HACCEL hAccelTable = LoadAccelerators(hInstance, MAKEINTRESOURCE(IDC_LAB2));
 
     MSG msg;
+    // Simulation runs in fixed steps of real time, rendering as often as the loop gets around
+    FrameClock frameClock;
 
     bool exit = false;
     while (!exit)
     {
-        if (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE))
+        // Drain the queue every iteration, the frame limiter would otherwise delay input by a frame per message
+        while (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE))
         {
             if (!TranslateAccelerator(msg.hwnd, hAccelTable, &msg))
             {
@@ -52,15 +58,27 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
             if (msg.message == WM_QUIT)
                 exit = true;
         }
-        if (pRenderer.IsRunning())
+        if (!exit && pRenderer.IsRunning())
         {
-            pRenderer.pSceneManager.Update(0.0004);
+            pRenderer.WaitForFrame();
+            FrameClock::Clock::time_point frameStart = FrameClock::Clock::now();
+            uint32_t steps = frameClock.Tick(frameStart);
+            for (uint32_t i = 0; i < steps; i++)
+            {
+                pRenderer.pSceneManager.Update(frameClock.GetFixedStep());
+            }
+            pRenderer.pSceneManager.Interpolate(frameClock.GetAlpha());
             if (!pRenderer.Render())
             {
                 PostQuitMessage(0);
             }
+            pRenderer.RecordFrameStats(std::chrono::duration<double>(FrameClock::Clock::now() - frameStart).count());
         }
     }
+#ifndef PROFILER_DISABLED
+    Profiler::WriteChromeTrace("profile.json");
+#endif
+    pRenderer.GetFrameStats().WriteCsv("frame_stats.csv");
     return (int)msg.wParam;
 }
 
@@ -161,6 +179,11 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
         Renderer::GetInstance().pSceneManager.OnLButtonUp(wParam, lParam);
         break;
     }
+    case WM_KEYDOWN:
+    {
+        Renderer::GetInstance().OnKeyDown(wParam);
+        break;
+    }
     case WM_DESTROY:
         PostQuitMessage(0);
         break;
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdio>
+
+// Checks for the console tests: a failed check prints where it failed and
+// keeps going, main returns CheckResult() so ctest sees the failure
+inline int& CheckFailures()
+{
+    static int failures = 0;
+    return failures;
+}
+
+#define CHECK(condition) \
+    do \
+    { \
+        if (!(condition)) \
+        { \
+            printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            CheckFailures()++; \
+        } \
+    } while (false)
+
+inline int CheckResult()
+{
+    if (CheckFailures() == 0)
+    {
+        printf("All checks passed\n");
+        return 0;
+    }
+    printf("%d checks failed\n", CheckFailures());
+    return 1;
+}
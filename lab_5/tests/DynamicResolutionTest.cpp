@@ -0,0 +1,281 @@
+// DynamicResolution in a simulated frame loop where GPU time grows with the
+// pixel count: step loads settle on the budget, a saturated controller comes
+// back without wind-up, measurement latency plus noise don't make it ring, and
+// CPU time before the first GPU pass doesn't count against the budget.
+
+#include "../DynamicResolution.h"
+#include "../GpuProfiler.h"
+#include "Check.h"
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <random>
+#include <vector>
+
+namespace
+{
+    const double Milliseconds = 1e-3;
+
+    // Renders at the controller's scale and hands each GPU time back latency
+    // frames later, the way timestamp queries arrive
+    class FrameLoop
+    {
+    public:
+        FrameLoop(DynamicResolution& controller, uint32_t latency, double noise)
+            : m_controller(controller), m_latency(latency), m_noise(-noise, noise)
+        {
+        }
+
+        // load is the GPU time of a full resolution frame; returns this frame's time
+        double Step(double load)
+        {
+            const double scale = m_controller.GetScale();
+            const double noise = m_noise.b() > 0.0 ? m_noise(m_random) : 0.0;
+            const double time = load * scale * scale * (1.0 + noise);
+            m_pending.push_back(time);
+            if (m_pending.size() > m_latency)
+            {
+                m_controller.Update(m_pending.front());
+                m_pending.pop_front();
+            }
+            return time;
+        }
+
+        // Runs the frames, appending the scale chosen after each one
+        void Run(double load, int frames, std::vector<double>& scales)
+        {
+            for (int frame = 0; frame < frames; frame++)
+            {
+                Step(load);
+                scales.push_back(m_controller.GetScale());
+            }
+        }
+    private:
+        DynamicResolution& m_controller;
+        uint32_t m_latency;
+        std::deque<double> m_pending;
+        std::mt19937 m_random{ 50 };
+        std::uniform_real_distribution<double> m_noise;
+    };
+
+    // Scale at which a frame of this full resolution load takes the budget
+    double ExpectedScale(const DynamicResolutionSettings& settings, double load)
+    {
+        const double budget = settings.targetFrameTime * (1.0 - settings.headroom);
+        const double scale = sqrt(budget / load);
+        return scale < settings.minScale ? settings.minScale : (scale > settings.maxScale ? settings.maxScale : scale);
+    }
+
+    // Frames until the scale enters the band around expected and never leaves
+    // it again, -1 if it isn't in the band at the end
+    int FramesToSettle(const std::vector<double>& scales, size_t first, double expected, double tolerance)
+    {
+        int settled = -1;
+        for (size_t i = first; i < scales.size(); i++)
+        {
+            if (fabs(scales[i] - expected) > tolerance * expected)
+                settled = -1;
+            else if (settled < 0)
+                settled = int(i - first) + 1;
+        }
+        return settled;
+    }
+
+    bool InRange(const DynamicResolutionSettings& settings, const std::vector<double>& scales)
+    {
+        for (double scale : scales)
+        {
+            if (scale < settings.minScale || scale > settings.maxScale)
+                return false;
+        }
+        return true;
+    }
+
+    // A load over budget settles on the scale that fits it without dipping
+    // below, a lighter one goes back to full resolution
+    void TestStepLoad()
+    {
+        DynamicResolution controller;
+        const DynamicResolutionSettings& settings = controller.GetSettings();
+        FrameLoop loop(controller, 0, 0.0);
+        std::vector<double> scales;
+
+        const double heavy = ExpectedScale(settings, 20.0 * Milliseconds);
+        loop.Run(20.0 * Milliseconds, 120, scales);
+        CHECK(heavy > 0.85 && heavy < 0.88);
+        const int down = FramesToSettle(scales, 0, heavy, 0.01);
+        CHECK(down > 0 && down <= 30);
+
+        loop.Run(10.0 * Milliseconds, 120, scales);
+        const int up = FramesToSettle(scales, 120, settings.maxScale, 0.01);
+        CHECK(up > 0 && up <= 10);
+        CHECK(scales.back() == settings.maxScale);
+
+        const double heavier = ExpectedScale(settings, 30.0 * Milliseconds);
+        loop.Run(30.0 * Milliseconds, 120, scales);
+        const int stepUp = FramesToSettle(scales, 240, heavier, 0.01);
+        CHECK(stepUp > 0 && stepUp <= 40);
+        CHECK(*std::min_element(scales.begin() + 240, scales.end()) > heavier * 0.99);
+        CHECK(InRange(settings, scales));
+    }
+
+    // One long frame moves the area by maxStep at most, and the controller
+    // is back at full resolution a few frames later
+    void TestHitch()
+    {
+        DynamicResolution controller;
+        const DynamicResolutionSettings& settings = controller.GetSettings();
+        for (int frame = 0; frame < 60; frame++)
+        {
+            controller.Update(10.0 * Milliseconds);
+        }
+        CHECK(controller.GetScale() == settings.maxScale);
+        controller.Update(100.0 * Milliseconds);
+        CHECK(controller.GetScale() >= settings.maxScale * exp(-0.5 * settings.maxStep) - 1e-9);
+        CHECK(controller.GetScale() < settings.maxScale);
+
+        FrameLoop loop(controller, 0, 0.0);
+        std::vector<double> scales;
+        loop.Run(10.0 * Milliseconds, 20, scales);
+        const int recovered = FramesToSettle(scales, 0, settings.maxScale, 0.001);
+        CHECK(recovered > 0 && recovered <= 5);
+    }
+
+    // Loads no scale can fit pin the controller to minScale; it comes back
+    // as fast after hundreds of saturated frames as after a few, so nothing
+    // wound up meanwhile
+    void TestSaturation()
+    {
+        int recovered[2] = {};
+        const int saturatedFrames[2] = { 20, 600 };
+        for (int run = 0; run < 2; run++)
+        {
+            DynamicResolution controller;
+            const DynamicResolutionSettings& settings = controller.GetSettings();
+            FrameLoop loop(controller, 0, 0.0);
+            std::vector<double> scales;
+            loop.Run(80.0 * Milliseconds, saturatedFrames[run], scales);
+            CHECK(scales.back() == settings.minScale);
+            loop.Run(10.0 * Milliseconds, 120, scales);
+            recovered[run] = FramesToSettle(scales, size_t(saturatedFrames[run]), settings.maxScale, 0.01);
+            CHECK(recovered[run] > 0 && recovered[run] <= 20);
+            CHECK(InRange(settings, scales));
+        }
+        CHECK(recovered[0] == recovered[1]);
+    }
+
+    // Times arriving up to four frames late with 3% noise still settle, and
+    // once settled the noise stays inside the headroom: no frame goes over
+    // the target and the scale doesn't ring
+    void TestLatencyAndNoise()
+    {
+        for (uint32_t latency = 0; latency <= 4; latency++)
+        {
+            DynamicResolution controller;
+            const DynamicResolutionSettings& settings = controller.GetSettings();
+            FrameLoop loop(controller, latency, 0.03);
+            const double expected = ExpectedScale(settings, 20.0 * Milliseconds);
+            std::vector<double> scales;
+            int over = 0;
+            for (int frame = 0; frame < 300; frame++)
+            {
+                const double time = loop.Step(20.0 * Milliseconds);
+                scales.push_back(controller.GetScale());
+                over += frame >= 60 && time > settings.targetFrameTime ? 1 : 0;
+            }
+            const int settled = FramesToSettle(scales, 0, expected, 0.03);
+            CHECK(settled > 0 && settled <= 30);
+            CHECK(over == 0);
+            const auto range = std::minmax_element(scales.begin() + 60, scales.end());
+            CHECK(*range.first > expected * 0.98 && *range.second < expected * 1.02);
+            CHECK(InRange(settings, scales));
+        }
+    }
+
+    // Renders frames through GpuProfiler on the fake backend the way
+    // Renderer::Render does: the frame timestamp is written before the CPU
+    // spends stall culling and setting up, then one pass takes load at the
+    // controller's scale. Each frame read back is fed once, as its pass span
+    // or as its whole duration.
+    std::vector<double> RunThroughProfiler(DynamicResolution& controller, double load, double stall, bool passSpan, int frames)
+    {
+        GpuQueryFakeBackend backend(2);
+        GpuProfiler profiler;
+        CHECK(profiler.Init(backend));
+        std::vector<double> scales;
+        uint64_t measured = 0;
+        for (int frame = 0; frame < frames; frame++)
+        {
+            backend.SetTickStep(1);
+            profiler.BeginFrame();
+            if (profiler.GetMeasuredFrames() != measured)
+            {
+                measured = profiler.GetMeasuredFrames();
+                controller.Update(passSpan ? profiler.GetLastPassSpan() : profiler.GetLastFrameDuration());
+            }
+            // The fake clock runs at 1 MHz
+            const double scale = controller.GetScale();
+            backend.SetTickStep(uint64_t(stall * 1e6));
+            const int pass = profiler.BeginPass("Opaque", nullptr);
+            backend.SetTickStep(uint64_t(load * scale * scale * 1e6 + 0.5));
+            profiler.EndPass(pass, nullptr);
+            backend.SetTickStep(1);
+            profiler.EndFrame();
+            scales.push_back(controller.GetScale());
+        }
+        profiler.Release();
+        return scales;
+    }
+
+    // A 12 ms CPU stall ahead of a 10 ms pass puts the frame over the
+    // target, but lowering the resolution can't shorten it: fed the pass
+    // span the controller stays at full resolution and still settles on a
+    // real overload, fed the frame duration it would throw pixels away
+    void TestCpuStall()
+    {
+        DynamicResolution controller;
+        const DynamicResolutionSettings& settings = controller.GetSettings();
+        std::vector<double> scales = RunThroughProfiler(controller, 10.0 * Milliseconds, 12.0 * Milliseconds, true, 120);
+        CHECK(*std::min_element(scales.begin(), scales.end()) == settings.maxScale);
+
+        DynamicResolution heavyController;
+        const double heavy = ExpectedScale(settings, 20.0 * Milliseconds);
+        scales = RunThroughProfiler(heavyController, 20.0 * Milliseconds, 12.0 * Milliseconds, true, 120);
+        const int settled = FramesToSettle(scales, 0, heavy, 0.01);
+        CHECK(settled > 0 && settled <= 40);
+
+        DynamicResolution frameController;
+        scales = RunThroughProfiler(frameController, 10.0 * Milliseconds, 12.0 * Milliseconds, false, 120);
+        CHECK(scales.back() < settings.maxScale * 0.9);
+    }
+
+    // Sizes round to the nearest pixel and never reach zero
+    void TestRenderSize()
+    {
+        DynamicResolutionSettings settings;
+        settings.minScale = 0.0001;
+        DynamicResolution controller(settings);
+        uint32_t width = 0;
+        uint32_t height = 0;
+        controller.GetRenderSize(1280, 720, width, height);
+        CHECK(width == 1280 && height == 720);
+        for (int frame = 0; frame < 200; frame++)
+        {
+            controller.Update(1.0);
+        }
+        controller.GetRenderSize(1280, 720, width, height);
+        CHECK(width == 1 && height == 1);
+    }
+}
+
+int main()
+{
+    TestStepLoad();
+    TestHitch();
+    TestSaturation();
+    TestLatencyAndNoise();
+    TestCpuStall();
+    TestRenderSize();
+    return CheckResult();
+}
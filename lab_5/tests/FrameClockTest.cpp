@@ -0,0 +1,141 @@
+// FrameClock fed synthetic frame times: step counts and the interpolation
+// factor, the clamp on long frames, the step limit dropping the backlog, and
+// the statistics over the history.
+
+#include "../FrameClock.h"
+#include "Check.h"
+
+#include <chrono>
+#include <cmath>
+
+namespace
+{
+    // A power of two step, so whole and half steps add up without rounding
+    const double Step = 1.0 / 64.0;
+
+    // Advances the time point by this many seconds and ticks the clock
+    uint32_t Advance(FrameClock& clock, FrameClock::Clock::time_point& now, double seconds)
+    {
+        now += std::chrono::duration_cast<FrameClock::Clock::duration>(std::chrono::duration<double>(seconds));
+        return clock.Tick(now);
+    }
+
+    bool Near(double a, double b)
+    {
+        return fabs(a - b) < 1e-6;
+    }
+
+    // The first tick only sets the origin; after it every step consumed moves
+    // the simulation by one step and the rest is left as the alpha
+    void TestSteps()
+    {
+        FrameClock clock(Step, 0.25, 8);
+        FrameClock::Clock::time_point now;
+        CHECK(clock.Tick(now) == 0);
+        CHECK(clock.GetFrameIndex() == 0 && clock.GetAlpha() == 0.0);
+
+        CHECK(Advance(clock, now, Step) == 1);
+        CHECK(Near(clock.GetAlpha(), 0.0));
+        CHECK(Advance(clock, now, 2.5 * Step) == 2);
+        CHECK(Near(clock.GetAlpha(), 0.5));
+        CHECK(Advance(clock, now, 0.25 * Step) == 0);
+        CHECK(Near(clock.GetAlpha(), 0.75));
+        CHECK(Advance(clock, now, 0.25 * Step) == 1);
+        CHECK(Near(clock.GetAlpha(), 0.0));
+        CHECK(Near(clock.GetSimulationTime(), 4.0 * Step));
+        CHECK(clock.GetFrameIndex() == 4);
+        CHECK(Near(clock.GetDelta(), 0.25 * Step));
+
+        // Going back in time counts as no time at all
+        now -= std::chrono::milliseconds(5);
+        CHECK(clock.Tick(now) == 0);
+        CHECK(clock.GetDelta() == 0.0 && Near(clock.GetAlpha(), 0.0));
+
+        // After a reset the next tick is a first frame again
+        clock.Reset();
+        CHECK(Advance(clock, now, 1.0) == 0);
+        CHECK(clock.GetSimulationTime() == 0.0 && clock.GetFrameIndex() == 0);
+    }
+
+    // Frames faster than the step: over a second of 144 Hz frames the 60 Hz
+    // simulation runs the steps that fit and keeps the rest in the alpha
+    void TestFastFrames()
+    {
+        FrameClock clock;
+        FrameClock::Clock::time_point now;
+        clock.Tick(now);
+        uint32_t steps = 0;
+        uint32_t maxPerFrame = 0;
+        bool alphaInRange = true;
+        for (int frame = 0; frame < 144; frame++)
+        {
+            const uint32_t frameSteps = Advance(clock, now, 1.0 / 144.0);
+            steps += frameSteps;
+            maxPerFrame = frameSteps > maxPerFrame ? frameSteps : maxPerFrame;
+            alphaInRange = alphaInRange && clock.GetAlpha() >= 0.0 && clock.GetAlpha() < 1.0;
+        }
+        CHECK(steps == 60 || steps == 59);
+        CHECK(maxPerFrame == 1);
+        CHECK(alphaInRange);
+        CHECK(Near(clock.GetSimulationTime() + clock.GetAlpha() * clock.GetFixedStep(), 1.0));
+    }
+
+    // A ten second frame counts as maxFrameTime, and a frame needing more
+    // than maxSteps runs maxSteps and drops the whole steps it couldn't run
+    void TestClamp()
+    {
+        FrameClock clock(Step, 0.25, 20);
+        FrameClock::Clock::time_point now;
+        clock.Tick(now);
+        CHECK(Advance(clock, now, 10.0) == 16);
+        CHECK(clock.GetDelta() == 0.25);
+        CHECK(Near(clock.GetAlpha(), 0.0));
+        CHECK(Near(clock.GetSimulationTime(), 0.25));
+
+        FrameClock limited(Step, 0.25, 8);
+        limited.Tick(now);
+        CHECK(Advance(limited, now, 13.5 * Step) == 8);
+        CHECK(Near(limited.GetAlpha(), 0.5));
+        CHECK(Near(limited.GetSimulationTime(), 8.0 * Step));
+        CHECK(Advance(limited, now, 0.5 * Step) == 1);
+        CHECK(Near(limited.GetAlpha(), 0.0));
+    }
+
+    // Statistics cover the last HistorySize frames, after clamping
+    void TestStats()
+    {
+        FrameClock clock(Step, 0.25, 8);
+        FrameClock::Clock::time_point now;
+        clock.Tick(now);
+        CHECK(clock.GetStats().frameCount == 0);
+
+        // Frames of 10 ms that fall out of the history, then alternating 1 and 3 steps
+        for (int frame = 0; frame < 50; frame++)
+        {
+            Advance(clock, now, 0.01);
+        }
+        for (size_t frame = 0; frame < FrameClock::HistorySize; frame++)
+        {
+            Advance(clock, now, frame % 2 == 0 ? Step : 3.0 * Step);
+        }
+        FrameTimeStats stats = clock.GetStats();
+        CHECK(stats.frameCount == FrameClock::HistorySize);
+        CHECK(Near(stats.average, 2.0 * Step));
+        CHECK(Near(stats.minimum, Step));
+        CHECK(Near(stats.maximum, 3.0 * Step));
+        CHECK(Near(stats.deviation, Step));
+
+        Advance(clock, now, 10.0);
+        stats = clock.GetStats();
+        CHECK(stats.maximum == 0.25);
+    }
+}
+
+int main()
+{
+    TestSteps();
+    TestFastFrames();
+    TestClamp();
+    TestStats();
+    return CheckResult();
+}
@@ -0,0 +1,288 @@
+// Frame graph compiler on the null backend: culling, ordering, aliasing of
+// transients and rejection of graphs that read a transient nobody wrote.
+
+#include "../FrameGraph.h"
+#include "Check.h"
+
+#include <string>
+#include <vector>
+
+namespace
+{
+    FrameGraphTextureDesc MakeDesc(uint32_t format)
+    {
+        FrameGraphTextureDesc desc;
+        desc.width = 64;
+        desc.height = 64;
+        desc.format = format;
+        return desc;
+    }
+
+    FrameGraph::ExecuteFunc Record(std::vector<std::string>& executed, const std::string& name)
+    {
+        return [&executed, name](const FrameGraph&, void*) { executed.push_back(name); };
+    }
+
+    bool IsCulled(const FrameGraph& graph, const std::string& name, int passCount)
+    {
+        for (int i = 0; i < passCount; i++)
+        {
+            if (graph.GetPassName(i) == name)
+                return graph.IsPassCulled(i);
+        }
+        return false;
+    }
+
+    // A pass is culled once nothing reads what it writes, and the passes
+    // feeding only it go with it
+    void TestCulling()
+    {
+        int backBuffer = 0;
+        FrameGraph graph;
+        const FrameGraphResource output = graph.Import("BackBuffer", &backBuffer);
+        FrameGraphResource scene = InvalidFrameGraphResource;
+        FrameGraphResource unused = InvalidFrameGraphResource;
+        FrameGraphResource unusedBlur = InvalidFrameGraphResource;
+        std::vector<std::string> executed;
+
+        graph.AddPass("Scene",
+            [&](FrameGraphBuilder& builder) { scene = builder.Write(builder.Create("Scene", MakeDesc(1))); },
+            Record(executed, "Scene"));
+        graph.AddPass("Unused",
+            [&](FrameGraphBuilder& builder) { unused = builder.Write(builder.Create("Unused", MakeDesc(1))); },
+            Record(executed, "Unused"));
+        graph.AddPass("UnusedBlur",
+            [&](FrameGraphBuilder& builder) {
+                builder.Read(unused);
+                unusedBlur = builder.Write(builder.Create("UnusedBlur", MakeDesc(1)));
+            },
+            Record(executed, "UnusedBlur"));
+        graph.AddPass("Capture",
+            [&](FrameGraphBuilder& builder) {
+                builder.Write(builder.Create("Capture", MakeDesc(2)));
+                builder.SideEffect();
+            },
+            Record(executed, "Capture"));
+        graph.AddPass("Present",
+            [&](FrameGraphBuilder& builder) {
+                builder.Read(scene);
+                builder.Write(output);
+            },
+            Record(executed, "Present"));
+
+        CHECK(graph.Compile());
+        CHECK(!IsCulled(graph, "Scene", 5));
+        CHECK(IsCulled(graph, "Unused", 5));
+        CHECK(IsCulled(graph, "UnusedBlur", 5));
+        CHECK(!IsCulled(graph, "Capture", 5));
+        CHECK(!IsCulled(graph, "Present", 5));
+        CHECK(graph.GetPassOrder().size() == 3);
+
+        FrameGraphNullBackend backend;
+        graph.Execute(backend, nullptr);
+        CHECK((executed == std::vector<std::string>{ "Scene", "Capture", "Present" }));
+        // Scene and Capture differ in format and overlap, culled passes get nothing
+        CHECK(backend.GetCreatedCount() == 2);
+        graph.ReleasePool(backend);
+        CHECK(backend.GetAliveCount() == 0);
+    }
+
+    // Dependencies only point forward in declaration order, so the schedule
+    // is the declaration order without the culled passes, whatever the
+    // mix of read-after-write, write-after-write and write-after-read
+    void TestOrdering()
+    {
+        int backBuffer = 0;
+        int depthBuffer = 0;
+        FrameGraph graph;
+        const FrameGraphResource color = graph.Import("BackBuffer", &backBuffer);
+        const FrameGraphResource depth = graph.Import("DepthBuffer", &depthBuffer);
+        FrameGraphResource lighting = InvalidFrameGraphResource;
+        std::vector<std::string> executed;
+
+        graph.AddPass("Opaque",
+            [&](FrameGraphBuilder& builder) {
+                builder.Write(color);
+                builder.Write(depth);
+            },
+            Record(executed, "Opaque"));
+        graph.AddPass("Debug",
+            [&](FrameGraphBuilder& builder) {
+                builder.Read(depth);
+                builder.Write(builder.Create("Debug", MakeDesc(1)));
+            },
+            Record(executed, "Debug"));
+        graph.AddPass("Lighting",
+            [&](FrameGraphBuilder& builder) {
+                builder.Read(depth);
+                lighting = builder.Write(builder.Create("Lighting", MakeDesc(1)));
+            },
+            Record(executed, "Lighting"));
+        graph.AddPass("Sky",
+            [&](FrameGraphBuilder& builder) {
+                builder.Read(depth);
+                builder.Write(color);
+            },
+            Record(executed, "Sky"));
+        graph.AddPass("Compose",
+            [&](FrameGraphBuilder& builder) {
+                builder.Read(lighting);
+                builder.Write(color);
+            },
+            Record(executed, "Compose"));
+        // Writes depth after the passes above read it
+        graph.AddPass("ClearDepth",
+            [&](FrameGraphBuilder& builder) { builder.Write(depth); },
+            Record(executed, "ClearDepth"));
+
+        CHECK(graph.Compile());
+        CHECK((graph.GetPassOrder() == std::vector<int>{ 0, 2, 3, 4, 5 }));
+        FrameGraphNullBackend backend;
+        graph.Execute(backend, nullptr);
+        CHECK((executed == std::vector<std::string>{ "Opaque", "Lighting", "Sky", "Compose", "ClearDepth" }));
+
+        // Compiling twice gives the same schedule
+        CHECK(graph.Compile());
+        CHECK((graph.GetPassOrder() == std::vector<int>{ 0, 2, 3, 4, 5 }));
+        graph.ReleasePool(backend);
+    }
+
+    // Transients whose [firstUse, lastUse] don't overlap share a physical
+    // texture; the pool survives Reset and drops what a frame didn't use
+    void TestAliasing()
+    {
+        int backBuffer = 0;
+        FrameGraph graph;
+        FrameGraphNullBackend backend;
+        const char* names[3] = { "A", "B", "C" };
+        std::vector<void*> physical(3, nullptr);
+        std::vector<FrameGraphResource> written(3, InvalidFrameGraphResource);
+
+        auto build = [&](uint32_t lastFormat) {
+            graph.Reset();
+            const FrameGraphResource output = graph.Import("BackBuffer", &backBuffer);
+            FrameGraphResource previous = InvalidFrameGraphResource;
+            for (int i = 0; i < 3; i++)
+            {
+                // Setup runs inside AddPass, after the execute callback is
+                // built, so the callback looks the handle up by reference
+                graph.AddPass(names[i],
+                    [&](FrameGraphBuilder& builder) {
+                        if (previous != InvalidFrameGraphResource)
+                            builder.Read(previous);
+                        written[i] = builder.Write(builder.Create(names[i], MakeDesc(i == 2 ? lastFormat : 1)));
+                    },
+                    [&physical, &written, i](const FrameGraph& graph, void*) { physical[i] = graph.GetResource(written[i]); });
+                previous = written[i];
+            }
+            graph.AddPass("Present",
+                [&](FrameGraphBuilder& builder) {
+                    builder.Read(previous);
+                    builder.Write(output);
+                },
+                FrameGraph::ExecuteFunc());
+            return graph.Compile();
+        };
+
+        // A lives over passes 0-1, B over 1-2, C over 2-3: C takes A's texture
+        CHECK(build(1));
+        graph.Execute(backend, nullptr);
+        CHECK(graph.GetPhysicalCount() == 2);
+        CHECK(backend.GetCreatedCount() == 2);
+        CHECK(physical[0] != nullptr && physical[1] != nullptr);
+        CHECK(physical[0] != physical[1]);
+        CHECK(physical[2] == physical[0]);
+        CHECK(graph.GetResource(graph.FindResource("A")) == nullptr); // unbound after the frame
+
+        // Same graph next frame, nothing new is created
+        CHECK(build(1));
+        graph.Execute(backend, nullptr);
+        CHECK(backend.GetCreatedCount() == 2);
+        CHECK(backend.GetAliveCount() == 2);
+
+        // Another format can't alias; the format 1 texture left idle goes back
+        CHECK(build(2));
+        graph.Execute(backend, nullptr);
+        CHECK(physical[2] != physical[0] && physical[2] != physical[1]);
+        CHECK(backend.GetCreatedCount() == 3);
+        CHECK(graph.GetPhysicalCount() == 3);
+        CHECK(build(2));
+        graph.Execute(backend, nullptr);
+        CHECK(backend.GetAliveCount() == 3);
+
+        graph.ReleasePool(backend);
+        CHECK(backend.GetAliveCount() == 0);
+        CHECK(graph.GetPhysicalCount() == 0);
+    }
+
+    // Creating a transient doesn't write it, a pass reading it must fail the compile
+    void TestReadBeforeWrite()
+    {
+        int backBuffer = 0;
+        FrameGraph graph;
+        const FrameGraphResource output = graph.Import("BackBuffer", &backBuffer);
+        FrameGraphResource accum = InvalidFrameGraphResource;
+        graph.AddPass("Accumulate",
+            [&](FrameGraphBuilder& builder) { accum = builder.Create("Accum", MakeDesc(1)); },
+            FrameGraph::ExecuteFunc());
+        graph.AddPass("Resolve",
+            [&](FrameGraphBuilder& builder) {
+                builder.Read(accum);
+                builder.Write(output);
+            },
+            FrameGraph::ExecuteFunc());
+        CHECK(!graph.Compile());
+
+        // Reading before the write in declaration order fails as well
+        graph.Reset();
+        FrameGraphResource late = InvalidFrameGraphResource;
+        graph.AddPass("Early",
+            [&](FrameGraphBuilder& builder) {
+                late = builder.Create("Late", MakeDesc(1));
+                builder.Read(late);
+                builder.Write(output);
+            },
+            FrameGraph::ExecuteFunc());
+        graph.AddPass("Writer",
+            [&](FrameGraphBuilder& builder) {
+                builder.Write(late);
+                builder.SideEffect();
+            },
+            FrameGraph::ExecuteFunc());
+        CHECK(!graph.Compile());
+
+        // The same graph with the write declared compiles
+        graph.Reset();
+        graph.AddPass("Accumulate",
+            [&](FrameGraphBuilder& builder) { accum = builder.Write(builder.Create("Accum", MakeDesc(1))); },
+            FrameGraph::ExecuteFunc());
+        graph.AddPass("Resolve",
+            [&](FrameGraphBuilder& builder) {
+                builder.Read(accum);
+                builder.Write(output);
+            },
+            FrameGraph::ExecuteFunc());
+        CHECK(graph.Compile());
+        CHECK(graph.GetPassOrder().size() == 2);
+
+        // Imported resources count as written before the frame
+        graph.Reset();
+        const FrameGraphResource imported = graph.Import("BackBuffer", &backBuffer);
+        graph.AddPass("Readback",
+            [&](FrameGraphBuilder& builder) {
+                builder.Read(imported);
+                builder.SideEffect();
+            },
+            FrameGraph::ExecuteFunc());
+        CHECK(graph.Compile());
+    }
+}
+
+int main()
+{
+    TestCulling();
+    TestOrdering();
+    TestAliasing();
+    TestReadBeforeWrite();
+    return CheckResult();
+}
@@ -0,0 +1,247 @@
+// GpuProfiler on the fake query backend: results arrive the configured number
+// of frames late, slots wrap around the ring, frames are skipped while every
+// slot is pending, disjoint frames are dropped and the pass span leaves out
+// the time before the first pass.
+
+#include "../GpuProfiler.h"
+#include "Check.h"
+
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+    // The fake clock advances 100 ticks of 1 MHz per timestamp, so every
+    // timestamp is 100 us after the one before
+    const double TickSeconds = 100e-6;
+
+    const char* PassNames[3] = { "Opaque", "Sky", "Transparent" };
+
+    bool Near(double a, double b)
+    {
+        return fabs(a - b) < 1e-9;
+    }
+
+    // Frame number f records f % 3 + 1 passes, so a result read from the
+    // wrong slot has the wrong shape
+    void RecordFrame(GpuProfiler& profiler, int frame)
+    {
+        profiler.BeginFrame();
+        const int passCount = frame % 3 + 1;
+        for (int pass = 0; pass < passCount; pass++)
+        {
+            GpuProfileScope scope(profiler, PassNames[pass], nullptr);
+        }
+        profiler.EndFrame();
+    }
+
+    // Timestamps go frame begin, then begin/end of each pass, then frame end
+    bool HasShapeOfFrame(const GpuProfiler& profiler, int frame)
+    {
+        const int passCount = frame % 3 + 1;
+        const std::vector<GpuPassTiming>& passes = profiler.GetLastFrame();
+        if (int(passes.size()) != passCount || !Near(profiler.GetLastFrameDuration(), (2 * passCount + 1) * TickSeconds) ||
+            !Near(profiler.GetLastPassSpan(), (2 * passCount - 1) * TickSeconds))
+            return false;
+        for (int pass = 0; pass < passCount; pass++)
+        {
+            if (strcmp(passes[pass].name, PassNames[pass]) != 0 || !Near(passes[pass].start, (2 * pass + 1) * TickSeconds) ||
+                !Near(passes[pass].duration, TickSeconds))
+                return false;
+        }
+        return true;
+    }
+
+    // A frame ended with latency L is read back at the BeginFrame L + 1
+    // frames later, never earlier and never later
+    void TestLatency()
+    {
+        for (uint32_t latency = 0; latency < GpuProfiler::FrameCount; latency++)
+        {
+            GpuQueryFakeBackend backend(latency);
+            GpuProfiler profiler;
+            CHECK(profiler.Init(backend));
+            for (int frame = 0; frame < 12; frame++)
+            {
+                RecordFrame(profiler, frame);
+                // BeginFrame of the next frame collects, EndFrame leaves it alone
+                const int readable = frame + 1 - int(latency);
+                CHECK(profiler.GetMeasuredFrames() == uint64_t(readable - 1 > 0 ? readable - 1 : 0));
+            }
+            CHECK(profiler.GetSkippedFrames() == 0);
+            CHECK(profiler.GetDisjointFrames() == 0);
+            profiler.Release();
+        }
+    }
+
+    // Many times around the ring of four slots, every result belongs to the
+    // frame it was read for
+    void TestWraparound()
+    {
+        const uint32_t latency = 2;
+        GpuQueryFakeBackend backend(latency);
+        GpuProfiler profiler;
+        CHECK(profiler.Init(backend));
+        for (int frame = 0; frame < 40; frame++)
+        {
+            profiler.BeginFrame();
+            const int collected = frame - int(latency) - 1;
+            if (collected >= 0)
+            {
+                CHECK(profiler.GetMeasuredFrames() == uint64_t(collected + 1));
+                CHECK(HasShapeOfFrame(profiler, collected));
+            }
+            const int passCount = frame % 3 + 1;
+            for (int pass = 0; pass < passCount; pass++)
+            {
+                const int idx = profiler.BeginPass(PassNames[pass], nullptr);
+                CHECK(idx == pass);
+                profiler.EndPass(idx, nullptr);
+            }
+            profiler.EndFrame();
+        }
+        CHECK(profiler.GetSkippedFrames() == 0);
+        profiler.Release();
+    }
+
+    // With the GPU further behind than the ring is deep, frames are skipped
+    // instead of waited for, and measuring resumes once slots free up
+    void TestSkipWhenFull()
+    {
+        GpuQueryFakeBackend backend(10);
+        GpuProfiler profiler;
+        CHECK(profiler.Init(backend));
+        for (uint32_t frame = 0; frame < GpuProfiler::FrameCount; frame++)
+        {
+            RecordFrame(profiler, int(frame));
+        }
+        CHECK(profiler.GetSkippedFrames() == 0);
+
+        // Every slot pending: nothing is recorded, passes get no index
+        for (int frame = 0; frame < 3; frame++)
+        {
+            profiler.BeginFrame();
+            CHECK(profiler.BeginPass("Skipped", nullptr) == -1);
+            profiler.EndPass(-1, nullptr);
+            profiler.EndFrame();
+        }
+        CHECK(profiler.GetSkippedFrames() == 3);
+        CHECK(profiler.GetMeasuredFrames() == 0);
+
+        // The GPU catches up: all four come back oldest first, in one BeginFrame
+        backend.SetLatency(0);
+        profiler.BeginFrame();
+        CHECK(profiler.GetMeasuredFrames() == GpuProfiler::FrameCount);
+        CHECK(HasShapeOfFrame(profiler, int(GpuProfiler::FrameCount) - 1));
+        CHECK(profiler.BeginPass(PassNames[0], nullptr) == 0);
+        profiler.EndPass(0, nullptr);
+        profiler.EndFrame();
+        profiler.BeginFrame();
+        CHECK(profiler.GetMeasuredFrames() == GpuProfiler::FrameCount + 1);
+        CHECK(profiler.GetSkippedFrames() == 3);
+        profiler.EndFrame();
+        profiler.Release();
+    }
+
+    // Frames with a disjoint counter are read and thrown away, the last
+    // good frame stays visible
+    void TestDisjoint()
+    {
+        GpuQueryFakeBackend backend(1);
+        GpuProfiler profiler;
+        CHECK(profiler.Init(backend));
+        RecordFrame(profiler, 0);
+        RecordFrame(profiler, 1);
+        backend.SetDisjoint(true);
+        RecordFrame(profiler, 2);
+        RecordFrame(profiler, 3);
+        backend.SetDisjoint(false);
+        RecordFrame(profiler, 4);
+        // Frame k is read at the BeginFrame of k + 2: 0 and 1 are measured, 2 is dropped
+        CHECK(profiler.GetMeasuredFrames() == 2);
+        CHECK(profiler.GetDisjointFrames() == 1);
+        CHECK(HasShapeOfFrame(profiler, 1));
+
+        RecordFrame(profiler, 5);
+        CHECK(profiler.GetMeasuredFrames() == 2);
+        CHECK(profiler.GetDisjointFrames() == 2);
+        CHECK(HasShapeOfFrame(profiler, 1));
+        RecordFrame(profiler, 6);
+        CHECK(profiler.GetMeasuredFrames() == 3);
+        CHECK(profiler.GetDisjointFrames() == 2);
+        CHECK(HasShapeOfFrame(profiler, 4));
+        CHECK(profiler.GetSkippedFrames() == 0);
+        profiler.Release();
+    }
+
+    // The backend isn't asked for a frame again after it was read
+    void TestReadsArePolls()
+    {
+        GpuQueryFakeBackend backend(2);
+        GpuProfiler profiler;
+        CHECK(profiler.Init(backend));
+        for (int frame = 0; frame < 10; frame++)
+        {
+            RecordFrame(profiler, frame);
+        }
+        // One failed poll per BeginFrame once a frame is pending, one success per measured frame
+        CHECK(backend.GetReadAttempts() == 9 + profiler.GetMeasuredFrames());
+        profiler.Release();
+    }
+
+    // The pass span runs from the earliest pass start to the latest pass
+    // end: the stall before the first pass and the tail after the last one
+    // are left out, gaps between passes are not
+    void TestPassSpan()
+    {
+        GpuQueryFakeBackend backend(0);
+        GpuProfiler profiler;
+        CHECK(profiler.Init(backend));
+
+        // Frame begin at 0, passes at 5000 to 5100 and 5300 to 5400, frame end at 5500
+        profiler.BeginFrame();
+        backend.SetTickStep(5000);
+        const int first = profiler.BeginPass(PassNames[0], nullptr);
+        backend.SetTickStep(100);
+        profiler.EndPass(first, nullptr);
+        backend.SetTickStep(200);
+        const int second = profiler.BeginPass(PassNames[1], nullptr);
+        backend.SetTickStep(100);
+        profiler.EndPass(second, nullptr);
+        profiler.EndFrame();
+        profiler.BeginFrame();
+        CHECK(profiler.GetMeasuredFrames() == 1);
+        CHECK(Near(profiler.GetLastFrameDuration(), 5500e-6));
+        CHECK(Near(profiler.GetLastPassSpan(), 400e-6));
+        profiler.EndFrame();
+
+        // A frame without passes has no span
+        profiler.BeginFrame();
+        CHECK(profiler.GetMeasuredFrames() == 2);
+        CHECK(Near(profiler.GetLastFrameDuration(), TickSeconds) && profiler.GetLastPassSpan() == 0.0);
+
+        // A pass recorded on another context may end after one begun later:
+        // the first at 100 to 400 around the second at 200 to 300
+        const int outer = profiler.BeginPass(PassNames[0], nullptr);
+        const int inner = profiler.BeginPass(PassNames[1], nullptr);
+        profiler.EndPass(inner, nullptr);
+        profiler.EndPass(outer, nullptr);
+        profiler.EndFrame();
+        profiler.BeginFrame();
+        CHECK(profiler.GetMeasuredFrames() == 3);
+        CHECK(Near(profiler.GetLastPassSpan(), 3 * TickSeconds));
+        profiler.EndFrame();
+        profiler.Release();
+    }
+}
+
+int main()
+{
+    TestLatency();
+    TestWraparound();
+    TestSkipWhenFull();
+    TestDisjoint();
+    TestReadsArePolls();
+    TestPassSpan();
+    return CheckResult();
+}
@@ -0,0 +1,245 @@
+// .mesh files written by WriteMeshFile open through MeshFile with every
+// section byte for byte as given, in 16 and 32 bit index variants, and
+// truncated or corrupted files are refused by Open.
+
+#include "../MeshFile.h"
+#include "Check.h"
+
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace
+{
+    const char* const MeshPath = "MeshFileTest.mesh";
+
+    // Random stream bytes and indices: nothing in the file format looks at them
+    MeshFileData MakeData(uint32_t vertexCount, uint32_t triangleCount)
+    {
+        std::mt19937 random(45);
+        std::uniform_int_distribution<uint32_t> byte(0, 255);
+        std::uniform_int_distribution<uint32_t> vertex(0, vertexCount - 1);
+
+        MeshFileData data;
+        data.vertexCount = vertexCount;
+        for (int i = 0; i < 4; i++)
+        {
+            data.quantization.scale[i] = 0.5f + float(i);
+            data.quantization.bias[i] = -float(i);
+        }
+        const float boundsMin[3] = { -1.0f, -2.0f, -3.0f };
+        const float boundsMax[3] = { 1.0f, 2.0f, 3.0f };
+        const float boundingSphere[4] = { 0.1f, 0.2f, 0.3f, 3.75f };
+        memcpy(data.boundsMin, boundsMin, sizeof(boundsMin));
+        memcpy(data.boundsMax, boundsMax, sizeof(boundsMax));
+        memcpy(data.boundingSphere, boundingSphere, sizeof(boundingSphere));
+
+        const MeshStreamFormat formats[2] = { MeshStreamPackedPosition, MeshStreamPackedNormal };
+        const uint32_t strides[2] = { sizeof(PackedPosition), sizeof(PackedNormal) };
+        for (int i = 0; i < 2; i++)
+        {
+            MeshFileStreamData stream;
+            stream.format = formats[i];
+            stream.stride = strides[i];
+            stream.data.resize(size_t(vertexCount) * strides[i]);
+            for (uint8_t& value : stream.data)
+            {
+                value = uint8_t(byte(random));
+            }
+            data.streams.push_back(stream);
+        }
+
+        data.indices.resize(size_t(triangleCount) * 3);
+        for (uint32_t& index : data.indices)
+        {
+            index = vertex(random);
+        }
+        const uint32_t lodIndexCount = triangleCount / 4 * 3;
+        data.lods.push_back(MeshLodLevel{ 0, uint32_t(data.indices.size()) - lodIndexCount, 0.0f });
+        data.lods.push_back(MeshLodLevel{ uint32_t(data.indices.size()) - lodIndexCount, lodIndexCount, 0.01f });
+        return data;
+    }
+
+    bool ReadBytes(std::vector<uint8_t>& bytes)
+    {
+        FILE* pFile = fopen(MeshPath, "rb");
+        if (pFile == nullptr)
+            return false;
+        bytes.clear();
+        uint8_t block[4096];
+        size_t read;
+        while ((read = fread(block, 1, sizeof(block), pFile)) > 0)
+            bytes.insert(bytes.end(), block, block + read);
+        fclose(pFile);
+        return true;
+    }
+
+    bool WriteBytes(const std::vector<uint8_t>& bytes)
+    {
+        FILE* pFile = fopen(MeshPath, "wb");
+        if (pFile == nullptr)
+            return false;
+        const bool written = bytes.empty() || fwrite(bytes.data(), 1, bytes.size(), pFile) == bytes.size();
+        return fclose(pFile) == 0 && written;
+    }
+
+    bool IsZero(const std::vector<uint8_t>& bytes, size_t first, size_t end)
+    {
+        for (size_t i = first; i < end; i++)
+        {
+            if (bytes[i] != 0)
+                return false;
+        }
+        return true;
+    }
+
+    // Writes, reopens and compares every field and section, and checks the
+    // padding between sections is zero
+    void CheckRoundTrip(const MeshFileData& data, uint32_t indexSize)
+    {
+        CHECK(WriteMeshFile(MeshPath, data));
+        std::vector<uint8_t> bytes;
+        CHECK(ReadBytes(bytes));
+
+        MeshFile file;
+        CHECK(file.Open(MeshPath));
+        if (!file.IsOpen())
+            return;
+        const MeshFileHeader& header = file.GetHeader();
+        CHECK(header.magic == MeshFileMagic && header.version == MeshFileVersion);
+        CHECK(header.fileSize == bytes.size() && header.fileSize % MeshFileAlignment == 0);
+        CHECK(header.vertexCount == data.vertexCount && header.indexCount == data.indices.size());
+        CHECK(header.indexSize == indexSize);
+        CHECK(memcmp(&header.quantization, &data.quantization, sizeof(VertexQuantization)) == 0);
+        CHECK(memcmp(header.boundsMin, data.boundsMin, sizeof(data.boundsMin)) == 0);
+        CHECK(memcmp(header.boundsMax, data.boundsMax, sizeof(data.boundsMax)) == 0);
+        CHECK(memcmp(header.boundingSphere, data.boundingSphere, sizeof(data.boundingSphere)) == 0);
+        CHECK(header.lodCount == data.lods.size());
+        CHECK(memcmp(header.lods, data.lods.data(), data.lods.size() * sizeof(MeshLodLevel)) == 0);
+        CHECK(file.FindStream(MeshStreamPackedTextureVertex) == nullptr);
+
+        // Sections follow each other in order, padded with zeros
+        size_t end = sizeof(MeshFileHeader);
+        CHECK(header.streamCount == data.streams.size());
+        for (const MeshFileStreamData& source : data.streams)
+        {
+            const MeshFileStream* pStream = file.FindStream(source.format);
+            CHECK(pStream != nullptr);
+            if (pStream == nullptr)
+                continue;
+            CHECK(pStream->stride == source.stride && pStream->size == source.data.size());
+            CHECK(IsZero(bytes, end, pStream->offset));
+            CHECK(memcmp(file.GetStreamData(*pStream), source.data.data(), source.data.size()) == 0);
+            end = pStream->offset + pStream->size;
+        }
+        CHECK(IsZero(bytes, end, header.indexOffset));
+
+        bool indicesMatch = true;
+        for (size_t i = 0; i < data.indices.size(); i++)
+        {
+            const uint32_t index = indexSize == 2
+                ? static_cast<const uint16_t*>(file.GetIndices())[i]
+                : static_cast<const uint32_t*>(file.GetIndices())[i];
+            indicesMatch = indicesMatch && index == data.indices[i];
+        }
+        CHECK(indicesMatch);
+        CHECK(IsZero(bytes, header.indexOffset + size_t(header.indexCount) * indexSize, bytes.size()));
+
+        // Writing the same data again gives the same file
+        file.Close();
+        std::vector<uint8_t> rewritten;
+        CHECK(WriteMeshFile(MeshPath, data) && ReadBytes(rewritten));
+        CHECK(rewritten == bytes);
+    }
+
+    void TestRoundTrip()
+    {
+        CheckRoundTrip(MakeData(100, 150), 2);
+        // One past what 16 bit indices address
+        CheckRoundTrip(MakeData(0x10001, 1000), 4);
+    }
+
+    bool OpensWith(const std::vector<uint8_t>& bytes, void (*pChange)(MeshFileHeader&))
+    {
+        std::vector<uint8_t> changed = bytes;
+        MeshFileHeader header;
+        memcpy(&header, changed.data(), sizeof(header));
+        pChange(header);
+        memcpy(changed.data(), &header, sizeof(header));
+        MeshFile file;
+        return WriteBytes(changed) && file.Open(MeshPath);
+    }
+
+    bool OpensTruncated(const std::vector<uint8_t>& bytes, size_t size)
+    {
+        MeshFile file;
+        return WriteBytes(std::vector<uint8_t>(bytes.begin(), bytes.begin() + size)) && file.Open(MeshPath);
+    }
+
+    // Any header that points outside the file or disagrees with itself is refused
+    void TestRejected()
+    {
+        std::vector<uint8_t> bytes;
+        CHECK(WriteMeshFile(MeshPath, MakeData(100, 150)) && ReadBytes(bytes));
+        CHECK(OpensWith(bytes, [](MeshFileHeader&) {}));
+
+        CHECK(!OpensTruncated(bytes, 0));
+        CHECK(!OpensTruncated(bytes, sizeof(MeshFileHeader) / 2));
+        CHECK(!OpensTruncated(bytes, bytes.size() - MeshFileAlignment));
+        CHECK(!OpensTruncated(bytes, bytes.size() - 1));
+        MeshFile missing;
+        remove(MeshPath);
+        CHECK(!missing.Open(MeshPath));
+
+        CHECK(!OpensWith(bytes, [](MeshFileHeader& header) { header.magic ^= 1; }));
+        CHECK(!OpensWith(bytes, [](MeshFileHeader& header) { header.version++; }));
+        CHECK(!OpensWith(bytes, [](MeshFileHeader& header) { header.fileSize += MeshFileAlignment; }));
+        CHECK(!OpensWith(bytes, [](MeshFileHeader& header) { header.vertexCount++; }));
+        CHECK(!OpensWith(bytes, [](MeshFileHeader& header) { header.vertexCount = 0xFFFFFFFF; }));
+        CHECK(!OpensWith(bytes, [](MeshFileHeader& header) { header.indexCount += 3 * MeshFileAlignment; }));
+        CHECK(!OpensWith(bytes, [](MeshFileHeader& header) { header.indexCount = 0xFFFFFFFF; }));
+        CHECK(!OpensWith(bytes, [](MeshFileHeader& header) { header.indexSize = 3; }));
+        CHECK(!OpensWith(bytes, [](MeshFileHeader& header) { header.indexOffset = 0; }));
+        CHECK(!OpensWith(bytes, [](MeshFileHeader& header) { header.indexOffset += 8; }));
+        CHECK(!OpensWith(bytes, [](MeshFileHeader& header) { header.indexOffset = header.fileSize; }));
+        CHECK(!OpensWith(bytes, [](MeshFileHeader& header) { header.streamCount = MeshFileMaxStreams + 1; }));
+        CHECK(!OpensWith(bytes, [](MeshFileHeader& header) { header.streams[0].format = MeshStreamPackedNormal; }));
+        CHECK(!OpensWith(bytes, [](MeshFileHeader& header) { header.streams[1].offset = header.fileSize; }));
+        CHECK(!OpensWith(bytes, [](MeshFileHeader& header) { header.streams[1].offset = 0xFFFFFFF0; }));
+        CHECK(!OpensWith(bytes, [](MeshFileHeader& header) { header.lodCount = 0; }));
+        CHECK(!OpensWith(bytes, [](MeshFileHeader& header) { header.lodCount = MeshLodChain::MaxLevels + 1; }));
+        CHECK(!OpensWith(bytes, [](MeshFileHeader& header) { header.lods[1].indexCount += 3; }));
+        CHECK(!OpensWith(bytes, [](MeshFileHeader& header) { header.lods[1].firstIndex = 0xFFFFFFFF; }));
+        CHECK(!OpensWith(bytes, [](MeshFileHeader& header) { header.lods[0].indexCount--; }));
+    }
+
+    // Data that can't make a valid file isn't written
+    void TestWriteRejected()
+    {
+        MeshFileData noLods = MakeData(100, 150);
+        noLods.lods.clear();
+        CHECK(!WriteMeshFile(MeshPath, noLods));
+
+        MeshFileData shortStream = MakeData(100, 150);
+        shortStream.streams[1].data.pop_back();
+        CHECK(!WriteMeshFile(MeshPath, shortStream));
+
+        MeshFileData tooManyStreams = MakeData(100, 150);
+        tooManyStreams.streams.resize(MeshFileMaxStreams + 1, tooManyStreams.streams[0]);
+        CHECK(!WriteMeshFile(MeshPath, tooManyStreams));
+
+        MeshFileData lodPastIndices = MakeData(100, 150);
+        lodPastIndices.lods.back().indexCount += 3;
+        CHECK(!WriteMeshFile(MeshPath, lodPastIndices));
+    }
+}
+
+int main()
+{
+    TestRoundTrip();
+    TestRejected();
+    TestWriteRejected();
+    remove(MeshPath);
+    return CheckResult();
+}
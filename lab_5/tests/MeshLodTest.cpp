@@ -0,0 +1,234 @@
+// SimplifyMesh and MeshLodChain on generated meshes: every level indexes the
+// shared vertices, shrinks, emits no degenerate or flipped triangles and stays
+// within the error it reports; borders stay put and SelectLevel follows the
+// projected size.
+
+#include "../MeshGenerator.h"
+#include "../MeshLod.h"
+#include "Check.h"
+
+#include <cmath>
+#include <vector>
+
+namespace
+{
+    const float MaxChainError = 0.05f;
+
+    void Cross(const float* a, const float* b, float* result)
+    {
+        result[0] = a[1] * b[2] - a[2] * b[1];
+        result[1] = a[2] * b[0] - a[0] * b[2];
+        result[2] = a[0] * b[1] - a[1] * b[0];
+    }
+
+    // Twice the area, along the clockwise front face normal
+    void GetAreaNormal(const std::vector<MeshVertex>& vertices, const uint32_t* triangle, float* normal)
+    {
+        const MeshVertex& a = vertices[triangle[0]];
+        const MeshVertex& b = vertices[triangle[1]];
+        const MeshVertex& c = vertices[triangle[2]];
+        const float e1[3] = { b.x - a.x, b.y - a.y, b.z - a.z };
+        const float e2[3] = { c.x - a.x, c.y - a.y, c.z - a.z };
+        Cross(e1, e2, normal);
+    }
+
+    // Every triangle indexes existing vertices, uses three different ones and has an area
+    bool IsValidLevel(const std::vector<MeshVertex>& vertices, const uint32_t* indices, size_t indexCount)
+    {
+        if (indexCount == 0 || indexCount % 3 != 0)
+            return false;
+        for (size_t i = 0; i < indexCount; i += 3)
+        {
+            const uint32_t* triangle = &indices[i];
+            if (triangle[0] >= vertices.size() || triangle[1] >= vertices.size() || triangle[2] >= vertices.size())
+                return false;
+            if (triangle[0] == triangle[1] || triangle[1] == triangle[2] || triangle[0] == triangle[2])
+                return false;
+            float normal[3];
+            GetAreaNormal(vertices, triangle, normal);
+            if (normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2] < 1e-20f)
+                return false;
+        }
+        return true;
+    }
+
+    // Largest distance of a triangle's centroid from a sphere of this radius
+    // around the origin, relative to the radius; triangles facing inward count
+    // as the whole radius
+    float GetSphereDeviation(const std::vector<MeshVertex>& vertices, const uint32_t* indices, size_t indexCount, float radius)
+    {
+        float deviation = 0.0f;
+        for (size_t i = 0; i < indexCount; i += 3)
+        {
+            const MeshVertex& a = vertices[indices[i]];
+            const MeshVertex& b = vertices[indices[i + 1]];
+            const MeshVertex& c = vertices[indices[i + 2]];
+            const float centroid[3] = { (a.x + b.x + c.x) / 3.0f, (a.y + b.y + c.y) / 3.0f, (a.z + b.z + c.z) / 3.0f };
+            float normal[3];
+            GetAreaNormal(vertices, &indices[i], normal);
+            if (normal[0] * centroid[0] + normal[1] * centroid[1] + normal[2] * centroid[2] <= 0.0f)
+                return 1.0f;
+            const float distance = sqrtf(centroid[0] * centroid[0] + centroid[1] * centroid[1] + centroid[2] * centroid[2]);
+            deviation = fmaxf(deviation, fabsf(radius - distance) / radius);
+        }
+        return deviation;
+    }
+
+    MeshLodChain BuildChain(const GeneratedMesh<uint32_t>& mesh)
+    {
+        MeshLodChain chain;
+        chain.Build(&mesh.vertices[0].x, mesh.vertices.size(), sizeof(MeshVertex), mesh.indices.data(),
+            mesh.indices.size(), MeshLodChain::MaxLevels, 0.5f, MaxChainError);
+        return chain;
+    }
+
+    // Levels are packed back to back, valid, shrinking, with errors growing
+    // up to the limit
+    void CheckChain(const MeshLodChain& chain, const std::vector<MeshVertex>& vertices)
+    {
+        const std::vector<uint32_t>& indices = chain.GetIndices();
+        CHECK(chain.GetLevelCount() >= 3 && chain.GetLevelCount() <= MeshLodChain::MaxLevels);
+        CHECK(chain.GetLevel(0).firstIndex == 0 && chain.GetLevel(0).error == 0.0f);
+        for (uint32_t level = 0; level < chain.GetLevelCount(); level++)
+        {
+            const MeshLodLevel& lod = chain.GetLevel(level);
+            CHECK(size_t(lod.firstIndex) + lod.indexCount <= indices.size());
+            CHECK(IsValidLevel(vertices, &indices[lod.firstIndex], lod.indexCount));
+            CHECK(lod.error >= 0.0f && lod.error <= MaxChainError);
+            if (level > 0)
+            {
+                const MeshLodLevel& previous = chain.GetLevel(level - 1);
+                CHECK(lod.indexCount < previous.indexCount);
+                CHECK(lod.error >= previous.error);
+                CHECK(lod.firstIndex == previous.firstIndex + previous.indexCount);
+            }
+        }
+        const MeshLodLevel& last = chain.GetLevel(chain.GetLevelCount() - 1);
+        CHECK(last.firstIndex + last.indexCount == indices.size());
+    }
+
+    // The chain holds on every generated closed shape
+    void TestChains()
+    {
+        GeneratedMesh<uint32_t> icosphere;
+        CHECK(GenerateIcosphere(1.0f, 5, icosphere));
+        CheckChain(BuildChain(icosphere), icosphere.vertices);
+        GeneratedMesh<uint32_t> torus;
+        CHECK(GenerateTorus(1.0f, 0.3f, 96, 48, torus));
+        CheckChain(BuildChain(torus), torus.vertices);
+    }
+
+    // On a sphere the geometry can be checked against the real surface. The
+    // error is measured at the vertices, triangle interiors sag a little
+    // further across the curvature, but never by more than a few times the
+    // error, and no triangle turns inward
+    void TestSphereDeviation()
+    {
+        GeneratedMesh<uint32_t> sphere;
+        CHECK(GenerateUVSphere(2.0f, 64, 128, sphere));
+        const MeshLodChain chain = BuildChain(sphere);
+        // Centered on the vertex centroid, which the repeated pole vertices pull a little off the origin
+        CHECK(fabsf(chain.GetRadius() - 2.0f) < 0.02f);
+        CheckChain(chain, sphere.vertices);
+        CHECK(chain.GetLevelCount() >= 5);
+
+        const std::vector<uint32_t>& indices = chain.GetIndices();
+        const float baseDeviation = GetSphereDeviation(sphere.vertices, indices.data(), chain.GetLevel(0).indexCount, 2.0f);
+        CHECK(baseDeviation < 0.001f);
+        for (uint32_t level = 1; level < chain.GetLevelCount(); level++)
+        {
+            const MeshLodLevel& lod = chain.GetLevel(level);
+            const float deviation = GetSphereDeviation(sphere.vertices, &indices[lod.firstIndex], lod.indexCount, 2.0f);
+            CHECK(deviation <= baseDeviation + 3.0f * lod.error);
+        }
+    }
+
+    // A flat grid loses its inside vertices at no error; the outline stays,
+    // so the area is unchanged and every triangle still faces up
+    void TestBorder()
+    {
+        GeneratedMesh<uint32_t> plane;
+        CHECK(GeneratePlane(4.0f, 2.0f, 32, 16, plane));
+        std::vector<uint32_t> simplified;
+        float error = -1.0f;
+        const size_t count = SimplifyMesh(&plane.vertices[0].x, plane.vertices.size(), sizeof(MeshVertex),
+            plane.indices.data(), plane.indices.size(), 0, 0.001f, simplified, &error);
+        CHECK(count == simplified.size());
+        CHECK(count < plane.indices.size() / 4);
+        CHECK(IsValidLevel(plane.vertices, simplified.data(), count));
+        CHECK(error >= 0.0f && error <= 0.001f);
+
+        double area = 0.0;
+        bool facingUp = true;
+        for (size_t i = 0; i < count; i += 3)
+        {
+            float normal[3];
+            GetAreaNormal(plane.vertices, &simplified[i], normal);
+            facingUp = facingUp && normal[1] > 0.0f;
+            area += 0.5 * sqrt(double(normal[0]) * normal[0] + double(normal[1]) * normal[1] + double(normal[2]) * normal[2]);
+        }
+        CHECK(facingUp);
+        CHECK(fabs(area - 8.0) < 1e-4);
+    }
+
+    // The target is met when the error allows it, the error limit wins when
+    // it doesn't; a curved surface can't lose anything at zero error
+    void TestLimits()
+    {
+        GeneratedMesh<uint32_t> sphere;
+        CHECK(GenerateUVSphere(1.0f, 32, 64, sphere));
+        const size_t source = sphere.indices.size();
+        std::vector<uint32_t> simplified;
+        float error = -1.0f;
+
+        const size_t target = source / 4 / 3 * 3;
+        size_t count = SimplifyMesh(&sphere.vertices[0].x, sphere.vertices.size(), sizeof(MeshVertex),
+            sphere.indices.data(), source, target, 1.0f, simplified, &error);
+        CHECK(count <= target && count > target / 2);
+        CHECK(error > 0.0f && error <= 1.0f);
+
+        count = SimplifyMesh(&sphere.vertices[0].x, sphere.vertices.size(), sizeof(MeshVertex),
+            sphere.indices.data(), source, target, 0.002f, simplified, &error);
+        CHECK(count > target && count < source);
+        CHECK(error <= 0.002f);
+
+        count = SimplifyMesh(&sphere.vertices[0].x, sphere.vertices.size(), sizeof(MeshVertex),
+            sphere.indices.data(), source, target, 0.0f, simplified, &error);
+        CHECK(count == source);
+        CHECK(error == 0.0f);
+        CHECK(simplified == sphere.indices);
+    }
+
+    // Smaller on screen never picks a finer level, and the level picked keeps
+    // its error under the pixel limit
+    void TestSelectLevel()
+    {
+        GeneratedMesh<uint32_t> sphere;
+        CHECK(GenerateUVSphere(1.0f, 64, 128, sphere));
+        const MeshLodChain chain = BuildChain(sphere);
+        CHECK(chain.SelectLevel(1e6f, 1.0f) == 0);
+        CHECK(chain.SelectLevel(0.0f, 1.0f) == chain.GetLevelCount() - 1);
+        uint32_t previous = 0;
+        for (float radius = 4000.0f; radius > 0.5f; radius *= 0.8f)
+        {
+            const uint32_t level = chain.SelectLevel(radius, 1.0f);
+            CHECK(level >= previous);
+            CHECK(chain.GetLevel(level).error * radius <= 1.0f);
+            previous = level;
+        }
+
+        // 1 unit sphere 10 units away, 90 degree field of view, 720 pixels high
+        CHECK(fabsf(GetProjectedRadius(1.0f, 10.0f, 1.0f, 720.0f) - 36.0f) < 1e-4f);
+        CHECK(GetProjectedRadius(1.0f, 0.5f, 1.0f, 720.0f) == 720.0f);
+    }
+}
+
+int main()
+{
+    TestChains();
+    TestSphereDeviation();
+    TestBorder();
+    TestLimits();
+    TestSelectLevel();
+    return CheckResult();
+}
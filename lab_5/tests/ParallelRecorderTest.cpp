@@ -0,0 +1,186 @@
+// ParallelRecorder on the null backend: command lists are executed in job
+// order on the calling thread whatever order the workers finish them in.
+
+#include "../ParallelRecorder.h"
+#include "Check.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    // Null backend that also keeps the order recordings finished in and
+    // wakes waiting jobs whenever a list is finished or executed
+    class OrderBackend : public CommandRecordingNullBackend
+    {
+    public:
+        void* FinishRecording(int slot) override
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_finished.push_back(slot);
+            }
+            m_changed.notify_all();
+            return CommandRecordingNullBackend::FinishRecording(slot);
+        }
+
+        void Execute(void* pCommandList) override
+        {
+            CHECK(std::this_thread::get_id() == m_recordThread);
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                CommandRecordingNullBackend::Execute(pCommandList);
+                m_executedCount++;
+            }
+            m_changed.notify_all();
+        }
+
+        void WaitFinished(size_t count)
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_changed.wait(lock, [this, count]() { return m_finished.size() >= count; });
+        }
+
+        void WaitExecuted(size_t count)
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_changed.wait(lock, [this, count]() { return m_executedCount >= count; });
+        }
+
+        void Reset()
+        {
+            Clear();
+            m_finished.clear();
+            m_executedCount = 0;
+            m_recordThread = std::this_thread::get_id();
+        }
+
+        const std::vector<int>& GetFinished() const { return m_finished; }
+    private:
+        std::mutex m_mutex;
+        std::condition_variable m_changed;
+        std::vector<int> m_finished;
+        size_t m_executedCount = 0;
+        std::thread::id m_recordThread = std::this_thread::get_id();
+    };
+
+    std::vector<int> Sequence(int count)
+    {
+        std::vector<int> sequence(count);
+        for (int i = 0; i < count; i++)
+        {
+            sequence[i] = i;
+        }
+        return sequence;
+    }
+
+    // One worker per job, every job waits for all later ones to finish, so
+    // recording completes in reverse
+    void TestReverseFinish()
+    {
+        const int jobCount = 4;
+        ParallelRecorder recorder;
+        recorder.Start(jobCount);
+        OrderBackend backend;
+        backend.Reset();
+
+        std::vector<ParallelRecorder::RecordFunc> jobs;
+        for (int i = 0; i < jobCount; i++)
+        {
+            jobs.push_back([&backend, i, jobCount](void*) { backend.WaitFinished(size_t(jobCount - 1 - i)); });
+        }
+        recorder.Record(backend, jobs);
+
+        CHECK((backend.GetFinished() == std::vector<int>{ 3, 2, 1, 0 }));
+        CHECK(backend.GetExecuted() == Sequence(jobCount));
+    }
+
+    // A job that only finishes once the one before it was executed: the
+    // recorder has to execute job N while later jobs are still recording
+    void TestExecuteWhileRecording()
+    {
+        const int jobCount = 3;
+        ParallelRecorder recorder;
+        recorder.Start(2);
+        OrderBackend backend;
+        backend.Reset();
+
+        std::vector<ParallelRecorder::RecordFunc> jobs;
+        for (int i = 0; i < jobCount; i++)
+        {
+            jobs.push_back([&backend, i](void*) { backend.WaitExecuted(size_t(i)); });
+        }
+        recorder.Record(backend, jobs);
+        CHECK(backend.GetExecuted() == Sequence(jobCount));
+    }
+
+    // Random recording times over many frames, more jobs than workers
+    void TestRandomDelays()
+    {
+        const int jobCount = 12;
+        ParallelRecorder recorder;
+        recorder.Start(3);
+        OrderBackend backend;
+        std::mt19937 random(7);
+        std::uniform_int_distribution<int> delay(0, 300);
+
+        bool outOfOrder = false;
+        for (int frame = 0; frame < 40; frame++)
+        {
+            backend.Reset();
+            std::vector<ParallelRecorder::RecordFunc> jobs;
+            for (int i = 0; i < jobCount; i++)
+            {
+                const int microseconds = delay(random);
+                jobs.push_back([microseconds](void*) { std::this_thread::sleep_for(std::chrono::microseconds(microseconds)); });
+            }
+            recorder.Record(backend, jobs);
+            CHECK(backend.GetExecuted() == Sequence(jobCount));
+            CHECK(backend.GetFinished().size() == size_t(jobCount));
+            outOfOrder = outOfOrder || backend.GetFinished() != Sequence(jobCount);
+        }
+        // Not a requirement, only tells whether the run exercised reordering
+        printf("Workers finished out of order: %s\n", outOfOrder ? "yes" : "no");
+    }
+
+    // Without workers the jobs are recorded and executed inline, same contract
+    void TestInline()
+    {
+        ParallelRecorder recorder;
+        CHECK(!recorder.IsStarted());
+        OrderBackend backend;
+        backend.Reset();
+        std::vector<int> recorded;
+        std::vector<ParallelRecorder::RecordFunc> jobs;
+        for (int i = 0; i < 5; i++)
+        {
+            jobs.push_back([&recorded, i](void*) { recorded.push_back(i); });
+        }
+        recorder.Record(backend, jobs);
+        CHECK(recorded == Sequence(5));
+        CHECK(backend.GetFinished() == Sequence(5));
+        CHECK(backend.GetExecuted() == Sequence(5));
+
+        // Started and stopped again falls back to inline recording
+        recorder.Start(2);
+        CHECK(recorder.IsStarted());
+        recorder.Stop();
+        CHECK(!recorder.IsStarted());
+        backend.Reset();
+        recorder.Record(backend, jobs);
+        CHECK(backend.GetExecuted() == Sequence(5));
+    }
+}
+
+int main()
+{
+    TestReverseFinish();
+    TestExecuteWhileRecording();
+    TestRandomDelays();
+    TestInline();
+    return CheckResult();
+}
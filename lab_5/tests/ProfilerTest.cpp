@@ -0,0 +1,340 @@
+// Profiler ring buffers and the Chrome trace: a thread that records more
+// scopes than it holds keeps its pinned first events and the most recent
+// ones in order, and the trace written is valid JSON with every event intact.
+
+#include "../Profiler.h"
+#include "Check.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace
+{
+    const char* const TracePath = "ProfilerTest.json";
+
+    struct JsonValue
+    {
+        enum Type { Null, Bool, Number, String, Array, Object };
+
+        Type type = Null;
+        double number = 0.0;
+        std::string text;
+        std::vector<JsonValue> items;
+        std::vector<std::pair<std::string, JsonValue>> members;
+
+        const JsonValue* Find(const char* key) const
+        {
+            for (const std::pair<std::string, JsonValue>& member : members)
+            {
+                if (member.first == key)
+                    return &member.second;
+            }
+            return nullptr;
+        }
+    };
+
+    // Strict enough for the trace: the whole text must be one value, strings
+    // may not hold raw control characters, \u escapes are read up to 0x7F
+    class JsonParser
+    {
+    public:
+        explicit JsonParser(const std::string& text)
+            : m_text(text)
+        {
+        }
+
+        bool Parse(JsonValue& value)
+        {
+            if (!ParseValue(value))
+                return false;
+            SkipSpace();
+            return m_pos == m_text.size();
+        }
+    private:
+        void SkipSpace()
+        {
+            while (m_pos < m_text.size() && (m_text[m_pos] == ' ' || m_text[m_pos] == '\n' || m_text[m_pos] == '\r' || m_text[m_pos] == '\t'))
+                m_pos++;
+        }
+
+        bool Consume(char c)
+        {
+            SkipSpace();
+            if (m_pos >= m_text.size() || m_text[m_pos] != c)
+                return false;
+            m_pos++;
+            return true;
+        }
+
+        bool ParseString(std::string& result)
+        {
+            if (!Consume('"'))
+                return false;
+            result.clear();
+            while (m_pos < m_text.size())
+            {
+                const unsigned char c = static_cast<unsigned char>(m_text[m_pos++]);
+                if (c == '"')
+                    return true;
+                if (c < 0x20)
+                    return false;
+                if (c != '\\')
+                {
+                    result += char(c);
+                    continue;
+                }
+                if (m_pos >= m_text.size())
+                    return false;
+                const char escape = m_text[m_pos++];
+                if (escape == '"' || escape == '\\' || escape == '/')
+                    result += escape;
+                else if (escape == 'n')
+                    result += '\n';
+                else if (escape == 't')
+                    result += '\t';
+                else if (escape == 'u' && m_pos + 4 <= m_text.size())
+                {
+                    char* pEnd = nullptr;
+                    const std::string digits = m_text.substr(m_pos, 4);
+                    const long code = strtol(digits.c_str(), &pEnd, 16);
+                    if (pEnd != digits.c_str() + 4 || code > 0x7F)
+                        return false;
+                    result += char(code);
+                    m_pos += 4;
+                }
+                else
+                    return false;
+            }
+            return false;
+        }
+
+        bool ParseValue(JsonValue& value)
+        {
+            SkipSpace();
+            if (m_pos >= m_text.size())
+                return false;
+            const char c = m_text[m_pos];
+            if (c == '"')
+            {
+                value.type = JsonValue::String;
+                return ParseString(value.text);
+            }
+            if (c == '{')
+            {
+                value.type = JsonValue::Object;
+                m_pos++;
+                if (Consume('}'))
+                    return true;
+                do
+                {
+                    std::pair<std::string, JsonValue> member;
+                    if (!ParseString(member.first) || !Consume(':') || !ParseValue(member.second))
+                        return false;
+                    value.members.push_back(std::move(member));
+                } while (Consume(','));
+                return Consume('}');
+            }
+            if (c == '[')
+            {
+                value.type = JsonValue::Array;
+                m_pos++;
+                if (Consume(']'))
+                    return true;
+                do
+                {
+                    value.items.push_back(JsonValue());
+                    if (!ParseValue(value.items.back()))
+                        return false;
+                } while (Consume(','));
+                return Consume(']');
+            }
+            const char* literals[3] = { "null", "true", "false" };
+            for (const char* literal : literals)
+            {
+                if (m_text.compare(m_pos, strlen(literal), literal) == 0)
+                {
+                    value.type = literal[0] == 'n' ? JsonValue::Null : JsonValue::Bool;
+                    value.number = literal[0] == 't' ? 1.0 : 0.0;
+                    m_pos += strlen(literal);
+                    return true;
+                }
+            }
+            if (c != '-' && (c < '0' || c > '9'))
+                return false;
+            char* pEnd = nullptr;
+            value.type = JsonValue::Number;
+            value.number = strtod(m_text.c_str() + m_pos, &pEnd);
+            m_pos = size_t(pEnd - m_text.c_str());
+            return true;
+        }
+
+        const std::string& m_text;
+        size_t m_pos = 0;
+    };
+
+    bool ReadTrace(JsonValue& trace)
+    {
+        FILE* pFile = fopen(TracePath, "rb");
+        if (pFile == nullptr)
+            return false;
+        std::string text;
+        char block[4096];
+        size_t read;
+        while ((read = fread(block, 1, sizeof(block), pFile)) > 0)
+            text.append(block, read);
+        fclose(pFile);
+        return JsonParser(text).Parse(trace);
+    }
+
+    struct TraceTrack
+    {
+        std::string name;
+        std::vector<const JsonValue*> events;
+    };
+
+    // Splits the events by tid, checking the fields every event must have
+    std::vector<TraceTrack> GetTracks(const JsonValue& trace)
+    {
+        std::vector<TraceTrack> tracks;
+        const JsonValue* pUnit = trace.Find("displayTimeUnit");
+        const JsonValue* pEvents = trace.Find("traceEvents");
+        CHECK(pUnit != nullptr && pUnit->type == JsonValue::String);
+        CHECK(pEvents != nullptr && pEvents->type == JsonValue::Array);
+        if (pEvents == nullptr)
+            return tracks;
+        for (const JsonValue& event : pEvents->items)
+        {
+            const JsonValue* pName = event.Find("name");
+            const JsonValue* pPhase = event.Find("ph");
+            const JsonValue* pTid = event.Find("tid");
+            const bool valid = pName != nullptr && pName->type == JsonValue::String && pPhase != nullptr
+                && pTid != nullptr && pTid->type == JsonValue::Number && pTid->number >= 1.0;
+            CHECK(valid);
+            if (!valid)
+                continue;
+            const size_t tid = size_t(pTid->number);
+            if (tracks.size() < tid)
+                tracks.resize(tid);
+            TraceTrack& track = tracks[tid - 1];
+            if (pPhase->text == "M")
+            {
+                const JsonValue* pArgs = event.Find("args");
+                const JsonValue* pTrackName = pArgs != nullptr ? pArgs->Find("name") : nullptr;
+                CHECK(pName->text == "thread_name" && pTrackName != nullptr && track.events.empty());
+                if (pTrackName != nullptr)
+                    track.name = pTrackName->text;
+                continue;
+            }
+            const JsonValue* pTs = event.Find("ts");
+            const JsonValue* pDur = event.Find("dur");
+            CHECK(pPhase->text == "X");
+            CHECK(pTs != nullptr && pTs->type == JsonValue::Number && pTs->number >= 0.0);
+            CHECK(pDur != nullptr && pDur->type == JsonValue::Number && pDur->number >= 0.0);
+            if (pTs != nullptr && pDur != nullptr)
+                track.events.push_back(&event);
+        }
+        return tracks;
+    }
+
+    const TraceTrack* FindTrack(const std::vector<TraceTrack>& tracks, const char* name)
+    {
+        for (const TraceTrack& track : tracks)
+        {
+            if (track.name == name)
+                return &track;
+        }
+        return nullptr;
+    }
+
+    // Records Pinned + 2 * Ring + extra scopes with ticks 1000 apart and 500
+    // long, then checks which ones the trace holds
+    void TestWrapAround()
+    {
+        const size_t extra = 1000;
+        const size_t total = Profiler::PinnedCapacity + 2 * Profiler::RingCapacity + extra;
+        // Record keeps the pointers, the names must live until the trace is written
+        std::vector<std::string> names(total);
+        for (size_t i = 0; i < total; i++)
+        {
+            names[i] = "scope " + std::to_string(i);
+        }
+
+        Profiler::SetThreadName("Wrap");
+        const uint64_t base = Profiler::Now();
+        for (size_t i = 0; i < total; i++)
+        {
+            Profiler::Record(names[i].c_str(), base + i * 1000, base + i * 1000 + 500);
+        }
+
+        // A second thread gets its own track under a default name, a registered
+        // track keeps names that need escaping
+        std::thread worker([]()
+        {
+            for (int i = 0; i < 10; i++)
+            {
+                PROFILE_SCOPE("worker");
+            }
+        });
+        worker.join();
+        const int track = Profiler::RegisterTrack("GPU \"queue\" \\ 1");
+        Profiler::RecordOnTrack(track, "pass\tone\n", base, base + 2000);
+
+        const double ticksPerMicrosecond = 1e-6 * Profiler::GetTicksPerSecond();
+        CHECK(Profiler::WriteChromeTrace(TracePath));
+        JsonValue trace;
+        const bool parsed = ReadTrace(trace);
+        remove(TracePath);
+        CHECK(parsed);
+        if (!parsed)
+            return;
+
+        const std::vector<TraceTrack> tracks = GetTracks(trace);
+        CHECK(tracks.size() == 3);
+        const TraceTrack* pWrap = FindTrack(tracks, "Wrap");
+        const TraceTrack* pWorker = FindTrack(tracks, "Thread 2");
+        const TraceTrack* pGpu = FindTrack(tracks, "GPU \"queue\" \\ 1");
+        CHECK(pWrap != nullptr && pWorker != nullptr && pGpu != nullptr);
+        if (pWrap == nullptr || pWorker == nullptr || pGpu == nullptr)
+            return;
+
+        // The pinned events, then the last RingCapacity in recording order
+        CHECK(pWrap->events.size() == Profiler::PinnedCapacity + Profiler::RingCapacity);
+        bool inOrder = pWrap->events.size() == Profiler::PinnedCapacity + Profiler::RingCapacity;
+        for (size_t idx = 0; inOrder && idx < pWrap->events.size(); idx++)
+        {
+            const size_t expected = idx < Profiler::PinnedCapacity ? idx : total - pWrap->events.size() + idx;
+            inOrder = pWrap->events[idx]->Find("name")->text == names[expected];
+            if (idx > 0)
+                inOrder = inOrder && pWrap->events[idx]->Find("ts")->number >= pWrap->events[idx - 1]->Find("ts")->number;
+        }
+        CHECK(inOrder);
+
+        // Times convert at the measured tick rate: 500 ticks long, the span
+        // from the first ring event to the last one in 1000 tick steps
+        if (inOrder)
+        {
+            const double duration = 500.0 / ticksPerMicrosecond;
+            const double span = double(Profiler::RingCapacity - 1) * 1000.0 / ticksPerMicrosecond;
+            const double measuredSpan = pWrap->events.back()->Find("ts")->number
+                - pWrap->events[Profiler::PinnedCapacity]->Find("ts")->number;
+            CHECK(fabs(pWrap->events.back()->Find("dur")->number - duration) <= 0.05 * duration + 0.002);
+            CHECK(fabs(measuredSpan - span) <= 0.05 * span);
+        }
+
+        CHECK(pWorker->events.size() == 10);
+        CHECK(pWorker->events.size() == 10 && pWorker->events[0]->Find("name")->text == "worker");
+        CHECK(pGpu->events.size() == 1 && pGpu->events[0]->Find("name")->text == "pass\tone\n");
+    }
+}
+
+int main()
+{
+    TestWrapAround();
+    return CheckResult();
+}
@@ -0,0 +1,260 @@
+// ResourceRegistry with fake reference counted objects: stale handles, the
+// generation wrap, swap-remove, deferred release and leak reporting.
+
+#include "../ResourceRegistry.h"
+#include "Check.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace
+{
+    // Order objects reached zero references in, by name
+    std::vector<std::string> g_released;
+
+    // Stands in for a COM object: starts with one reference, Release returns the rest
+    struct FakeResource
+    {
+        explicit FakeResource(const char* name) : name(name) {}
+
+        uint32_t AddRef() { return ++refCount; }
+        uint32_t Release()
+        {
+            const uint32_t left = --refCount;
+            if (left == 0)
+                g_released.push_back(name);
+            return left;
+        }
+
+        std::string name;
+        uint32_t refCount = 1;
+    };
+
+    struct FakeTexture : FakeResource
+    {
+        using FakeResource::FakeResource;
+    };
+
+    struct FakeView : FakeResource
+    {
+        using FakeResource::FakeResource;
+    };
+
+    typedef ResourceRegistry<FakeTexture, FakeView> Registry;
+
+    bool WasReleased(const std::string& name)
+    {
+        return std::find(g_released.begin(), g_released.end(), name) != g_released.end();
+    }
+
+    // Copies of a handle stop resolving the moment the object is removed,
+    // deferred or not, and a new object in the same slot doesn't revive them
+    void TestStaleHandles()
+    {
+        g_released.clear();
+        Registry registry(2);
+        FakeTexture deferred("deferred");
+        FakeTexture immediate("immediate");
+        ResourceHandle<FakeTexture> deferredHandle = registry.Add(&deferred, deferred.name.c_str());
+        ResourceHandle<FakeTexture> immediateHandle = registry.Add(&immediate, immediate.name.c_str());
+        const ResourceHandle<FakeTexture> deferredCopy = deferredHandle;
+        const ResourceHandle<FakeTexture> immediateCopy = immediateHandle;
+        CHECK(registry.Get(deferredCopy) == &deferred);
+        CHECK(registry.Get(immediateCopy) == &immediate);
+
+        registry.Destroy(deferredHandle);
+        CHECK(!deferredHandle.IsValid());
+        CHECK(registry.Get(deferredCopy) == nullptr);
+        CHECK(!WasReleased("deferred"));
+        registry.DestroyNow(immediateHandle);
+        CHECK(!immediateHandle.IsValid());
+        CHECK(registry.Get(immediateCopy) == nullptr);
+        CHECK(WasReleased("immediate"));
+
+        // The freed slots are reused with a new generation
+        FakeTexture reused("reused");
+        const ResourceHandle<FakeTexture> reusedHandle = registry.Add(&reused, reused.name.c_str());
+        CHECK(reusedHandle.GetIndex() == immediateCopy.GetIndex() || reusedHandle.GetIndex() == deferredCopy.GetIndex());
+        CHECK(registry.Get(reusedHandle) == &reused);
+        CHECK(registry.Get(deferredCopy) == nullptr);
+        CHECK(registry.Get(immediateCopy) == nullptr);
+
+        // Removing twice through a stale copy does nothing
+        ResourceHandle<FakeTexture> staleCopy = immediateCopy;
+        registry.DestroyNow(staleCopy);
+        CHECK(registry.Get(reusedHandle) == &reused);
+        CHECK(registry.GetLiveCount() == 1);
+
+        // The zero handle and unknown slots never resolve
+        CHECK(registry.Get(ResourceHandle<FakeTexture>()) == nullptr);
+        CHECK(registry.Get(ResourceHandle<FakeTexture>::Make(1000, 1)) == nullptr);
+        CHECK(registry.ReleaseAll().empty());
+        CHECK(WasReleased("deferred") && WasReleased("reused"));
+    }
+
+    // 12 bits of generation: after MaxGeneration removals the slot goes back
+    // to generation 1, never 0
+    void TestGenerationWrap()
+    {
+        g_released.clear();
+        ResourcePool<FakeTexture> pool;
+        std::vector<FakeTexture> objects(ResourceHandle<FakeTexture>::MaxGeneration + 1, FakeTexture("cycled"));
+        ResourceHandle<FakeTexture> first = pool.Add(&objects[0], "cycled");
+        CHECK(first.GetGeneration() == 1);
+        ResourceHandle<FakeTexture> handle = first;
+        for (uint32_t i = 1; i < ResourceHandle<FakeTexture>::MaxGeneration; i++)
+        {
+            CHECK(pool.Release(handle, nullptr));
+            handle = pool.Add(&objects[i], "cycled");
+            CHECK(handle.GetIndex() == first.GetIndex());
+            CHECK(handle.GetGeneration() == i + 1);
+            CHECK(pool.Get(first) == nullptr);
+        }
+        CHECK(handle.GetGeneration() == ResourceHandle<FakeTexture>::MaxGeneration);
+
+        CHECK(pool.Release(handle, nullptr));
+        const ResourceHandle<FakeTexture> wrapped = pool.Add(&objects.back(), "cycled");
+        CHECK(wrapped.GetIndex() == first.GetIndex());
+        CHECK(wrapped.GetGeneration() == 1);
+        CHECK(wrapped.IsValid());
+        CHECK(pool.Get(handle) == nullptr);
+        CHECK(pool.Get(wrapped) == &objects.back());
+        pool.ReleaseAll(nullptr);
+        CHECK(g_released.size() == objects.size());
+    }
+
+    // Removing from the middle moves the last object into the hole; every
+    // other handle keeps resolving to its own object
+    void TestSwapRemove()
+    {
+        g_released.clear();
+        ResourcePool<FakeTexture> pool;
+        std::vector<FakeTexture> objects;
+        for (int i = 0; i < 6; i++)
+        {
+            objects.push_back(FakeTexture(("object" + std::to_string(i)).c_str()));
+        }
+        std::vector<ResourceHandle<FakeTexture>> handles;
+        for (FakeTexture& object : objects)
+        {
+            handles.push_back(pool.Add(&object, object.name.c_str()));
+        }
+
+        const int removeOrder[3] = { 2, 0, 5 };
+        std::vector<bool> removed(objects.size(), false);
+        for (int idx : removeOrder)
+        {
+            CHECK(pool.Release(handles[idx], nullptr));
+            removed[idx] = true;
+            for (size_t i = 0; i < objects.size(); i++)
+            {
+                CHECK(pool.Get(handles[i]) == (removed[i] ? nullptr : &objects[i]));
+            }
+        }
+
+        // The dense array holds exactly the objects left
+        CHECK(pool.GetLiveCount() == 3);
+        std::vector<FakeTexture*> dense(pool.GetObjects(), pool.GetObjects() + pool.GetLiveCount());
+        std::sort(dense.begin(), dense.end());
+        std::vector<FakeTexture*> expected = { &objects[1], &objects[3], &objects[4] };
+        std::sort(expected.begin(), expected.end());
+        CHECK(dense == expected);
+
+        // Names moved with their objects, so a leak is reported under the right one
+        objects[4].AddRef();
+        std::vector<std::string> leaks;
+        pool.Release(handles[4], &leaks);
+        CHECK((leaks == std::vector<std::string>{ "object4" }));
+        pool.ReleaseAll(&leaks);
+        CHECK(leaks.size() == 1);
+        objects[4].Release();
+    }
+
+    // Destroy holds the object for exactly framesInFlight EndFrame calls
+    void TestDeferredRelease()
+    {
+        g_released.clear();
+        const uint32_t framesInFlight = 3;
+        Registry registry(framesInFlight);
+        FakeTexture early("early");
+        FakeTexture late("late");
+        FakeView view("view");
+        ResourceHandle<FakeTexture> earlyHandle = registry.Add(&early, "early");
+        ResourceHandle<FakeTexture> lateHandle = registry.Add(&late, "late");
+        ResourceHandle<FakeView> viewHandle = registry.Add(&view, "view");
+
+        registry.Destroy(earlyHandle);
+        CHECK(registry.GetRetiredCount() == 1);
+        registry.EndFrame();
+        registry.Destroy(lateHandle);
+        registry.Destroy(viewHandle);
+        CHECK(registry.GetRetiredCount() == 3);
+        CHECK(registry.GetLiveCount() == 0);
+
+        for (uint32_t frame = 1; frame < framesInFlight; frame++)
+        {
+            CHECK(!WasReleased("early"));
+            registry.EndFrame();
+        }
+        // Destroyed in frame 0, released as frame 3 begins
+        CHECK(registry.GetFrame() == framesInFlight);
+        CHECK((g_released == std::vector<std::string>{ "early" }));
+        CHECK(registry.GetRetiredCount() == 2);
+
+        registry.EndFrame();
+        CHECK(WasReleased("late") && WasReleased("view"));
+        CHECK(registry.GetRetiredCount() == 0);
+        CHECK(registry.ReleaseAll().empty());
+    }
+
+    // Objects still referenced when the registry lets go are reported by
+    // name, whichever way they were released
+    void TestLeakReporting()
+    {
+        g_released.clear();
+        Registry registry(1);
+        FakeTexture texture("texture");
+        FakeView view("view");
+        FakeTexture heldDeferred("held deferred");
+        FakeTexture heldNow("held now");
+        FakeView heldView("held view");
+        heldDeferred.AddRef();
+        heldNow.AddRef();
+        heldView.AddRef();
+        registry.Add(&texture, "texture");
+        registry.Add(&view, "view");
+        ResourceHandle<FakeTexture> deferredHandle = registry.Add(&heldDeferred, "held deferred");
+        ResourceHandle<FakeTexture> nowHandle = registry.Add(&heldNow, "held now");
+        registry.Add(&heldView, "held view");
+
+        registry.Destroy(deferredHandle);
+        registry.DestroyNow(nowHandle);
+        registry.EndFrame();
+        const std::vector<std::string> leaks = registry.ReleaseAll();
+        CHECK((leaks == std::vector<std::string>{ "held now", "held deferred", "held view" }));
+        CHECK(registry.GetLiveCount() == 0);
+
+        // Views go before the textures they were made from
+        const auto viewReleased = std::find(g_released.begin(), g_released.end(), "view");
+        const auto textureReleased = std::find(g_released.begin(), g_released.end(), "texture");
+        CHECK(viewReleased != g_released.end() && textureReleased != g_released.end());
+        CHECK(viewReleased < textureReleased);
+
+        // The leak list was handed over, a second call starts empty
+        CHECK(registry.ReleaseAll().empty());
+        heldDeferred.Release();
+        heldNow.Release();
+        heldView.Release();
+    }
+}
+
+int main()
+{
+    TestStaleHandles();
+    TestGenerationWrap();
+    TestSwapRemove();
+    TestDeferredRelease();
+    TestLeakReporting();
+    return CheckResult();
+}
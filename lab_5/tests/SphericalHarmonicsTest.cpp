@@ -0,0 +1,347 @@
+// ProjectCubemapSh and ShRadianceToIrradiance against irradiance known in
+// closed form and integrated texel by texel, and the SH cache refusing files
+// that are truncated, damaged or made from other faces.
+
+#include "../SphericalHarmonics.h"
+#include "../WorkerPool.h"
+#include "Check.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace
+{
+    const double Pi = 3.14159265358979;
+    // 96 rows make two bands of a face, one of them short
+    const uint32_t FaceSize = 96;
+    const char* const CachePath = "SphericalHarmonicsTest.bin";
+
+    typedef void (*RadianceFunction)(const double direction[3], double rgb[3]);
+
+    struct TestCubemap
+    {
+        std::vector<uint8_t> texels[6];
+        CubemapFaces faces;
+    };
+
+    void Normalize(double v[3])
+    {
+        const double length = sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+        v[0] /= length;
+        v[1] /= length;
+        v[2] /= length;
+    }
+
+    void GetTexelDirection(uint32_t face, uint32_t x, uint32_t y, double direction[3])
+    {
+        float unnormalized[3];
+        GetCubemapDirection(face, (float(x) + 0.5f) / float(FaceSize) * 2.0f - 1.0f, (float(y) + 0.5f) / float(FaceSize) * 2.0f - 1.0f, unnormalized);
+        for (int axis = 0; axis < 3; axis++)
+        {
+            direction[axis] = unnormalized[axis];
+        }
+        Normalize(direction);
+    }
+
+    // RGBA8 faces with the radiance at every texel center, rounded
+    void MakeCubemap(RadianceFunction radiance, TestCubemap& cubemap)
+    {
+        for (uint32_t face = 0; face < 6; face++)
+        {
+            std::vector<uint8_t>& texels = cubemap.texels[face];
+            texels.resize(size_t(FaceSize) * FaceSize * 4);
+            for (uint32_t y = 0; y < FaceSize; y++)
+            {
+                for (uint32_t x = 0; x < FaceSize; x++)
+                {
+                    double direction[3];
+                    double rgb[3];
+                    GetTexelDirection(face, x, y, direction);
+                    radiance(direction, rgb);
+                    uint8_t* pTexel = &texels[(size_t(y) * FaceSize + x) * 4];
+                    for (int channel = 0; channel < 3; channel++)
+                    {
+                        pTexel[channel] = uint8_t(lround(rgb[channel] * 255.0));
+                    }
+                    pTexel[3] = 255;
+                }
+            }
+            cubemap.faces.pFaces[face] = texels.data();
+        }
+        cubemap.faces.size = FaceSize;
+        cubemap.faces.format = CubemapFormatRGBA8;
+    }
+
+    double GetAreaElement(double x, double y)
+    {
+        return atan2(x * y, sqrt(x * x + y * y + 1.0));
+    }
+
+    // Reflected radiance off a white diffuse surface, E(n) / pi, summed over
+    // the texels as stored with their exact solid angles
+    void IntegrateIrradiance(const TestCubemap& cubemap, const double normal[3], double rgb[3])
+    {
+        rgb[0] = rgb[1] = rgb[2] = 0.0;
+        const double texelSize = 2.0 / FaceSize;
+        for (uint32_t face = 0; face < 6; face++)
+        {
+            for (uint32_t y = 0; y < FaceSize; y++)
+            {
+                for (uint32_t x = 0; x < FaceSize; x++)
+                {
+                    double direction[3];
+                    GetTexelDirection(face, x, y, direction);
+                    const double cosine = direction[0] * normal[0] + direction[1] * normal[1] + direction[2] * normal[2];
+                    if (cosine <= 0.0)
+                        continue;
+                    const double u0 = x * texelSize - 1.0;
+                    const double v0 = y * texelSize - 1.0;
+                    const double solidAngle = GetAreaElement(u0, v0) - GetAreaElement(u0 + texelSize, v0)
+                        - GetAreaElement(u0, v0 + texelSize) + GetAreaElement(u0 + texelSize, v0 + texelSize);
+                    const uint8_t* pTexel = &cubemap.texels[face][(size_t(y) * FaceSize + x) * 4];
+                    for (int channel = 0; channel < 3; channel++)
+                    {
+                        rgb[channel] += pTexel[channel] / 255.0 * cosine * solidAngle / Pi;
+                    }
+                }
+            }
+        }
+    }
+
+    // Axes, diagonals and random directions
+    std::vector<std::vector<double>> GetNormals()
+    {
+        std::vector<std::vector<double>> normals;
+        for (int x = -1; x <= 1; x++)
+        {
+            for (int y = -1; y <= 1; y++)
+            {
+                for (int z = -1; z <= 1; z++)
+                {
+                    if (x == 0 && y == 0 && z == 0)
+                        continue;
+                    double n[3] = { double(x), double(y), double(z) };
+                    Normalize(n);
+                    normals.push_back(std::vector<double>(n, n + 3));
+                }
+            }
+        }
+        std::mt19937 random(48);
+        std::normal_distribution<double> gaussian;
+        for (int i = 0; i < 64; i++)
+        {
+            double n[3] = { gaussian(random), gaussian(random), gaussian(random) };
+            Normalize(n);
+            normals.push_back(std::vector<double>(n, n + 3));
+        }
+        return normals;
+    }
+
+    void ComputeIrradiance(const TestCubemap& cubemap, ShCoefficients& irradiance)
+    {
+        ShCoefficients radiance;
+        ProjectCubemapSh(cubemap.faces, radiance);
+        ShRadianceToIrradiance(radiance, irradiance);
+    }
+
+    // Largest difference over the normals between the SH result and reference
+    double GetMaxError(const ShCoefficients& irradiance, void (*reference)(const double normal[3], double rgb[3]))
+    {
+        double maxError = 0.0;
+        for (const std::vector<double>& normal : GetNormals())
+        {
+            const float n[3] = { float(normal[0]), float(normal[1]), float(normal[2]) };
+            float rgb[3];
+            double expected[3];
+            EvaluateShIrradiance(irradiance, n, rgb);
+            reference(normal.data(), expected);
+            for (int channel = 0; channel < 3; channel++)
+            {
+                maxError = fmax(maxError, fabs(rgb[channel] - expected[channel]));
+            }
+        }
+        return maxError;
+    }
+
+    const double LobeAxis[3] = { 0.48, 0.6, -0.64 };
+
+    double Dot(const double* a, const double* b)
+    {
+        return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+    }
+
+    void UniformRadiance(const double*, double rgb[3])
+    {
+        rgb[0] = 0.25;
+        rgb[1] = 0.5;
+        rgb[2] = 1.0;
+    }
+
+    // The sky is the same in every direction, so is the light on any surface
+    void TestUniform()
+    {
+        TestCubemap cubemap;
+        MakeCubemap(UniformRadiance, cubemap);
+        ShCoefficients irradiance;
+        ComputeIrradiance(cubemap, irradiance);
+        // Stored values: 64, 128 and 255 over 255
+        const double error = GetMaxError(irradiance, [](const double*, double rgb[3])
+        {
+            rgb[0] = 64.0 / 255.0;
+            rgb[1] = 128.0 / 255.0;
+            rgb[2] = 1.0;
+        });
+        CHECK(error < 1e-4);
+        bool higherBandsZero = true;
+        for (int k = 1; k < 9; k++)
+        {
+            higherBandsZero = higherBandsZero && fabs(irradiance.c[k][0]) + fabs(irradiance.c[k][1]) + fabs(irradiance.c[k][2]) < 1e-4;
+        }
+        CHECK(higherBandsZero);
+    }
+
+    // Radiance in bands 1 and 2 only, where the cosine convolution is exact:
+    // a + b (w.d) reflects a + 2/3 b (n.d), (w.d)^2 reflects 1/3 + (3 (n.d)^2 - 1) / 12
+    void PolynomialRadiance(const double* direction, double rgb[3])
+    {
+        const double cosine = Dot(direction, LobeAxis);
+        rgb[0] = 0.5 + 0.5 * cosine;
+        rgb[1] = cosine * cosine;
+        rgb[2] = 0.0;
+    }
+
+    void TestPolynomial()
+    {
+        TestCubemap cubemap;
+        MakeCubemap(PolynomialRadiance, cubemap);
+        ShCoefficients irradiance;
+        ComputeIrradiance(cubemap, irradiance);
+        // Rounding to 8 bits moves a texel by 1/510 at most and averages out over the sphere,
+        // the sums come within 2e-5
+        const double error = GetMaxError(irradiance, [](const double* normal, double rgb[3])
+        {
+            const double cosine = Dot(normal, LobeAxis);
+            rgb[0] = 0.5 + 0.5 * 2.0 / 3.0 * cosine;
+            rgb[1] = 1.0 / 3.0 + (3.0 * cosine * cosine - 1.0) / 12.0;
+            rgb[2] = 0.0;
+        });
+        CHECK(error < 2e-4);
+    }
+
+    // One clamped cosine lobe of light: L2 can't hold it exactly, but the
+    // bands it drops are nearly filtered out by the cosine already
+    void LobeRadiance(const double* direction, double rgb[3])
+    {
+        const double cosine = Dot(direction, LobeAxis);
+        rgb[0] = cosine > 0.0 ? cosine : 0.0;
+        rgb[1] = cosine > 0.0 ? cosine * cosine * cosine * cosine : 0.0;
+        rgb[2] = 0.0;
+    }
+
+    const TestCubemap* g_pLobeCubemap = nullptr;
+
+    void TestLobe()
+    {
+        TestCubemap cubemap;
+        MakeCubemap(LobeRadiance, cubemap);
+        ShCoefficients irradiance;
+        ComputeIrradiance(cubemap, irradiance);
+        g_pLobeCubemap = &cubemap;
+        // The reference peaks at 2/3 and 1/3 facing the lobe; what L2 drops
+        // comes to under 0.005 of it
+        const double error = GetMaxError(irradiance, [](const double* normal, double rgb[3])
+        {
+            IntegrateIrradiance(*g_pLobeCubemap, normal, rgb);
+        });
+        CHECK(error < 0.01);
+
+        // Threads split the work by bands and the sums go back in band order
+        WorkerPool pool(4);
+        ShCoefficients serial;
+        ShCoefficients parallel;
+        ProjectCubemapSh(cubemap.faces, serial);
+        ProjectCubemapSh(cubemap.faces, parallel, &pool);
+        CHECK(memcmp(&serial, &parallel, sizeof(ShCoefficients)) == 0);
+    }
+
+    bool WriteFileBytes(const std::vector<uint8_t>& bytes)
+    {
+        FILE* pFile = fopen(CachePath, "wb");
+        if (pFile == nullptr)
+            return false;
+        const bool written = bytes.empty() || fwrite(bytes.data(), 1, bytes.size(), pFile) == bytes.size();
+        return fclose(pFile) == 0 && written;
+    }
+
+    bool ReadFileBytes(std::vector<uint8_t>& bytes)
+    {
+        FILE* pFile = fopen(CachePath, "rb");
+        if (pFile == nullptr)
+            return false;
+        uint8_t block[256];
+        size_t read;
+        bytes.clear();
+        while ((read = fread(block, 1, sizeof(block), pFile)) > 0)
+            bytes.insert(bytes.end(), block, block + read);
+        fclose(pFile);
+        return true;
+    }
+
+    // Reads the cache, checking that a refused file leaves the coefficients alone
+    bool ReadsAs(uint64_t hash, const ShCoefficients& expected)
+    {
+        ShCoefficients read;
+        memset(&read, 0xCD, sizeof(read));
+        const ShCoefficients untouched = read;
+        if (ReadShCache(CachePath, hash, read))
+            return memcmp(&read, &expected, sizeof(read)) == 0;
+        CHECK(memcmp(&read, &untouched, sizeof(read)) == 0);
+        return false;
+    }
+
+    void TestCache()
+    {
+        TestCubemap cubemap;
+        MakeCubemap(LobeRadiance, cubemap);
+        const uint64_t hash = HashCubemapFaces(cubemap.faces);
+        ShCoefficients irradiance;
+        ComputeIrradiance(cubemap, irradiance);
+
+        remove(CachePath);
+        CHECK(!ReadsAs(hash, irradiance));
+        CHECK(WriteShCache(CachePath, hash, irradiance));
+        CHECK(ReadsAs(hash, irradiance));
+
+        // Faces that changed by one texel hash differently
+        cubemap.texels[3][100] ^= 1;
+        const uint64_t otherHash = HashCubemapFaces(cubemap.faces);
+        CHECK(otherHash != hash);
+        CHECK(!ReadsAs(otherHash, irradiance));
+
+        std::vector<uint8_t> bytes;
+        CHECK(ReadFileBytes(bytes) && !bytes.empty());
+        std::vector<uint8_t> truncated(bytes.begin(), bytes.end() - 1);
+        CHECK(WriteFileBytes(truncated) && !ReadsAs(hash, irradiance));
+        CHECK(WriteFileBytes(std::vector<uint8_t>()) && !ReadsAs(hash, irradiance));
+        // Magic, then version
+        for (size_t offset : { size_t(0), size_t(4) })
+        {
+            std::vector<uint8_t> damaged = bytes;
+            damaged[offset] ^= 0x10;
+            CHECK(WriteFileBytes(damaged) && !ReadsAs(hash, irradiance));
+        }
+        remove(CachePath);
+    }
+}
+
+int main()
+{
+    TestUniform();
+    TestPolynomial();
+    TestLobe();
+    TestCache();
+    return CheckResult();
+}
@@ -0,0 +1,216 @@
+// Build, refit and query timings of the BVH over random boxes, with every
+// query checked against brute force, built on its own next to the renderer:
+//   g++ -std=c++14 -O2 -I.. BvhBenchmark.cpp ../Bvh.cpp ../FrustumCulling.cpp -o BvhBenchmark
+// or as the BvhBenchmark target of lab_5/CMakeLists.txt.
+//
+//   BvhBenchmark [objects] [queries]
+// Boxes of 0.5 to 5 units fill a 1000 unit cube. Query times are averaged
+// over [queries] random frusta, spheres and rays.
+
+#include "../Bvh.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+namespace
+{
+    double MillisecondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Left handed perspective for row vectors, camera at eye turned by yaw
+    void MakeViewProj(const float eye[3], float yaw, float viewProj[16])
+    {
+        const float nearZ = 0.1f;
+        const float farZ = 300.0f;
+        const float yScale = 1.0f / tanf(0.5f * 1.0471976f);
+        const float xScale = yScale / (16.0f / 9.0f);
+        const float zScale = farZ / (farZ - nearZ);
+        const float c = cosf(yaw);
+        const float s = sinf(yaw);
+        // Rows of the inverse rotation, then the translation by -eye
+        const float view[16] = {
+            c, 0.0f, s, 0.0f,
+            0.0f, 1.0f, 0.0f, 0.0f,
+            -s, 0.0f, c, 0.0f,
+            -(eye[0] * c - eye[2] * s), -eye[1], -(eye[0] * s + eye[2] * c), 1.0f };
+        const float projection[16] = {
+            xScale, 0.0f, 0.0f, 0.0f,
+            0.0f, yScale, 0.0f, 0.0f,
+            0.0f, 0.0f, zScale, 1.0f,
+            0.0f, 0.0f, -nearZ * zScale, 0.0f };
+        for (int row = 0; row < 4; row++)
+        {
+            for (int column = 0; column < 4; column++)
+            {
+                float sum = 0.0f;
+                for (int k = 0; k < 4; k++)
+                {
+                    sum += view[row * 4 + k] * projection[k * 4 + column];
+                }
+                viewProj[row * 4 + column] = sum;
+            }
+        }
+    }
+
+    bool BoxInFrustum(const BvhAabb& box, const FrustumPlanes& planes)
+    {
+        const float c[3] = { (box.min[0] + box.max[0]) * 0.5f, (box.min[1] + box.max[1]) * 0.5f, (box.min[2] + box.max[2]) * 0.5f };
+        const float e[3] = { (box.max[0] - box.min[0]) * 0.5f, (box.max[1] - box.min[1]) * 0.5f, (box.max[2] - box.min[2]) * 0.5f };
+        for (int p = 0; p < 6; p++)
+        {
+            const float dist = planes.nx[p] * c[0] + planes.ny[p] * c[1] + planes.nz[p] * c[2] + planes.d[p];
+            const float reach = fabsf(planes.nx[p]) * e[0] + fabsf(planes.ny[p]) * e[1] + fabsf(planes.nz[p]) * e[2];
+            if (dist + reach < 0.0f)
+                return false;
+        }
+        return true;
+    }
+
+    bool BoxInSphere(const BvhAabb& box, const float center[3], float radius)
+    {
+        float distSq = 0.0f;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            const float v = std::max(box.min[axis] - center[axis], std::max(0.0f, center[axis] - box.max[axis]));
+            distSq += v * v;
+        }
+        return distSq <= radius * radius;
+    }
+
+    float RayBox(const BvhAabb& box, const float origin[3], const float dir[3], float maxT)
+    {
+        float tMin = 0.0f;
+        float tMax = maxT;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            const float invDir = dir[axis] != 0.0f ? 1.0f / dir[axis] : FLT_MAX;
+            float t0 = (box.min[axis] - origin[axis]) * invDir;
+            float t1 = (box.max[axis] - origin[axis]) * invDir;
+            if (t0 > t1)
+                std::swap(t0, t1);
+            tMin = std::max(tMin, t0);
+            tMax = std::min(tMax, t1);
+        }
+        return tMin <= tMax ? tMin : FLT_MAX;
+    }
+
+    bool SameObjects(std::vector<uint32_t> a, std::vector<uint32_t> b)
+    {
+        std::sort(a.begin(), a.end());
+        std::sort(b.begin(), b.end());
+        return a == b;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const size_t count = argc > 1 ? size_t(std::max(1, atoi(argv[1]))) : 1000000;
+    const int queries = argc > 2 ? std::max(1, atoi(argv[2])) : 20;
+
+    std::mt19937 random(30);
+    std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+    std::uniform_real_distribution<float> size(0.5f, 5.0f);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    std::vector<BvhAabb> bounds(count);
+    for (BvhAabb& box : bounds)
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            box.min[axis] = position(random);
+            box.max[axis] = box.min[axis] + size(random);
+        }
+    }
+
+    Bvh bvh;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    bvh.Build(bounds);
+    const double buildTime = MillisecondsSince(start);
+
+    // Every object drifts by up to a unit, the topology stays
+    for (BvhAabb& box : bounds)
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            const float offset = unit(random);
+            box.min[axis] += offset;
+            box.max[axis] += offset;
+        }
+    }
+    start = std::chrono::steady_clock::now();
+    bvh.Refit(bounds);
+    const double refitTime = MillisecondsSince(start);
+    printf("%zu objects, %zu nodes: build %.1f ms, refit %.2f ms\n", count, bvh.GetNodeCount(), buildTime, refitTime);
+
+    double frustumTime = 0.0;
+    double sphereTime = 0.0;
+    double rayTime = 0.0;
+    double bruteTime = 0.0;
+    size_t frustumHits = 0;
+    size_t sphereHits = 0;
+    int rayHits = 0;
+    int mismatches = 0;
+    std::vector<uint32_t> result;
+    std::vector<uint32_t> reference;
+    for (int query = 0; query < queries; query++)
+    {
+        const float eye[3] = { position(random), position(random), position(random) };
+        float viewProj[16];
+        MakeViewProj(eye, 3.14159265f * unit(random), viewProj);
+        FrustumPlanes planes;
+        ExtractFrustumPlanes(viewProj, planes);
+        start = std::chrono::steady_clock::now();
+        bvh.QueryFrustum(planes, result);
+        frustumTime += MillisecondsSince(start);
+        frustumHits += result.size();
+        start = std::chrono::steady_clock::now();
+        reference.clear();
+        for (uint32_t i = 0; i < uint32_t(count); i++)
+        {
+            if (BoxInFrustum(bounds[i], planes))
+                reference.push_back(i);
+        }
+        bruteTime += MillisecondsSince(start);
+        mismatches += SameObjects(result, reference) ? 0 : 1;
+
+        const float radius = 20.0f;
+        start = std::chrono::steady_clock::now();
+        bvh.QuerySphere(eye, radius, result);
+        sphereTime += MillisecondsSince(start);
+        sphereHits += result.size();
+        reference.clear();
+        for (uint32_t i = 0; i < uint32_t(count); i++)
+        {
+            if (BoxInSphere(bounds[i], eye, radius))
+                reference.push_back(i);
+        }
+        mismatches += SameObjects(result, reference) ? 0 : 1;
+
+        const float dir[3] = { unit(random), unit(random), unit(random) };
+        uint32_t object = 0;
+        float t = 0.0f;
+        start = std::chrono::steady_clock::now();
+        const bool hit = bvh.QueryRay(eye, dir, 2000.0f, object, t);
+        rayTime += MillisecondsSince(start);
+        float closest = FLT_MAX;
+        for (uint32_t i = 0; i < uint32_t(count); i++)
+        {
+            closest = std::min(closest, RayBox(bounds[i], eye, dir, 2000.0f));
+        }
+        rayHits += hit ? 1 : 0;
+        mismatches += hit == (closest != FLT_MAX) && (!hit || t == closest) ? 0 : 1;
+    }
+
+    printf("per query: frustum %.3f ms (%zu objects avg, brute force %.2f ms), sphere %.3f ms (%zu objects avg), "
+        "ray %.3f ms (%d of %d hit)\n", frustumTime / queries, frustumHits / queries, bruteTime / queries,
+        sphereTime / queries, sphereHits / queries, rayTime / queries, rayHits, queries);
+    printf("%d queries differ from brute force\n", mismatches);
+    return mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,155 @@
+// Frustum culling of random spheres and boxes against a scalar reference,
+// built on its own next to the renderer:
+//   g++ -std=c++14 -O2 -I.. CullingBenchmark.cpp ../FrustumCulling.cpp -o CullingBenchmark
+// or as the CullingBenchmark target of lab_5/CMakeLists.txt. Add -mavx to
+// time the 8 wide path, the default build runs the SSE one.
+//
+//   CullingBenchmark [objects] [repeats]
+// Objects are scattered in a 1000 unit cube around a 60 degree camera with
+// a 1000 unit far plane; the best of the repeats is reported.
+
+#include "../FrustumCulling.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+namespace
+{
+    double MillisecondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Left handed perspective for row vectors with the camera turned a bit
+    // off the axes, so no plane is axis aligned
+    void MakeViewProj(float viewProj[16])
+    {
+        const float nearZ = 0.1f;
+        const float farZ = 1000.0f;
+        const float yScale = 1.0f / tanf(0.5f * 1.0471976f);
+        const float xScale = yScale / (16.0f / 9.0f);
+        const float zScale = farZ / (farZ - nearZ);
+        const float projection[16] = {
+            xScale, 0.0f, 0.0f, 0.0f,
+            0.0f, yScale, 0.0f, 0.0f,
+            0.0f, 0.0f, zScale, 1.0f,
+            0.0f, 0.0f, -nearZ * zScale, 0.0f };
+        const float yaw = 0.6f;
+        const float view[16] = {
+            cosf(yaw), 0.0f, sinf(yaw), 0.0f,
+            0.0f, 1.0f, 0.0f, 0.0f,
+            -sinf(yaw), 0.0f, cosf(yaw), 0.0f,
+            0.0f, 0.0f, 0.0f, 1.0f };
+        for (int row = 0; row < 4; row++)
+        {
+            for (int column = 0; column < 4; column++)
+            {
+                float sum = 0.0f;
+                for (int k = 0; k < 4; k++)
+                {
+                    sum += view[row * 4 + k] * projection[k * 4 + column];
+                }
+                viewProj[row * 4 + column] = sum;
+            }
+        }
+    }
+
+    // Same operations in the same order as the SIMD lanes, so results match exactly
+    float PlaneDistance(const FrustumPlanes& planes, int p, float x, float y, float z)
+    {
+        float dist = x * planes.nx[p] + planes.d[p];
+        dist = dist + y * planes.ny[p];
+        return dist + z * planes.nz[p];
+    }
+
+    void CullReference(const FrustumPlanes& planes, const CullingBounds& bounds, bool boxes, std::vector<uint32_t>& visible)
+    {
+        visible.clear();
+        for (size_t i = 0; i < bounds.GetSize(); i++)
+        {
+            bool inside = true;
+            for (int p = 0; p < 6; p++)
+            {
+                const float dist = PlaneDistance(planes, p, bounds.GetCenterX()[i], bounds.GetCenterY()[i], bounds.GetCenterZ()[i]);
+                float reach = bounds.GetRadius()[i];
+                if (boxes)
+                {
+                    reach = bounds.GetExtentX()[i] * fabsf(planes.nx[p]);
+                    reach = reach + bounds.GetExtentY()[i] * fabsf(planes.ny[p]);
+                    reach = reach + bounds.GetExtentZ()[i] * fabsf(planes.nz[p]);
+                }
+                inside = inside && dist + reach >= 0.0f;
+            }
+            if (inside)
+                visible.push_back(uint32_t(i));
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const size_t count = argc > 1 ? size_t(std::max(1, atoi(argv[1]))) : 1000000;
+    const int repeats = argc > 2 ? std::max(1, atoi(argv[2])) : 10;
+
+    float viewProj[16];
+    MakeViewProj(viewProj);
+    FrustumPlanes planes;
+    ExtractFrustumPlanes(viewProj, planes);
+
+    std::mt19937 random(29);
+    std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+    std::uniform_real_distribution<float> size(0.5f, 5.0f);
+    CullingBounds spheres;
+    CullingBounds boxes;
+    spheres.Resize(count);
+    boxes.Resize(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        const float x = position(random);
+        const float y = position(random);
+        const float z = position(random);
+        spheres.SetSphere(i, x, y, z, size(random));
+        boxes.SetAabb(i, x, y, z, x + size(random), y + size(random), z + size(random));
+    }
+
+#ifdef __AVX__
+    const char* path = "AVX";
+#else
+    const char* path = "SSE";
+#endif
+    printf("%zu objects, %s path, best of %d\n", count, path, repeats);
+
+    std::vector<uint32_t> visible;
+    std::vector<uint32_t> reference;
+    for (int test = 0; test < 2; test++)
+    {
+        const bool testBoxes = test == 1;
+        const CullingBounds& bounds = testBoxes ? boxes : spheres;
+        double simdTime = 1e30;
+        double scalarTime = 1e30;
+        for (int repeat = 0; repeat < repeats; repeat++)
+        {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            if (testBoxes)
+                CullAabbs(planes, bounds, visible);
+            else
+                CullSpheres(planes, bounds, visible);
+            simdTime = std::min(simdTime, MillisecondsSince(start));
+
+            start = std::chrono::steady_clock::now();
+            CullReference(planes, bounds, testBoxes, reference);
+            scalarTime = std::min(scalarTime, MillisecondsSince(start));
+        }
+        const bool match = visible == reference;
+        printf("  %-7s %8.3f ms, scalar %8.3f ms, %zu visible%s\n", testBoxes ? "boxes" : "spheres", simdTime,
+            scalarTime, visible.size(), match ? "" : "  MISMATCH");
+        if (!match)
+            return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,101 @@
+// Headless run of FramePacer at fixed targets: reports the frame interval,
+// percentiles of its deviation from the target and the CPU time the process
+// used against wall time. Built on its own next to the renderer:
+//   g++ -std=c++14 -O2 -I.. FramePacerHarness.cpp ../FramePacer.cpp -o FramePacerHarness
+// or as the FramePacerHarness target of lab_5/CMakeLists.txt.
+//
+//   FramePacerHarness [fps] [seconds] [work_ms]
+// Without fps it runs 60, 144 and 240 fps in turn. Every frame busy-waits for
+// work_ms (default 1 ms) to stand in for simulation and rendering.
+
+#include "../FramePacer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <vector>
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    double Percentile(const std::vector<double>& sorted, double fraction)
+    {
+        const size_t idx = size_t(fraction * double(sorted.size() - 1) + 0.5);
+        return sorted[std::min(idx, sorted.size() - 1)];
+    }
+
+    void RunTarget(double fps, double seconds, double workMs)
+    {
+        FramePacer pacer;
+        pacer.SetTargetFps(fps);
+        const int frameCount = std::max(2, int(fps * seconds));
+        std::vector<double> intervals;
+        intervals.reserve(frameCount);
+
+        const std::clock_t cpuStart = std::clock();
+        const Clock::time_point wallStart = Clock::now();
+        Clock::time_point lastStart;
+        for (int frame = 0; frame < frameCount; frame++)
+        {
+            pacer.WaitForNextFrame();
+            const Clock::time_point frameStart = Clock::now();
+            if (frame > 0)
+            {
+                intervals.push_back(std::chrono::duration<double, std::milli>(frameStart - lastStart).count());
+            }
+            lastStart = frameStart;
+            while (std::chrono::duration<double, std::milli>(Clock::now() - frameStart).count() < workMs)
+            {
+            }
+        }
+        const double wall = std::chrono::duration<double>(Clock::now() - wallStart).count();
+        const double cpu = double(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+
+        const double target = 1000.0 / fps;
+        double sum = 0.0;
+        std::vector<double> deviations;
+        for (double interval : intervals)
+        {
+            sum += interval;
+            deviations.push_back(fabs(interval - target));
+        }
+        std::sort(deviations.begin(), deviations.end());
+        const FramePacingStats stats = pacer.GetStats();
+        printf("%.0f fps, %d frames: interval %.3f ms (target %.3f), jitter %.3f ms\n", fps, frameCount,
+            sum / intervals.size(), target, stats.jitter * 1000.0);
+        printf("  |interval - target| p50 %.3f, p90 %.3f, p99 %.3f, p99.9 %.3f, max %.3f ms\n",
+            Percentile(deviations, 0.5), Percentile(deviations, 0.9), Percentile(deviations, 0.99),
+            Percentile(deviations, 0.999), deviations.back());
+        printf("  CPU %.3f s of %.3f s wall (%.0f%%, work alone %.0f%%), slept %.3f s, spun %.3f s, latest %.3f ms\n",
+            cpu, wall, 100.0 * cpu / wall, 100.0 * workMs / target, stats.sleepTime, stats.spinTime,
+            stats.maxLateness * 1000.0);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const double fps = argc > 1 ? atof(argv[1]) : 0.0;
+    const double seconds = argc > 2 ? atof(argv[2]) : 2.0;
+    const double workMs = argc > 3 ? atof(argv[3]) : 1.0;
+    if (argc > 4 || fps < 0.0 || seconds <= 0.0 || workMs < 0.0)
+    {
+        printf("Usage: FramePacerHarness [fps] [seconds] [work_ms]\n");
+        return 1;
+    }
+
+    if (fps > 0.0)
+    {
+        RunTarget(fps, seconds, workMs);
+        return 0;
+    }
+    const double targets[3] = { 60.0, 144.0, 240.0 };
+    for (double target : targets)
+    {
+        RunTarget(target, seconds, workMs);
+    }
+    return 0;
+}
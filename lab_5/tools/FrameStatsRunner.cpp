@@ -0,0 +1,147 @@
+// Headless stand-in for the render loop that feeds FrameStats the way the
+// renderer does and writes the same CSV, so the statistics path can be run
+// and compared on machines without a device. Built on its own next to the renderer:
+//   g++ -std=c++14 -O2 -I.. FrameStatsRunner.cpp ../FrameStats.cpp ../FrustumCulling.cpp ../DrawQueue.cpp
+//       -o FrameStatsRunner
+// or as the FrameStatsRunner target of lab_5/CMakeLists.txt.
+//
+//   FrameStatsRunner [output.csv] [frames] [objects]
+// Every frame turns the camera, culls the objects against the frustum, sorts
+// the visible ones through a DrawQueue and walks the queue counting draws,
+// state changes and constant uploads like SubmitDrawQueue.
+
+#include "../DrawQueue.h"
+#include "../FrameStats.h"
+#include "../FrustumCulling.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+namespace
+{
+    // Size of SceneBuffer, one world matrix per draw
+    const uint64_t SceneBufferBytes = 64;
+
+    // Left handed perspective for row vectors, camera at the origin turned by yaw
+    void MakeViewProj(float yaw, float viewProj[16])
+    {
+        const float nearZ = 0.1f;
+        const float farZ = 500.0f;
+        const float yScale = 1.0f / tanf(0.5f * 1.0471976f);
+        const float xScale = yScale / (16.0f / 9.0f);
+        const float zScale = farZ / (farZ - nearZ);
+        const float c = cosf(yaw);
+        const float s = sinf(yaw);
+        // Inverse rotation of the camera times the projection, written out
+        const float view[16] = { c, 0.0f, s, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, -s, 0.0f, c, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f };
+        const float projection[16] = { xScale, 0.0f, 0.0f, 0.0f, 0.0f, yScale, 0.0f, 0.0f, 0.0f, 0.0f, zScale, 1.0f,
+            0.0f, 0.0f, -nearZ * zScale, 0.0f };
+        for (int row = 0; row < 4; row++)
+        {
+            for (int column = 0; column < 4; column++)
+            {
+                float sum = 0.0f;
+                for (int k = 0; k < 4; k++)
+                {
+                    sum += view[row * 4 + k] * projection[k * 4 + column];
+                }
+                viewProj[row * 4 + column] = sum;
+            }
+        }
+    }
+
+    double ExactPercentile(const std::vector<double>& sorted, double p)
+    {
+        return sorted[std::min(sorted.size() - 1, size_t(p * double(sorted.size())))];
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const char* path = argc > 1 ? argv[1] : "frame_stats.csv";
+    const int frames = argc > 2 ? std::max(1, atoi(argv[2])) : 2000;
+    const size_t objectCount = argc > 3 ? size_t(std::max(1, atoi(argv[3]))) : 20000;
+    if (argc > 4)
+    {
+        printf("Usage: FrameStatsRunner [output.csv] [frames] [objects]\n");
+        return 1;
+    }
+
+    std::mt19937 random(39);
+    std::uniform_real_distribution<float> position(-300.0f, 300.0f);
+    std::uniform_int_distribution<uint32_t> shader(0, 7);
+    std::uniform_int_distribution<uint32_t> texture(0, 31);
+    CullingBounds bounds;
+    bounds.Resize(objectCount);
+    std::vector<uint32_t> shaders(objectCount);
+    std::vector<uint32_t> textures(objectCount);
+    for (size_t i = 0; i < objectCount; i++)
+    {
+        bounds.SetSphere(i, position(random), position(random), position(random), 1.0f);
+        shaders[i] = shader(random);
+        textures[i] = texture(random);
+    }
+
+    FrameStats stats;
+    DrawQueue queue;
+    std::vector<uint32_t> visible;
+    std::vector<double> cpuTimes;
+    for (int frame = 0; frame < frames; frame++)
+    {
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        const float yaw = 0.01f * float(frame);
+        float viewProj[16];
+        MakeViewProj(yaw, viewProj);
+        FrustumPlanes planes;
+        ExtractFrustumPlanes(viewProj, planes);
+        CullSpheres(planes, bounds, visible);
+
+        queue.Clear();
+        for (uint32_t object : visible)
+        {
+            // View depth along the turned camera axis
+            const float depth = bounds.GetCenterX()[object] * sinf(yaw) + bounds.GetCenterZ()[object] * cosf(yaw);
+            queue.Submit(DrawKey::MakeOpaque(1, shaders[object], textures[object], depth), object);
+        }
+        queue.Sort();
+
+        FrameSample sample;
+        uint32_t boundShader = uint32_t(-1);
+        uint32_t boundTexture = uint32_t(-1);
+        for (size_t i = 0; i < queue.GetSize(); i++)
+        {
+            const uint64_t key = queue[i].key;
+            sample.stateChanges += DrawKey::GetShader(key) != boundShader ? 1 : 0;
+            sample.stateChanges += DrawKey::GetTexture(key) != boundTexture ? 1 : 0;
+            boundShader = DrawKey::GetShader(key);
+            boundTexture = DrawKey::GetTexture(key);
+            sample.drawCalls++;
+            sample.bytesUploaded += SceneBufferBytes;
+        }
+        sample.cpuTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        stats.Record(sample);
+        cpuTimes.push_back(sample.cpuTime * 1000.0);
+    }
+
+    if (!stats.WriteCsv(path))
+    {
+        printf("Can't write %s\n", path);
+        return 1;
+    }
+
+    // The histogram against the exact percentiles of the same frames
+    std::sort(cpuTimes.begin(), cpuTimes.end());
+    const FrameStatsSummary cpu = stats.GetSummary(FrameStats::MetricCpuTime);
+    const FrameStatsSummary draws = stats.GetSummary(FrameStats::MetricDrawCalls);
+    printf("%llu frames, %zu objects, %.0f draws per frame on average, written to %s\n",
+        (unsigned long long)stats.GetFrameCount(), objectCount, draws.mean, path);
+    printf("  CPU ms   p50 %.3f  p95 %.3f  p99 %.3f  max %.3f\n", cpu.p50, cpu.p95, cpu.p99, cpu.maximum);
+    printf("  exact    p50 %.3f  p95 %.3f  p99 %.3f  max %.3f\n", ExactPercentile(cpuTimes, 0.5),
+        ExactPercentile(cpuTimes, 0.95), ExactPercentile(cpuTimes, 0.99), cpuTimes.back());
+    return 0;
+}
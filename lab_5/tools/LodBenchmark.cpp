@@ -0,0 +1,86 @@
+// LOD chain build time and level sizes on generated meshes, built on its own
+// next to the renderer:
+//   g++ -std=c++14 -O2 -I.. LodBenchmark.cpp ../MeshLod.cpp ../MeshOptimizer.cpp ../MeshGenerator.cpp
+//       ../WorkerPool.cpp ../Profiler.cpp -lpthread -o LodBenchmark
+// or as the LodBenchmark target of lab_5/CMakeLists.txt.
+//
+//   LodBenchmark
+// Chains are built with the renderer's defaults: halving per level, errors up
+// to 5% of the radius. Fails if a level indexes past the vertices, holds a
+// degenerate triangle or doesn't shrink.
+
+#include "../MeshGenerator.h"
+#include "../MeshLod.h"
+
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+namespace
+{
+    double MillisecondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    bool IsValidChain(const MeshLodChain& chain, size_t vertexCount)
+    {
+        const std::vector<uint32_t>& indices = chain.GetIndices();
+        for (uint32_t level = 0; level < chain.GetLevelCount(); level++)
+        {
+            const MeshLodLevel& lod = chain.GetLevel(level);
+            if (level > 0 && lod.indexCount >= chain.GetLevel(level - 1).indexCount)
+                return false;
+            for (uint32_t i = lod.firstIndex; i < lod.firstIndex + lod.indexCount; i += 3)
+            {
+                const uint32_t a = indices[i];
+                const uint32_t b = indices[i + 1];
+                const uint32_t c = indices[i + 2];
+                if (a >= vertexCount || b >= vertexCount || c >= vertexCount || a == b || b == c || a == c)
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    bool Report(const char* name, const GeneratedMesh<uint32_t>& mesh)
+    {
+        MeshLodChain chain;
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        chain.Build(&mesh.vertices[0].x, mesh.vertices.size(), sizeof(MeshVertex), mesh.indices.data(), mesh.indices.size());
+        const double buildTime = MillisecondsSince(start);
+        const bool valid = IsValidChain(chain, mesh.vertices.size());
+
+        printf("%-14s %8zu tris %9.1f ms %7.2f us/tri%s\n", name, mesh.indices.size() / 3, buildTime,
+            buildTime * 1000.0 / double(mesh.indices.size() / 3), valid ? "" : "  INVALID CHAIN");
+        for (uint32_t level = 1; level < chain.GetLevelCount(); level++)
+        {
+            const MeshLodLevel& lod = chain.GetLevel(level);
+            printf("  level %u %8u tris, error %.4f of the radius\n", level, lod.indexCount / 3, lod.error);
+        }
+        return valid;
+    }
+}
+
+int main()
+{
+    struct SphereCase { const char* name; uint32_t rings; uint32_t segments; };
+    const SphereCase spheres[3] = { { "sphere 32x64", 32, 64 }, { "sphere 128x256", 128, 256 },
+        { "sphere 256x512", 256, 512 } };
+
+    bool ok = true;
+    for (const SphereCase& sphere : spheres)
+    {
+        GeneratedMesh<uint32_t> mesh;
+        if (!GenerateUVSphere(1.0f, sphere.rings, sphere.segments, mesh))
+            return 1;
+        ok = Report(sphere.name, mesh) && ok;
+    }
+    GeneratedMesh<uint32_t> icosphere;
+    GeneratedMesh<uint32_t> torus;
+    if (!GenerateIcosphere(1.0f, 7, icosphere) || !GenerateTorus(1.0f, 0.3f, 256, 128, torus))
+        return 1;
+    ok = Report("icosphere 7", icosphere) && ok;
+    ok = Report("torus 256x128", torus) && ok;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,114 @@
+// Generation time per million triangles for every procedural shape, with 16
+// and 32 bit indices, on the calling thread and on a WorkerPool. Built on its
+// own next to the renderer:
+//   g++ -std=c++14 -O2 -I.. MeshGenerationBenchmark.cpp ../MeshGenerator.cpp ../WorkerPool.cpp ../Profiler.cpp
+//       -lpthread -o MeshGenerationBenchmark
+// or as the MeshGenerationBenchmark target of lab_5/CMakeLists.txt.
+//
+//   MeshGenerationBenchmark [threads]
+// 32 bit meshes are 4-5M triangles, 16 bit ones as big as the index type
+// allows. Fails if the pooled mesh differs in any byte from the serial one.
+
+#include "../MeshGenerator.h"
+#include "../WorkerPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+    double MillisecondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    template <typename Index>
+    bool SameMesh(const GeneratedMesh<Index>& a, const GeneratedMesh<Index>& b)
+    {
+        return a.indices == b.indices && a.vertices.size() == b.vertices.size() &&
+            memcmp(a.vertices.data(), b.vertices.data(), a.vertices.size() * sizeof(MeshVertex)) == 0;
+    }
+
+    // Best of a few runs into a fresh mesh each, allocation included, in ms
+    template <typename Index, typename Generate>
+    double TimeGeneration(int repeats, WorkerPool* pPool, GeneratedMesh<Index>& mesh, Generate generate)
+    {
+        double best = 1e30;
+        for (int repeat = 0; repeat < repeats; repeat++)
+        {
+            mesh = GeneratedMesh<Index>();
+            const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            if (!generate(mesh, pPool))
+                return -1.0;
+            best = std::min(best, MillisecondsSince(start));
+        }
+        return best;
+    }
+
+    template <typename Index, typename Generate>
+    bool Report(const char* name, int repeats, WorkerPool& pool, Generate generate)
+    {
+        GeneratedMesh<Index> serial;
+        GeneratedMesh<Index> pooled;
+        const double serialTime = TimeGeneration(repeats, nullptr, serial, generate);
+        const double pooledTime = TimeGeneration(repeats, &pool, pooled, generate);
+        if (serialTime < 0.0 || pooledTime < 0.0)
+        {
+            printf("%-10s %2zu bit  parameters rejected\n", name, sizeof(Index) * 8);
+            return false;
+        }
+
+        const bool same = SameMesh(serial, pooled);
+        const double millions = double(serial.indices.size() / 3) / 1e6;
+        printf("%-10s %2zu bit %9zu %9zu %10.2f %10.2f %8.2fx%s\n", name, sizeof(Index) * 8, serial.indices.size() / 3,
+            serial.vertices.size(), serialTime / millions, pooledTime / millions, serialTime / pooledTime,
+            same ? "" : "  POOLED MESH DIFFERS");
+        return same;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    WorkerPool pool(argc > 1 ? unsigned(std::max(1, atoi(argv[1]))) : 0);
+    printf("%u threads in the pool, ms per million triangles\n", pool.GetThreadCount());
+    printf("%-10s %6s %9s %9s %10s %10s %9s\n", "shape", "index", "tris", "vertices", "serial", "pooled", "speedup");
+
+    bool ok = true;
+    ok = Report<uint32_t>("uv sphere", 3, pool, [](GeneratedMesh<uint32_t>& mesh, WorkerPool* pPool) {
+        return GenerateUVSphere(1.0f, 1024, 2048, mesh, pPool);
+    }) && ok;
+    ok = Report<uint32_t>("icosphere", 3, pool, [](GeneratedMesh<uint32_t>& mesh, WorkerPool* pPool) {
+        return GenerateIcosphere(1.0f, 9, mesh, pPool);
+    }) && ok;
+    ok = Report<uint32_t>("cube", 3, pool, [](GeneratedMesh<uint32_t>& mesh, WorkerPool* pPool) {
+        return GenerateCube(1.0f, 600, mesh, pPool);
+    }) && ok;
+    ok = Report<uint32_t>("plane", 3, pool, [](GeneratedMesh<uint32_t>& mesh, WorkerPool* pPool) {
+        return GeneratePlane(1.0f, 1.0f, 1450, 1450, mesh, pPool);
+    }) && ok;
+    ok = Report<uint32_t>("torus", 3, pool, [](GeneratedMesh<uint32_t>& mesh, WorkerPool* pPool) {
+        return GenerateTorus(1.0f, 0.3f, 2048, 1024, mesh, pPool);
+    }) && ok;
+
+    // Small enough for a 16 bit index, so more runs to get a stable best
+    ok = Report<uint16_t>("uv sphere", 50, pool, [](GeneratedMesh<uint16_t>& mesh, WorkerPool* pPool) {
+        return GenerateUVSphere(1.0f, 180, 360, mesh, pPool);
+    }) && ok;
+    ok = Report<uint16_t>("icosphere", 50, pool, [](GeneratedMesh<uint16_t>& mesh, WorkerPool* pPool) {
+        return GenerateIcosphere(1.0f, 6, mesh, pPool);
+    }) && ok;
+    ok = Report<uint16_t>("cube", 50, pool, [](GeneratedMesh<uint16_t>& mesh, WorkerPool* pPool) {
+        return GenerateCube(1.0f, 100, mesh, pPool);
+    }) && ok;
+    ok = Report<uint16_t>("plane", 50, pool, [](GeneratedMesh<uint16_t>& mesh, WorkerPool* pPool) {
+        return GeneratePlane(1.0f, 1.0f, 254, 254, mesh, pPool);
+    }) && ok;
+    ok = Report<uint16_t>("torus", 50, pool, [](GeneratedMesh<uint16_t>& mesh, WorkerPool* pPool) {
+        return GenerateTorus(1.0f, 0.3f, 250, 250, mesh, pPool);
+    }) && ok;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,67 @@
+// Offline converter from OBJ to .mesh, built on its own next to the renderer:
+//   g++ -std=c++14 -O2 -I.. MeshImport.cpp ../MeshImporter.cpp ../MeshFile.cpp ../MeshLod.cpp
+//       ../MeshOptimizer.cpp ../MeshPacking.cpp -o MeshImport
+// or as the MeshImport target of lab_5/CMakeLists.txt.
+
+#include "../MeshImporter.h"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+namespace
+{
+    double MillisecondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 3)
+    {
+        printf("Usage: MeshImport input.obj output.mesh\n");
+        return 1;
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    ImportedMesh mesh;
+    std::string error;
+    if (!ImportObj(argv[1], mesh, &error))
+    {
+        printf("%s\n", error.c_str());
+        return 1;
+    }
+    const double parseTime = MillisecondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    MeshFileData data;
+    BuildMeshFileData(mesh, data);
+    const double buildTime = MillisecondsSince(start);
+    if (!WriteMeshFile(argv[2], data))
+    {
+        printf("Can't write %s\n", argv[2]);
+        return 1;
+    }
+
+    // Read back through the same path the renderer takes
+    start = std::chrono::steady_clock::now();
+    MeshFile file;
+    if (!file.Open(argv[2]))
+    {
+        printf("%s doesn't validate\n", argv[2]);
+        return 1;
+    }
+    const double openTime = MillisecondsSince(start);
+
+    const MeshFileHeader& header = file.GetHeader();
+    printf("%u vertices, %u triangles, %u LODs, %u bit indices, %u bytes\n", header.vertexCount,
+        header.lods[0].indexCount / 3, header.lodCount, header.indexSize * 8, header.fileSize);
+    for (uint32_t level = 1; level < header.lodCount; level++)
+    {
+        printf("  LOD %u: %u triangles, error %.4f\n", level, header.lods[level].indexCount / 3, header.lods[level].error);
+    }
+    printf("parse %.2f ms, optimize and pack %.2f ms, open %.3f ms\n", parseTime, buildTime, openTime);
+    return 0;
+}
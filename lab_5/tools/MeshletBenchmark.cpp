@@ -0,0 +1,242 @@
+// Meshlet build and per frame cluster culling on generated meshes, with the
+// culled index lists checked against a per triangle reference. Built on its
+// own next to the renderer:
+//   g++ -std=c++14 -O2 -I.. MeshletBenchmark.cpp ../Meshlets.cpp ../FrustumCulling.cpp ../MeshGenerator.cpp
+//       ../MeshOptimizer.cpp ../WorkerPool.cpp ../Profiler.cpp -lpthread -o MeshletBenchmark
+// or as the MeshletBenchmark target of lab_5/CMakeLists.txt.
+//
+//   MeshletBenchmark [cameras]
+// Cameras sit 1.5 to 4 units from the origin looking near it; cull times are
+// averaged over them, "none" is CullNone writing every index. Every eighth
+// camera is checked: no triangle that faces the camera with a corner inside
+// the frustum may be missing from the list.
+
+#include "../FrustumCulling.h"
+#include "../MeshGenerator.h"
+#include "../MeshOptimizer.h"
+#include "../Meshlets.h"
+#include "../WorkerPool.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+namespace
+{
+    typedef std::array<uint32_t, 3> Triangle;
+
+    double MillisecondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void Cross(const float* a, const float* b, float* result)
+    {
+        result[0] = a[1] * b[2] - a[2] * b[1];
+        result[1] = a[2] * b[0] - a[0] * b[2];
+        result[2] = a[0] * b[1] - a[1] * b[0];
+    }
+
+    float Dot(const float* a, const float* b)
+    {
+        return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+    }
+
+    void Normalize(float* v)
+    {
+        const float length = sqrtf(Dot(v, v));
+        v[0] /= length;
+        v[1] /= length;
+        v[2] /= length;
+    }
+
+    // Left handed look-at times a 60 degree perspective, for row vectors
+    void MakeViewProj(const float eye[3], const float target[3], float viewProj[16])
+    {
+        const float nearZ = 0.01f;
+        const float farZ = 100.0f;
+        const float yScale = 1.0f / tanf(0.5f * 1.0471976f);
+        const float xScale = yScale / (16.0f / 9.0f);
+        const float zScale = farZ / (farZ - nearZ);
+        const float projection[16] = {
+            xScale, 0.0f, 0.0f, 0.0f,
+            0.0f, yScale, 0.0f, 0.0f,
+            0.0f, 0.0f, zScale, 1.0f,
+            0.0f, 0.0f, -nearZ * zScale, 0.0f };
+
+        const float up[3] = { 0.0f, 1.0f, 0.0f };
+        float zAxis[3] = { target[0] - eye[0], target[1] - eye[1], target[2] - eye[2] };
+        Normalize(zAxis);
+        float xAxis[3];
+        Cross(up, zAxis, xAxis);
+        Normalize(xAxis);
+        float yAxis[3];
+        Cross(zAxis, xAxis, yAxis);
+        const float view[16] = {
+            xAxis[0], yAxis[0], zAxis[0], 0.0f,
+            xAxis[1], yAxis[1], zAxis[1], 0.0f,
+            xAxis[2], yAxis[2], zAxis[2], 0.0f,
+            -Dot(xAxis, eye), -Dot(yAxis, eye), -Dot(zAxis, eye), 1.0f };
+        for (int row = 0; row < 4; row++)
+        {
+            for (int column = 0; column < 4; column++)
+            {
+                float sum = 0.0f;
+                for (int k = 0; k < 4; k++)
+                {
+                    sum += view[row * 4 + k] * projection[k * 4 + column];
+                }
+                viewProj[row * 4 + column] = sum;
+            }
+        }
+    }
+
+    // Rotated to start at the smallest index, winding kept
+    std::vector<Triangle> GetTriangles(const uint32_t* indices, size_t indexCount)
+    {
+        std::vector<Triangle> triangles(indexCount / 3);
+        for (size_t t = 0; t < triangles.size(); t++)
+        {
+            const uint32_t* corners = &indices[t * 3];
+            const int first = int(std::min_element(corners, corners + 3) - corners);
+            triangles[t] = { corners[first], corners[(first + 1) % 3], corners[(first + 2) % 3] };
+        }
+        std::sort(triangles.begin(), triangles.end());
+        return triangles;
+    }
+
+    bool CheckLimits(const MeshletMesh& meshlets)
+    {
+        for (const Meshlet& meshlet : meshlets.meshlets)
+        {
+            if (meshlet.vertexCount > MeshletMaxVertices || meshlet.triangleCount > MeshletMaxTriangles)
+                return false;
+            for (uint32_t k = 0; k < meshlet.triangleCount * 3; k++)
+            {
+                if (meshlets.triangles[meshlet.triangleOffset * 3 + k] >= meshlet.vertexCount)
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    // Triangles facing the camera with a corner strictly inside the frustum
+    // that aren't in the culled list. The facing test has a small margin, the
+    // culler keeps edge-on triangles either way.
+    size_t CountWronglyCulled(const GeneratedMesh<uint32_t>& mesh, const float viewProj[16], const float eye[3],
+        const std::vector<uint32_t>& culled)
+    {
+        FrustumPlanes planes;
+        ExtractFrustumPlanes(viewProj, planes);
+        const std::vector<Triangle> kept = GetTriangles(culled.data(), culled.size());
+        const std::vector<Triangle> all = GetTriangles(mesh.indices.data(), mesh.indices.size());
+        size_t wrong = 0;
+        for (const Triangle& triangle : all)
+        {
+            const float* a = &mesh.vertices[triangle[0]].x;
+            const float* b = &mesh.vertices[triangle[1]].x;
+            const float* c = &mesh.vertices[triangle[2]].x;
+            const float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+            const float e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+            const float toEye[3] = { eye[0] - a[0], eye[1] - a[1], eye[2] - a[2] };
+            float normal[3];
+            Cross(e1, e2, normal);
+            if (Dot(normal, toEye) <= 1e-4f * sqrtf(Dot(normal, normal) * Dot(toEye, toEye)))
+                continue;
+
+            bool cornerInside = false;
+            for (const float* corner : { a, b, c })
+            {
+                bool inside = true;
+                for (int p = 0; p < 6; p++)
+                {
+                    inside = inside && corner[0] * planes.nx[p] + corner[1] * planes.ny[p] + corner[2] * planes.nz[p] + planes.d[p] > 1e-4f;
+                }
+                cornerInside = cornerInside || inside;
+            }
+            if (cornerInside && !std::binary_search(kept.begin(), kept.end(), triangle))
+                wrong++;
+        }
+        return wrong;
+    }
+
+    bool Report(const char* name, GeneratedMesh<uint32_t>& mesh, int cameraCount, WorkerPool& pool)
+    {
+        OptimizeVertexCache(mesh.indices.data(), mesh.indices.size(), mesh.vertices.size(), mesh.indices.data());
+        MeshletMesh meshlets;
+        const std::chrono::steady_clock::time_point buildStart = std::chrono::steady_clock::now();
+        BuildMeshlets(mesh.indices.data(), mesh.indices.size(), &mesh.vertices[0].x, mesh.vertices.size(),
+            sizeof(MeshVertex), meshlets);
+        const double buildTime = MillisecondsSince(buildStart);
+
+        MeshletCuller culler;
+        culler.SetMesh(&meshlets);
+        culler.CullNone(&pool);
+        const bool limitsHold = CheckLimits(meshlets);
+        const bool sameTriangles = GetTriangles(culler.GetIndices().data(), culler.GetIndices().size()) ==
+            GetTriangles(mesh.indices.data(), mesh.indices.size());
+
+        std::mt19937 random(46);
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+        std::uniform_real_distribution<float> distance(1.5f, 4.0f);
+        double cullTime = 0.0;
+        double noneTime = 0.0;
+        double culledFraction = 0.0;
+        size_t wrong = 0;
+        for (int camera = 0; camera < cameraCount; camera++)
+        {
+            float eye[3] = { unit(random), unit(random), unit(random) };
+            Normalize(eye);
+            const float eyeDistance = distance(random);
+            for (float& axis : eye)
+            {
+                axis *= eyeDistance;
+            }
+            const float target[3] = { 0.5f * unit(random), 0.5f * unit(random), 0.5f * unit(random) };
+            float viewProj[16];
+            MakeViewProj(eye, target, viewProj);
+
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            culler.CullNone(&pool);
+            noneTime += MillisecondsSince(start);
+            start = std::chrono::steady_clock::now();
+            culler.Cull(viewProj, eye, &pool);
+            cullTime += MillisecondsSince(start);
+            culledFraction += 1.0 - double(culler.GetStats().triangles) / double(mesh.indices.size() / 3);
+
+            if (camera % 8 == 0)
+                wrong += CountWronglyCulled(mesh, viewProj, eye, culler.GetIndices());
+        }
+
+        printf("%-10s %8zu %8zu %9.1f %8.2f %8.2f %7.0f%%%s%s%s\n", name, mesh.indices.size() / 3,
+            meshlets.meshlets.size(), buildTime, cullTime / cameraCount, noneTime / cameraCount,
+            100.0 * culledFraction / cameraCount, limitsHold ? "" : "  LIMITS BROKEN",
+            sameTriangles ? "" : "  TRIANGLES CHANGED", wrong == 0 ? "" : "  VISIBLE TRIANGLES CULLED");
+        return limitsHold && sameTriangles && wrong == 0;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const int cameraCount = argc > 1 ? std::max(1, atoi(argv[1])) : 40;
+    WorkerPool pool;
+    printf("%d cameras, %u threads in the pool, times in ms\n", cameraCount, pool.GetThreadCount());
+    printf("%-10s %8s %8s %9s %8s %8s %8s\n", "mesh", "tris", "meshlets", "build", "cull", "none", "culled");
+
+    bool ok = true;
+    GeneratedMesh<uint32_t> torus;
+    GeneratedMesh<uint32_t> icosphere;
+    GeneratedMesh<uint32_t> sphere;
+    if (!GenerateTorus(1.0f, 0.3f, 384, 384, torus) || !GenerateIcosphere(1.0f, 8, icosphere) ||
+        !GenerateUVSphere(1.0f, 1024, 1024, sphere))
+        return 1;
+    ok = Report("torus", torus, cameraCount, pool) && ok;
+    ok = Report("icosphere", icosphere, cameraCount, pool) && ok;
+    ok = Report("uv sphere", sphere, cameraCount, pool) && ok;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,150 @@
+// Software occlusion buffer timings: binning, tiled rasterization, Hi-Z
+// build and AABB queries, with every culled box checked against the full
+// resolution depth. Built on its own next to the renderer:
+//   g++ -std=c++14 -O2 -I.. OcclusionBenchmark.cpp ../OcclusionCulling.cpp ../WorkerPool.cpp ../Profiler.cpp
+//       -lpthread -o OcclusionBenchmark
+// or as the OcclusionBenchmark target of lab_5/CMakeLists.txt.
+//
+//   OcclusionBenchmark [triangles] [boxes] [frames]
+// Occluders are small random triangles straight in clip space (identity
+// transform) on the renderer's 320x192 buffer; times are averaged over frames.
+
+#include "../OcclusionCulling.h"
+#include "../WorkerPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+namespace
+{
+    double MillisecondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Culling is conservative when no texel under the box's screen rectangle
+    // holds depth at or behind the box's nearest point
+    bool IsOccludedAtFullRes(const OcclusionBuffer& buffer, const float boxMin[3], const float boxMax[3])
+    {
+        const float width = float(buffer.GetWidth());
+        const float height = float(buffer.GetHeight());
+        const int x0 = std::max(0, int(floorf((boxMin[0] * 0.5f + 0.5f) * width)));
+        const int x1 = std::min(int(buffer.GetWidth()) - 1, int(ceilf((boxMax[0] * 0.5f + 0.5f) * width)));
+        const int y0 = std::max(0, int(floorf((0.5f - boxMax[1] * 0.5f) * height)));
+        const int y1 = std::min(int(buffer.GetHeight()) - 1, int(ceilf((0.5f - boxMin[1] * 0.5f) * height)));
+        const float* pDepth = buffer.GetDepth(0);
+        for (int y = y0; y <= y1; y++)
+        {
+            for (int x = x0; x <= x1; x++)
+            {
+                if (boxMax[2] >= pDepth[y * buffer.GetWidth() + x])
+                    return false;
+            }
+        }
+        return true;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const int triangleCount = argc > 1 ? std::max(1, atoi(argv[1])) : 20000;
+    const int boxCount = argc > 2 ? std::max(1, atoi(argv[2])) : 100000;
+    const int frames = argc > 3 ? std::max(1, atoi(argv[3])) : 50;
+
+    std::mt19937 random(31);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::uniform_real_distribution<float> screen(-1.0f, 1.0f);
+    std::vector<float> positions;
+    for (int i = 0; i < triangleCount; i++)
+    {
+        const float cx = screen(random);
+        const float cy = screen(random);
+        const float z = unit(random);
+        for (int v = 0; v < 3; v++)
+        {
+            positions.push_back(cx + (unit(random) - 0.5f) * 0.2f);
+            positions.push_back(cy + (unit(random) - 0.5f) * 0.2f);
+            positions.push_back(z);
+        }
+    }
+    // 16 bit indices, so occluders go in batches of 6000 triangles
+    const int batchTriangles = std::min(triangleCount, 6000);
+    std::vector<uint16_t> indices(batchTriangles * 3);
+    for (size_t i = 0; i < indices.size(); i++)
+    {
+        indices[i] = uint16_t(i);
+    }
+    const float identity[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+
+    std::vector<float> boxes(boxCount * 6);
+    for (int i = 0; i < boxCount; i++)
+    {
+        float* pBox = &boxes[i * 6];
+        const float size = 0.01f + 0.1f * unit(random);
+        pBox[0] = screen(random);
+        pBox[1] = screen(random);
+        pBox[2] = 0.99f * unit(random);
+        pBox[3] = pBox[0] + size;
+        pBox[4] = pBox[1] + size;
+        pBox[5] = pBox[2] + 0.01f;
+    }
+
+    OcclusionBuffer buffer;
+    buffer.Resize(320, 192);
+    WorkerPool pool;
+    double addTime = 0.0;
+    double rasterTime = 0.0;
+    double hiZTime = 0.0;
+    double queryTime = 0.0;
+    int culled = 0;
+    for (int frame = 0; frame < frames; frame++)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        buffer.Clear();
+        for (int first = 0; first < triangleCount; first += batchTriangles)
+        {
+            const int count = std::min(batchTriangles, triangleCount - first);
+            buffer.AddOccluder(&positions[first * 9], size_t(count * 3), 3 * sizeof(float), indices.data(),
+                size_t(count * 3), identity);
+        }
+        addTime += MillisecondsSince(start);
+
+        start = std::chrono::steady_clock::now();
+        buffer.Rasterize(pool);
+        rasterTime += MillisecondsSince(start);
+
+        start = std::chrono::steady_clock::now();
+        buffer.BuildHiZ();
+        hiZTime += MillisecondsSince(start);
+
+        start = std::chrono::steady_clock::now();
+        culled = 0;
+        for (int i = 0; i < boxCount; i++)
+        {
+            culled += buffer.IsVisible(&boxes[i * 6], &boxes[i * 6 + 3], identity) ? 0 : 1;
+        }
+        queryTime += MillisecondsSince(start);
+    }
+
+    // The last frame's results against full resolution depth
+    int wrong = 0;
+    int occludedAtFullRes = 0;
+    for (int i = 0; i < boxCount; i++)
+    {
+        const bool occluded = IsOccludedAtFullRes(buffer, &boxes[i * 6], &boxes[i * 6 + 3]);
+        occludedAtFullRes += occluded ? 1 : 0;
+        wrong += !occluded && !buffer.IsVisible(&boxes[i * 6], &boxes[i * 6 + 3], identity) ? 1 : 0;
+    }
+
+    printf("%d triangles on %ux%u, %u threads, average of %d frames\n", triangleCount, buffer.GetWidth(),
+        buffer.GetHeight(), pool.GetThreadCount(), frames);
+    printf("  add %.3f ms, rasterize %.3f ms, hi-z %.3f ms\n", addTime / frames, rasterTime / frames, hiZTime / frames);
+    printf("  %d boxes: %.3f us per query, %d culled, %d occluded at full resolution, %d culled while visible\n",
+        boxCount, 1000.0 * queryTime / frames / boxCount, culled, occludedAtFullRes, wrong);
+    return wrong == 0 ? 0 : 1;
+}
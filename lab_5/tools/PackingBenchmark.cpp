@@ -0,0 +1,157 @@
+// Vertex packing throughput and error on a dense random sphere, plus checks
+// of the half float conversions. Built on its own next to the renderer:
+//   g++ -std=c++14 -O2 -I.. PackingBenchmark.cpp ../MeshPacking.cpp -o PackingBenchmark
+// or as the PackingBenchmark target of lab_5/CMakeLists.txt. With -mf16c the
+// conversions are also compared with the hardware ones.
+//
+//   PackingBenchmark [vertices] [--exhaustive]
+// --exhaustive compares FloatToHalf with F16C over all 2^32 floats, which
+// takes a while.
+
+#include "../MeshPacking.h"
+
+#ifdef __F16C__
+#include <immintrin.h>
+#endif
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace
+{
+    struct TextureVertex
+    {
+        float x, y, z;
+        float u, v;
+        float nx, ny, nz;
+    };
+
+    // Best of a few runs, in nanoseconds per vertex
+    template <typename Func>
+    double TimePerVertex(size_t count, Func func)
+    {
+        double best = 1e30;
+        for (int repeat = 0; repeat < 5; repeat++)
+        {
+            const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            func();
+            const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            best = seconds < best ? seconds : best;
+        }
+        return best * 1e9 / double(count);
+    }
+
+    bool SameFloat(float a, float b)
+    {
+        return memcmp(&a, &b, sizeof(float)) == 0 || (std::isnan(a) && std::isnan(b));
+    }
+
+    // Every half that isn't NaN survives half -> float -> half unchanged
+    uint32_t CountRoundTripMismatches()
+    {
+        uint32_t mismatches = 0;
+        for (uint32_t bits = 0; bits < 65536; bits++)
+        {
+            const uint16_t half = uint16_t(bits);
+            const bool nan = (half & 0x7C00) == 0x7C00 && (half & 0x03FF) != 0;
+            if (!nan && FloatToHalf(HalfToFloat(half)) != half)
+                mismatches++;
+        }
+        return mismatches;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    size_t count = 1000000;
+    bool exhaustive = false;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--exhaustive") == 0)
+            exhaustive = true;
+        else
+            count = size_t(atoi(argv[i]) > 0 ? atoi(argv[i]) : 1);
+    }
+
+    // Radius 3 sphere off the origin with random UVs
+    std::mt19937 random(42);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::vector<TextureVertex> vertices(count);
+    for (TextureVertex& vertex : vertices)
+    {
+        const float theta = unit(random) * 6.2831853f;
+        const float phi = unit(random) * 3.1415927f;
+        vertex.nx = sinf(phi) * cosf(theta);
+        vertex.ny = cosf(phi);
+        vertex.nz = sinf(phi) * sinf(theta);
+        vertex.x = 3.0f * vertex.nx + 1.0f;
+        vertex.y = 3.0f * vertex.ny;
+        vertex.z = 3.0f * vertex.nz - 2.0f;
+        vertex.u = unit(random);
+        vertex.v = unit(random);
+    }
+    const size_t stride = sizeof(TextureVertex);
+    const VertexQuantization quantization = ComputeQuantization(&vertices[0].x, count, stride);
+
+    std::vector<PackedTextureVertex> packed(count);
+    std::vector<PackedPosition> positions(count);
+    std::vector<PackedNormal> normals(count);
+    const double textureTime = TimePerVertex(count, [&]() {
+        PackTextureVertices(&vertices[0].x, &vertices[0].u, count, stride, quantization, packed.data());
+    });
+    const double positionTime = TimePerVertex(count, [&]() {
+        PackPositions(&vertices[0].x, count, stride, quantization, positions.data());
+    });
+    const double normalTime = TimePerVertex(count, [&]() {
+        PackNormals(&vertices[0].nx, count, stride, normals.data());
+    });
+    printf("%zu vertices, %zu bytes each packed against %zu\n", count, sizeof(PackedTextureVertex), 5 * sizeof(float));
+    printf("  textured %.2f ns (%.0f M/s), positions %.2f ns (%.0f M/s), normals %.2f ns (%.0f M/s)\n",
+        textureTime, 1e3 / textureTime, positionTime, 1e3 / positionTime, normalTime, 1e3 / normalTime);
+
+    const QuantizationError error = MeasureQuantizationError(&vertices[0].x, &vertices[0].u, count, stride,
+        quantization, packed.data());
+    printf("  position error max %.3g, rms %.3g, max relative to extent %.3g\n", error.maxPosition,
+        error.rmsPosition, error.maxRelativePosition);
+    printf("  uv error max %.3g, rms %.3g\n", error.maxUV, error.rmsUV);
+
+    uint32_t mismatches = CountRoundTripMismatches();
+    printf("  half round trip mismatches: %u\n", mismatches);
+
+#ifdef __F16C__
+    uint32_t hardwareMismatches = 0;
+    for (uint32_t bits = 0; bits < 65536; bits++)
+    {
+        hardwareMismatches += SameFloat(HalfToFloat(uint16_t(bits)), _cvtsh_ss(uint16_t(bits))) ? 0 : 1;
+    }
+    printf("  HalfToFloat against F16C over all halves: %u mismatches\n", hardwareMismatches);
+    mismatches += hardwareMismatches;
+    if (exhaustive)
+    {
+        // NaNs only have to stay NaN, their payload may differ
+        uint64_t floatMismatches = 0;
+        for (uint64_t bits = 0; bits <= 0xFFFFFFFFull; bits++)
+        {
+            const uint32_t value = uint32_t(bits);
+            float f;
+            memcpy(&f, &value, sizeof(f));
+            const uint16_t software = FloatToHalf(f);
+            const uint16_t hardware = uint16_t(_cvtss_sh(f, _MM_FROUND_TO_NEAREST_INT));
+            if (software != hardware && !(std::isnan(f) && (software & 0x7C00) == 0x7C00 && (software & 0x03FF) != 0))
+                floatMismatches++;
+        }
+        printf("  FloatToHalf against F16C over all floats: %llu mismatches\n", (unsigned long long)floatMismatches);
+        mismatches += floatMismatches > 0 ? 1 : 0;
+    }
+#else
+    (void)SameFloat;
+    if (exhaustive)
+        printf("  --exhaustive needs a build with -mf16c\n");
+#endif
+    return mismatches == 0 ? 0 : 1;
+}
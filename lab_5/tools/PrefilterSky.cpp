@@ -0,0 +1,175 @@
+// Offline GGX prefilter of the skybox faces into one mip chained cubemap DDS,
+// built on its own next to the renderer:
+//   g++ -std=c++14 -O2 -I.. PrefilterSky.cpp ../CubemapPrefilter.cpp ../Cubemap.cpp ../WorkerPool.cpp
+//       ../Profiler.cpp -lpthread -o PrefilterSky
+// or as the PrefilterSky target of lab_5/CMakeLists.txt.
+//
+//   PrefilterSky faces_dir output.dds [samples] [size] [mips]
+//   PrefilterSky --benchmark faces_dir [size] [mips]
+// The faces are px.dds, nx.dds, py.dds, ny.dds, pz.dds and nz.dds, BC1 or
+// R8G8B8A8; only their top mip is read.
+
+#include "../CubemapPrefilter.h"
+#include "../WorkerPool.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace
+{
+    const uint32_t DdsMagic = 0x20534444; // "DDS "
+    const uint32_t DdsHeaderSize = 124;
+    const uint32_t DdpfFourCC = 0x4;
+    const uint32_t DdpfRgb = 0x40;
+    const uint32_t FourCCDxt1 = 0x31545844; // "DXT1"
+
+    double MillisecondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    uint32_t ReadUint(const std::vector<uint8_t>& file, size_t offset)
+    {
+        uint32_t value;
+        memcpy(&value, &file[offset], sizeof(value));
+        return value;
+    }
+
+    // Top mip of a square legacy DDS, the rest of the file is left alone
+    bool ReadFace(const std::string& path, std::vector<uint8_t>& file, uint32_t& size, CubemapFormat& format)
+    {
+        FILE* pFile = fopen(path.c_str(), "rb");
+        if (pFile == nullptr)
+            return false;
+        fseek(pFile, 0, SEEK_END);
+        const long length = ftell(pFile);
+        fseek(pFile, 0, SEEK_SET);
+        file.resize(length > 0 ? size_t(length) : 0);
+        const bool read = !file.empty() && fread(file.data(), file.size(), 1, pFile) == 1;
+        fclose(pFile);
+        if (!read || file.size() < 4 + DdsHeaderSize || ReadUint(file, 0) != DdsMagic || ReadUint(file, 4) != DdsHeaderSize)
+            return false;
+
+        const uint32_t height = ReadUint(file, 12);
+        size = ReadUint(file, 16);
+        const uint32_t pixelFlags = ReadUint(file, 80);
+        if ((pixelFlags & DdpfFourCC) != 0 && ReadUint(file, 84) == FourCCDxt1)
+        {
+            format = CubemapFormatBC1;
+        }
+        else if ((pixelFlags & DdpfRgb) != 0 && ReadUint(file, 88) == 32 && ReadUint(file, 92) == 0x000000FF &&
+            ReadUint(file, 96) == 0x0000FF00 && ReadUint(file, 100) == 0x00FF0000)
+        {
+            format = CubemapFormatRGBA8;
+        }
+        else
+        {
+            return false;
+        }
+        CubemapFaces faces = {};
+        faces.size = size;
+        faces.format = format;
+        return size == height && file.size() >= 4 + DdsHeaderSize + GetCubemapFaceBytes(faces);
+    }
+
+    // Root mean square difference over every channel of every level, in 8 bit steps
+    double RmsDifference(const PrefilteredCubemap& a, const PrefilteredCubemap& b)
+    {
+        double sum = 0.0;
+        for (size_t i = 0; i < a.texels.size(); i++)
+        {
+            const double difference = double(a.texels[i]) - double(b.texels[i]);
+            sum += difference * difference;
+        }
+        return a.texels.empty() ? 0.0 : sqrt(sum / double(a.texels.size()));
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const bool benchmark = argc >= 3 && strcmp(argv[1], "--benchmark") == 0;
+    const int firstOption = benchmark ? 3 : 4;
+    if (argc < 3 || argc > firstOption + 2)
+    {
+        printf("Usage: PrefilterSky faces_dir output.dds [samples] [size] [mips]\n"
+               "       PrefilterSky --benchmark faces_dir [size] [mips]\n");
+        return 1;
+    }
+
+    PrefilterSettings settings;
+    if (!benchmark && argc > 3)
+    {
+        settings.sampleCount = uint32_t(atoi(argv[3]));
+    }
+    if (argc > firstOption)
+    {
+        settings.size = uint32_t(atoi(argv[firstOption]));
+    }
+    if (argc > firstOption + 1)
+    {
+        settings.mipCount = uint32_t(atoi(argv[firstOption + 1]));
+    }
+
+    const char* faceNames[6] = { "px.dds", "nx.dds", "py.dds", "ny.dds", "pz.dds", "nz.dds" };
+    const std::string directory = argv[benchmark ? 2 : 1];
+    std::vector<uint8_t> files[6];
+    CubemapFaces faces = {};
+    for (int face = 0; face < 6; face++)
+    {
+        uint32_t size = 0;
+        CubemapFormat format = CubemapFormatBC1;
+        const std::string path = directory + "/" + faceNames[face];
+        if (!ReadFace(path, files[face], size, format) || (face > 0 && (size != faces.size || format != faces.format)))
+        {
+            printf("Can't read %s as a face of the cubemap\n", path.c_str());
+            return 1;
+        }
+        faces.pFaces[face] = files[face].data() + 4 + DdsHeaderSize;
+        faces.size = size;
+        faces.format = format;
+    }
+
+    WorkerPool pool;
+    if (!benchmark)
+    {
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        PrefilteredCubemap cubemap;
+        PrefilterCubemap(faces, settings, cubemap, &pool);
+        const double prefilterTime = MillisecondsSince(start);
+        if (cubemap.mipCount == 0 || !WriteCubemapDds(argv[2], cubemap))
+        {
+            printf("Can't write %s\n", argv[2]);
+            return 1;
+        }
+        printf("%u^2 x %u levels, %u samples, %u threads: %.1f ms\n", cubemap.size, cubemap.mipCount,
+            settings.sampleCount, pool.GetThreadCount(), prefilterTime);
+        return 0;
+    }
+
+    // Time and noise against many samples; single threaded runs show the scaling
+    PrefilterSettings referenceSettings = settings;
+    referenceSettings.sampleCount = 1024;
+    PrefilteredCubemap reference;
+    PrefilterCubemap(faces, referenceSettings, reference, &pool);
+    printf("%u^2 x %u levels, %u threads, error in 8 bit steps against 1024 samples\n", settings.size,
+        reference.mipCount, pool.GetThreadCount());
+    for (uint32_t sampleCount = 8; sampleCount <= 512; sampleCount *= 2)
+    {
+        settings.sampleCount = sampleCount;
+        PrefilteredCubemap cubemap;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        PrefilterCubemap(faces, settings, cubemap, &pool);
+        const double poolTime = MillisecondsSince(start);
+        start = std::chrono::steady_clock::now();
+        PrefilterCubemap(faces, settings, cubemap);
+        const double serialTime = MillisecondsSince(start);
+        printf("  %4u samples: %8.1f ms pool, %8.1f ms one thread, rms %.3f\n", sampleCount, poolTime, serialTime,
+            RmsDifference(cubemap, reference));
+    }
+    return 0;
+}
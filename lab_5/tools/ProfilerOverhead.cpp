@@ -0,0 +1,109 @@
+// Cost of a PROFILE_SCOPE marker, built on its own next to the renderer:
+//   g++ -std=c++14 -O2 -I.. ProfilerOverhead.cpp ../Profiler.cpp -lpthread -o ProfilerOverhead
+// or as the ProfilerOverhead target of lab_5/CMakeLists.txt.
+//
+//   ProfilerOverhead [scopes per thread] [limit ns]
+// Times empty scopes on one thread, nested four deep, and on every hardware
+// thread at once, after a warm up that registers the threads and wraps their
+// rings. The best of five runs is reported; with a limit given, fails when
+// any of them costs more per scope.
+
+#include "../Profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    double MillisecondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void FlatScopes(size_t count)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            PROFILE_SCOPE("flat");
+        }
+    }
+
+    // Four scopes per iteration
+    void NestedScopes(size_t count)
+    {
+        for (size_t i = 0; i < count; i += 4)
+        {
+            PROFILE_SCOPE("outer");
+            {
+                PROFILE_SCOPE("middle");
+                {
+                    PROFILE_SCOPE("inner");
+                    {
+                        PROFILE_SCOPE("innermost");
+                    }
+                }
+            }
+        }
+    }
+
+    void ReadClock(size_t count)
+    {
+        volatile uint64_t sink = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            sink = sink + Profiler::Now();
+        }
+    }
+
+    // Nanoseconds per call, best of the runs, with every thread running body at once
+    double Measure(void (*body)(size_t), size_t count, unsigned threadCount)
+    {
+        double best = 1e30;
+        for (int run = 0; run < 5; run++)
+        {
+            std::vector<std::thread> threads;
+            const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            for (unsigned idx = 1; idx < threadCount; idx++)
+            {
+                threads.emplace_back(body, count);
+            }
+            body(count);
+            for (std::thread& thread : threads)
+            {
+                thread.join();
+            }
+            best = std::min(best, MillisecondsSince(start) * 1e6 / double(count));
+        }
+        return best;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const size_t count = argc > 1 ? size_t(atoll(argv[1])) : size_t(1) << 22;
+    const double limit = argc > 2 ? atof(argv[2]) : 0.0;
+    const unsigned hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+    if (count == 0)
+        return 1;
+
+    FlatScopes(Profiler::RingCapacity * 2);
+    struct Case { const char* name; void (*body)(size_t); unsigned threads; };
+    const Case cases[4] = { { "clock read", ReadClock, 1 }, { "flat scope", FlatScopes, 1 },
+        { "nested scope", NestedScopes, 1 }, { "flat scope, all threads", FlatScopes, hardwareThreads } };
+
+    bool ok = true;
+    printf("%zu calls per thread, %u hardware threads\n", count, hardwareThreads);
+    for (const Case& test : cases)
+    {
+        const double cost = Measure(test.body, count, test.threads);
+        // Threads run side by side, so the wall time per call is already the cost per call on each thread
+        const bool over = limit > 0.0 && test.body != ReadClock && cost > limit;
+        printf("%-24s %8.2f ns%s\n", test.name, cost, over ? "  OVER LIMIT" : "");
+        ok = ok && !over;
+    }
+    return ok ? 0 : 1;
+}
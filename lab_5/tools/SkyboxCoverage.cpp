@@ -0,0 +1,332 @@
+// Work of the two skybox modes, rasterized on the CPU the way D3D11 does it,
+// built on its own next to the renderer:
+//   g++ -std=c++14 -O2 -I.. SkyboxCoverage.cpp ../MeshGenerator.cpp ../MeshOptimizer.cpp ../MeshPacking.cpp
+//       ../WorkerPool.cpp ../Profiler.cpp -lpthread -o SkyboxCoverage
+// or as the SkyboxCoverage target of lab_5/CMakeLists.txt.
+//
+//   SkyboxCoverage [width height]
+// The sphere is the renderer's: 8 x 18, cache optimized, 16 bit positions,
+// centered on the camera at depth 0 with front faces culled. The rays mode is
+// one fullscreen triangle with back faces culled. Both are drawn into an empty
+// frame and into one whose lower half is covered by geometry; a pixel is
+// shaded when its center is covered (top left rule, 8 subpixel bits) and the
+// depth test passes. Pixel shader lanes count the 2x2 quads of every primitive
+// holding a shaded pixel; vertex shader runs count misses of a 16 entry FIFO.
+// Fails unless each mode covers every pixel exactly once, so that both shade
+// the same pixels.
+
+#include "../MeshGenerator.h"
+#include "../MeshOptimizer.h"
+#include "../MeshPacking.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+namespace
+{
+    const float Pi = 3.14159265f;
+    const int64_t SubpixelSteps = 256;
+    // Primitives are clipped to this many screen sizes around the screen, the
+    // hardware guard band does the same so edges on screen are never moved
+    const float GuardBand = 4.0f;
+
+    struct ClipVertex
+    {
+        float x, y, w;
+    };
+
+    struct Camera
+    {
+        const char* name;
+        float yaw;
+        float pitch;
+    };
+
+    struct DrawCounts
+    {
+        size_t vertexShaderRuns = 0;
+        size_t primitives = 0;
+        size_t clipped = 0;
+        size_t culled = 0;
+        size_t rasterized = 0;
+        size_t pixels = 0;
+        size_t lanes = 0;
+    };
+
+    // Screen in fixed point, the depth test result per pixel and the coverage
+    // and quad bookkeeping of the draw
+    class Rasterizer
+    {
+    public:
+        Rasterizer(int width, int height)
+            : m_width(width), m_height(height), m_coverage(size_t(width) * height), m_occluded(size_t(width) * height),
+            m_quadStamp(size_t((width + 1) / 2) * ((height + 1) / 2), ~size_t(0))
+        {
+        }
+
+        // Geometry over the lower half fails the skybox's depth test there
+        void SetLowerHalfOccluded(bool occluded)
+        {
+            for (int y = 0; y < m_height; y++)
+            {
+                for (int x = 0; x < m_width; x++)
+                {
+                    m_occluded[size_t(y) * m_width + x] = occluded && y >= m_height / 2;
+                }
+            }
+        }
+
+        void Begin(DrawCounts& counts)
+        {
+            std::fill(m_coverage.begin(), m_coverage.end(), uint8_t(0));
+            m_pCounts = &counts;
+        }
+
+        // keepClockwise: back face culling keeps the clockwise triangles on
+        // screen, front face culling the counterclockwise ones
+        void DrawTriangle(const ClipVertex* triangle, bool keepClockwise)
+        {
+            m_pCounts->primitives++;
+            std::vector<ClipVertex> polygon(triangle, triangle + 3);
+            // x <= g w, -x <= g w, y <= g w, -y <= g w, and w above zero
+            const float planes[5][3] = { { -1.0f, 0.0f, GuardBand }, { 1.0f, 0.0f, GuardBand }, { 0.0f, -1.0f, GuardBand },
+                { 0.0f, 1.0f, GuardBand }, { 0.0f, 0.0f, 1.0f } };
+            for (const float* plane : planes)
+            {
+                polygon = Clip(polygon, plane, plane == planes[4] ? 1e-6f : 0.0f);
+                if (polygon.size() < 3)
+                {
+                    m_pCounts->clipped++;
+                    return;
+                }
+            }
+
+            std::vector<int64_t> xs(polygon.size());
+            std::vector<int64_t> ys(polygon.size());
+            for (size_t i = 0; i < polygon.size(); i++)
+            {
+                xs[i] = int64_t(llround((polygon[i].x / polygon[i].w * 0.5f + 0.5f) * float(m_width) * SubpixelSteps));
+                ys[i] = int64_t(llround((0.5f - polygon[i].y / polygon[i].w * 0.5f) * float(m_height) * SubpixelSteps));
+            }
+            // The clipped polygon is convex, so its area says which way every fan triangle winds
+            int64_t area = 0;
+            for (size_t i = 0; i < polygon.size(); i++)
+            {
+                const size_t next = (i + 1) % polygon.size();
+                area += xs[i] * ys[next] - xs[next] * ys[i];
+            }
+            // y points down: a positive area is clockwise on screen
+            if (area == 0 || (area > 0) != keepClockwise)
+            {
+                m_pCounts->culled++;
+                return;
+            }
+            for (size_t i = 1; i + 1 < polygon.size(); i++)
+            {
+                RasterizeTriangle(xs[0], ys[0], xs[i], ys[i], xs[i + 1], ys[i + 1]);
+            }
+        }
+
+        // Pixels covered other than exactly once
+        size_t CountCoverageErrors() const
+        {
+            size_t errors = 0;
+            for (uint8_t coverage : m_coverage)
+            {
+                errors += coverage != 1 ? 1 : 0;
+            }
+            return errors;
+        }
+    private:
+        // Keeps the part where a * x + b * y + c * w >= minimum; a point on an
+        // edge is interpolated from the same end whichever triangle the edge
+        // belongs to, so neighbours get the same point and no crack
+        static std::vector<ClipVertex> Clip(const std::vector<ClipVertex>& polygon, const float* plane, float minimum)
+        {
+            std::vector<ClipVertex> result;
+            for (size_t i = 0; i < polygon.size(); i++)
+            {
+                const ClipVertex& current = polygon[i];
+                const ClipVertex& next = polygon[(i + 1) % polygon.size()];
+                const float currentDistance = plane[0] * current.x + plane[1] * current.y + plane[2] * current.w - minimum;
+                const float nextDistance = plane[0] * next.x + plane[1] * next.y + plane[2] * next.w - minimum;
+                if (currentDistance >= 0.0f)
+                    result.push_back(current);
+                if ((currentDistance >= 0.0f) != (nextDistance >= 0.0f))
+                {
+                    const bool fromCurrent = current.x < next.x || (current.x == next.x && (current.y < next.y || (current.y == next.y && current.w < next.w)));
+                    const ClipVertex& a = fromCurrent ? current : next;
+                    const ClipVertex& b = fromCurrent ? next : current;
+                    const float aDistance = fromCurrent ? currentDistance : nextDistance;
+                    const float bDistance = fromCurrent ? nextDistance : currentDistance;
+                    const float t = aDistance / (aDistance - bDistance);
+                    result.push_back(ClipVertex{ a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, a.w + (b.w - a.w) * t });
+                }
+            }
+            return result;
+        }
+
+        // Top and left edges of a clockwise triangle: going up, or flat and going right
+        static bool IsTopLeft(int64_t dx, int64_t dy)
+        {
+            return dy < 0 || (dy == 0 && dx > 0);
+        }
+
+        void RasterizeTriangle(int64_t x0, int64_t y0, int64_t x1, int64_t y1, int64_t x2, int64_t y2)
+        {
+            if ((x1 - x0) * (y2 - y0) - (x2 - x0) * (y1 - y0) < 0)
+            {
+                std::swap(x1, x2);
+                std::swap(y1, y2);
+            }
+            const int64_t xs[3] = { x0, x1, x2 };
+            const int64_t ys[3] = { y0, y1, y2 };
+            const int minX = int(std::max<int64_t>(0, std::min(x0, std::min(x1, x2)) / SubpixelSteps - 1));
+            const int maxX = int(std::min<int64_t>(m_width - 1, std::max(x0, std::max(x1, x2)) / SubpixelSteps + 1));
+            const int minY = int(std::max<int64_t>(0, std::min(y0, std::min(y1, y2)) / SubpixelSteps - 1));
+            const int maxY = int(std::min<int64_t>(m_height - 1, std::max(y0, std::max(y1, y2)) / SubpixelSteps + 1));
+
+            m_pCounts->rasterized++;
+            const size_t quadsPerRow = size_t((m_width + 1) / 2);
+            for (int y = minY; y <= maxY; y++)
+            {
+                const int64_t py = int64_t(y) * SubpixelSteps + SubpixelSteps / 2;
+                for (int x = minX; x <= maxX; x++)
+                {
+                    const int64_t px = int64_t(x) * SubpixelSteps + SubpixelSteps / 2;
+                    bool inside = true;
+                    for (int edge = 0; edge < 3 && inside; edge++)
+                    {
+                        const int next = (edge + 1) % 3;
+                        const int64_t dx = xs[next] - xs[edge];
+                        const int64_t dy = ys[next] - ys[edge];
+                        const int64_t side = dx * (py - ys[edge]) - dy * (px - xs[edge]);
+                        inside = side > 0 || (side == 0 && IsTopLeft(dx, dy));
+                    }
+                    if (!inside)
+                        continue;
+                    const size_t pixel = size_t(y) * m_width + x;
+                    m_coverage[pixel]++;
+                    if (m_occluded[pixel])
+                        continue;
+                    m_pCounts->pixels++;
+                    // A quad runs four lanes for the primitive once any of its pixels is shaded
+                    size_t& stamp = m_quadStamp[size_t(y / 2) * quadsPerRow + size_t(x / 2)];
+                    if (stamp != m_pCounts->rasterized + m_drawBase)
+                    {
+                        stamp = m_pCounts->rasterized + m_drawBase;
+                        m_pCounts->lanes += 4;
+                    }
+                }
+            }
+        }
+
+        int m_width;
+        int m_height;
+        std::vector<uint8_t> m_coverage;
+        std::vector<bool> m_occluded;
+        std::vector<size_t> m_quadStamp;
+        DrawCounts* m_pCounts = nullptr;
+    public:
+        // Keeps quad stamps of different draws apart
+        size_t m_drawBase = 0;
+    };
+
+    // Row vector clip position of a point relative to the camera, with the
+    // renderer's projection; z doesn't matter, both modes write depth 0
+    ClipVertex Project(const float* point, const Camera& camera, float projScaleX, float projScaleY)
+    {
+        const float cy = cosf(camera.yaw * Pi / 180.0f);
+        const float sy = sinf(camera.yaw * Pi / 180.0f);
+        const float cp = cosf(camera.pitch * Pi / 180.0f);
+        const float sp = sinf(camera.pitch * Pi / 180.0f);
+        const float forward[3] = { cp * sy, sp, cp * cy };
+        const float right[3] = { cy, 0.0f, -sy };
+        const float up[3] = { forward[1] * right[2] - forward[2] * right[1], forward[2] * right[0] - forward[0] * right[2],
+            forward[0] * right[1] - forward[1] * right[0] };
+        const float x = point[0] * right[0] + point[1] * right[1] + point[2] * right[2];
+        const float y = point[0] * up[0] + point[1] * up[1] + point[2] * up[2];
+        const float z = point[0] * forward[0] + point[1] * forward[1] + point[2] * forward[2];
+        return ClipVertex{ x * projScaleX, y * projScaleY, z };
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const int width = argc > 2 ? atoi(argv[1]) : 1280;
+    const int height = argc > 2 ? atoi(argv[2]) : 720;
+    if (width <= 0 || height <= 0 || width > 8192 || height > 8192)
+        return 1;
+
+    // Built like Renderer::InitShaders builds it, decoded like Skybox_VS decodes it
+    GeneratedMesh<uint32_t> sphere;
+    if (!GenerateUVSphere(1.1f, 8, 18, sphere))
+        return 1;
+    sphere.vertices.resize(OptimizeMesh(sphere.indices.data(), sphere.indices.size(), sphere.vertices.data(),
+        sphere.vertices.size(), sizeof(MeshVertex)));
+    const VertexQuantization quantization = ComputeQuantization(&sphere.vertices[0].x, sphere.vertices.size(), sizeof(MeshVertex));
+    std::vector<PackedPosition> packed(sphere.vertices.size());
+    PackPositions(&sphere.vertices[0].x, sphere.vertices.size(), sizeof(MeshVertex), quantization, packed.data());
+    const VertexCacheStats cache = AnalyzeVertexCache(sphere.indices.data(), sphere.indices.size(), sphere.vertices.size());
+
+    // 60 degree vertical field of view as in Renderer::Render; the sphere sits
+    // on the camera, so its scale doesn't change what it covers
+    const float projScaleX = 1.0f / tanf(Pi / 6.0f);
+    const float projScaleY = projScaleX * float(width) / float(height);
+    const Camera cameras[4] = { { "level", 0.0f, 0.0f }, { "turned", 37.0f, 20.0f }, { "at the pole", 10.0f, 89.0f },
+        { "down", -120.0f, -60.0f } };
+
+    Rasterizer rasterizer(width, height);
+    bool ok = true;
+    printf("%d x %d, sphere of %zu triangles\n", width, height, sphere.indices.size() / 3);
+    for (int occluded = 0; occluded < 2; occluded++)
+    {
+        rasterizer.SetLowerHalfOccluded(occluded != 0);
+        for (const Camera& camera : cameras)
+        {
+            DrawCounts sphereCounts;
+            rasterizer.Begin(sphereCounts);
+            sphereCounts.vertexShaderRuns = cache.misses;
+            for (size_t i = 0; i < sphere.indices.size(); i += 3)
+            {
+                ClipVertex triangle[3];
+                for (int corner = 0; corner < 3; corner++)
+                {
+                    const PackedPosition& position = packed[sphere.indices[i + corner]];
+                    const float point[3] = { Snorm16ToFloat(position.x) * quantization.scale[0] + quantization.bias[0],
+                        Snorm16ToFloat(position.y) * quantization.scale[1] + quantization.bias[1],
+                        Snorm16ToFloat(position.z) * quantization.scale[2] + quantization.bias[2] };
+                    triangle[corner] = Project(point, camera, projScaleX, projScaleY);
+                }
+                rasterizer.DrawTriangle(triangle, false);
+            }
+            const size_t sphereErrors = rasterizer.CountCoverageErrors();
+            rasterizer.m_drawBase += sphereCounts.rasterized;
+
+            // SkyboxRay_VS: (-1, 1), (3, 1), (-1, -3) at w = 1
+            DrawCounts rayCounts;
+            rasterizer.Begin(rayCounts);
+            rayCounts.vertexShaderRuns = 3;
+            const ClipVertex fullscreen[3] = { { -1.0f, 1.0f, 1.0f }, { 3.0f, 1.0f, 1.0f }, { -1.0f, -3.0f, 1.0f } };
+            rasterizer.DrawTriangle(fullscreen, true);
+            const size_t rayErrors = rasterizer.CountCoverageErrors();
+            rasterizer.m_drawBase += rayCounts.rasterized;
+
+            const bool valid = sphereErrors == 0 && rayErrors == 0 && sphereCounts.pixels == rayCounts.pixels;
+            ok = ok && valid;
+            printf("%-12s %s\n", camera.name, occluded != 0 ? "lower half covered" : "empty frame");
+            printf("  sphere: %3zu VS runs, %3zu triangles, %3zu off screen, %3zu culled, %3zu rasterized, %8zu pixels, %8zu lanes (%.3f per pixel)\n",
+                sphereCounts.vertexShaderRuns, sphereCounts.primitives, sphereCounts.clipped, sphereCounts.culled, sphereCounts.rasterized,
+                sphereCounts.pixels, sphereCounts.lanes, double(sphereCounts.lanes) / double(std::max<size_t>(sphereCounts.pixels, 1)));
+            printf("  rays:   %3zu VS runs, %3zu triangles, %3zu off screen, %3zu culled, %3zu rasterized, %8zu pixels, %8zu lanes (%.3f per pixel)\n",
+                rayCounts.vertexShaderRuns, rayCounts.primitives, rayCounts.clipped, rayCounts.culled, rayCounts.rasterized,
+                rayCounts.pixels, rayCounts.lanes, double(rayCounts.lanes) / double(std::max<size_t>(rayCounts.pixels, 1)));
+            if (!valid)
+                printf("  MISMATCH: %zu sphere and %zu ray pixels not covered exactly once\n", sphereErrors, rayErrors);
+        }
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,125 @@
+// Per frame cost of ordering transparent objects back to front with
+// TransparencySorter under a slowly turning camera, against a cold sort and
+// std::stable_sort of (index, depth) pairs. Built on its own next to the renderer:
+//   g++ -std=c++14 -O2 -I.. TransparencyBenchmark.cpp ../TransparencySorter.cpp ../FrustumCulling.cpp
+//       -o TransparencyBenchmark
+// or as the TransparencyBenchmark target of lab_5/CMakeLists.txt.
+//
+//   TransparencyBenchmark [frames]
+// Objects are scattered over a 100 x 100 x 1000 box in front of the camera,
+// every frame turns the camera by 0.05 degrees and moves it forward a little.
+
+#include "../TransparencySorter.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace
+{
+    double MicrosecondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Row vector view matrix turned around Y, only the depth column matters
+    void MakeView(int frame, float view[16])
+    {
+        const float angle = float(frame) * 0.05f * 3.14159265f / 180.0f;
+        const float identity[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+        std::copy(identity, identity + 16, view);
+        view[0] = cosf(angle);
+        view[2] = sinf(angle);
+        view[8] = -sinf(angle);
+        view[10] = cosf(angle);
+        view[14] = -0.01f * float(frame);
+    }
+
+    float ViewDepth(const float view[16], float x, float y, float z)
+    {
+        return x * view[2] + y * view[6] + z * view[10] + view[14];
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const int frames = argc > 1 ? std::max(1, atoi(argv[1])) : 50;
+    printf("%8s %14s %14s %14s %12s\n", "objects", "coherent us", "cold us", "stable us", "incremental");
+
+    for (size_t count = 10; count <= 100000; count *= 10)
+    {
+        std::mt19937 random(uint32_t(33 + count));
+        std::uniform_real_distribution<float> side(0.0f, 100.0f);
+        std::uniform_real_distribution<float> depth(0.0f, 1000.0f);
+        std::vector<float> x(count);
+        std::vector<float> y(count);
+        std::vector<float> z(count);
+        TransparencySorter sorter;
+        sorter.Resize(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            x[i] = side(random);
+            y[i] = side(random);
+            z[i] = depth(random);
+            sorter.SetPosition(i, x[i], y[i], z[i]);
+        }
+        std::vector<uint32_t> visible(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            visible[i] = uint32_t(i);
+        }
+
+        double coherentTime = 0.0;
+        double coldTime = 0.0;
+        double stableTime = 0.0;
+        int incremental = 0;
+        bool ordered = true;
+        float view[16];
+        MakeView(0, view);
+        sorter.Sort(view, visible.data(), count);
+        std::vector<std::pair<uint32_t, float>> pairs(count);
+        for (int frame = 1; frame <= frames; frame++)
+        {
+            MakeView(frame, view);
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            const std::vector<uint32_t>& order = sorter.Sort(view, visible.data(), count);
+            coherentTime += MicrosecondsSince(start);
+            incremental += sorter.WasIncremental() ? 1 : 0;
+            ordered = ordered && order.size() == count;
+            for (size_t i = 1; i < order.size(); i++)
+            {
+                ordered = ordered && sorter.GetDepth(order[i - 1]) >= sorter.GetDepth(order[i]);
+            }
+
+            // A fresh sorter has no previous order and always takes the radix sort
+            TransparencySorter cold;
+            cold.Resize(count);
+            for (size_t i = 0; i < count; i++)
+            {
+                cold.SetPosition(i, x[i], y[i], z[i]);
+            }
+            start = std::chrono::steady_clock::now();
+            cold.Sort(view, visible.data(), count);
+            coldTime += MicrosecondsSince(start);
+
+            start = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < count; i++)
+            {
+                pairs[i] = std::make_pair(uint32_t(i), ViewDepth(view, x[i], y[i], z[i]));
+            }
+            std::stable_sort(pairs.begin(), pairs.end(),
+                [](const std::pair<uint32_t, float>& a, const std::pair<uint32_t, float>& b) { return a.second > b.second; });
+            stableTime += MicrosecondsSince(start);
+        }
+        printf("%8zu %14.1f %14.1f %14.1f %9d/%d%s\n", count, coherentTime / frames, coldTime / frames,
+            stableTime / frames, incremental, frames, ordered ? "" : "  NOT ORDERED");
+        if (!ordered)
+            return 1;
+    }
+    return 0;
+}
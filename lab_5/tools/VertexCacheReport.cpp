@@ -0,0 +1,114 @@
+// ACMR and ATVR of the generated sphere and torus before and after the
+// vertex cache pass and the whole OptimizeMesh chain, built on its own next to the renderer:
+//   g++ -std=c++14 -O2 -I.. VertexCacheReport.cpp ../MeshGenerator.cpp ../MeshOptimizer.cpp ../WorkerPool.cpp
+//       ../Profiler.cpp -lpthread -o VertexCacheReport
+// or as the VertexCacheReport target of lab_5/CMakeLists.txt.
+//
+//   VertexCacheReport [cache_size]
+// Counts come from a simulated FIFO cache of cache_size entries (16 by
+// default). Fails if a pass changes the set of triangles, or at the default
+// size if the cache pass makes ACMR or ATVR worse; with a bigger cache a small
+// mesh can already be close to one miss per vertex in generation order.
+
+#include "../MeshGenerator.h"
+#include "../MeshOptimizer.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+namespace
+{
+    typedef std::array<float, 9> TrianglePositions;
+
+    // Positions of every triangle, each rotated to start at its smallest
+    // corner, so reordered indices and moved vertices compare equal
+    std::vector<TrianglePositions> GetTriangles(const std::vector<MeshVertex>& vertices, const std::vector<uint32_t>& indices)
+    {
+        std::vector<TrianglePositions> triangles;
+        for (size_t i = 0; i < indices.size(); i += 3)
+        {
+            TrianglePositions corners;
+            for (int corner = 0; corner < 3; corner++)
+            {
+                const MeshVertex& vertex = vertices[indices[i + corner]];
+                corners[corner * 3 + 0] = vertex.x;
+                corners[corner * 3 + 1] = vertex.y;
+                corners[corner * 3 + 2] = vertex.z;
+            }
+            TrianglePositions best = corners;
+            for (int rotation = 1; rotation < 3; rotation++)
+            {
+                TrianglePositions rotated;
+                for (int k = 0; k < 9; k++)
+                {
+                    rotated[k] = corners[(k + 3 * rotation) % 9];
+                }
+                best = std::min(best, rotated);
+            }
+            triangles.push_back(best);
+        }
+        std::sort(triangles.begin(), triangles.end());
+        return triangles;
+    }
+
+    bool Report(const char* name, const GeneratedMesh<uint32_t>& mesh, uint32_t cacheSize, bool requireBetter)
+    {
+        const std::vector<uint32_t>& indices = mesh.indices;
+        const size_t vertexCount = mesh.vertices.size();
+        const VertexCacheStats before = AnalyzeVertexCache(indices.data(), indices.size(), vertexCount, cacheSize);
+
+        std::vector<uint32_t> cacheOrder(indices.size());
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        OptimizeVertexCache(indices.data(), indices.size(), vertexCount, cacheOrder.data());
+        const double cacheTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        const VertexCacheStats cache = AnalyzeVertexCache(cacheOrder.data(), cacheOrder.size(), vertexCount, cacheSize);
+
+        std::vector<MeshVertex> vertices = mesh.vertices;
+        std::vector<uint32_t> optimized = indices;
+        vertices.resize(OptimizeMesh(optimized.data(), optimized.size(), vertices.data(), vertices.size(), sizeof(MeshVertex)));
+        const VertexCacheStats all = AnalyzeVertexCache(optimized.data(), optimized.size(), vertices.size(), cacheSize);
+
+        const std::vector<TrianglePositions> original = GetTriangles(mesh.vertices, indices);
+        const bool sameTriangles = GetTriangles(mesh.vertices, cacheOrder) == original &&
+            GetTriangles(vertices, optimized) == original;
+        const bool better = cache.acmr <= before.acmr && cache.atvr <= before.atvr;
+        printf("%-16s %8zu %7.3f %7.3f %7.3f %7.3f %7.3f %7.3f %9.1f%s\n", name, indices.size() / 3, before.acmr,
+            cache.acmr, all.acmr, before.atvr, cache.atvr, all.atvr, cacheTime,
+            !sameTriangles ? "  TRIANGLES CHANGED" : (!better ? "  WORSE" : ""));
+        return sameTriangles && (better || !requireBetter);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const uint32_t cacheSize = argc > 1 ? uint32_t(std::max(1, atoi(argv[1]))) : 16;
+    printf("FIFO %u          %8s %23s %23s %9s\n", cacheSize, "", "ACMR", "ATVR", "");
+    printf("%-16s %8s %7s %7s %7s %7s %7s %7s %9s\n", "mesh", "tris", "before", "cache", "all", "before", "cache", "all",
+        "cache ms");
+
+    struct SphereCase { const char* name; uint32_t rings; uint32_t segments; };
+    const SphereCase spheres[3] = { { "sphere 8x18", 8, 18 }, { "sphere 64x128", 64, 128 }, { "sphere 256x512", 256, 512 } };
+    struct TorusCase { const char* name; uint32_t major; uint32_t minor; };
+    const TorusCase tori[3] = { { "torus 24x12", 24, 12 }, { "torus 128x64", 128, 64 }, { "torus 512x256", 512, 256 } };
+
+    bool ok = true;
+    for (const SphereCase& sphere : spheres)
+    {
+        GeneratedMesh<uint32_t> mesh;
+        if (!GenerateUVSphere(1.0f, sphere.rings, sphere.segments, mesh))
+            return 1;
+        ok = Report(sphere.name, mesh, cacheSize, cacheSize == 16) && ok;
+    }
+    for (const TorusCase& torus : tori)
+    {
+        GeneratedMesh<uint32_t> mesh;
+        if (!GenerateTorus(1.0f, 0.3f, torus.major, torus.minor, mesh))
+            return 1;
+        ok = Report(torus.name, mesh, cacheSize, cacheSize == 16) && ok;
+    }
+    return ok ? 0 : 1;
+}